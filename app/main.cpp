@@ -1,5 +1,4 @@
 #include <cstdio>
-#include <gurobi_c++.h>
 #include "base/Include.h"
 #include "base/DB.h"
 #include "base/Parser.h"
@@ -7,6 +6,7 @@
 #include "base/SVGPlot.h"
 #include "detailed/DetailedMgr.h"
 #include "global/PreMgr.h"
+#include "global/LPModel.h"
 #include "base/OutputWriter.h"
 #include  <time.h>
 
@@ -14,6 +14,14 @@ using namespace std;
 
 int main(int argc, char* argv[]){
 
+    // optional arguments after the six files: --threads <number of layers routed (or per-net LPs solved, see decomposeLP) concurrently>
+    size_t numThreads = 1;
+    for (int argId = 7; argId < argc; ++ argId) {
+        if (string(argv[argId]) == "--threads" && argId+1 < argc) {
+            numThreads = max(1, atoi(argv[++ argId]));
+        }
+    }
+
     ifstream finST, fin, finOb, finPa;
     ofstream fout, ftunRes;
     finST.open(argv[1], ifstream::in);
@@ -24,6 +32,15 @@ int main(int argc, char* argv[]){
     }
     finPa.open(argv[2], ifstream::in);
     int numVIter, numIIter, numIVIter; 
+    int peecSolver = 0;     // PEECSolverType, 0 = chosen by the matrix size
+    int peecPrecision = 0;  // PEECPrecision, 0 = double
+    int corridorMargin = -1;    // the margin (in grids) of the A* search corridor around a segment, < 0 = the whole layer
+    int numNegoIters = 1;       // the maximum number of negotiation (rip-up and reroute) iterations of each layer in negoAStar
+    int checkEstimate = 0;      // 1 = simulate the SmartGrow / SmartRemove steps rejected by the coarse estimate too, and log its deviation
+    int lpBackend = LPModel::defaultBackend();   // LPBackend, 0 = Gurobi, 1 = HiGHS
+    int decomposeLP = 0;    // 1 = one FlowLP / VoltSLP model per net, solved on numThreads threads
+    int lambdaSchedule = ScheduleExp;       // MultiplierSchedule, 0 = exp (the original schedule), 1 = P, 2 = PD, 3 = Polyak
+    int earlyStop = 0;      // 0 = always run numIVIter x (numIIter + numVIter) solves in voltCurrOpt, as originally
     if (finPa.is_open()) {
         cout << "input file (Parameters) is opened successfully" << endl;
         std::map<std::string, int> parameters;
@@ -50,6 +67,15 @@ int main(int argc, char* argv[]){
         numIVIter = parameters["numIVIter"];
         numIIter = parameters["numIIter"];
         numVIter = parameters["numVIter"];
+        if (parameters.count("peecSolver") > 0) peecSolver = parameters["peecSolver"];
+        if (parameters.count("peecPrecision") > 0) peecPrecision = parameters["peecPrecision"];
+        if (parameters.count("corridorMargin") > 0) corridorMargin = parameters["corridorMargin"];
+        if (parameters.count("numNegoIters") > 0) numNegoIters = max(1, parameters["numNegoIters"]);
+        if (parameters.count("checkEstimate") > 0) checkEstimate = parameters["checkEstimate"];
+        if (parameters.count("lpBackend") > 0) lpBackend = parameters["lpBackend"];
+        if (parameters.count("decomposeLP") > 0) decomposeLP = parameters["decomposeLP"];
+        if (parameters.count("lambdaSchedule") > 0) lambdaSchedule = parameters["lambdaSchedule"];
+        if (parameters.count("earlyStop") > 0) earlyStop = parameters["earlyStop"];
 
     } else {
         cerr << "Error opening input file (Parameters)" << endl;
@@ -165,14 +191,25 @@ int main(int argc, char* argv[]){
     // // db.print();
     
     DetailedMgr* detailedMgr = new DetailedMgr(db, plot, 2 * db.VIA16D8A24()->padRadius(0));
+    detailedMgr->setNumThreads(numThreads);
+    detailedMgr->setPEECSolver((PEECSolverType)peecSolver);
+    detailedMgr->setPEECPrecision((PEECPrecision)peecPrecision);
+    detailedMgr->setCorridorMargin(corridorMargin);
+    detailedMgr->setNumNegoIters(numNegoIters);
+    detailedMgr->setCheckEstimate(checkEstimate != 0);
     detailedMgr->initPortGridMap();
     detailedMgr->check();
 
+    LPModel::setDefaultBackend((LPBackend)lpBackend);
     GlobalMgr globalMgr(db, plot);
     
     globalMgr.numIIter = numIIter;
     globalMgr.numVIter = numVIter;
     globalMgr.numIVIter = numIVIter;
+    globalMgr.decomposeLP = (decomposeLP != 0);
+    globalMgr.numThreads = numThreads;
+    globalMgr.lambdaSchedule = lambdaSchedule;
+    globalMgr.earlyStop = (earlyStop != 0);
 
     globalMgr.plotDB();
 
@@ -234,6 +271,12 @@ int main(int argc, char* argv[]){
     // DetailedMgr detailedMgr(db, plot, 2 * db.VIA16D8A24()->drillRadius());
     delete detailedMgr;
     detailedMgr = new DetailedMgr(db, plot, 2 * db.VIA16D8A24()->drillRadius());
+    detailedMgr->setNumThreads(numThreads);
+    detailedMgr->setPEECSolver((PEECSolverType)peecSolver);
+    detailedMgr->setPEECPrecision((PEECPrecision)peecPrecision);
+    detailedMgr->setCorridorMargin(corridorMargin);
+    detailedMgr->setNumNegoIters(numNegoIters);
+    detailedMgr->setCheckEstimate(checkEstimate != 0);
     detailedMgr->initGridMap();
     // detailedMgr->initSegObsGridMap();
     //detailedMgr->check();
@@ -278,7 +321,12 @@ int main(int argc, char* argv[]){
     //globalMgr.plotDB();
     OutputWriter outputWriter;
 
-    outputWriter.writeTuningResult(ftunRes, numIIter, numVIter, numIVIter, globalMgr._vArea, globalMgr._vOverlap, globalMgr._vSameNetOverlap, globalMgr._vViaArea, globalMgr._vAfterCost);
+    vector< pair<size_t, char> > vIVStage;
+    for (size_t recordId = 0; recordId < globalMgr._vScheduleRecord.size(); ++ recordId) {
+        vIVStage.push_back(make_pair(globalMgr._vScheduleRecord[recordId].ivIter, globalMgr._vScheduleRecord[recordId].stage));
+    }
+    outputWriter.writeTuningResult(ftunRes, vIVStage, globalMgr._vArea, globalMgr._vOverlap, globalMgr._vSameNetOverlap, globalMgr._vViaArea, globalMgr._vAfterCost);
+    MultiplierScheduler::writeTrajectory(ftunRes, globalMgr._vScheduleRecord);
     detailedMgr->buildMtx();
 
     cout << "Time : " << hour << " hours " << min <<" mins "<< fixed << setprecision(5) << time_used << " sec " << endl; 
@@ -292,5 +340,6 @@ int main(int argc, char* argv[]){
     // // // mgr.drawRGraph(true);
     // // mgr.drawDB();
     // // fout.close();
+    LPModel::printStats();
     return 0;
 }
\ No newline at end of file
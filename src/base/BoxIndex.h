@@ -0,0 +1,151 @@
+#ifndef BOX_INDEX_H
+#define BOX_INDEX_H
+
+#include "Include.h"
+using namespace std;
+
+// A uniform-bin index of axis-aligned bounding boxes.
+// Boxes are identified by their insertion order (boxId), so an index built from a list of objects
+// answers "which objects may touch this region" with ids directly usable on that list.
+// build() must be called after the last addBox() and before any query.
+class BoxIndex {
+    public:
+        BoxIndex() : _numBinXs(0), _numBinYs(0), _lowerX(0), _lowerY(0), _binW(1), _binH(1) {}
+        ~BoxIndex() {}
+
+        void clear() {
+            _vBox.clear();
+            _vBin.clear();
+            _numBinXs = 0;
+            _numBinYs = 0;
+        }
+        size_t addBox(double minX, double maxX, double minY, double maxY) {
+            _vBox.push_back(Box(minX, maxX, minY, maxY));
+            return _vBox.size() - 1;
+        }
+        // distribute the boxes into about sqrt(numBoxes) x sqrt(numBoxes) bins over their bounding box
+        void build() {
+            _vBin.clear();
+            if (_vBox.empty()) {
+                _numBinXs = 0;
+                _numBinYs = 0;
+                return;
+            }
+            double upperX = _vBox[0].maxX;
+            double upperY = _vBox[0].maxY;
+            _lowerX = _vBox[0].minX;
+            _lowerY = _vBox[0].minY;
+            for (size_t boxId = 1; boxId < _vBox.size(); ++ boxId) {
+                _lowerX = min(_lowerX, _vBox[boxId].minX);
+                _lowerY = min(_lowerY, _vBox[boxId].minY);
+                upperX = max(upperX, _vBox[boxId].maxX);
+                upperY = max(upperY, _vBox[boxId].maxY);
+            }
+            size_t numBins = max((size_t)1, min((size_t)256, (size_t)ceil(sqrt((double)_vBox.size()))));
+            _numBinXs = numBins;
+            _numBinYs = numBins;
+            _binW = max((upperX - _lowerX) / _numBinXs, 1e-9);
+            _binH = max((upperY - _lowerY) / _numBinYs, 1e-9);
+            _vBin.resize(_numBinXs * _numBinYs);
+            for (size_t boxId = 0; boxId < _vBox.size(); ++ boxId) {
+                const Box& box = _vBox[boxId];
+                size_t lBinX = binX(box.minX), uBinX = binX(box.maxX);
+                size_t lBinY = binY(box.minY), uBinY = binY(box.maxY);
+                for (size_t bX = lBinX; bX <= uBinX; ++ bX) {
+                    for (size_t bY = lBinY; bY <= uBinY; ++ bY) {
+                        _vBin[bX * _numBinYs + bY].push_back(boxId);
+                    }
+                }
+            }
+        }
+
+        size_t numBoxes() const          { return _vBox.size(); }
+        double minX(size_t boxId) const  { return _vBox[boxId].minX; }
+        double maxX(size_t boxId) const  { return _vBox[boxId].maxX; }
+        double minY(size_t boxId) const  { return _vBox[boxId].minY; }
+        double maxY(size_t boxId) const  { return _vBox[boxId].maxY; }
+        // the (Euclidean) gap between box boxId and the given box, 0 if they touch
+        double boxDist(size_t boxId, double minX, double maxX, double minY, double maxY) const {
+            const Box& box = _vBox[boxId];
+            double dX = max(0.0, max(box.minX - maxX, minX - box.maxX));
+            double dY = max(0.0, max(box.minY - maxY, minY - box.maxY));
+            return sqrt(dX * dX + dY * dY);
+        }
+
+        // vBoxId = the boxes touching the closed box [minX, maxX] x [minY, maxY], in increasing boxId
+        void query(double minX, double maxX, double minY, double maxY, vector<size_t>& vBoxId) const {
+            vBoxId.clear();
+            if (_vBin.empty() || minX > maxX || minY > maxY) return;
+            size_t lBinX = binX(minX), uBinX = binX(maxX);
+            size_t lBinY = binY(minY), uBinY = binY(maxY);
+            for (size_t bX = lBinX; bX <= uBinX; ++ bX) {
+                for (size_t bY = lBinY; bY <= uBinY; ++ bY) {
+                    const vector<size_t>& vBin = _vBin[bX * _numBinYs + bY];
+                    for (size_t i = 0; i < vBin.size(); ++ i) {
+                        const Box& box = _vBox[vBin[i]];
+                        if (box.minX <= maxX && box.maxX >= minX && box.minY <= maxY && box.maxY >= minY) {
+                            vBoxId.push_back(vBin[i]);
+                        }
+                    }
+                }
+            }
+            sort(vBoxId.begin(), vBoxId.end());
+            vBoxId.erase(unique(vBoxId.begin(), vBoxId.end()), vBoxId.end());
+        }
+        void queryPoint(double x, double y, vector<size_t>& vBoxId) const { query(x, x, y, y, vBoxId); }
+        // vBoxId = the boxes (inflated by eps) crossed by the segment (x1, y1)-(x2, y2), in increasing boxId
+        void querySegment(double x1, double y1, double x2, double y2, vector<size_t>& vBoxId, double eps = 0) const {
+            query(min(x1, x2) - eps, max(x1, x2) + eps, min(y1, y2) - eps, max(y1, y2) + eps, vBoxId);
+            size_t numKept = 0;
+            for (size_t i = 0; i < vBoxId.size(); ++ i) {
+                const Box& box = _vBox[vBoxId[i]];
+                if (clipSegment(x1, y1, x2, y2, box.minX - eps, box.maxX + eps, box.minY - eps, box.maxY + eps)) {
+                    vBoxId[numKept ++] = vBoxId[i];
+                }
+            }
+            vBoxId.resize(numKept);
+        }
+
+    private:
+        struct Box {
+            Box(double minX, double maxX, double minY, double maxY) : minX(minX), maxX(maxX), minY(minY), maxY(maxY) {}
+            double minX, maxX, minY, maxY;
+        };
+        size_t binX(double x) const {
+            if (x <= _lowerX) return 0;
+            return min(_numBinXs - 1, (size_t)((x - _lowerX) / _binW));
+        }
+        size_t binY(double y) const {
+            if (y <= _lowerY) return 0;
+            return min(_numBinYs - 1, (size_t)((y - _lowerY) / _binH));
+        }
+        // Liang-Barsky: whether the segment touches the closed box
+        static bool clipSegment(double x1, double y1, double x2, double y2, double minX, double maxX, double minY, double maxY) {
+            double t0 = 0, t1 = 1;
+            double dX = x2 - x1, dY = y2 - y1;
+            double p[4] = {-dX, dX, -dY, dY};
+            double q[4] = {x1 - minX, maxX - x1, y1 - minY, maxY - y1};
+            for (size_t i = 0; i < 4; ++ i) {
+                if (p[i] == 0) {
+                    if (q[i] < 0) return false;
+                } else {
+                    double t = q[i] / p[i];
+                    if (p[i] < 0) t0 = max(t0, t);
+                    else t1 = min(t1, t);
+                    if (t0 > t1) return false;
+                }
+            }
+            return true;
+        }
+
+        vector<Box> _vBox;                  // index = [boxId]
+        vector< vector<size_t> > _vBin;     // index = [binXId * _numBinYs + binYId], the boxes overlapping the bin
+        size_t _numBinXs;
+        size_t _numBinYs;
+        double _lowerX;
+        double _lowerY;
+        double _binW;
+        double _binH;
+};
+
+#endif
@@ -200,6 +200,13 @@ class DB {
             _vMetalLayer[layId]->addObstacle(obs);
         }
 
+        // index the obstacles of every metal layer, call after the last obstacle is added
+        void buildObsIndex() {
+            for (size_t layId = 0; layId < numLayers(); ++ layId) {
+                _vMetalLayer[layId]->buildObsIndex();
+            }
+        }
+
         void addRectObstacle(size_t layId, double xLeft, double xRight, double yDown, double yUp) {
             assert((xLeft < xRight) && (yDown < yUp));
             vector< pair<double, double> > vVtx;
@@ -3,6 +3,7 @@
 
 #include "Include.h"
 #include "Obstacle.h"
+#include "BoxIndex.h"
 using namespace std;
 
 class Layer {
@@ -54,6 +55,24 @@ class MetalLayer : public Layer {
         double conductivity() const {return _conductivity; }
 
         void addObstacle(Obstacle* obs) { _vObstacle.push_back(obs); }
+        // index the bounding boxes of the obstacles, boxId = obsId; call after the last addObstacle()
+        void buildObsIndex() {
+            _obsIndex.clear();
+            for (size_t obsId = 0; obsId < _vObstacle.size(); ++ obsId) {
+                Obstacle* obs = _vObstacle[obsId];
+                double minX = obs->vShape(0)->minX(), maxX = obs->vShape(0)->maxX();
+                double minY = obs->vShape(0)->minY(), maxY = obs->vShape(0)->maxY();
+                for (size_t shapeId = 1; shapeId < obs->numShapes(); ++ shapeId) {
+                    minX = min(minX, obs->vShape(shapeId)->minX());
+                    maxX = max(maxX, obs->vShape(shapeId)->maxX());
+                    minY = min(minY, obs->vShape(shapeId)->minY());
+                    maxY = max(maxY, obs->vShape(shapeId)->maxY());
+                }
+                _obsIndex.addBox(minX, maxX, minY, maxY);
+            }
+            _obsIndex.build();
+        }
+        const BoxIndex& obsIndex() const { return _obsIndex; }
         void print() {
             cerr << "MetalLayer {layId=" << _layId << ", layName=" << _layName << ", thickness=" << _thickness 
                  << ", conductivity=" << _conductivity << ", permittivity=" << _permittivity << ", vObstacle=" << endl;
@@ -69,6 +88,7 @@ class MetalLayer : public Layer {
         // string            _layName;
         double            _conductivity;
         vector<Obstacle*> _vObstacle;
+        BoxIndex          _obsIndex;    // the bounding boxes of _vObstacle, boxId = obsId
 };
 
 #endif
\ No newline at end of file
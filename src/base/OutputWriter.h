@@ -12,7 +12,9 @@ class OutputWriter {
         }
         ~OutputWriter() {}
 
-    void writeTuningResult(std::ofstream& outputFile, int numIIter, int numVIter, int numIVIter, vector<double> vArea, vector<double> vOverlap, vector<double> vSameNetOverlap, vector<double> vViaArea, vector<double> vAfterCost) {
+    // vIVStage: (ivIter, 'I' or 'V') of each point, the last vIVStage.size() values of the vectors (see GlobalMgr::_vScheduleRecord);
+    // voltCurrOpt may stop an I or V loop early, so the stage of a point is not given by its index
+    void writeTuningResult(std::ofstream& outputFile, const vector< pair<size_t, char> >& vIVStage, vector<double> vArea, vector<double> vOverlap, vector<double> vSameNetOverlap, vector<double> vViaArea, vector<double> vAfterCost) {
         //1:v_area, 2:v_Overlap, 3:v_SameNetOverlap, 4:viaArea
 
         vector<int> vXI;
@@ -24,7 +26,10 @@ class OutputWriter {
         // 遍历向量并将每个 double 写入文件
         //每個資料的第一行是xI , 再來是yI, xV, yV
         int indexIV = 0;
-        int IVnum = numIIter + numVIter;
+        // the I curve also ends at the last V point of each ivIter and the V curve starts at its last I point, as before
+        auto lastOfStage = [&] (size_t pointId) -> bool {
+            return (pointId+1 == vIVStage.size() || vIVStage[pointId+1] != vIVStage[pointId]);
+        };
 
         for (int i = 0; i < 5; ++i){
             data.clear();
@@ -49,14 +54,17 @@ class OutputWriter {
                 // outputFile << "vAfterCost\n\n"; 
                 data = vAfterCost;
             }
-            for (const double& value : data) {
-                if( (indexIV % IVnum ) < numIIter || (indexIV % IVnum ) == (IVnum-1) ){
+            size_t firstPoint = data.size() - min(data.size(), vIVStage.size());
+            for (size_t i = firstPoint; i < data.size(); ++ i) {
+                size_t pointId = vIVStage.size() - (data.size() - i);
+                char stage = vIVStage[pointId].second;
+                if( stage == 'I' || lastOfStage(pointId) ){
                     vXI.push_back(indexIV);
-                    vYI.push_back(value);
+                    vYI.push_back(data[i]);
                 }
-                if( (indexIV % IVnum ) >= numIIter || (indexIV % IVnum ) == numIIter -1 ){
+                if( stage == 'V' || lastOfStage(pointId) ){
                     vXV.push_back(indexIV);
-                    vYV.push_back(value);
+                    vYV.push_back(data[i]);
                 }
                 ++ indexIV;
             }
@@ -189,6 +189,7 @@ void Parser::parse() {
     // cerr << "before parseConnect: " << data << endl;
     parseConnect();
     parseObstacle();
+    _db.buildObsIndex();
 
 }
 
@@ -1,23 +1,66 @@
 #include "AStarRouter.h"
 
-bool AStarRouter::route() {
+bool AStarRouter::route(const SegmentRequest& request) {
+    _sPos = request.sPos;
+    _tPos = request.tPos;
+    _sRealPos = request.sRealPos;
+    _tRealPos = request.tRealPos;
+    _lbLength = request.lbLength;
+    _lbWidth = request.lbWidth;
+    _path.clear();
+    _vPGrid.clear();
+    _exactWidth = 0;
+    _exactLength = 0;
+    // bring the congestion prefix sums up to date with the grids changed since the last search
+    _congestMap.refresh();
+
+    // search the corridor around the global trace first, and double its margin on every failure
+    // until the window covers the whole layer
+    if (_corridorMargin < 0) {
+        setWindow(0, (int)numXId()-1, 0, (int)numYId()-1);
+        return search();
+    }
+    int margin = max(1, _corridorMargin + (int)ceil(_lbWidth/_gridWidth));
+    while (true) {
+        setWindow(min(min(_sPos.first, _tPos.first), min(_sRealPos.first, _tRealPos.first)) - margin,
+                  max(max(_sPos.first, _tPos.first), max(_sRealPos.first, _tRealPos.first)) + margin,
+                  min(min(_sPos.second, _tPos.second), min(_sRealPos.second, _tRealPos.second)) - margin,
+                  max(max(_sPos.second, _tPos.second), max(_sRealPos.second, _tRealPos.second)) + margin);
+        if (search()) return true;
+        if (_lXId == 0 && _uXId == (int)numXId()-1 && _lYId == 0 && _uYId == (int)numYId()-1) return false;
+        margin *= 2;
+        ++ _numWidenings;
+    }
+}
+
+void AStarRouter::setWindow(int lXId, int uXId, int lYId, int uYId) {
+    _lXId = max(lXId, 0);
+    _uXId = min(uXId, (int)numXId()-1);
+    _lYId = max(lYId, 0);
+    _uYId = min(uYId, (int)numYId()-1);
+}
+
+bool AStarRouter::search() {
+    // invalidate all GNodes of the previous search
+    ++ _generation;
+
     // define the priority queue
-    auto cmp = [](GNode* a, GNode* b) { return a->cost() < b->cost(); };
-    multiset<GNode*, decltype(cmp) > Q(cmp);
+    OpenList& Q = _Q;
+    Q.clear();
 
     // initialize the source node
-    GNode* sNode = _vGNode[_sPos.first][_sPos.second];
+    GNode* sNode = gNode(_sPos.first, _sPos.second);
     sNode->setParent(sNode);
     sNode->setCost(0.0);
     sNode->setCurDist(0.0);
     sNode->setEstDist(0.0);
     sNode->setCongest(0.0);
-    Q.insert(sNode);
+    Q.push(sNode);
     sNode->setStatus(GNodeStatus::InQueue);
 
     // define lambda functions
     auto step = [&](GNode* orgNode, int xId, int yId, Direction dir) -> bool {
-        GNode* stepNode = _vGNode[xId][yId];
+        GNode* stepNode = gNode(xId, yId);
         double newCurDist, newEstDist, newLineDist, newCongest, newCost;
         if (xId == _tPos.first && yId == _tPos.second) {
         // if ((dir == Direction::Up && xId == _tPos.first && yId + floor(ceil(_lbWidth/_gridWidth)/2.0) == _tPos.second) ||
@@ -47,18 +90,18 @@ bool AStarRouter::route() {
                 stepNode->setCost(newCost);
                 stepNode->setParent(orgNode);
                 stepNode->setStatus(GNodeStatus::InQueue);
-                Q.insert(stepNode);
+                Q.push(stepNode);
             } else {
                 assert(stepNode->status() == GNodeStatus::InQueue);
                 if (stepNode->cost() > newCost) {
                     // cerr << stepNode << ": InQueue" << endl;
-                    // Q.erase(Q.find(stepNode));
+                    double oldCost = stepNode->cost();
                     stepNode->setCurDist(newCurDist);
                     stepNode->setEstDist(newEstDist);
                     stepNode->setCongest(newCongest);
                     stepNode->setCost(newCost);
                     stepNode->setParent(orgNode);
-                    Q.insert(stepNode);
+                    Q.decrease(stepNode, oldCost);
                 }
             }
             // cerr << "stepNode = (" << stepNode->xId() << ", " << stepNode->yId() << "), cost = " << stepNode->cost() << ", address = " << stepNode << endl;
@@ -70,33 +113,33 @@ bool AStarRouter::route() {
 
     // start searching
     while (!Q.empty()) {
-        GNode* node = *Q.begin();
-        Q.erase(Q.begin());
+        GNode* node = Q.pop();
+        ++ _numExpanded;
         // cerr << "node = (" << node->xId() << ", " << node->yId() << "), ";
         // cerr << "node->cost() = " << node->cost() << endl;
         node->setStatus(GNodeStatus::InPath);
-        if (legal(node->xId(), node->yId()+1)) {
+        if (inWindow(node->xId(), node->yId()+1)) {
             if (step(node, node->xId(), node->yId()+1, Direction::Up)) return true;
         }
-        if (legal(node->xId(), node->yId()-1)) {
+        if (inWindow(node->xId(), node->yId()-1)) {
             if (step(node, node->xId(), node->yId()-1, Direction::Down)) return true;
         }
-        if (legal(node->xId()+1, node->yId())) {
+        if (inWindow(node->xId()+1, node->yId())) {
             if (step(node, node->xId()+1, node->yId(), Direction::Right)) return true;
         }
-        if (legal(node->xId()-1, node->yId())) {
+        if (inWindow(node->xId()-1, node->yId())) {
             if (step(node, node->xId()-1, node->yId(), Direction::Left)) return true;
         }
-        if (legal(node->xId()+1, node->yId()+1)) {
+        if (inWindow(node->xId()+1, node->yId()+1)) {
             if (step(node, node->xId()+1, node->yId()+1, Direction::UpRight)) return true;
         }
-        if (legal(node->xId()-1, node->yId()+1)) {
+        if (inWindow(node->xId()-1, node->yId()+1)) {
             if (step(node, node->xId()-1, node->yId()+1, Direction::UpLeft)) return true;
         }
-        if (legal(node->xId()+1, node->yId()-1)) {
+        if (inWindow(node->xId()+1, node->yId()-1)) {
             if (step(node, node->xId()+1, node->yId()-1, Direction::DownRight)) return true;
         }
-        if (legal(node->xId()-1, node->yId()-1)) {
+        if (inWindow(node->xId()-1, node->yId()-1)) {
             if (step(node, node->xId()-1, node->yId()-1, Direction::DownLeft)) return true;
         }
         // if (node->yId() < numYId()-1-floor(ceil(_lbWidth)/2.0)) {
@@ -123,7 +166,7 @@ bool AStarRouter::route() {
 
 void AStarRouter::backTrace(int tXId, int tYId) {
     // GNode* node = _vGNode[_tPos.first][_tPos.second];
-    GNode* node = _vGNode[tXId][tYId];
+    GNode* node = gNode(tXId, tYId);
     while(node->parent() != node) {
         _path.push_back(_vGrid[node->xId()][node->yId()]);
         node = node->parent();
@@ -148,7 +191,7 @@ void AStarRouter::backTrace(int tXId, int tYId) {
         }
     }
     // around the path
-    node = _vGNode[_tPos.first][_tPos.second];
+    node = gNode(_tPos.first, _tPos.second);
     while(node->parent() != node) {
         // cerr << "node->parent() = (" << node->parent()->xId() << ", " << node->parent()->yId() << ")" << endl;
         // vector<Grid*> gg;
@@ -249,7 +292,7 @@ void AStarRouter::backTraceNoPad() {
             } 
         return false;
     };
-    GNode* node = _vGNode[_tPos.first][_tPos.second];
+    GNode* node = gNode(_tPos.first, _tPos.second);
     // GNode* node = _vGNode[tXId][tYId];
     _exactLength = 0.0;
     while(node->parent() != node) {
@@ -269,7 +312,7 @@ void AStarRouter::backTraceNoPad() {
     _exactWidth = ceil(_lbWidth * _exactLength / _lbLength);
     if (_exactWidth < ceil(_lbWidth/_gridWidth)) {
         _exactWidth = ceil(_lbWidth/_gridWidth);
-        cerr << "WARNING: A* grid length < global length !" << endl;
+        *_log << "WARNING: A* grid length < global length !" << endl;
     }
     // _exactWidth = ceil(_lbWidth/_gridWidth);
     int halfWidth = ceil(0.5 * _lbWidth / _gridWidth);
@@ -423,120 +466,35 @@ double AStarRouter::marginCongestCost(int xId, int yId, Direction dir) {
     auto prob = [&](int w) -> double{
         return pow(1-_widthRatio, w-ceil(_lbWidth/_gridWidth)) * _widthRatio;
     };
+    // every width only adds the row and/or column of grids on the front edge of the step,
+    // each of which is a range query on the prefix sums of _congestMap
     double congestion = 0.0;
     double threshold = 0.0001;
     for (int w = ceil(_lbWidth/_gridWidth); prob(w) > threshold; ++ w) {
         // cerr << "w = " << w << ", prob = " << prob(w) << endl;
+        int halfW = floor(w/2.0);
         double wCongestion = 0.0;
         if (dir == Direction::Up) {
-            // cerr << "Up" << endl;
-            for (int x = xId-floor(w/2.0); x <= xId+floor(w/2.0); ++ x) {
-                // cerr << "x = " << x << ", y = " << yId+floor(w/2.0) << endl;
-                if (legal(x, yId+floor(w/2.0))) {
-                    wCongestion += _vGrid[x][yId+floor(w/2.0)]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
+            wCongestion = _congestMap.rowCongest(yId+halfW, xId-halfW, xId+halfW);
         } else if (dir == Direction::Down) {
-            // cerr << "Down" << endl;
-            for (int x = xId-floor(w/2.0); x <= xId+floor(w/2.0); ++ x) {
-                // cerr << "x = " << x << ", y = " << yId-floor(w/2.0) << endl;
-                if (legal(x, yId-floor(w/2.0))) {
-                    wCongestion += _vGrid[x][yId-floor(w/2.0)]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
+            wCongestion = _congestMap.rowCongest(yId-halfW, xId-halfW, xId+halfW);
         } else if (dir == Direction::Right) {
-            // cerr << "Right" << endl;
-            for (int y = yId-floor(w/2.0); y <= yId+floor(w/2.0); ++ y) {
-                // cerr << "x = " << xId+floor(w/2.0) << ", y = " << y << endl;
-                if (legal(xId+floor(w/2.0), y)) {
-                    wCongestion += _vGrid[xId+floor(w/2.0)][y]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
+            wCongestion = _congestMap.colCongest(xId+halfW, yId-halfW, yId+halfW);
         } else if (dir == Direction::Left) {
-            // cerr << "Left" << endl;
-            for (int y = yId-floor(w/2.0); y <= yId+floor(w/2.0); ++ y) {
-                // cerr << "x = " << xId-floor(w/2.0) << ", y = " << y << endl;
-                if (legal(xId-floor(w/2.0), y)) {
-                    wCongestion += _vGrid[xId-floor(w/2.0)][y]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
+            wCongestion = _congestMap.colCongest(xId-halfW, yId-halfW, yId+halfW);
         } else if (dir == Direction::UpRight) {
-            for (int x = xId-floor(w/2.0); x <= xId+floor(w/2.0); ++ x) {
-                // cerr << "x = " << x << ", y = " << yId+floor(w/2.0) << endl;
-                if (legal(x, yId+floor(w/2.0))) {
-                    wCongestion += _vGrid[x][yId+floor(w/2.0)]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
-            for (int y = yId-floor(w/2.0); y <= yId+floor(w/2.0)-1; ++ y) {
-                // cerr << "x = " << xId+floor(w/2.0) << ", y = " << y << endl;
-                if (legal(xId+floor(w/2.0), y)) {
-                    wCongestion += _vGrid[xId+floor(w/2.0)][y]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
+            wCongestion = _congestMap.rowCongest(yId+halfW, xId-halfW, xId+halfW)
+                        + _congestMap.colCongest(xId+halfW, yId-halfW, yId+halfW-1);
         } else if (dir == Direction::UpLeft) {
-            for (int x = xId-floor(w/2.0); x <= xId+floor(w/2.0); ++ x) {
-                // cerr << "x = " << x << ", y = " << yId+floor(w/2.0) << endl;
-                if (legal(x, yId+floor(w/2.0))) {
-                    wCongestion += _vGrid[x][yId+floor(w/2.0)]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
-            for (int y = yId-floor(w/2.0); y <= yId+floor(w/2.0)-1; ++ y) {
-                // cerr << "x = " << xId-floor(w/2.0) << ", y = " << y << endl;
-                if (legal(xId-floor(w/2.0), y)) {
-                    wCongestion += _vGrid[xId-floor(w/2.0)][y]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
+            wCongestion = _congestMap.rowCongest(yId+halfW, xId-halfW, xId+halfW)
+                        + _congestMap.colCongest(xId-halfW, yId-halfW, yId+halfW-1);
         } else if (dir == Direction::DownRight) {
-            for (int x = xId-floor(w/2.0); x <= xId+floor(w/2.0); ++ x) {
-                // cerr << "x = " << x << ", y = " << yId-floor(w/2.0) << endl;
-                if (legal(x, yId-floor(w/2.0))) {
-                    wCongestion += _vGrid[x][yId-floor(w/2.0)]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
-            for (int y = yId-floor(w/2.0)+1; y <= yId+floor(w/2.0); ++ y) {
-                // cerr << "x = " << xId+floor(w/2.0) << ", y = " << y << endl;
-                if (legal(xId+floor(w/2.0), y)) {
-                    wCongestion += _vGrid[xId+floor(w/2.0)][y]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
+            wCongestion = _congestMap.rowCongest(yId-halfW, xId-halfW, xId+halfW)
+                        + _congestMap.colCongest(xId+halfW, yId-halfW+1, yId+halfW);
         } else {
             assert(dir == Direction::DownLeft);
-            for (int x = xId-floor(w/2.0); x <= xId+floor(w/2.0); ++ x) {
-                // cerr << "x = " << x << ", y = " << yId-floor(w/2.0) << endl;
-                if (legal(x, yId-floor(w/2.0))) {
-                    wCongestion += _vGrid[x][yId-floor(w/2.0)]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
-            for (int y = yId-floor(w/2.0)+1; y <= yId+floor(w/2.0); ++ y) {
-                // cerr << "x = " << xId-floor(w/2.0) << ", y = " << y << endl;
-                if (legal(xId-floor(w/2.0), y)) {
-                    wCongestion += _vGrid[xId-floor(w/2.0)][y]->congestion();
-                } else {
-                    wCongestion += _obsCongest;
-                }
-            }
+            wCongestion = _congestMap.rowCongest(yId-halfW, xId-halfW, xId+halfW)
+                        + _congestMap.colCongest(xId-halfW, yId-halfW+1, yId+halfW);
         }
         wCongestion *= prob(w);
         congestion += wCongestion;
@@ -597,7 +555,7 @@ double AStarRouter::pathLength(int threshold, int method) {
         int buffer = 0;
         bool turned = false;
         bool turn = false;
-        GNode* node = _vGNode[_tPos.first][_tPos.second];
+        GNode* node = gNode(_tPos.first, _tPos.second);
         //一開始的Node就是從Target開始找，所以直接用_tPos，也就是target Pos。
         // cout << "Coordinate of this pt -> X =" <<   _tPos.first << "Y = " << _tPos.second << endl;
         
@@ -3,29 +3,68 @@
 
 #include "../base/Include.h"
 #include "DetailedDB.h"
+#include "OpenList.h"
+#include "CongestMap.h"
 using namespace std;
 
+// open list used by A*: 0 = indexed 4-ary heap, 1 = bucket queue, 2 = ordered set (the original implementation)
+#ifndef ASTAR_OPEN_LIST
+#define ASTAR_OPEN_LIST 0
+#endif
+
+#if ASTAR_OPEN_LIST == 1
+typedef BucketOpenList OpenList;
+#elif ASTAR_OPEN_LIST == 2
+typedef MultisetOpenList OpenList;
+#else
+typedef HeapOpenList OpenList;
+#endif
+
 enum Direction {
     Up, Down, Right, Left,
     UpRight, UpLeft, DownRight, DownLeft
 };
 
+// the per-segment input of AStarRouter::route()
+struct SegmentRequest {
+    pair<int, int> sPos;        // (source xId, source yId) of the trace (of segment)
+    pair<int, int> tPos;        // (target xId, target yId) of the trace (of segment)
+    pair<int, int> sRealPos;    // (source xId, source yId) of the segment (not trace)
+    pair<int, int> tRealPos;    // (target xId, target yId) of the segment (not trace)
+    double lbLength;            // the shortest wirelength form the last iteration
+    double lbWidth;             // the width lower bound calculated from the shortest wirelength
+};
+
+// A router owns the search workspace of one layer and is reused for all segments (and iterations) routed on it.
+// The GNodes are stored contiguously and reset lazily: a node is only re-initialized when it is first touched
+// by a new search, detected by comparing its generation with the router's.
 class AStarRouter {
     public:
-        AStarRouter(vector< vector< Grid* > > vGrid, pair<int, int> sPos, pair<int, int> tPos, pair<int, int> sRealPos, pair<int, int> tRealPos, double gridWidth, double lbLength, double lbWidth, double widthRatio, double obsCongest, double distWeight, double cLineDistWeight)
-        : _vGrid(vGrid), _sPos(sPos), _tPos(tPos), _sRealPos(sRealPos), _tRealPos(tRealPos), _gridWidth(gridWidth), _lbLength(lbLength), _lbWidth(lbWidth), _widthRatio(widthRatio), _obsCongest(obsCongest), _distWeight(distWeight), _cLineDistWeight(cLineDistWeight) {
+        AStarRouter(vector< vector< Grid* > >& vGrid, CongestMap& congestMap, double gridWidth, double widthRatio, double distWeight, double cLineDistWeight)
+        : _vGrid(vGrid), _congestMap(congestMap), _gridWidth(gridWidth), _widthRatio(widthRatio), _distWeight(distWeight), _cLineDistWeight(cLineDistWeight) {
+            _corridorMargin = -1;
+            _log = &cerr;
+            _numExpanded = 0;
+            _numWidenings = 0;
+            _generation = 0;
+            _exactWidth = 0;
+            _exactLength = 0;
+            _vGNode.reserve(numXId() * numYId());
             for (size_t xId = 0; xId < numXId(); ++ xId) {
-                vector<GNode*> temp;
                 for (size_t yId = 0; yId < numYId(); ++ yId) {
-                    GNode* node = new GNode(xId, yId);
-                    temp.push_back(node);
+                    _vGNode.push_back(GNode(xId, yId));
                 }
-                _vGNode.push_back(temp);
             }
         }
         ~AStarRouter() {}
 
-        bool route();
+        bool route(const SegmentRequest& request);
+        // restrict the search to the bounding box of the segment inflated by margin grids (< 0: the whole layer)
+        void setCorridorMargin(int margin) { _corridorMargin = margin; }
+        // where the warnings of the router go, e.g. the log buffer of a layer routed by a worker thread
+        void setLog(ostream& log) { _log = &log; }
+        size_t numExpanded() const { return _numExpanded; }
+        size_t numWidenings() const { return _numWidenings; }
         void backTrace(int tXId, int tYId);
         void backTraceNoPad();
         double marginCongestCost(int xId, int yId, Direction dir);
@@ -56,9 +95,18 @@ class AStarRouter {
 
     private:
         bool legal(int xId, int yId) { return (xId>=0 && xId<numXId() && yId>=0 && yId<numYId()); }
+        bool inWindow(int xId, int yId) { return (xId>=_lXId && xId<=_uXId && yId>=_lYId && yId<=_uYId); }
+        void setWindow(int lXId, int uXId, int lYId, int uYId);
+        bool search();
+        GNode* gNode(int xId, int yId) {
+            GNode* node = &_vGNode[xId * numYId() + yId];
+            if (node->generation() != _generation) node->reset(_generation);
+            return node;
+        }
         
         // input
-        vector< vector< Grid* > > _vGrid;   // index = [xId] [yId]
+        vector< vector< Grid* > >& _vGrid;   // index = [xId] [yId], not owned
+        CongestMap& _congestMap;             // congestion prefix sums of _vGrid, not owned
         pair<int, int> _sPos;     // (source xId, source yId) of the trace (of segment)
         pair<int, int> _tPos;     // (target xId, target yId) of the trace (of segment)
         pair<int, int> _sRealPos;     // (source xId, source yId) of the segment (not trace)
@@ -71,14 +119,20 @@ class AStarRouter {
         double _widthRatio;     // the probability of straight routing (without detour on a step)
         double _distWeight;     // the weight of distance cost w.r.t. congestion cost
         double _cLineDistWeight;
+        int _corridorMargin;    // the margin (in grids) of the search corridor around the segment, < 0 to search the whole layer
+        ostream* _log;          // not owned
         // output
         vector< Grid* > _path;  // the spine of the path
         vector< Grid* > _vPGrid;    // the grids in the path (considering width)
         size_t _exactWidth;
         size_t _exactLength;
+        size_t _numExpanded;    // the number of nodes popped from the open list, accumulated over all route() calls
+        size_t _numWidenings;   // the number of times the corridor was widened after a failed search
         // process
-        vector< vector< GNode* > > _vGNode;     // index = [xId] [yId]
-        double _obsCongest;         // congestion cost (including history) of obstacles and grids out of boudaries
+        vector< GNode > _vGNode;     // index = [xId * numYId() + yId]
+        size_t _generation;          // incremented by every search
+        OpenList _Q;                 // the open list, kept to reuse its buffer
+        int _lXId, _uXId, _lYId, _uYId;  // the search window (inclusive) of the current search
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,104 @@
+#ifndef CONGEST_MAP_H
+#define CONGEST_MAP_H
+
+#include "../base/Include.h"
+#include "DetailedDB.h"
+using namespace std;
+
+// 1D prefix sums of Grid::congestion() of one layer, along every row (fixed yId) and every column (fixed xId),
+// so that the congestion of any horizontal or vertical run of grids is an O(1) query.
+// Grids outside the layer count as obsCongest.
+// DetailedMgr calls update() whenever the congestion of a grid changes; the affected row and column are
+// only marked dirty and rebuilt by refresh(), which AStarRouter calls once before each search.
+class CongestMap {
+    public:
+        CongestMap(vector< vector< Grid* > >& vGrid, double obsCongest) : _vGrid(vGrid), _obsCongest(obsCongest) {
+            _numXs = _vGrid.size();
+            _numYs = _vGrid[0].size();
+            _vRowSum.resize(_numYs * (_numXs+1), 0.0);
+            _vColSum.resize(_numXs * (_numYs+1), 0.0);
+            _vRowDirty.resize(_numYs, false);
+            _vColDirty.resize(_numXs, false);
+            build();
+        }
+        ~CongestMap() {}
+
+        // rebuild all rows and columns
+        void build() {
+            for (size_t yId = 0; yId < _numYs; ++ yId) buildRow(yId);
+            for (size_t xId = 0; xId < _numXs; ++ xId) buildCol(xId);
+            _vDirtyRow.clear();
+            _vDirtyCol.clear();
+        }
+        // the congestion of grid (xId, yId) has changed
+        void update(size_t xId, size_t yId) {
+            if (!_vRowDirty[yId]) {
+                _vRowDirty[yId] = true;
+                _vDirtyRow.push_back(yId);
+            }
+            if (!_vColDirty[xId]) {
+                _vColDirty[xId] = true;
+                _vDirtyCol.push_back(xId);
+            }
+        }
+        void update(Grid* grid) { update(grid->xId(), grid->yId()); }
+        // rebuild the rows and columns marked by update()
+        void refresh() {
+            for (size_t i = 0; i < _vDirtyRow.size(); ++ i) buildRow(_vDirtyRow[i]);
+            for (size_t i = 0; i < _vDirtyCol.size(); ++ i) buildCol(_vDirtyCol[i]);
+            _vDirtyRow.clear();
+            _vDirtyCol.clear();
+        }
+
+        // the total congestion of grids (lXId..uXId, yId)
+        double rowCongest(int yId, int lXId, int uXId) const {
+            if (lXId > uXId) return 0.0;
+            if (yId < 0 || yId >= (int)_numYs) return (uXId-lXId+1) * _obsCongest;
+            int lIn = max(lXId, 0);
+            int uIn = min(uXId, (int)_numXs-1);
+            if (lIn > uIn) return (uXId-lXId+1) * _obsCongest;
+            const double* sum = &_vRowSum[yId * (_numXs+1)];
+            return (sum[uIn+1] - sum[lIn]) + ((uXId-lXId) - (uIn-lIn)) * _obsCongest;
+        }
+        // the total congestion of grids (xId, lYId..uYId)
+        double colCongest(int xId, int lYId, int uYId) const {
+            if (lYId > uYId) return 0.0;
+            if (xId < 0 || xId >= (int)_numXs) return (uYId-lYId+1) * _obsCongest;
+            int lIn = max(lYId, 0);
+            int uIn = min(uYId, (int)_numYs-1);
+            if (lIn > uIn) return (uYId-lYId+1) * _obsCongest;
+            const double* sum = &_vColSum[xId * (_numYs+1)];
+            return (sum[uIn+1] - sum[lIn]) + ((uYId-lYId) - (uIn-lIn)) * _obsCongest;
+        }
+
+    private:
+        void buildRow(size_t yId) {
+            double* sum = &_vRowSum[yId * (_numXs+1)];
+            sum[0] = 0.0;
+            for (size_t xId = 0; xId < _numXs; ++ xId) {
+                sum[xId+1] = sum[xId] + _vGrid[xId][yId]->congestion();
+            }
+            _vRowDirty[yId] = false;
+        }
+        void buildCol(size_t xId) {
+            double* sum = &_vColSum[xId * (_numYs+1)];
+            sum[0] = 0.0;
+            for (size_t yId = 0; yId < _numYs; ++ yId) {
+                sum[yId+1] = sum[yId] + _vGrid[xId][yId]->congestion();
+            }
+            _vColDirty[xId] = false;
+        }
+
+        vector< vector< Grid* > >& _vGrid;    // index = [xId] [yId], not owned
+        double _obsCongest;
+        size_t _numXs;
+        size_t _numYs;
+        vector<double> _vRowSum;    // index = [yId * (numXs+1) + xId], sum of congestion of grids (0..xId-1, yId)
+        vector<double> _vColSum;    // index = [xId * (numYs+1) + yId], sum of congestion of grids (xId, 0..yId-1)
+        vector<bool> _vRowDirty;    // index = [yId]
+        vector<bool> _vColDirty;    // index = [xId]
+        vector<size_t> _vDirtyRow;
+        vector<size_t> _vDirtyCol;
+};
+
+#endif
@@ -3,83 +3,221 @@
 
 #include "../base/Include.h"
 #include <cstddef>
+#include <cstdint>
 using namespace std;
 
+class GridMap;
+
+// A handle of one grid of GridMap; the state itself lives in the arrays of the map.
 class Grid {
     public:
-        Grid(size_t xId, size_t yId, size_t numNets) : _xId(xId), _yId(yId) {
-            _congestion = 0;
-            _congestCur = 0;
-            _congestHis = 0;
-            _hasObs = false;
-            for (size_t netId = 0; netId < numNets; ++ netId) {
-                _vVoltage.push_back(-1);
-                _vCurrent.push_back(-1);
-            }
-            for (size_t netId = 0; netId < numNets; ++ netId) {
-                _IsPort.push_back(false);
-            }
-        }
+        Grid(GridMap* map, size_t id, size_t layId, size_t xId, size_t yId) : _map(map), _id(id), _layId(layId), _xId(xId), _yId(yId) {}
         ~Grid() {}
 
         // get function
-        int congestion() const { return _congestion; }
-        int congestCur() const { return _congestCur; }
-        int congestHis() const { return _congestHis; }
-        size_t vNetId(size_t i) const { return _vNetId[i]; }
-        size_t numNets() const { return _vNetId.size(); }
-        bool hasNet(size_t netId) {
-            for (size_t i = 0; i<_vNetId.size(); ++ i) {
-                if (_vNetId[i] == netId) return true;
-            }
-            return false;
-        }
+        inline int congestion() const;
+        inline int congestCur() const;
+        inline int congestHis() const;
+        inline size_t vNetId(size_t i) const;
+        inline size_t numNets() const;
+        inline bool hasNet(size_t netId);
+        size_t id() const { return _id; }
         int xId() { return _xId; }
         int yId() { return _yId; }
-        double voltage(size_t netId) const { return _vVoltage[netId]; }
-        double current(size_t netId) const { return _vCurrent[netId]; }
-        bool hasObs() const { return _hasObs; }
-        bool IsPort(size_t netId ) const { return _IsPort[netId]; }
+        inline double voltage(size_t netId) const;
+        inline double current(size_t netId) const;
+        inline bool hasObs() const;
+        inline bool IsPort(size_t netId ) const;
 
         // set function
-        void incCongestCur() { _congestCur ++; _congestion ++; }
-        void decCongestCur() { _congestCur --; _congestion --; }
-        void incCongestHis() { _congestHis ++; _congestion ++; }
-        void setPort(size_t netId){ _IsPort[netId] = true; }
+        inline void incCongestCur();
+        inline void decCongestCur();
+        inline void incCongestHis();
+        inline void setPort(size_t netId);
         // void decCongestHis() { _congestHis --; _congestion --; }
-        void addCongestCur(int congestion) { _congestCur += congestion; _congestion += congestion; } 
-        void addNet(size_t netId) { _vNetId.push_back(netId); }
-        void removeNet(size_t netId) {
-            for (vector<size_t>::iterator i = _vNetId.begin(); i != _vNetId.end(); ++ i) {
-                if (*i == netId) {
-                    _vNetId.erase(i);
-                    return;
+        inline void addCongestCur(int congestion);
+        inline void addNet(size_t netId);
+        inline void removeNet(size_t netId);
+        inline void setVoltage(size_t netId, double voltage);
+        inline void setCurrent(size_t netId, double current);
+        inline void setObs();
+
+        // other function
+        inline void print();
+        
+    private:
+        GridMap* _map;  // not owned
+        size_t _id;     // index of the grid in the arrays of _map
+        int _layId;
+        int _xId;
+        int _yId;
+};
+
+// The grids of all layers. The per-grid state is stored in contiguous arrays indexed by
+// id = (layId * numXs + xId) * numYs + yId, and the voltage, current and port flag of a net are
+// only stored for the grids where they are set (most grids are never touched by most nets).
+// The occupancy of a net is a bit-plane per layer, one row of 64-bit words per yId with bit xId,
+// so membership tests and updates are O(1) and neighborhoods can be tested a whole row at a time.
+class GridMap {
+    public:
+        GridMap(size_t numLayers, size_t numXs, size_t numYs, size_t numNets) : _numLayers(numLayers), _numXs(numXs), _numYs(numYs), _numNets(numNets) {
+            size_t numGrids = numLayers * numXs * numYs;
+            _numRowWords = (numXs + 63) / 64;
+            _vCongestCur.resize(numGrids, 0);
+            _vCongestHis.resize(numGrids, 0);
+            _vHasObs.resize(numGrids, false);
+            _vNumNets.resize(numGrids, 0);
+            _vNetPlane.resize(numNets * numLayers * numYs * _numRowWords, 0);
+            _vVoltage.resize(numNets);
+            _vCurrent.resize(numNets);
+            _vPort.resize(numNets);
+            _vGrid.reserve(numGrids);
+            for (size_t layId = 0; layId < numLayers; ++ layId) {
+                for (size_t xId = 0; xId < numXs; ++ xId) {
+                    for (size_t yId = 0; yId < numYs; ++ yId) {
+                        _vGrid.push_back(Grid(this, _vGrid.size(), layId, xId, yId));
+                    }
                 }
             }
         }
-        void setVoltage(size_t netId, double voltage) { _vVoltage[netId] = voltage; }
-        void setCurrent(size_t netId, double current) { _vCurrent[netId] = current; }
-        void setObs() { _hasObs = true; }
+        ~GridMap() {}
 
-        // other function
-        void print() {
-            printf("(%d, %d), net: ", _xId, _yId);
-            for(int i=0; i<_vNetId.size(); i++)
-                printf("%d ", _vNetId[i]);
-            printf("\n");
+        size_t numLayers() const { return _numLayers; }
+        size_t numXs() const { return _numXs; }
+        size_t numYs() const { return _numYs; }
+        Grid* grid(size_t layId, size_t xId, size_t yId) { return &_vGrid[(layId * _numXs + xId) * _numYs + yId]; }
+
+        // the occupancy of net netId in row yId of layer layId: bit (xId % 64) of word (xId / 64)
+        size_t numRowWords() const { return _numRowWords; }
+        const uint64_t* netRow(size_t netId, size_t layId, size_t yId) const { return &_vNetPlane[rowOffset(netId, layId, yId)]; }
+        // vEdge = the grids of the net in row yId with a (legal) 4-neighbor not in the net, see DetailedMgr::NetEdgeDetect
+        void netEdgeRow(size_t netId, size_t layId, size_t yId, vector<uint64_t>& vEdge) const {
+            const uint64_t* row = netRow(netId, layId, yId);
+            const uint64_t* down = (yId > 0)? netRow(netId, layId, yId-1) : NULL;
+            const uint64_t* up = (yId+1 < _numYs)? netRow(netId, layId, yId+1) : NULL;
+            // bits beyond numXs count as occupied, so the right boundary is not an edge
+            uint64_t tailMask = (_numXs % 64 == 0)? 0 : (~(uint64_t)0 << (_numXs % 64));
+            vEdge.assign(_numRowWords, 0);
+            for (size_t w = 0; w < _numRowWords; ++ w) {
+                uint64_t tail = (w+1 == _numRowWords)? tailMask : 0;
+                uint64_t cur = row[w] | tail;
+                uint64_t next = (w+1 < _numRowWords)? row[w+1] : ~(uint64_t)0;
+                uint64_t prev = (w > 0)? row[w-1] : ~(uint64_t)0;
+                uint64_t right = (cur >> 1) | (next << 63);
+                uint64_t left = (cur << 1) | (prev >> 63);
+                uint64_t all = right & left;
+                if (down != NULL) all &= (down[w] | tail);
+                if (up != NULL) all &= (up[w] | tail);
+                vEdge[w] = row[w] & ~all;
+            }
         }
-        
+
     private:
-        int _congestion;    // _congestHis + _congestCur
-        int _congestCur;    // current congestion cost
-        int _congestHis;    // history congestion cost
-        bool _hasObs;
-        vector<bool> _IsPort; // index = [netId], port of the net
-        vector<size_t> _vNetId;
-        size_t _xId;
-        size_t _yId;
-        vector<double> _vVoltage;    // index = [netId], the voltage of the grid center point, assigned in detailedMgr::buildMtx
-        vector<double> _vCurrent;    // index = [netId], the current through the grid center point
+        friend class Grid;
+        size_t rowOffset(size_t netId, size_t layId, size_t yId) const { return ((netId * _numLayers + layId) * _numYs + yId) * _numRowWords; }
+        bool testNet(size_t netId, size_t layId, size_t xId, size_t yId) const {
+            return (_vNetPlane[rowOffset(netId, layId, yId) + xId / 64] >> (xId % 64)) & 1;
+        }
+
+        size_t _numLayers;
+        size_t _numXs;
+        size_t _numYs;
+        size_t _numNets;
+        size_t _numRowWords;
+        vector<Grid> _vGrid;                // index = [id], never reallocated after construction
+        vector<int> _vCongestCur;           // index = [id], current congestion cost
+        vector<int> _vCongestHis;           // index = [id], history congestion cost
+        vector<char> _vHasObs;              // index = [id]
+        vector<unsigned short> _vNumNets;   // index = [id], the number of nets occupying the grid
+        vector<uint64_t> _vNetPlane;        // index = [rowOffset(netId, layId, yId) + xId / 64], bit xId % 64
+        vector< unordered_map<size_t, double> > _vVoltage;  // index = [netId] [id], the voltage of the grid center point, assigned in detailedMgr::buildMtx
+        vector< unordered_map<size_t, double> > _vCurrent;  // index = [netId] [id], the current through the grid center point
+        vector< unordered_set<size_t> > _vPort;             // index = [netId], the grids in a port of the net
+};
+
+int Grid::congestion() const { return _map->_vCongestCur[_id] + _map->_vCongestHis[_id]; }
+int Grid::congestCur() const { return _map->_vCongestCur[_id]; }
+int Grid::congestHis() const { return _map->_vCongestHis[_id]; }
+size_t Grid::vNetId(size_t i) const {
+    // the i-th net (in increasing netId) occupying the grid
+    for (size_t netId = 0; netId < _map->_numNets; ++ netId) {
+        if (_map->testNet(netId, _layId, _xId, _yId)) {
+            if (i == 0) return netId;
+            -- i;
+        }
+    }
+    assert(false);
+    return 0;
+}
+size_t Grid::numNets() const { return _map->_vNumNets[_id]; }
+bool Grid::hasNet(size_t netId) { return _map->testNet(netId, _layId, _xId, _yId); }
+double Grid::voltage(size_t netId) const {
+    unordered_map<size_t, double>::const_iterator it = _map->_vVoltage[netId].find(_id);
+    return (it == _map->_vVoltage[netId].end())? -1 : it->second;
+}
+double Grid::current(size_t netId) const {
+    unordered_map<size_t, double>::const_iterator it = _map->_vCurrent[netId].find(_id);
+    return (it == _map->_vCurrent[netId].end())? -1 : it->second;
+}
+bool Grid::hasObs() const { return _map->_vHasObs[_id]; }
+bool Grid::IsPort(size_t netId) const { return _map->_vPort[netId].count(_id) > 0; }
+
+void Grid::incCongestCur() { _map->_vCongestCur[_id] ++; }
+void Grid::decCongestCur() { _map->_vCongestCur[_id] --; }
+void Grid::incCongestHis() { _map->_vCongestHis[_id] ++; }
+void Grid::setPort(size_t netId) { _map->_vPort[netId].insert(_id); }
+void Grid::addCongestCur(int congestion) { _map->_vCongestCur[_id] += congestion; }
+void Grid::addNet(size_t netId) {
+    if (hasNet(netId)) return;
+    _map->_vNetPlane[_map->rowOffset(netId, _layId, _yId) + _xId / 64] |= (uint64_t)1 << (_xId % 64);
+    _map->_vNumNets[_id] ++;
+}
+void Grid::removeNet(size_t netId) {
+    if (!hasNet(netId)) return;
+    _map->_vNetPlane[_map->rowOffset(netId, _layId, _yId) + _xId / 64] &= ~((uint64_t)1 << (_xId % 64));
+    _map->_vNumNets[_id] --;
+}
+void Grid::setVoltage(size_t netId, double voltage) { _map->_vVoltage[netId][_id] = voltage; }
+void Grid::setCurrent(size_t netId, double current) { _map->_vCurrent[netId][_id] = current; }
+void Grid::setObs() { _map->_vHasObs[_id] = true; }
+
+void Grid::print() {
+    printf("(%d, %d), net: ", _xId, _yId);
+    for(int i=0; i<numNets(); i++)
+        printf("%d ", vNetId(i));
+    printf("\n");
+}
+
+// A dense (layId, xId, yId) -> node index table of the grids of one net, used to assemble its PEEC matrix.
+// reset() only clears the entries set since the last reset, so one table is reused for all nets.
+class NodeIndex {
+    public:
+        static const unsigned NoNode = UINT_MAX;
+        NodeIndex(size_t numLayers, size_t numXs, size_t numYs) : _numXs(numXs), _numYs(numYs), _vNodeId(numLayers * numXs * numYs, (unsigned)NoNode) {}
+        ~NodeIndex() {}
+
+        void reset() {
+            for (size_t i = 0; i < _vSetId.size(); ++ i) {
+                _vNodeId[_vSetId[i]] = NoNode;
+            }
+            _vSetId.clear();
+        }
+        void setNodeId(size_t layId, size_t xId, size_t yId, size_t nodeId) {
+            size_t id = (layId * _numXs + xId) * _numYs + yId;
+            if (_vNodeId[id] == NoNode) _vSetId.push_back(id);
+            _vNodeId[id] = nodeId;
+        }
+        // grids without a node (e.g. a via to a layer the net does not reach) map to node 0
+        size_t nodeId(size_t layId, size_t xId, size_t yId) const { return nodeId((layId * _numXs + xId) * _numYs + yId); }
+        // id = the index of the grid in GridMap, (layId * numXs + xId) * numYs + yId
+        size_t nodeId(size_t id) const { return (_vNodeId[id] == NoNode)? 0 : _vNodeId[id]; }
+        bool hasNode(size_t id) const { return _vNodeId[id] != NoNode; }
+
+    private:
+        size_t _numXs;
+        size_t _numYs;
+        vector<unsigned> _vNodeId;  // index = [(layId * numXs + xId) * numYs + yId]
+        vector<size_t> _vSetId;     // the entries of _vNodeId set since the last reset()
 };
 
 enum GNodeStatus {
@@ -90,15 +228,24 @@ enum GNodeStatus {
 
 class GNode {
     public:
+        static const size_t NoHeapId = (size_t)-1;
         GNode(int xId, int yId) : _xId(xId), _yId(yId) {
+            reset(0);
+        }
+        ~GNode() {}
+
+        // bring the node back to the initial state of a new search
+        void reset(size_t generation) {
+            _generation = generation;
             _status = GNodeStatus::Init;
             _parent = NULL;
+            _heapId = NoHeapId;
+            _bucketId = 0;
             _cost = numeric_limits<double>::infinity();
             _curDist = numeric_limits<double>::infinity();
             _estDist = numeric_limits<double>::infinity();
             _congest = numeric_limits<double>::infinity();
         }
-        ~GNode() {}
 
         // get function
         int xId() const { return _xId; }
@@ -109,6 +256,9 @@ class GNode {
         double curDist() const { return _curDist; }
         double estDist() const { return _estDist; }
         double congest() const { return _congest; }
+        size_t heapId() const { return _heapId; }
+        size_t bucketId() const { return _bucketId; }
+        size_t generation() const { return _generation; }
 
         // set function
         void setStatus(GNodeStatus status) { _status = status; }
@@ -117,6 +267,8 @@ class GNode {
         void setCurDist(double curDist) { _curDist = curDist; }
         void setEstDist(double estDist) { _estDist = estDist; }
         void setCongest(double congest) { _congest = congest; }
+        void setHeapId(size_t heapId) { _heapId = heapId; }
+        void setBucketId(size_t bucketId) { _bucketId = bucketId; }
 
     private:
         int _xId;
@@ -127,6 +279,9 @@ class GNode {
         double _curDist;    // the current distance cost (from the source)
         double _estDist;    // the estimated distance cost (to the target)
         double _congest;    // the (accumulated) congestion cost
+        size_t _heapId;     // the position in the open list, maintained by OpenList.h
+        size_t _bucketId;   // the bucket in BucketOpenList
+        size_t _generation; // the search (AStarRouter::route call) that last touched the node
 };
 
 #endif
\ No newline at end of file
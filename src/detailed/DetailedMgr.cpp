@@ -5,146 +5,69 @@
 #include <tuple>
 #include <utility>
 #include <vector>
-#include <Eigen/IterativeLinearSolvers>
+#include <thread>
+#include <atomic>
+#include <functional>
 
 void DetailedMgr::initGridMap() {
     cerr << "Initializing Grid Map..." << endl;
-    auto occupiedBySegments = [&] (size_t layId, size_t xId, size_t yId, size_t netId) -> bool {
-        for (size_t segId = 0; segId < _db.vNet(netId)->numSegments(layId); ++ segId) {
-            Trace* trace = _db.vNet(netId)->vSegment(layId, segId)->trace();
-            if (trace->width() > 0) {
-                if (trace->enclose(xId*_gridWidth, yId*_gridWidth)) return true;
-                if (trace->enclose((xId+1)*_gridWidth, yId*_gridWidth)) return true;
-                if (trace->enclose(xId*_gridWidth, (yId+1)*_gridWidth)) return true;
-                if (trace->enclose((xId+1)*_gridWidth, (yId+1)*_gridWidth)) return true;
-            }
-        }
-        return false;
-    };
-    auto occupiedByPorts = [&] (size_t xId, size_t yId, size_t netId) -> bool {
-        Polygon* sBPolygon = _db.vNet(netId)->sourcePort()->boundPolygon();
-        if (sBPolygon->enclose(xId*_gridWidth, yId*_gridWidth)) return true;
-        if (sBPolygon->enclose((xId+1)*_gridWidth, yId*_gridWidth)) return true;
-        if (sBPolygon->enclose(xId*_gridWidth, (yId+1)*_gridWidth)) return true;
-        if (sBPolygon->enclose((xId+1)*_gridWidth, (yId+1)*_gridWidth)) return true;
+    // a grid is occupied by a shape if one of its corners is enclosed by the shape
+    // the grids of the ports, index = [netId] [portId] [gridId]
+    vector< vector< vector< pair<int, int> > > > vPortPos(_db.numNets());
+    for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+        vPortPos[netId].resize(_db.vNet(netId)->numTPorts()+1);
+        rasterize(_db.vNet(netId)->sourcePort()->boundPolygon(), false, vPortPos[netId][0]);
         for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
-            Polygon* tBPolygon = _db.vNet(netId)->targetPort(tPortId)->boundPolygon();
-            if (tBPolygon->enclose(xId*_gridWidth, yId*_gridWidth)) return true;
-            if (tBPolygon->enclose((xId+1)*_gridWidth, yId*_gridWidth)) return true;
-            if (tBPolygon->enclose(xId*_gridWidth, (yId+1)*_gridWidth)) return true;
-            if (tBPolygon->enclose((xId+1)*_gridWidth, (yId+1)*_gridWidth)) return true;
+            rasterize(_db.vNet(netId)->targetPort(tPortId)->boundPolygon(), false, vPortPos[netId][tPortId+1]);
         }
-        return false;
-    };
-
-    auto occupiedBySPort = [&] (size_t xId, size_t yId, size_t netId) -> bool {
-        Polygon* sBPolygon = _db.vNet(netId)->sourcePort()->boundPolygon();
-        if (sBPolygon->enclose(xId*_gridWidth, yId*_gridWidth)) return true;
-        if (sBPolygon->enclose((xId+1)*_gridWidth, yId*_gridWidth)) return true;
-        if (sBPolygon->enclose(xId*_gridWidth, (yId+1)*_gridWidth)) return true;
-        if (sBPolygon->enclose((xId+1)*_gridWidth, (yId+1)*_gridWidth)) return true;
-        return false;
-    };
-
-    auto occupiedByTPort = [&] (size_t xId, size_t yId, size_t netId, size_t tPortId) -> bool {
-        Polygon* tBPolygon = _db.vNet(netId)->targetPort(tPortId)->boundPolygon();
-        // if (netId == -1) {
-        //     if (tBPolygon->minX() <= xId*_gridWidth && tBPolygon->maxX() >= xId*_gridWidth &&
-        //         tBPolygon->minY() <= yId*_gridWidth && tBPolygon->maxY() >= yId*_gridWidth) return true;
-        //     if (tBPolygon->minX() <= (xId+1)*_gridWidth && tBPolygon->maxX() >= (xId+1)*_gridWidth &&
-        //         tBPolygon->minY() <= yId*_gridWidth && tBPolygon->maxY() >= yId*_gridWidth) return true;
-        //     if (tBPolygon->minX() <= xId*_gridWidth && tBPolygon->maxX() >= xId*_gridWidth &&
-        //         tBPolygon->minY() <= (yId+1)*_gridWidth && tBPolygon->maxY() >= (yId+1)*_gridWidth) return true;
-        //     if (tBPolygon->minX() <= (xId+1)*_gridWidth && tBPolygon->maxX() >= (xId+1)*_gridWidth &&
-        //         tBPolygon->minY() <= (yId+1)*_gridWidth && tBPolygon->maxY() >= (yId+1)*_gridWidth) return true;
-        // } else {
-            if (tBPolygon->enclose(xId*_gridWidth, yId*_gridWidth)) return true;
-            if (tBPolygon->enclose((xId+1)*_gridWidth, yId*_gridWidth)) return true;
-            if (tBPolygon->enclose(xId*_gridWidth, (yId+1)*_gridWidth)) return true;
-            if (tBPolygon->enclose((xId+1)*_gridWidth, (yId+1)*_gridWidth)) return true;
-        // }
-        return false;
-    };
-
-    auto occupiedByObstacle = [&] (size_t xId, size_t yId, size_t layId) -> bool {
-        for (size_t obsId = 0; obsId < _db.numObstacles(layId); ++ obsId) {
-            Shape* shape = _db.vObstacle(layId, obsId)->vShape(0);
-            if (shape->enclose(xId*_gridWidth, yId*_gridWidth)) return true;
-            if (shape->enclose((xId+1)*_gridWidth, yId*_gridWidth)) return true;
-            if (shape->enclose(xId*_gridWidth, (yId+1)*_gridWidth)) return true;
-            if (shape->enclose((xId+1)*_gridWidth, (yId+1)*_gridWidth)) return true;
-        }
-        return false;
-    };
+    }
 
-    // init grids occupied by segments and ports
-    for (size_t xId = 0; xId < _numXs; ++ xId) {
-        for (size_t yId = 0; yId < _numYs; ++ yId) {
-            // segments
-            for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
-                Grid* grid = _vGrid[layId][xId][yId];
-                for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
-                    // if (occupiedByPorts(xId, yId, netId)) {
-                    //     assert(!grid->hasNet(netId));
-                    //     grid->addNet(netId);
-                    //     grid->incCongestCur();
-                    //     _vNetGrid[netId][layId].push_back(grid);
-                    //     _vNetPortGrid[netId].push_back(grid);
-                    // }
-                    // if (occupiedBySegments(layId, xId, yId, netId) && !grid->hasNet(netId)) {
-                    //     // assert(!grid->hasNet(netId));
-                    //     grid->addNet(netId);
-                    //     grid->incCongestCur();
-                    //     _vNetGrid[netId][layId].push_back(grid);
-                    // }
-                    if (occupiedBySegments(layId, xId, yId, netId)) {
-                        assert(!grid->hasNet(netId));
-                        grid->addNet(netId);
-                        grid->incCongestCur();
-                        _vNetGrid[netId][layId].push_back(grid);
-                    }
+    // init grids occupied by segments, ports and obstacles, the layers are independent
+    forEachLayer([&] (size_t layId) {
+        for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+            vector< pair<int, int> > vPos;
+            for (size_t segId = 0; segId < _db.vNet(netId)->numSegments(layId); ++ segId) {
+                Trace* trace = _db.vNet(netId)->vSegment(layId, segId)->trace();
+                if (trace->width() > 0) {
+                    vector< pair<int, int> > vSegPos;
+                    rasterize(trace, false, vSegPos);
+                    vPos.insert(vPos.end(), vSegPos.begin(), vSegPos.end());
                 }
             }
-            // ports
-            for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
-                if (occupiedBySPort(xId, yId, netId)) {
-                    _vNetPortGrid[netId][0].push_back(make_pair(xId, yId));
-                    for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
-                        Grid* grid = _vGrid[layId][xId][yId];
-                        grid->setPort(netId);
-                        if (! grid->hasNet(netId)) {
-                            grid->addNet(netId);
-                            grid->incCongestCur();
-                            _vNetGrid[netId][layId].push_back(grid);
-                        }
-                    }
-                }
-                for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
-                    if (occupiedByTPort(xId, yId, netId, tPortId)) {
-                        _vNetPortGrid[netId][tPortId+1].push_back(make_pair(xId, yId));
-                        for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
-                            Grid* grid = _vGrid[layId][xId][yId];
-                            grid->setPort(netId);
-                            if (! grid->hasNet(netId)) {
-                                grid->addNet(netId);
-                                grid->incCongestCur();
-                                _vNetGrid[netId][layId].push_back(grid);
-                            }
-                        }
-                    }
-                }
+            for (size_t portId = 0; portId < vPortPos[netId].size(); ++ portId) {
+                vPos.insert(vPos.end(), vPortPos[netId][portId].begin(), vPortPos[netId][portId].end());
+            }
+            sort(vPos.begin(), vPos.end());
+            vPos.erase(unique(vPos.begin(), vPos.end()), vPos.end());
+            for (size_t posId = 0; posId < vPos.size(); ++ posId) {
+                Grid* grid = _vGrid[layId][vPos[posId].first][vPos[posId].second];
+                grid->addNet(netId);
+                grid->incCongestCur();
+                _vNetGrid[netId][layId].push_back(grid);
             }
         }
-    }
+        vector< pair<int, int> > vObsPos;
+        for (size_t obsId = 0; obsId < _db.numObstacles(layId); ++ obsId) {
+            vector< pair<int, int> > vPos;
+            rasterize(_db.vObstacle(layId, obsId)->vShape(0), false, vPos);
+            vObsPos.insert(vObsPos.end(), vPos.begin(), vPos.end());
+        }
+        sort(vObsPos.begin(), vObsPos.end());
+        vObsPos.erase(unique(vObsPos.begin(), vObsPos.end()), vObsPos.end());
+        for (size_t posId = 0; posId < vObsPos.size(); ++ posId) {
+            Grid* grid = _vGrid[layId][vObsPos[posId].first][vObsPos[posId].second];
+            // grid->incCongestCur();
+            grid->addCongestCur(_obsCongest);
+            grid->setObs();
+        }
+    });
 
-    for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
-        for (size_t xId = 0; xId < _numXs; ++ xId) {
-            for (size_t yId = 0; yId < _numYs; ++ yId) {
-                Grid* grid = _vGrid[layId][xId][yId];
-                if (occupiedByObstacle(xId, yId, layId)) {
-                    // grid->incCongestCur();
-                    grid->addCongestCur(_obsCongest);
-                    grid->setObs();
+    for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+        for (size_t portId = 0; portId < vPortPos[netId].size(); ++ portId) {
+            _vNetPortGrid[netId][portId].insert(_vNetPortGrid[netId][portId].end(), vPortPos[netId][portId].begin(), vPortPos[netId][portId].end());
+            for (size_t posId = 0; posId < vPortPos[netId][portId].size(); ++ posId) {
+                for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
+                    _vGrid[layId][vPortPos[netId][portId][posId].first][vPortPos[netId][portId][posId].second]->setPort(netId);
                 }
             }
         }
@@ -246,67 +169,134 @@ void DetailedMgr::initGridMap() {
 }
 
 void DetailedMgr::initPortGridMap() {
-    auto occupiedBySPort = [&] (size_t xId, size_t yId, size_t netId) -> bool {
-        Polygon* sBPolygon = _db.vNet(netId)->sourcePort()->boundPolygon();
-        if (sBPolygon->enclose(xId*_gridWidth, yId*_gridWidth)) return true;
-        if (sBPolygon->enclose((xId+1)*_gridWidth, yId*_gridWidth)) return true;
-        if (sBPolygon->enclose(xId*_gridWidth, (yId+1)*_gridWidth)) return true;
-        if (sBPolygon->enclose((xId+1)*_gridWidth, (yId+1)*_gridWidth)) return true;
-        return false;
-    };
-
-    auto occupiedByTPort = [&] (size_t xId, size_t yId, size_t netId, size_t tPortId) -> bool {
-        Polygon* tBPolygon = _db.vNet(netId)->targetPort(tPortId)->boundPolygon();
-        if (netId == 2) {
-            if (tBPolygon->minX() <= xId*_gridWidth && tBPolygon->maxX() >= xId*_gridWidth &&
-                tBPolygon->minY() <= yId*_gridWidth && tBPolygon->maxY() >= yId*_gridWidth) return true;
-            if (tBPolygon->minX() <= (xId+1)*_gridWidth && tBPolygon->maxX() >= (xId+1)*_gridWidth &&
-                tBPolygon->minY() <= yId*_gridWidth && tBPolygon->maxY() >= yId*_gridWidth) return true;
-            if (tBPolygon->minX() <= xId*_gridWidth && tBPolygon->maxX() >= xId*_gridWidth &&
-                tBPolygon->minY() <= (yId+1)*_gridWidth && tBPolygon->maxY() >= (yId+1)*_gridWidth) return true;
-            if (tBPolygon->minX() <= (xId+1)*_gridWidth && tBPolygon->maxX() >= (xId+1)*_gridWidth &&
-                tBPolygon->minY() <= (yId+1)*_gridWidth && tBPolygon->maxY() >= (yId+1)*_gridWidth) return true;
-        } else {
-            if (tBPolygon->enclose(xId*_gridWidth, yId*_gridWidth)) return true;
-            if (tBPolygon->enclose((xId+1)*_gridWidth, yId*_gridWidth)) return true;
-            if (tBPolygon->enclose(xId*_gridWidth, (yId+1)*_gridWidth)) return true;
-            if (tBPolygon->enclose((xId+1)*_gridWidth, (yId+1)*_gridWidth)) return true;
+    for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+        for (size_t portId = 0; portId < _db.vNet(netId)->numTPorts()+1; ++ portId) {
+            vector< pair<int, int> > vPos;
+            if (portId == 0) {
+                rasterize(_db.vNet(netId)->sourcePort()->boundPolygon(), false, vPos);
+            } else {
+                // the target ports of net 2 are taken as their bounding boxes
+                rasterize(_db.vNet(netId)->targetPort(portId-1)->boundPolygon(), netId == 2, vPos);
+            }
+            _vNetPortGrid[netId][portId].insert(_vNetPortGrid[netId][portId].end(), vPos.begin(), vPos.end());
+            for (size_t posId = 0; posId < vPos.size(); ++ posId) {
+                for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
+                    Grid* grid = _vGrid[layId][vPos[posId].first][vPos[posId].second];
+                    grid->setPort(netId);
+                    if (! grid->hasNet(netId)) {
+                        grid->addNet(netId);
+                        grid->incCongestCur();
+                        _vNetGrid[netId][layId].push_back(grid);
+                    }
+                }
+            }
         }
-        return false;
-    };
+    }
+}
 
-    for (size_t xId = 0; xId < _numXs; ++ xId) {
-        for (size_t yId = 0; yId < _numYs; ++ yId) {
-            // ports
-            for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
-                if (occupiedBySPort(xId, yId, netId)) {
-                    _vNetPortGrid[netId][0].push_back(make_pair(xId, yId));
-                    for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
-                        Grid* grid = _vGrid[layId][xId][yId];
-                        grid->setPort(netId);
-                        if (! grid->hasNet(netId)) {
-                            grid->addNet(netId);
-                            grid->incCongestCur();
-                            _vNetGrid[netId][layId].push_back(grid);
-                        }
-                    }
+void DetailedMgr::rasterize(Shape* shape, bool boundBox, vector< pair<int, int> >& vPos) {
+    // scan the shape row by row over the grid corners (xId*_gridWidth, yId*_gridWidth) of its bounding box;
+    // a polygon row is decided by its edge crossings with the same even-odd rule as Shape::enclose
+    bool polygon = !boundBox && dynamic_cast<Circle*>(shape) == NULL && dynamic_cast<Square*>(shape) == NULL;
+    vector< pair<double, double> > vVtx;
+    double minX, maxX, minY, maxY;
+    if (polygon) {
+        if (shape->numBPolyVtcs() == 0) return;
+        for (size_t vtxId = 0; vtxId < shape->numBPolyVtcs(); ++ vtxId) {
+            vVtx.push_back(make_pair(shape->bPolygonX(vtxId), shape->bPolygonY(vtxId)));
+        }
+        minX = maxX = vVtx[0].first;
+        minY = maxY = vVtx[0].second;
+        for (size_t vtxId = 1; vtxId < vVtx.size(); ++ vtxId) {
+            minX = min(minX, vVtx[vtxId].first);
+            maxX = max(maxX, vVtx[vtxId].first);
+            minY = min(minY, vVtx[vtxId].second);
+            maxY = max(maxY, vVtx[vtxId].second);
+        }
+    } else {
+        minX = shape->minX();
+        maxX = shape->maxX();
+        minY = shape->minY();
+        maxY = shape->maxY();
+    }
+    int lXId = max(0, (int)floor(minX / _gridWidth) - 1);
+    int uXId = min((int)_numXs, (int)ceil(maxX / _gridWidth) + 1);
+    int lYId = max(0, (int)floor(minY / _gridWidth) - 1);
+    int uYId = min((int)_numYs, (int)ceil(maxY / _gridWidth) + 1);
+    if (lXId > uXId || lYId > uYId) return;
+    int numCols = uXId - lXId + 1;
+    // vIn[(yId-lYId) * numCols + (xId-lXId)]: whether corner (xId, yId) is enclosed
+    vector<char> vIn((uYId - lYId + 1) * numCols, false);
+    vector<double> vCross;
+    for (int yId = lYId; yId <= uYId; ++ yId) {
+        double y = yId*_gridWidth;
+        char* in = &vIn[(yId - lYId) * numCols];
+        if (polygon) {
+            vCross.clear();
+            for (size_t i = 0, j = vVtx.size()-1; i < vVtx.size(); j = i++) {
+                if ((vVtx[i].second >= y) != (vVtx[j].second >= y)) {
+                    vCross.push_back((vVtx[j].first - vVtx[i].first) * (y - vVtx[i].second) / (vVtx[j].second - vVtx[i].second) + vVtx[i].first);
                 }
-                for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
-                    if (occupiedByTPort(xId, yId, netId, tPortId)) {
-                        _vNetPortGrid[netId][tPortId+1].push_back(make_pair(xId, yId));
-                        for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
-                            Grid* grid = _vGrid[layId][xId][yId];
-                            grid->setPort(netId);
-                            if (! grid->hasNet(netId)) {
-                                grid->addNet(netId);
-                                grid->incCongestCur();
-                                _vNetGrid[netId][layId].push_back(grid);
-                            }
-                        }
+            }
+            sort(vCross.begin(), vCross.end());
+            // a corner is enclosed if an odd number of crossings lie at or to its right
+            size_t crossId = 0;
+            for (int xId = lXId; xId <= uXId; ++ xId) {
+                double x = xId*_gridWidth;
+                while (crossId < vCross.size() && vCross[crossId] < x) ++ crossId;
+                in[xId - lXId] = (vCross.size() - crossId) & 1;
+            }
+        } else if (boundBox) {
+            for (int xId = lXId; xId <= uXId; ++ xId) {
+                double x = xId*_gridWidth;
+                in[xId - lXId] = (minX <= x && maxX >= x && minY <= y && maxY >= y);
+            }
+        } else {
+            for (int xId = lXId; xId <= uXId; ++ xId) {
+                in[xId - lXId] = shape->enclose(xId*_gridWidth, y);
+            }
+        }
+    }
+    // grid (xId, yId) has the corners (xId..xId+1, yId..yId+1)
+    for (int xId = max(lXId-1, 0); xId <= min(uXId, (int)_numXs-1); ++ xId) {
+        for (int yId = max(lYId-1, 0); yId <= min(uYId, (int)_numYs-1); ++ yId) {
+            bool occupied = false;
+            for (int cx = xId; cx <= xId+1 && !occupied; ++ cx) {
+                for (int cy = yId; cy <= yId+1 && !occupied; ++ cy) {
+                    if (cx >= lXId && cx <= uXId && cy >= lYId && cy <= uYId) {
+                        occupied = vIn[(cy - lYId) * numCols + (cx - lXId)];
                     }
                 }
             }
+            if (occupied) vPos.push_back(make_pair(xId, yId));
+        }
+    }
+}
+
+void DetailedMgr::forEachLayer(const function<void(size_t)>& func) {
+    forEachTask(_db.numLayers(), [&](size_t layId, size_t) { func(layId); });
+}
+
+void DetailedMgr::forEachTask(size_t numTasks, const function<void(size_t, size_t)>& func) {
+    size_t numThreads = min(_numThreads, numTasks);
+    if (numThreads <= 1) {
+        for (size_t taskId = 0; taskId < numTasks; ++ taskId) {
+            func(taskId, 0);
         }
+        return;
+    }
+    atomic<size_t> nextTaskId(0);
+    auto worker = [&](size_t threadId) {
+        for (size_t taskId = nextTaskId ++; taskId < numTasks; taskId = nextTaskId ++) {
+            func(taskId, threadId);
+        }
+    };
+    vector<thread> vThread;
+    for (size_t threadId = 0; threadId < numThreads; ++ threadId) {
+        vThread.push_back(thread(worker, threadId));
+    }
+    for (size_t threadId = 0; threadId < numThreads; ++ threadId) {
+        vThread[threadId].join();
     }
 }
 
@@ -325,8 +315,12 @@ void DetailedMgr::initSegObsGridMap() {
         return false;
     };
 
+    // only the obstacles whose bounding box touches the grid can enclose one of its corners
+    vector<size_t> vObsId;
     auto occupiedByObstacle = [&] (size_t xId, size_t yId, size_t layId) -> bool {
-        for (size_t obsId = 0; obsId < _db.numObstacles(layId); ++ obsId) {
+        _db.vMetalLayer(layId)->obsIndex().query(xId*_gridWidth, (xId+1)*_gridWidth, yId*_gridWidth, (yId+1)*_gridWidth, vObsId);
+        for (size_t i = 0; i < vObsId.size(); ++ i) {
+            size_t obsId = vObsId[i];
             Shape* shape = _db.vObstacle(layId, obsId)->vShape(0);
             if (shape->enclose(xId*_gridWidth, yId*_gridWidth)) return true;
             if (shape->enclose((xId+1)*_gridWidth, yId*_gridWidth)) return true;
@@ -482,6 +476,8 @@ void DetailedMgr::naiveAStar() {
     cerr << "naiveAStar..." << endl;
     for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
         // cerr << "layId = " << layId;
+        CongestMap congestMap(_vGrid[layId], _db.numNets() * 10.0);
+        AStarRouter router(_vGrid[layId], congestMap, _gridWidth, 0.9, 0.2, 0);
         for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
             // cerr << " netId = " << netId << endl;
     // size_t layId = 0;
@@ -499,9 +495,9 @@ void DetailedMgr::naiveAStar() {
                     int sRealYId = floor(segment->sY() / _gridWidth);
                     int tRealXId = floor(segment->tX() / _gridWidth);
                     int tRealYId = floor(segment->tY() / _gridWidth);
-                    AStarRouter router(_vGrid[layId], make_pair(sXId, sYId), make_pair(tXId, tYId), make_pair(sRealXId, sRealYId), make_pair(tRealXId, tRealYId), 
-                                       _gridWidth, segment->length(), segment->width(), 0.9, _db.numNets() * 10.0, 0.2, 0);
-                    router.route();
+                    SegmentRequest request = {make_pair(sXId, sYId), make_pair(tXId, tYId), make_pair(sRealXId, sRealYId), make_pair(tRealXId, tRealYId), 
+                                              segment->length(), segment->width()};
+                    router.route(request);
                     segment->setWidth(router.exactWidth() * _gridWidth);
                     segment->setLength(router.exactLength() * _gridWidth);
                     for (size_t pGridId = 0; pGridId < router.numPGrids(); ++ pGridId) {
@@ -539,6 +535,7 @@ void DetailedMgr::naiveAStar() {
                 //     _vNetGrid[netId][layId][gridId]->incCongestHis();
                 // }
                 _vNetGrid[netId][layId][gridId]->incCongestCur();
+                congestMap.update(_vNetGrid[netId][layId][gridId]);
             }
         }
     }
@@ -560,120 +557,203 @@ void DetailedMgr::naiveAStar() {
 
 void DetailedMgr::negoAStar(bool sameNetCong) {
     cerr << "negoAStar..." << endl;
+    // the layers share no grids, nets on different layers are routed independently;
+    // the logs and the path plots are buffered per layer and flushed in layer order,
+    // so the output is identical for any number of threads
+    vector<ostringstream> vLog(_db.numLayers());
+    vector< vector<Grid*> > vPathGrid(_db.numLayers());
+    forEachLayer([&] (size_t layId) {
+        negoAStarLayer(layId, sameNetCong, vLog[layId], vPathGrid[layId]);
+    });
     for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
-        cerr << "layId = " << layId << endl;
-        for (size_t iter = 0; iter < _numNegoIters; ++ iter) {
-            cerr << "iter = " << iter << endl;
-            // if (iter > 0) {
-            //     for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
-            //         clearNet(layId, netId);
-            //     }
-            // }
-            for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
-                cerr << " netId = " << netId << endl;
-                Net* net = _db.vNet(netId);
-                clearNet(layId, netId);
-                for (size_t segId = 0; segId < net->numSegments(layId); ++ segId) {
-                    Segment* segment = net->vSegment(layId, segId);
-                    if (segment->width() > 3 * _gridWidth) {
-                        int sXId = floor(segment->trace()->sNode()->ctrX() / _gridWidth);
-                        int sYId = floor(segment->trace()->sNode()->ctrY() / _gridWidth);
-                        int tXId = floor(segment->trace()->tNode()->ctrX() / _gridWidth);
-                        int tYId = floor(segment->trace()->tNode()->ctrY() / _gridWidth);
-                        int sRealXId = floor(segment->sX() / _gridWidth);
-                        int sRealYId = floor(segment->sY() / _gridWidth);
-                        int tRealXId = floor(segment->tX() / _gridWidth);
-                        int tRealYId = floor(segment->tY() / _gridWidth);
-                        AStarRouter router(_vGrid[layId], make_pair(sXId, sYId), make_pair(tXId, tYId), make_pair(sRealXId, sRealYId), make_pair(tRealXId, tRealYId), 
-                                        _gridWidth, segment->length(), segment->width(), _widthRatio, _obsCongest, _distWeight, _cLineDistWeight);
-                        router.route();
-                        segment->setWidth(router.exactWidth() * _gridWidth);
-                        segment->setLength(router.exactLength() * _gridWidth);
-                        if (iter == _numNegoIters - 1) {
-                            for (size_t pathId = 0; pathId < router.numPaths(); ++ pathId) {
-                                Grid* grid = router.vPath(pathId);
-                                vector< pair<double, double> > vVtx;
-                                int xId = grid->xId();
-                                int yId = grid->yId();
-                                vVtx.push_back(make_pair(xId*_gridWidth, yId*_gridWidth));
-                                vVtx.push_back(make_pair((xId+1)*_gridWidth, yId*_gridWidth));
-                                vVtx.push_back(make_pair((xId+1)*_gridWidth, (yId+1)*_gridWidth));
-                                vVtx.push_back(make_pair(xId*_gridWidth, (yId+1)*_gridWidth));
-                                Polygon* p = new Polygon(vVtx, _plot);
-                                p->plot(SVGPlotColor::black, layId);
-                            }
-                        }
-                        for (size_t pGridId = 0; pGridId < router.numPGrids(); ++ pGridId) {
-                            Grid* grid = router.vPGrid(pGridId);
-                            if (sameNetCong) {
-                                grid->addCongestCur(0.5);
-                            }
-                            if (!grid->hasNet(netId)) {
-                                _vNetGrid[netId][layId].push_back(grid);
-                                grid->addNet(netId);
-                            }
-                        }
+        cerr << vLog[layId].str();
+        for (size_t pathId = 0; pathId < vPathGrid[layId].size(); ++ pathId) {
+            Grid* grid = vPathGrid[layId][pathId];
+            vector< pair<double, double> > vVtx;
+            int xId = grid->xId();
+            int yId = grid->yId();
+            vVtx.push_back(make_pair(xId*_gridWidth, yId*_gridWidth));
+            vVtx.push_back(make_pair((xId+1)*_gridWidth, yId*_gridWidth));
+            vVtx.push_back(make_pair((xId+1)*_gridWidth, (yId+1)*_gridWidth));
+            vVtx.push_back(make_pair(xId*_gridWidth, (yId+1)*_gridWidth));
+            Polygon* p = new Polygon(vVtx, _plot);
+            p->plot(SVGPlotColor::black, layId);
+        }
+    }
+}
+
+void DetailedMgr::negoAStarLayer(size_t layId, bool sameNetCong, ostream& log, vector<Grid*>& vPathGrid) {
+    log << "layId = " << layId << endl;
+    // one router (and its search workspace) per layer, reused by all segments and iterations
+    _vCongestMap[layId]->build();
+    AStarRouter router(_vGrid[layId], *_vCongestMap[layId], _gridWidth, _widthRatio, _distWeight, _cLineDistWeight);
+    router.setCorridorMargin(_corridorMargin);
+    router.setLog(log);
+    // negotiation (PathFinder): the first iteration routes every net, the later ones only rip up and reroute
+    // the nets occupying an overflowed grid (a grid shared by several nets), whose history cost is raised
+    // after every iteration; stop once no grid is shared, or go back to the best iteration once the overlap
+    // stops improving. Every iteration routes against the width and length from the global stage; the exact
+    // ones of the kept iteration are written back to the segments when the negotiation is over
+    vector<bool> vReroute(_db.numNets(), true);  // index = [netId]
+    vector< vector<Grid*> > vNetPath(_db.numNets());    // index = [netId] [pathId], the spines of the latest routing
+    vector< vector< pair<double, double> > > vGlobalSize(_db.numNets());  // (width, length) from the global stage, index = [netId] [segId]
+    for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+        Net* net = _db.vNet(netId);
+        for (size_t segId = 0; segId < net->numSegments(layId); ++ segId) {
+            Segment* segment = net->vSegment(layId, segId);
+            vGlobalSize[netId].push_back(make_pair(segment->width(), segment->length()));
+        }
+    }
+    vector< vector< pair<double, double> > > vExactSize(vGlobalSize);    // (width, length) of the latest routing, index = [netId] [segId]
+    // the best iteration so far
+    int bestOverlapGrids = INT_MAX;
+    vector< vector<Grid*> > vBestNetGrid(_db.numNets());    // index = [netId] [gridId]
+    vector< vector<Grid*> > vBestNetPath(_db.numNets());
+    vector< vector< pair<double, double> > > vBestExactSize(vGlobalSize);
+    // the congestion a net adds to the grids it occupies, once they are in _vNetGrid
+    auto occupyNet = [&] (size_t netId) {
+        for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); ++ gridId) {
+            if (sameNetCong) {
+                _vNetGrid[netId][layId][gridId]->addCongestCur(0.5);
+            } else {
+                _vNetGrid[netId][layId][gridId]->incCongestCur();
+            }
+            _vCongestMap[layId]->update(_vNetGrid[netId][layId][gridId]);
+        }
+    };
+    for (size_t iter = 0; iter < _numNegoIters; ++ iter) {
+        log << "iter = " << iter << endl;
+        for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+            if (!vReroute[netId]) continue;
+            log << " netId = " << netId << endl;
+            Net* net = _db.vNet(netId);
+            clearNet(layId, netId);
+            vNetPath[netId].clear();
+            for (size_t segId = 0; segId < net->numSegments(layId); ++ segId) {
+                Segment* segment = net->vSegment(layId, segId);
+                double globalWidth = vGlobalSize[netId][segId].first;
+                double globalLength = vGlobalSize[netId][segId].second;
+                if (globalWidth > 3 * _gridWidth) {
+                    int sXId = floor(segment->trace()->sNode()->ctrX() / _gridWidth);
+                    int sYId = floor(segment->trace()->sNode()->ctrY() / _gridWidth);
+                    int tXId = floor(segment->trace()->tNode()->ctrX() / _gridWidth);
+                    int tYId = floor(segment->trace()->tNode()->ctrY() / _gridWidth);
+                    int sRealXId = floor(segment->sX() / _gridWidth);
+                    int sRealYId = floor(segment->sY() / _gridWidth);
+                    int tRealXId = floor(segment->tX() / _gridWidth);
+                    int tRealYId = floor(segment->tY() / _gridWidth);
+                    SegmentRequest request = {make_pair(sXId, sYId), make_pair(tXId, tYId), make_pair(sRealXId, sRealYId), make_pair(tRealXId, tRealYId), 
+                                              globalLength, globalWidth};
+                    router.route(request);
+                    vExactSize[netId][segId] = make_pair(router.exactWidth() * _gridWidth, router.exactLength() * _gridWidth);
+                    for (size_t pathId = 0; pathId < router.numPaths(); ++ pathId) {
+                        vNetPath[netId].push_back(router.vPath(pathId));
                     }
-                    else {
-                        if (segment->width() > 0) {
-                            cerr << "WARNING: net" << netId << " segment" << segId << " is not wide enough. Discard!" << endl;
+                    for (size_t pGridId = 0; pGridId < router.numPGrids(); ++ pGridId) {
+                        Grid* grid = router.vPGrid(pGridId);
+                        if (sameNetCong) {
+                            grid->addCongestCur(0.5);
+                            _vCongestMap[layId]->update(grid);
                         }
-                    }
-                }
-                for (size_t portId = 0; portId < _db.vNet(netId)->numTPorts()+1; ++ portId) {
-                    for (size_t gridId = 0; gridId < _vNetPortGrid[netId][portId].size(); ++ gridId) {
-                        Grid* grid = _vGrid[layId][_vNetPortGrid[netId][portId][gridId].first][_vNetPortGrid[netId][portId][gridId].second];
-                        // grid->addCongestCur(_obsCongest);
-                        if (! grid->hasNet(netId)) {
+                        if (!grid->hasNet(netId)) {
                             _vNetGrid[netId][layId].push_back(grid);
                             grid->addNet(netId);
                         }
                     }
                 }
-                for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); ++ gridId) {
-                    double threshold;
-                    if (sameNetCong) {
-                        threshold = 0.6;
-                    } else {
-                        threshold = 0;
+                else {
+                    if (globalWidth > 0) {
+                        log << "WARNING: net" << netId << " segment" << segId << " is not wide enough. Discard!" << endl;
                     }
-                    // if (_vNetGrid[netId][layId][gridId]->congestCur() > threshold) {
-                    //     _vNetGrid[netId][layId][gridId]->incCongestHis();
-                    // }
-                    if (sameNetCong) {
-                        _vNetGrid[netId][layId][gridId]->addCongestCur(0.5);
-                    } else {
-                        _vNetGrid[netId][layId][gridId]->incCongestCur();
+                }
+            }
+            for (size_t portId = 0; portId < _db.vNet(netId)->numTPorts()+1; ++ portId) {
+                for (size_t gridId = 0; gridId < _vNetPortGrid[netId][portId].size(); ++ gridId) {
+                    Grid* grid = _vGrid[layId][_vNetPortGrid[netId][portId][gridId].first][_vNetPortGrid[netId][portId][gridId].second];
+                    // grid->addCongestCur(_obsCongest);
+                    if (! grid->hasNet(netId)) {
+                        _vNetGrid[netId][layId].push_back(grid);
+                        grid->addNet(netId);
                     }
                 }
             }
-            int area = 0;
-            int overlapArea = 0;
-            int overlapGrids = 0;
+            occupyNet(netId);
+        }
+        int area = 0;
+        int overlapArea = 0;
+        int overlapGrids = 0;
+        for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+            for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
+                Grid* grid = _vNetGrid[netId][layId][gridId];
+                area++;
+                overlapArea += grid->congestCur();
+                if (grid->numNets() > 1) {
+                    overlapGrids ++;
+                }
+            }
+        }
+        overlapArea -= area;
+        overlapGrids /= 2;
+        log << "area = " << area << endl;
+        log << "overlapArea = " << overlapArea << endl;
+        log << "overlapGrids = " << overlapGrids << endl;
+        // printResult();
+        if (overlapGrids >= bestOverlapGrids) {
+            // worse than the best iteration, go back to it
+            log << "restore the routing of overlapGrids = " << bestOverlapGrids << endl;
             for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
-                for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
-                    Grid* grid = _vNetGrid[netId][layId][gridId];
-                    area++;
-                    overlapArea += grid->congestCur();
-                    if (grid->numNets() > 1) {
-                        overlapGrids ++;
+                clearNet(layId, netId);
+                _vNetGrid[netId][layId] = vBestNetGrid[netId];
+                for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); ++ gridId) {
+                    _vNetGrid[netId][layId][gridId]->addNet(netId);
+                }
+                occupyNet(netId);
+            }
+            vNetPath = vBestNetPath;
+            vExactSize = vBestExactSize;
+            break;
+        }
+        bestOverlapGrids = overlapGrids;
+        if (overlapGrids == 0 || iter + 1 == _numNegoIters) break;
+        for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+            vBestNetGrid[netId] = _vNetGrid[netId][layId];
+        }
+        vBestNetPath = vNetPath;
+        vBestExactSize = vExactSize;
+        // raise the history cost of the overflowed grids and mark the nets on them for rerouting
+        fill(vReroute.begin(), vReroute.end(), false);
+        for (size_t xId = 0; xId < _numXs; ++ xId) {
+            for (size_t yId = 0; yId < _numYs; ++ yId) {
+                Grid* grid = _vGrid[layId][xId][yId];
+                if (grid->numNets() > 1) {
+                    grid->incCongestHis();
+                    _vCongestMap[layId]->update(grid);
+                    for (size_t i = 0; i < grid->numNets(); ++ i) {
+                        vReroute[grid->vNetId(i)] = true;
                     }
                 }
             }
-            overlapArea -= area;
-            overlapGrids /= 2;
-            cerr << "area = " << area << endl;
-            cerr << "overlapArea = " << overlapArea << endl;
-            cerr << "overlapGrids = " << overlapGrids << endl;
-            // printResult();
         }
     }
+    for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+        Net* net = _db.vNet(netId);
+        for (size_t segId = 0; segId < net->numSegments(layId); ++ segId) {
+            if (vGlobalSize[netId][segId].first > 3 * _gridWidth) {
+                net->vSegment(layId, segId)->setWidth(vExactSize[netId][segId].first);
+                net->vSegment(layId, segId)->setLength(vExactSize[netId][segId].second);
+            }
+        }
+        vPathGrid.insert(vPathGrid.end(), vNetPath[netId].begin(), vNetPath[netId].end());
+    }
+    log << "expandedNodes = " << router.numExpanded() << endl;
+    log << "corridorWidenings = " << router.numWidenings() << endl;
 }
 
 void DetailedMgr::clearNet(size_t layId, size_t netId) {
     for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); ++ gridId) {
         _vNetGrid[netId][layId][gridId]->removeNet(netId);
         _vNetGrid[netId][layId][gridId]->decCongestCur();
+        _vCongestMap[layId]->update(_vNetGrid[netId][layId][gridId]);
     }
     _vNetGrid[netId][layId].clear();
 }
@@ -864,361 +944,109 @@ void DetailedMgr::plotVia() {
     }
 }
 
+bool DetailedMgr::enclosingCell(double x, double y, size_t& xId, size_t& yId) const {
+    // cell (xId, yId) = [xId * _gridWidth, (xId+1) * _gridWidth) x [yId * _gridWidth, (yId+1) * _gridWidth),
+    // the rounding of x / _gridWidth is corrected so that a via on a cell border always goes to the upper cell
+    if (x < 0 || y < 0) return false;
+    xId = floor(x / _gridWidth);
+    yId = floor(y / _gridWidth);
+    if (xId > 0 && x < xId * _gridWidth) -- xId;
+    if (x >= (xId+1) * _gridWidth) ++ xId;
+    if (yId > 0 && y < yId * _gridWidth) -- yId;
+    if (y >= (yId+1) * _gridWidth) ++ yId;
+    return (xId < _numXs && yId < _numYs);
+}
+
+void DetailedMgr::indexPortVias() {
+    _vNetViaPort.assign(_db.numNets(), unordered_map< size_t, vector<int> >());
+    for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+        size_t xId, yId;
+        for (size_t sViaId = 0; sViaId < _db.vNet(netId)->sourceViaCstr()->numVias(); ++ sViaId) {
+            double sX = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->x();
+            double sY = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->y();
+            if (enclosingCell(sX, sY, xId, yId)) {
+                _vNetViaPort[netId][xId * _numYs + yId].push_back(-1);
+            }
+        }
+        for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
+            for (size_t tViaId = 0; tViaId < _db.vNet(netId)->vTargetViaCstr(tPortId)->numVias(); ++ tViaId) {
+                double tX = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->x();
+                double tY = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->y();
+                if (enclosingCell(tX, tY, xId, yId)) {
+                    _vNetViaPort[netId][xId * _numYs + yId].push_back(tPortId);
+                }
+            }
+        }
+    }
+}
+
+void DetailedMgr::initPEEC() {
+    indexPortVias();
+    _stackup.build(_db);
+    // the rows cached by the nets were stamped with the old vias and conductances (and node order)
+    for (size_t netId = 0; netId < _vPEECContext.size(); ++ netId) {
+        delete _vPEECContext[netId];
+        _vPEECContext[netId] = new PEECContext();
+    }
+}
+
 void DetailedMgr::addViaGrid() {
-    auto gridEnclose = [&] (Grid* grid, double x, double y) -> bool {
-        double gridLX = grid->xId() * _gridWidth;
-        double gridUX = (grid->xId()+1) * _gridWidth;
-        double gridLY = grid->yId() * _gridWidth;
-        double gridUY = (grid->yId()+1) * _gridWidth;
-        // to avoid a via enclosed by multiple grids, set ">=" but "<" only
-        return ((x >= gridLX) && (x < gridUX) && (y >= gridLY) && (y < gridUY));
-    };
+    initPEEC();
+    // every grid enclosing a port via of a net belongs to the net, on every layer;
+    // the grids are added in (xId, yId) order, as the original scan over the layer did, not in hash order
+    vector< vector<size_t> > vNetViaGrid(_db.numNets());   // index = [netId] [i], the sorted keys of _vNetViaPort[netId]
+    for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+        for (unordered_map< size_t, vector<int> >::const_iterator it = _vNetViaPort[netId].begin(); it != _vNetViaPort[netId].end(); ++ it) {
+            vNetViaGrid[netId].push_back(it->first);
+        }
+        sort(vNetViaGrid[netId].begin(), vNetViaGrid[netId].end());
+    }
     for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
-        for (size_t xId = 0; xId < _numXs; ++ xId) {
-            for (size_t yId = 0; yId < _numYs; ++ yId) {
-                Grid* grid = _vGrid[layId][xId][yId];
-                for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
-                    if (!grid->hasNet(netId)) {
-                        for (size_t sViaId = 0; sViaId < _db.vNet(netId)->sourceViaCstr()->numVias(); ++ sViaId) {
-                            double sX = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->x();
-                            double sY = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->y();
-                            if (gridEnclose(grid, sX, sY)) {
-                                _vNetGrid[netId][layId].push_back(grid);
-                                grid->addNet(netId);
-                                //grid->setPort(netId);
-                            }
-                        }
-                        for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
-                            for (size_t tViaId = 0; tViaId < _db.vNet(netId)->vTargetViaCstr(tPortId)->numVias(); ++ tViaId) {
-                                double tX = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->x();
-                                double tY = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->y();
-                                if (gridEnclose(grid, tX, tY)) {
-                                    _vNetGrid[netId][layId].push_back(grid);
-                                    grid->addNet(netId);
-                                    //grid->setPort(netId);
-                                }
-                            }
-                        }
-                    }
+        for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+            for (size_t i = 0; i < vNetViaGrid[netId].size(); ++ i) {
+                Grid* grid = _vGrid[layId][vNetViaGrid[netId][i] / _numYs][vNetViaGrid[netId][i] % _numYs];
+                if (!grid->hasNet(netId)) {
+                    _vNetGrid[netId][layId].push_back(grid);
+                    grid->addNet(netId);
                 }
             }
         }
     }
 }
 
+size_t DetailedMgr::indexNodes(size_t netId, NodeIndex& nodeIndex) {
+    // node i = the ith grid of _vNetGrid[netId], in layer order
+    size_t numNode = 0;
+    nodeIndex.reset();
+    for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
+        for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
+            nodeIndex.setNodeId(layId, _vNetGrid[netId][layId][gridId]->xId(), _vNetGrid[netId][layId][gridId]->yId(), numNode);
+            numNode++;
+        }
+    }
+    return numNode;
+}
+
 void DetailedMgr::buildMtx() {
     cerr << "PEEC Simulation start..." << endl;
+    if (_vNetViaPort.size() != _db.numNets()) initPEEC();
     // https://i.imgur.com/rIwlXJQ.png
     // return an impedance matrix for each net
     // number of nodes: \sum_{layId=0}^{_vNetGrid[netID].size()} _vNetGrid[netID][layId].size()
 
-    auto gridEnclose = [&] (Grid* grid, double x, double y) -> bool {
-        double gridLX = grid->xId() * _gridWidth;
-        double gridUX = (grid->xId()+1) * _gridWidth;
-        double gridLY = grid->yId() * _gridWidth;
-        double gridUY = (grid->yId()+1) * _gridWidth;
-        // to avoid a via enclosed by multiple grids, set ">=" but "<" only
-        return ((x >= gridLX) && (x < gridUX) && (y >= gridLY) && (y < gridUY));
-    };
-
+    // the nets are independent: each one is assembled and solved by one worker with its own node index,
+    // and writes only its own voltages, currents and _vTPortCurr[netId]
+    size_t numThreads = max((size_t)1, min(_numThreads, _db.numNets()));
+    while (_vNodeIndex.size() < numThreads) {
+        _vNodeIndex.push_back(new NodeIndex(_db.numLayers(), _numXs, _numYs));
+    }
+    vector<ostringstream> vLog(_db.numNets());
+    forEachTask(_db.numNets(), [&](size_t netId, size_t threadId) {
+        vLog[netId] << "netID: " << netId << endl;
+        simulateNet(netId, *_vNodeIndex[threadId], &vLog[netId]);
+    });
     for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
-        printf("netID: %d\n", netId);
-        
-        size_t numNode = 0;
-        map< tuple<size_t, size_t, size_t>, size_t > getID; // i = getID[layID, xId, yId] = ith node
-        for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
-            for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
-                getID[make_tuple(layId, _vNetGrid[netId][layId][gridId]->xId(), _vNetGrid[netId][layId][gridId]->yId())] = numNode;
-                numNode++;
-            }
-        }
-        printf("numNode: %d\n", numNode);
-
-        // initialize matrix and vector
-        Eigen::SparseMatrix<double, Eigen::RowMajor> Y(numNode, numNode);
-        Eigen::VectorXd I(numNode);
-        Eigen::VectorXd V(numNode);
-        vector< Eigen::Triplet<double> > vTplY;
-        vTplY.reserve(6 * numNode);
-        for (size_t i = 0; i < numNode; ++ i) {
-            I[i] = 0;
-            V[i] = 0;
-        }
-
-        // // initialize
-        // vector< vector<double > > mtx;
-        // // numNode += (_db.vNet(netId)->numTPorts() + 1) * _db.numLayers();    // add the source/target via nodes on each layer
-        // for(int i=0; i<numNode; i++) {
-        //     mtx.push_back(vector<double>());
-        //     for(int j=0; j<numNode; j++)
-        //         mtx[i].push_back(0.0);
-        // }
-        assert(_vNetGrid[netId].size() == _db.numLayers());
-        for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
-            int numSVias = 0;
-            vector<int> numTVias(_db.vNet(netId)->numTPorts(), 0);
-            for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
-                Grid* grid_i = _vNetGrid[netId][layId][gridId];
-                // cerr << "grid = (" << grid_i->xId() << " " << grid_i->yId() << ")" << endl;
-                size_t node_id = getID[make_tuple(layId, grid_i->xId(), grid_i->yId())];
-            //    printf("x: %-4d, y: %-4d, lay: %-4d, ID: %-4d\n", i->xId(), i->yId(), layId, getID[make_tuple(layId, i->xId(), i->yId())]);
-            
-                double g2g_condutance = _db.vMetalLayer(layId)->conductivity() * _db.vMetalLayer(layId)->thickness() * 1E-3;
-                double via_condutance_up, via_condutance_down;
-                if (layId > 0) {
-                    via_condutance_down = (_db.vMetalLayer(0)->conductivity() * _db.VIA16D8A24()->metalArea() * 1E-6) / (1E-3 * (0.5*_db.vMetalLayer(layId-1)->thickness()+ _db.vMediumLayer(layId)->thickness()+0.5* _db.vMetalLayer(layId)->thickness()));
-                }
-                if (layId < _db.numLayers() - 1) {
-                    via_condutance_up = (_db.vMetalLayer(0)->conductivity() * _db.VIA16D8A24()->metalArea() * 1E-6) / (1E-3 * (0.5*_db.vMetalLayer(layId)->thickness()+ _db.vMediumLayer(layId+1)->thickness()+0.5* _db.vMetalLayer(layId+1)->thickness()));
-                }
-                double small_conductance = 1.0;
-                // if (gridId == 0) {
-                //     cerr << "layer" << layId << ": g2g_conductance = " << g2g_condutance << ", via_conductance_up = " << via_condutance_up;
-                //     cerr << ", via_conductance_down = " << via_condutance_down << endl;
-                // }
-
-                // check left
-                if(grid_i->xId() > 0 && _vGrid[layId][grid_i->xId()-1][grid_i->yId()]->hasNet(netId)) {
-                    // mtx[node_id][node_id] += g2g_condutance;
-                    // mtx[node_id][getID[make_tuple(layId, grid_i->xId()-1, grid_i->yId())]] -= g2g_condutance;
-                    vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, g2g_condutance));
-                    vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId, grid_i->xId()-1, grid_i->yId())], -g2g_condutance));
-                }
-
-                // check right
-                if(grid_i->xId() < _numXs-1 && _vGrid[layId][grid_i->xId()+1][grid_i->yId()]->hasNet(netId)) {
-                    // mtx[node_id][node_id] += g2g_condutance;
-                    // mtx[node_id][getID[make_tuple(layId, grid_i->xId()+1, grid_i->yId())]] -= g2g_condutance;
-                    vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, g2g_condutance));
-                    vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId, grid_i->xId()+1, grid_i->yId())], -g2g_condutance));
-                }
-                
-                // check down
-                if(grid_i->yId() > 0 && _vGrid[layId][grid_i->xId()][grid_i->yId()-1]->hasNet(netId)) {
-                    // mtx[node_id][node_id] += g2g_condutance;
-                    // mtx[node_id][getID[make_tuple(layId, grid_i->xId(), grid_i->yId()-1)]] -= g2g_condutance;
-                    vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, g2g_condutance));
-                    vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId, grid_i->xId(), grid_i->yId()-1)], -g2g_condutance));
-                }
-                
-                // check up
-                if(grid_i->yId() < _numYs-1 && _vGrid[layId][grid_i->xId()][grid_i->yId()+1]->hasNet(netId)) {
-                    // mtx[node_id][node_id] += g2g_condutance;
-                    // mtx[node_id][getID[make_tuple(layId, grid_i->xId(), grid_i->yId()+1)]] -= g2g_condutance;
-                    vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, g2g_condutance));
-                    vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId, grid_i->xId(), grid_i->yId()+1)], -g2g_condutance));
-                }
-
-                // // check top layer
-                // if(layId > 0 && _vGrid[layId-1][grid_i->xId()][grid_i->yId()]->hasNet(netId)) {
-                //     mtx[node_id][node_id] += via_condutance;
-                //     mtx[node_id][getID[make_tuple(layId-1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-                // }
-
-                // // check bottom layer
-                // if(layId < _db.numLayers()-1 && _vGrid[layId+1][grid_i->xId()][grid_i->yId()]->hasNet(netId)) {
-                //     mtx[node_id][node_id] += via_condutance;
-                //     mtx[node_id][getID[make_tuple(layId+1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-                // }
-
-                for (size_t sViaId = 0; sViaId < _db.vNet(netId)->sourceViaCstr()->numVias(); ++ sViaId) {
-                    double sX = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->x();
-                    double sY = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->y();
-                    if (gridEnclose(grid_i, sX, sY)) {
-                        numSVias ++;
-                        // cerr << "Enclose: net" << netId << " layer" << layId << " source, grid = (" << grid_i->xId() << ", " << grid_i->yId() << ")" << endl; 
-                        if (layId > 0) {
-                            // mtx[node_id][node_id] += via_condutance;
-                            // mtx[node_id][getID[make_tuple(layId-1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-                            vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, via_condutance_down));
-                            vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId-1, grid_i->xId(), grid_i->yId())], -via_condutance_down));
-                        } else {
-                            // if (netId != 1) {
-                            vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, via_condutance_up));
-                            I(node_id) = _db.vNet(netId)->sourcePort()->voltage() * via_condutance_up;
-                            // }
-                            // cerr << "layer" << layId << " node" << node_id;
-                            // cerr << ": sVolt = " << _db.vNet(netId)->sourcePort()->voltage();
-                            // cerr << ", via_conductance_up = " << via_condutance_up;
-                            // cerr << ", I" << node_id << " = " << I(node_id) << endl;
-                        }
-                        if (layId < _db.numLayers()-1) {
-                            // mtx[node_id][node_id] += via_condutance;
-                            // mtx[node_id][getID[make_tuple(layId+1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-                            vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, via_condutance_up));
-                            vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId+1, grid_i->xId(), grid_i->yId())], -via_condutance_up));
-                        }
-                    }
-                }
-                for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
-                    for (size_t tViaId = 0; tViaId < _db.vNet(netId)->vTargetViaCstr(tPortId)->numVias(); ++ tViaId) {
-                        double tX = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->x();
-                        double tY = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->y();
-                        if (gridEnclose(grid_i, tX, tY)) {
-                            numTVias[tPortId] ++;
-                            if (layId > 0) {
-                                // mtx[node_id][node_id] += via_condutance;
-                                // mtx[node_id][getID[make_tuple(layId-1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-                                vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, via_condutance_down));
-                                vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId-1, grid_i->xId(), grid_i->yId())], -via_condutance_down));
-                            } else {
-                                double loadConductance = _db.vNet(netId)->targetPort(tPortId)->current() / (_db.vNet(netId)->targetPort(tPortId)->voltage() * _db.vNet(netId)->targetPort(tPortId)->viaCluster()->numVias());
-                                //  * _db.vNet(netId)->targetPort(tPortId)->viaCluster()->numVias()
-                                // if (netId != 1) {
-                                vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, 1.0/(1.0/via_condutance_up + 1.0/loadConductance)));
-                                // } else {
-                                //     vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, 1.0/(1.0/via_condutance_down + 1.0/loadConductance)));
-                                // }
-                                // cerr << "layer" << layId << " node" << node_id;
-                                // cerr << ": tPort" << tPortId ;
-                                // cerr << ", total conductance = " << 1.0/(1.0/via_condutance_up + 1.0/loadConductance) << endl;
-                                // << ": via_conductance = " << via_condutance_up << ", loadConductance = " << loadConductance;
-                            }
-                            if (layId < _db.numLayers()-1) {
-                                // mtx[node_id][node_id] += via_condutance;
-                                // mtx[node_id][getID[make_tuple(layId+1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-                                vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, via_condutance_up));
-                                vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId+1, grid_i->xId(), grid_i->yId())], -via_condutance_up));
-                            } 
-                        }
-                    }
-                }
-            }
-            // Port* sPort = _db.vNet(netId)->sourcePort();
-            // int realNumSVias = sPort->viaCluster()->numVias();
-            // cerr << "layer" << layId << ": numSVias = " << numSVias << ", real numSVias = " << realNumSVias << endl;
-            // for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
-            //     Port* tPort = _db.vNet(netId)->targetPort(tPortId);
-            //     int realNumTVias = tPort->viaCluster()->numVias();
-            //     cerr << "layer" << layId << " tPort" << tPortId << ": numTVias = " << numTVias[tPortId] << ", real numTVias = " << realNumTVias << endl;
-            // }
-        }
-
-        // if (netId == 1) {
-        //     cerr << "net1, I = " << endl;
-        //     for (size_t i = 0; i < I.size(); ++ i) {
-        //         if (I[i] > 0) {
-        //             cerr << "I[" << i << "] = " << I[i] << endl;
-        //         }
-        //     }
-        // }
-
-        Y.setFromTriplets(vTplY.begin(), vTplY.end());
-        // Eigen::BiCGSTAB<Eigen::SparseMatrix<double, Eigen::RowMajor>, Eigen::IdentityPreconditioner> solver;
-        Eigen::ConjugateGradient<Eigen::SparseMatrix<double, Eigen::RowMajor>, Eigen::Upper> solver;
-        // solver.setMaxIterations(1000000);
-        // solver.setTolerance(1e-14);
-        solver.compute(Y);
-        // V = solver.solveWithGuess(I, V);
-        V = solver.solve(I);
-        assert(solver.info() == Eigen::Success);
-
-        // set voltage of each grid
-        for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
-            for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
-                Grid* grid_i = _vNetGrid[netId][layId][gridId];
-                size_t node_id = getID[make_tuple(layId, grid_i->xId(), grid_i->yId())];
-                grid_i->setVoltage(netId, V[node_id]);
-                // assert(grid_i->voltage(netId) <= _db.vNet(netId)->sourcePort()->voltage());
-            }
-        }
-
-        // set current of each grid
-        for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
-            _vTPortCurr[netId][tPortId] = 0.0;
-        }
-        assert(_vNetGrid[netId].size() == _db.numLayers());
-        for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
-            for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
-                Grid* grid_i = _vNetGrid[netId][layId][gridId];
-                size_t xId = grid_i->xId();
-                size_t yId = grid_i->yId();
-                size_t node_id = getID[make_tuple(layId, grid_i->xId(), grid_i->yId())];
-                double g2g_condutance = _db.vMetalLayer(layId)->conductivity() * _db.vMetalLayer(layId)->thickness() * 1E-3;
-                double via_condutance_up, via_condutance_down;
-                if (layId > 0) {
-                    via_condutance_down = (_db.vMetalLayer(0)->conductivity() * _db.VIA16D8A24()->metalArea() * 1E-6) / (1E-3 * (0.5*_db.vMetalLayer(layId-1)->thickness()+ _db.vMediumLayer(layId)->thickness()+0.5* _db.vMetalLayer(layId)->thickness()));
-                }
-                if (layId < _db.numLayers() - 1) {
-                    via_condutance_up = (_db.vMetalLayer(0)->conductivity() * _db.VIA16D8A24()->metalArea() * 1E-6) / (1E-3 * (0.5*_db.vMetalLayer(layId)->thickness()+ _db.vMediumLayer(layId+1)->thickness()+0.5* _db.vMetalLayer(layId+1)->thickness()));
-                }
-                if (gridId == 0) {
-                    // cerr << "layer" << layId << ": g2g_conductance = " << g2g_condutance << ", via_conductance_up = " << via_condutance_up;
-                    // cerr << ", via_conductance_down = " << via_condutance_down << endl;
-                }
-                double small_conductance = 1.0;
-                double current = 0;
-                size_t nbrId;
-                if (legal(xId+1, yId)) {
-                    if (_vGrid[layId][xId+1][yId]->hasNet(netId)) {
-                        current += abs(grid_i->voltage(netId) - _vGrid[layId][xId+1][yId]->voltage(netId)) * g2g_condutance;
-                    }
-                }
-                if (legal(xId-1, yId)) {
-                    if (_vGrid[layId][xId-1][yId]->hasNet(netId)) {
-                        current += abs(grid_i->voltage(netId) - _vGrid[layId][xId-1][yId]->voltage(netId)) * g2g_condutance;
-                    }
-                }
-                if (legal(xId, yId+1)) {
-                    if (_vGrid[layId][xId][yId+1]->hasNet(netId)) {
-                        current += abs(grid_i->voltage(netId) - _vGrid[layId][xId][yId+1]->voltage(netId)) * g2g_condutance;
-                    }
-                }
-                if (legal(xId, yId-1)) {
-                    if (_vGrid[layId][xId][yId-1]->hasNet(netId)) {
-                        current += abs(grid_i->voltage(netId) - _vGrid[layId][xId][yId-1]->voltage(netId)) * g2g_condutance;
-                    }
-                }
-                // via current
-                for (size_t sViaId = 0; sViaId < _db.vNet(netId)->sourceViaCstr()->numVias(); ++ sViaId) {
-                    double sX = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->x();
-                    double sY = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->y();
-                    if (gridEnclose(grid_i, sX, sY)) {
-                        // cerr << "Enclose: net" << netId << " layer" << layId << " source, grid = (" << grid_i->xId() << ", " << grid_i->yId() << ")" << endl; 
-                        if (layId > 0) {
-                            current += abs(grid_i->voltage(netId) - _vGrid[layId-1][xId][yId]->voltage(netId)) * via_condutance_down;
-                        } else {
-                            current += abs(grid_i->voltage(netId) - _db.vNet(netId)->sourcePort()->voltage()) * via_condutance_up;
-                        }
-                        if (layId < _db.numLayers()-1) {
-                            current += abs(grid_i->voltage(netId) - _vGrid[layId+1][xId][yId]->voltage(netId)) * via_condutance_up;
-                        }
-                    }
-                }
-                for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
-                    // double tPortCurr = 0;
-                    double loadConductance = _db.vNet(netId)->targetPort(tPortId)->current() / (_db.vNet(netId)->targetPort(tPortId)->voltage()* _db.vNet(netId)->targetPort(tPortId)->viaCluster()->numVias());
-                    for (size_t tViaId = 0; tViaId < _db.vNet(netId)->vTargetViaCstr(tPortId)->numVias(); ++ tViaId) {
-                        double tX = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->x();
-                        double tY = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->y();
-                        if (gridEnclose(grid_i, tX, tY)) {
-                            if (layId > 0) {
-                                current += abs(grid_i->voltage(netId) - _vGrid[layId-1][xId][yId]->voltage(netId)) * via_condutance_down;
-                            } else {
-                                current += abs(grid_i->voltage(netId)) /(1.0/via_condutance_up + 1.0/loadConductance);
-                                _vTPortCurr[netId][tPortId] += abs(grid_i->voltage(netId)) /(1.0/via_condutance_up + 1.0/loadConductance);
-                                cerr << "net" << netId << ", tPort" << tPortId << ": voltage = " << grid_i->voltage(netId);
-                                cerr << ", current = " << abs(grid_i->voltage(netId)) /(1.0/via_condutance_up + 1.0/loadConductance) << endl;
-                            }
-                            if (layId < _db.numLayers()-1) {
-                                current += abs(grid_i->voltage(netId) - _vGrid[layId+1][xId][yId]->voltage(netId)) * via_condutance_up;
-                            } 
-                        }
-                    }
-                    // _vTPortCurr[netId][tPortId] += tPortCurr;
-                    // _vTPortCurr[netId].push_back(tPortCurr);
-                    // _vTPortVolt[netId].push_back(tPortCurr / loadConductance);
-                    // cerr << "tPortCurr = " << tPortCurr << ", tPortVolt = " << _vTPortVolt[netId][tPortId] << endl;
-                }
-                grid_i->setCurrent(netId, current * 0.5);
-                // cerr << "gridCurrent = " << current * 0.5 << endl;
-            }
-        }
-        // for(int i=0; i<20; i++) {
-        //     for(int j=0; j<20; j++)
-        //         printf("%4.1f ", mtx[i][j]);
-        //     printf("\n");
-        // }
+        cerr << vLog[netId].str();
     }
 
     for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
@@ -1266,212 +1094,234 @@ void DetailedMgr::check() {
     }
 }
 
-void DetailedMgr::buildSingleNetMtx(size_t netId) {
-    cerr << "Single Net PEEC Simulation start..." << endl;
-
-    auto gridEnclose = [&] (Grid* grid, double x, double y) -> bool {
-        double gridLX = grid->xId() * _gridWidth;
-        double gridUX = (grid->xId()+1) * _gridWidth;
-        double gridLY = grid->yId() * _gridWidth;
-        double gridUY = (grid->yId()+1) * _gridWidth;
-        // to avoid a via enclosed by multiple grids, set ">=" but "<" only
-        return ((x >= gridLX) && (x < gridUX) && (y >= gridLY) && (y < gridUY));
+void DetailedMgr::stampRow(size_t netId, size_t layId, Grid* grid_i, PEECRow& row) {
+    auto neighbor = [&] (size_t nbrLayId, size_t xId, size_t yId) -> size_t {
+        return (nbrLayId * _numXs + xId) * _numYs + yId;
     };
+    row.diag = 0;
+    row.rhs = 0;
+    row.hasRhs = false;
+    row.vOffDiag.clear();
+
+    double g2g_condutance = _stackup.g2gCond(layId);
+    double via_condutance_up = _stackup.viaCondUp(layId);
+    double via_condutance_down = (layId > 0)? _stackup.viaCondDown(layId) : 0;
+
+    size_t xId = grid_i->xId();
+    size_t yId = grid_i->yId();
+
+    // check left
+    if(xId > 0 && _vGrid[layId][xId-1][yId]->hasNet(netId)) {
+        row.diag += g2g_condutance;
+        row.vOffDiag.push_back(make_pair(neighbor(layId, xId-1, yId), -g2g_condutance));
+    }
+
+    // check right
+    if(xId < _numXs-1 && _vGrid[layId][xId+1][yId]->hasNet(netId)) {
+        row.diag += g2g_condutance;
+        row.vOffDiag.push_back(make_pair(neighbor(layId, xId+1, yId), -g2g_condutance));
+    }
     
-    //wait for the answer
-    size_t numNode = 0;
-    map< tuple<size_t, size_t, size_t>, size_t > getID; // i = getID[layID, xId, yId] = ith node
-    for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
-        for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
-            getID[make_tuple(layId, _vNetGrid[netId][layId][gridId]->xId(), _vNetGrid[netId][layId][gridId]->yId())] = numNode;
-            numNode++;
+    // check down
+    if(yId > 0 && _vGrid[layId][xId][yId-1]->hasNet(netId)) {
+        row.diag += g2g_condutance;
+        row.vOffDiag.push_back(make_pair(neighbor(layId, xId, yId-1), -g2g_condutance));
+    }
+    
+    // check up
+    if(yId < _numYs-1 && _vGrid[layId][xId][yId+1]->hasNet(netId)) {
+        row.diag += g2g_condutance;
+        row.vOffDiag.push_back(make_pair(neighbor(layId, xId, yId+1), -g2g_condutance));
+    }
+
+    unordered_map< size_t, vector<int> >::const_iterator itVia = _vNetViaPort[netId].find(xId * _numYs + yId);
+    if (itVia == _vNetViaPort[netId].end()) return;
+    for (size_t i = 0; i < itVia->second.size(); ++ i) {
+        int tPortId = itVia->second[i];
+        if (layId > 0) {
+            row.diag += via_condutance_down;
+            row.vOffDiag.push_back(make_pair(neighbor(layId-1, xId, yId), -via_condutance_down));
+        } else if (tPortId < 0) {
+            row.diag += via_condutance_up;
+            row.rhs = _db.vNet(netId)->sourcePort()->voltage() * via_condutance_up;
+            row.hasRhs = true;
+        } else {
+            row.diag += _stackup.loadCond(netId, tPortId);
+        }
+        if (layId < _db.numLayers()-1) {
+            row.diag += via_condutance_up;
+            row.vOffDiag.push_back(make_pair(neighbor(layId+1, xId, yId), -via_condutance_up));
         }
     }
+}
 
-    // initialize matrix and vector
-    Eigen::SparseMatrix<double, Eigen::RowMajor> Y(numNode, numNode);
-    Eigen::VectorXd I(numNode);
-    Eigen::VectorXd V(numNode);
-    vector< Eigen::Triplet<double> > vTplY;
-    vTplY.reserve(6 * numNode);
-    for (size_t i = 0; i < numNode; ++ i) {
-        I[i] = 0;
-        V[i] = 0;
-    }
-
-    // // initialize
-    // vector< vector<double > > mtx;
-    // // numNode += (_db.vNet(netId)->numTPorts() + 1) * _db.numLayers();    // add the source/target via nodes on each layer
-    // for(int i=0; i<numNode; i++) {
-    //     mtx.push_back(vector<double>());
-    //     for(int j=0; j<numNode; j++)
-    //         mtx[i].push_back(0.0);
-    // }
+size_t DetailedMgr::refreshRows(size_t netId, const NodeIndex& nodeIndex) {
+    // a row only depends on the grid itself and on which of its 4 neighbors (in the same layer) belong to the net,
+    // so after grids are added or removed only those grids and their neighbors are restamped
     assert(_vNetGrid[netId].size() == _db.numLayers());
+    PEECContext& context = *_vPEECContext[netId];
+    unordered_set<size_t> sDirtyId;
+    auto markChanged = [&] (size_t id) {
+        size_t yId = id % _numYs;
+        size_t xId = (id / _numYs) % _numXs;
+        sDirtyId.insert(id);
+        if (xId > 0) sDirtyId.insert(id - _numYs);
+        if (xId < _numXs-1) sDirtyId.insert(id + _numYs);
+        if (yId > 0) sDirtyId.insert(id - 1);
+        if (yId < _numYs-1) sDirtyId.insert(id + 1);
+    };
+    for (unordered_map<size_t, PEECRow>::iterator it = context.mRow.begin(); it != context.mRow.end(); ) {
+        if (!nodeIndex.hasNode(it->first)) {
+            markChanged(it->first);
+            it = context.mRow.erase(it);
+        } else {
+            ++ it;
+        }
+    }
     for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
-        int numSVias = 0;
-        vector<int> numTVias(_db.vNet(netId)->numTPorts(), 0);
         for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
             Grid* grid_i = _vNetGrid[netId][layId][gridId];
-            // cerr << "grid = (" << grid_i->xId() << " " << grid_i->yId() << ")" << endl;
-            size_t node_id = getID[make_tuple(layId, grid_i->xId(), grid_i->yId())];
-        //    printf("x: %-4d, y: %-4d, lay: %-4d, ID: %-4d\n", i->xId(), i->yId(), layId, getID[make_tuple(layId, i->xId(), i->yId())]);
-        
-            double g2g_condutance = _db.vMetalLayer(layId)->conductivity() * _db.vMetalLayer(layId)->thickness() * 1E-3;
-            double via_condutance_up, via_condutance_down;
-            if (layId > 0) {
-                via_condutance_down = (_db.vMetalLayer(0)->conductivity() * _db.VIA16D8A24()->metalArea() * 1E-6) / (1E-3 * (0.5*_db.vMetalLayer(layId-1)->thickness()+ _db.vMediumLayer(layId)->thickness()+0.5* _db.vMetalLayer(layId)->thickness()));
-            }
-            if (layId < _db.numLayers() - 1) {
-                via_condutance_up = (_db.vMetalLayer(0)->conductivity() * _db.VIA16D8A24()->metalArea() * 1E-6) / (1E-3 * (0.5*_db.vMetalLayer(layId)->thickness()+ _db.vMediumLayer(layId+1)->thickness()+0.5* _db.vMetalLayer(layId+1)->thickness()));
-            }
-            double small_conductance = 1.0;
-            // if (gridId == 0) {
-            //     cerr << "layer" << layId << ": g2g_conductance = " << g2g_condutance << ", via_conductance_up = " << via_condutance_up;
-            //     cerr << ", via_conductance_down = " << via_condutance_down << endl;
-            // }
-
-            // check left
-            if(grid_i->xId() > 0 && _vGrid[layId][grid_i->xId()-1][grid_i->yId()]->hasNet(netId)) {
-                // mtx[node_id][node_id] += g2g_condutance;
-                // mtx[node_id][getID[make_tuple(layId, grid_i->xId()-1, grid_i->yId())]] -= g2g_condutance;
-                vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, g2g_condutance));
-                vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId, grid_i->xId()-1, grid_i->yId())], -g2g_condutance));
+            if (context.mRow.count(grid_i->id()) == 0) markChanged(grid_i->id());
+        }
+    }
+    size_t numRestamped = 0;
+    for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
+        for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
+            Grid* grid_i = _vNetGrid[netId][layId][gridId];
+            if (sDirtyId.count(grid_i->id()) > 0) {
+                stampRow(netId, layId, grid_i, context.mRow[grid_i->id()]);
+                ++ numRestamped;
             }
+        }
+    }
+    return numRestamped;
+}
 
-            // check right
-            if(grid_i->xId() < _numXs-1 && _vGrid[layId][grid_i->xId()+1][grid_i->yId()]->hasNet(netId)) {
-                // mtx[node_id][node_id] += g2g_condutance;
-                // mtx[node_id][getID[make_tuple(layId, grid_i->xId()+1, grid_i->yId())]] -= g2g_condutance;
-                vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, g2g_condutance));
-                vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId, grid_i->xId()+1, grid_i->yId())], -g2g_condutance));
-            }
-            
-            // check down
-            if(grid_i->yId() > 0 && _vGrid[layId][grid_i->xId()][grid_i->yId()-1]->hasNet(netId)) {
-                // mtx[node_id][node_id] += g2g_condutance;
-                // mtx[node_id][getID[make_tuple(layId, grid_i->xId(), grid_i->yId()-1)]] -= g2g_condutance;
-                vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, g2g_condutance));
-                vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId, grid_i->xId(), grid_i->yId()-1)], -g2g_condutance));
+void DetailedMgr::assembleMtx(size_t netId, const NodeIndex& nodeIndex, PEECSolver::SpMat& Y, Eigen::VectorXd& I) {
+    const PEECContext& context = *_vPEECContext[netId];
+    vector< Eigen::Triplet<double> > vTplY;
+    vTplY.reserve(6 * Y.rows());
+    I.setZero(Y.rows());
+    for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
+        for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
+            Grid* grid_i = _vNetGrid[netId][layId][gridId];
+            size_t node_id = nodeIndex.nodeId(layId, grid_i->xId(), grid_i->yId());
+            const PEECRow& row = context.mRow.at(grid_i->id());
+            if (row.diag != 0) vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, row.diag));
+            for (size_t i = 0; i < row.vOffDiag.size(); ++ i) {
+                vTplY.push_back(Eigen::Triplet<double>(node_id, nodeIndex.nodeId(row.vOffDiag[i].first), row.vOffDiag[i].second));
             }
-            
-            // check up
-            if(grid_i->yId() < _numYs-1 && _vGrid[layId][grid_i->xId()][grid_i->yId()+1]->hasNet(netId)) {
-                // mtx[node_id][node_id] += g2g_condutance;
-                // mtx[node_id][getID[make_tuple(layId, grid_i->xId(), grid_i->yId()+1)]] -= g2g_condutance;
-                vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, g2g_condutance));
-                vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId, grid_i->xId(), grid_i->yId()+1)], -g2g_condutance));
-            }
-
-            // // check top layer
-            // if(layId > 0 && _vGrid[layId-1][grid_i->xId()][grid_i->yId()]->hasNet(netId)) {
-            //     mtx[node_id][node_id] += via_condutance;
-            //     mtx[node_id][getID[make_tuple(layId-1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-            // }
-
-            // // check bottom layer
-            // if(layId < _db.numLayers()-1 && _vGrid[layId+1][grid_i->xId()][grid_i->yId()]->hasNet(netId)) {
-            //     mtx[node_id][node_id] += via_condutance;
-            //     mtx[node_id][getID[make_tuple(layId+1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-            // }
+            if (row.hasRhs) I(node_id) = row.rhs;
+        }
+    }
+    Y.setFromTriplets(vTplY.begin(), vTplY.end());
+}
 
-            for (size_t sViaId = 0; sViaId < _db.vNet(netId)->sourceViaCstr()->numVias(); ++ sViaId) {
-                double sX = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->x();
-                double sY = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->y();
-                if (gridEnclose(grid_i, sX, sY)) {
-                    numSVias ++;
-                    // cerr << "Enclose: net" << netId << " layer" << layId << " source, grid = (" << grid_i->xId() << ", " << grid_i->yId() << ")" << endl; 
-                    if (layId > 0) {
-                        // mtx[node_id][node_id] += via_condutance;
-                        // mtx[node_id][getID[make_tuple(layId-1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-                        vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, via_condutance_down));
-                        vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId-1, grid_i->xId(), grid_i->yId())], -via_condutance_down));
-                    } else {
-                        // if (netId != 1) {
-                        vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, via_condutance_up));
-                        I(node_id) = _db.vNet(netId)->sourcePort()->voltage() * via_condutance_up;
-                        // }
-                        // cerr << "layer" << layId << " node" << node_id;
-                        // cerr << ": sVolt = " << _db.vNet(netId)->sourcePort()->voltage();
-                        // cerr << ", via_conductance_up = " << via_condutance_up;
-                        // cerr << ", I" << node_id << " = " << I(node_id) << endl;
-                    }
-                    if (layId < _db.numLayers()-1) {
-                        // mtx[node_id][node_id] += via_condutance;
-                        // mtx[node_id][getID[make_tuple(layId+1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-                        vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, via_condutance_up));
-                        vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId+1, grid_i->xId(), grid_i->yId())], -via_condutance_up));
-                    }
-                }
-            }
-            for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
-                for (size_t tViaId = 0; tViaId < _db.vNet(netId)->vTargetViaCstr(tPortId)->numVias(); ++ tViaId) {
-                    double tX = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->x();
-                    double tY = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->y();
-                    if (gridEnclose(grid_i, tX, tY)) {
-                        numTVias[tPortId] ++;
-                        if (layId > 0) {
-                            // mtx[node_id][node_id] += via_condutance;
-                            // mtx[node_id][getID[make_tuple(layId-1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-                            vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, via_condutance_down));
-                            vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId-1, grid_i->xId(), grid_i->yId())], -via_condutance_down));
-                        } else {
-                            double loadConductance = _db.vNet(netId)->targetPort(tPortId)->current() / (_db.vNet(netId)->targetPort(tPortId)->voltage() * _db.vNet(netId)->targetPort(tPortId)->viaCluster()->numVias());
-                            //  * _db.vNet(netId)->targetPort(tPortId)->viaCluster()->numVias()
-                            // if (netId != 1) {
-                            vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, 1.0/(1.0/via_condutance_up + 1.0/loadConductance)));
-                            // } else {
-                            //     vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, 1.0/(1.0/via_condutance_down + 1.0/loadConductance)));
-                            // }
-                            // cerr << "layer" << layId << " node" << node_id;
-                            // cerr << ": tPort" << tPortId ;
-                            // cerr << ", total conductance = " << 1.0/(1.0/via_condutance_up + 1.0/loadConductance) << endl;
-                            // << ": via_conductance = " << via_condutance_up << ", loadConductance = " << loadConductance;
-                        }
-                        if (layId < _db.numLayers()-1) {
-                            // mtx[node_id][node_id] += via_condutance;
-                            // mtx[node_id][getID[make_tuple(layId+1, grid_i->xId(), grid_i->yId())]] -= via_condutance;
-                            vTplY.push_back(Eigen::Triplet<double>(node_id, node_id, via_condutance_up));
-                            vTplY.push_back(Eigen::Triplet<double>(node_id, getID[make_tuple(layId+1, grid_i->xId(), grid_i->yId())], -via_condutance_up));
-                        } 
-                    }
+void DetailedMgr::loadMultigrid(size_t netId, const NodeIndex& nodeIndex, PEECMultigrid& multigrid, Eigen::VectorXd& I) {
+    const PEECContext& context = *_vPEECContext[netId];
+    for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
+        multigrid.setLayerConductance(layId, _stackup.g2gCond(layId));
+    }
+    for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
+        for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
+            Grid* grid_i = _vNetGrid[netId][layId][gridId];
+            size_t node_id = nodeIndex.nodeId(layId, grid_i->xId(), grid_i->yId());
+            const PEECRow& row = context.mRow.at(grid_i->id());
+            // node_id = the order of addNode(); the lateral entries are implied by the layer conductance,
+            // the vias to a grid outside the net have no node and are left out
+            multigrid.addNode(layId, grid_i->xId(), grid_i->yId(), row.diag);
+            for (size_t i = 0; i < row.vOffDiag.size(); ++ i) {
+                size_t nbrId = row.vOffDiag[i].first;
+                if (nbrId / (_numXs * _numYs) != layId && nodeIndex.hasNode(nbrId)) {
+                    multigrid.addCoupling(node_id, nodeIndex.nodeId(nbrId), -row.vOffDiag[i].second);
                 }
             }
+            if (row.hasRhs) I(node_id) = row.rhs;
         }
-        // Port* sPort = _db.vNet(netId)->sourcePort();
-        // int realNumSVias = sPort->viaCluster()->numVias();
-        // cerr << "layer" << layId << ": numSVias = " << numSVias << ", real numSVias = " << realNumSVias << endl;
-        // for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
-        //     Port* tPort = _db.vNet(netId)->targetPort(tPortId);
-        //     int realNumTVias = tPort->viaCluster()->numVias();
-        //     cerr << "layer" << layId << " tPort" << tPortId << ": numTVias = " << numTVias[tPortId] << ", real numTVias = " << realNumTVias << endl;
-        // }
     }
+}
 
-    // if (netId == 1) {
-    //     cerr << "net1, I = " << endl;
-    //     for (size_t i = 0; i < I.size(); ++ i) {
-    //         if (I[i] > 0) {
-    //             cerr << "I[" << i << "] = " << I[i] << endl;
-    //         }
-    //     }
-    // }
+void DetailedMgr::simulateNet(size_t netId, NodeIndex& nodeIndex, ostream* log) {
+    
+    size_t numNode = indexNodes(netId, nodeIndex);
+    if (log != NULL) *log << "numNode: " << numNode << endl;
+    size_t numRestamped = refreshRows(netId, nodeIndex);
+    if (log != NULL) *log << "restamped rows: " << numRestamped << endl;
 
-    Y.setFromTriplets(vTplY.begin(), vTplY.end());
-    // Eigen::BiCGSTAB<Eigen::SparseMatrix<double, Eigen::RowMajor>, Eigen::IdentityPreconditioner> solver;
-    Eigen::ConjugateGradient<Eigen::SparseMatrix<double, Eigen::RowMajor>, Eigen::Upper> solver;
-    // solver.setMaxIterations(1000000);
-    // solver.setTolerance(1e-14);
-    solver.compute(Y);
-    // V = solver.solveWithGuess(I, V);
-    V = solver.solve(I);
-    assert(solver.info() == Eigen::Success);
+    // initialize matrix and vector
+    // the multigrid solver takes the rows as stencils on the lattice and never assembles Y
+    PEECContext& context = *_vPEECContext[netId];
+    bool useMultigrid = (_peecSolver == PEECCGMultigrid) || (_peecSolver == PEECAuto && numNode > PEECSolver::maxDirectNodes());
+    PEECMultigrid multigrid(_db.numLayers(), _numXs, _numYs);
+    PEECSolver::SpMat Y(numNode, numNode);
+    Eigen::VectorXd I = Eigen::VectorXd::Zero(numNode);
+    Eigen::VectorXd V = Eigen::VectorXd::Zero(numNode);
+    if (useMultigrid) {
+        loadMultigrid(netId, nodeIndex, multigrid, I);
+    } else {
+        assembleMtx(netId, nodeIndex, Y, I);
+    }
+    // warm start from the last solution of the net
+    for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
+        for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
+            Grid* grid_i = _vNetGrid[netId][layId][gridId];
+            if (grid_i->voltage(netId) >= 0) V(nodeIndex.nodeId(layId, grid_i->xId(), grid_i->yId())) = grid_i->voltage(netId);
+        }
+    }
+
+    bool success;
+    if (useMultigrid) {
+        // matrix-free in double whatever _peecPrecision, the operator is applied from the stencils and never stored
+        multigrid.build();
+        success = multigrid.solve(I, V, 1e-10, 500, context.stats);
+        if (!success) {
+            // assemble Y and fall back to CG+Jacobi (the original solver) from the last iterate, as PEECSolver::solve() does
+            // from a singular LDL^T; the incomplete Cholesky would stop at the empty rows of grids cut off by SmartRemove
+            ostream& out = (log != NULL)? *log : cerr;
+            out << "WARNING: net" << netId << ": " << context.stats.name << " stopped at residual = " << context.stats.residual;
+            out << " after " << context.stats.iterations << " iterations, falling back to CG+Jacobi" << endl;
+            assembleMtx(netId, nodeIndex, Y, I);
+            if (!V.allFinite()) V.setZero(numNode);
+            success = context.solver.solve(PEECCGJacobi, Y, I, V, context.stats, _peecPrecision != PEECDouble);
+        }
+    } else {
+        Eigen::VectorXd V0 = V;
+        success = context.solver.solve(_peecSolver, Y, I, V, context.stats, _peecPrecision != PEECDouble);
+        if (_peecPrecision == PEECMixedChecked) {
+            // the largest deviation of the target port voltages (proportional to their load currents) from the double precision solve,
+            // also for the single net simulations of SmartGrow / SmartRemove, which have no log of their own
+            PEECSolver solver;
+            PEECSolveStats stats;
+            solver.solve(_peecSolver, Y, I, V0, stats);
+            vector<double> vCurr, vCurr0;
+            loadCurrents(netId, nodeIndex, V, vCurr);
+            loadCurrents(netId, nodeIndex, V0, vCurr0);
+            double maxVoltDiff = 0;
+            double maxRelDiff = 0;
+            for (size_t tPortId = 0; tPortId < vCurr.size(); ++ tPortId) {
+                double loadResistance = _db.vNet(netId)->targetPort(tPortId)->voltage() / _db.vNet(netId)->targetPort(tPortId)->current();
+                maxVoltDiff = max(maxVoltDiff, abs(vCurr[tPortId] - vCurr0[tPortId]) * loadResistance);
+                if (vCurr0[tPortId] != 0) maxRelDiff = max(maxRelDiff, abs(vCurr[tPortId] - vCurr0[tPortId]) / abs(vCurr0[tPortId]));
+            }
+            ostream& out = (log != NULL)? *log : cerr;
+            out << "mixed precision: net" << netId << ": max target port voltage deviation = " << maxVoltDiff << " V (relative " << maxRelDiff;
+            out << "), double precision time = " << stats.seconds << " s" << endl;
+        }
+    }
+    if (log != NULL) {
+        *log << "solver = " << context.stats.name << ", iterations = " << context.stats.iterations;
+        *log << ", residual = " << context.stats.residual << ", time = " << context.stats.seconds << " s" << endl;
+    }
+    if (!success) {
+        ostream& out = (log != NULL)? *log : cerr;
+        out << "WARNING: net" << netId << ": the PEEC solve did not converge, residual = " << context.stats.residual << endl;
+    }
 
     // set voltage of each grid
     for (size_t layId = 0; layId < _vNetGrid[netId].size(); ++ layId) {
         for (size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId ++) {
             Grid* grid_i = _vNetGrid[netId][layId][gridId];
-            size_t node_id = getID[make_tuple(layId, grid_i->xId(), grid_i->yId())];
+            size_t node_id = nodeIndex.nodeId(layId, grid_i->xId(), grid_i->yId());
             grid_i->setVoltage(netId, V[node_id]);
             // assert(grid_i->voltage(netId) <= _db.vNet(netId)->sourcePort()->voltage());
         }
@@ -1487,22 +1337,10 @@ void DetailedMgr::buildSingleNetMtx(size_t netId) {
             Grid* grid_i = _vNetGrid[netId][layId][gridId];
             size_t xId = grid_i->xId();
             size_t yId = grid_i->yId();
-            size_t node_id = getID[make_tuple(layId, grid_i->xId(), grid_i->yId())];
-            double g2g_condutance = _db.vMetalLayer(layId)->conductivity() * _db.vMetalLayer(layId)->thickness() * 1E-3;
-            double via_condutance_up, via_condutance_down;
-            if (layId > 0) {
-                via_condutance_down = (_db.vMetalLayer(0)->conductivity() * _db.VIA16D8A24()->metalArea() * 1E-6) / (1E-3 * (0.5*_db.vMetalLayer(layId-1)->thickness()+ _db.vMediumLayer(layId)->thickness()+0.5* _db.vMetalLayer(layId)->thickness()));
-            }
-            if (layId < _db.numLayers() - 1) {
-                via_condutance_up = (_db.vMetalLayer(0)->conductivity() * _db.VIA16D8A24()->metalArea() * 1E-6) / (1E-3 * (0.5*_db.vMetalLayer(layId)->thickness()+ _db.vMediumLayer(layId+1)->thickness()+0.5* _db.vMetalLayer(layId+1)->thickness()));
-            }
-            if (gridId == 0) {
-                // cerr << "layer" << layId << ": g2g_conductance = " << g2g_condutance << ", via_conductance_up = " << via_condutance_up;
-                // cerr << ", via_conductance_down = " << via_condutance_down << endl;
-            }
-            double small_conductance = 1.0;
+            double g2g_condutance = _stackup.g2gCond(layId);
+            double via_condutance_up = _stackup.viaCondUp(layId);
+            double via_condutance_down = (layId > 0)? _stackup.viaCondDown(layId) : 0;
             double current = 0;
-            size_t nbrId;
             if (legal(xId+1, yId)) {
                 if (_vGrid[layId][xId+1][yId]->hasNet(netId)) {
                     current += abs(grid_i->voltage(netId) - _vGrid[layId][xId+1][yId]->voltage(netId)) * g2g_condutance;
@@ -1524,45 +1362,25 @@ void DetailedMgr::buildSingleNetMtx(size_t netId) {
                 }
             }
             // via current
-            for (size_t sViaId = 0; sViaId < _db.vNet(netId)->sourceViaCstr()->numVias(); ++ sViaId) {
-                double sX = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->x();
-                double sY = _db.vNet(netId)->sourceViaCstr()->vVia(sViaId)->y();
-                if (gridEnclose(grid_i, sX, sY)) {
-                    // cerr << "Enclose: net" << netId << " layer" << layId << " source, grid = (" << grid_i->xId() << ", " << grid_i->yId() << ")" << endl; 
-                    if (layId > 0) {
-                        current += abs(grid_i->voltage(netId) - _vGrid[layId-1][xId][yId]->voltage(netId)) * via_condutance_down;
-                    } else {
-                        current += abs(grid_i->voltage(netId) - _db.vNet(netId)->sourcePort()->voltage()) * via_condutance_up;
-                    }
-                    if (layId < _db.numLayers()-1) {
-                        current += abs(grid_i->voltage(netId) - _vGrid[layId+1][xId][yId]->voltage(netId)) * via_condutance_up;
+            unordered_map< size_t, vector<int> >::const_iterator itVia = _vNetViaPort[netId].find(xId * _numYs + yId);
+            for (size_t i = 0; itVia != _vNetViaPort[netId].end() && i < itVia->second.size(); ++ i) {
+                int tPortId = itVia->second[i];
+                if (layId > 0) {
+                    current += abs(grid_i->voltage(netId) - _vGrid[layId-1][xId][yId]->voltage(netId)) * via_condutance_down;
+                } else if (tPortId < 0) {
+                    current += abs(grid_i->voltage(netId) - _db.vNet(netId)->sourcePort()->voltage()) * via_condutance_up;
+                } else {
+                    double loadCurrent = abs(grid_i->voltage(netId)) * _stackup.loadCond(netId, tPortId);
+                    current += loadCurrent;
+                    _vTPortCurr[netId][tPortId] += loadCurrent;
+                    if (log != NULL) {
+                        *log << "net" << netId << ", tPort" << tPortId << ": voltage = " << grid_i->voltage(netId);
+                        *log << ", current = " << loadCurrent << endl;
                     }
                 }
-            }
-            for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
-                // double tPortCurr = 0;
-                double loadConductance = _db.vNet(netId)->targetPort(tPortId)->current() / (_db.vNet(netId)->targetPort(tPortId)->voltage()* _db.vNet(netId)->targetPort(tPortId)->viaCluster()->numVias());
-                for (size_t tViaId = 0; tViaId < _db.vNet(netId)->vTargetViaCstr(tPortId)->numVias(); ++ tViaId) {
-                    double tX = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->x();
-                    double tY = _db.vNet(netId)->vTargetViaCstr(tPortId)->vVia(tViaId)->y();
-                    if (gridEnclose(grid_i, tX, tY)) {
-                        if (layId > 0) {
-                            current += abs(grid_i->voltage(netId) - _vGrid[layId-1][xId][yId]->voltage(netId)) * via_condutance_down;
-                        } else {
-                            current += abs(grid_i->voltage(netId)) /(1.0/via_condutance_up + 1.0/loadConductance);
-                            _vTPortCurr[netId][tPortId] += abs(grid_i->voltage(netId)) /(1.0/via_condutance_up + 1.0/loadConductance);
-                            //cerr << "net" << netId << ", tPort" << tPortId << ": voltage = " << grid_i->voltage(netId);
-                            //cerr << ", current = " << abs(grid_i->voltage(netId)) /(1.0/via_condutance_up + 1.0/loadConductance) << endl;
-                        }
-                        if (layId < _db.numLayers()-1) {
-                            current += abs(grid_i->voltage(netId) - _vGrid[layId+1][xId][yId]->voltage(netId)) * via_condutance_up;
-                        } 
-                    }
+                if (layId < _db.numLayers()-1) {
+                    current += abs(grid_i->voltage(netId) - _vGrid[layId+1][xId][yId]->voltage(netId)) * via_condutance_up;
                 }
-                // _vTPortCurr[netId][tPortId] += tPortCurr;
-                // _vTPortCurr[netId].push_back(tPortCurr);
-                // _vTPortVolt[netId].push_back(tPortCurr / loadConductance);
-                // cerr << "tPortCurr = " << tPortCurr << ", tPortVolt = " << _vTPortVolt[netId][tPortId] << endl;
             }
             grid_i->setCurrent(netId, current * 0.5);
             // cerr << "gridCurrent = " << current * 0.5 << endl;
@@ -1573,7 +1391,16 @@ void DetailedMgr::buildSingleNetMtx(size_t netId) {
     //         printf("%4.1f ", mtx[i][j]);
     //     printf("\n");
     // }
-   
+}
+
+void DetailedMgr::buildSingleNetMtx(size_t netId) {
+    cerr << "Single Net PEEC Simulation start..." << endl;
+    if (_vNetViaPort.size() != _db.numNets()) initPEEC();
+    simulateNet(netId, *_vNodeIndex[0], NULL);
+    const PEECSolveStats& stats = _vPEECContext[netId]->stats;
+    cerr << "net" << netId << ": solver = " << stats.name << ", iterations = " << stats.iterations;
+    cerr << ", residual = " << stats.residual << ", time = " << stats.seconds << " s" << endl;
+
     for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
         double loadResistance = _db.vNet(netId)->targetPort(tPortId)->voltage() / _db.vNet(netId)->targetPort(tPortId)->current();
         _vTPortVolt[netId][tPortId] = _vTPortCurr[netId][tPortId] * loadResistance;
@@ -1582,37 +1409,232 @@ void DetailedMgr::buildSingleNetMtx(size_t netId) {
     }
 }
 
-//function for current sortint
-bool compareByCurrent(const std::tuple<double, int, int>& a, const std::tuple<double, int, int>& b) {
-    return get<0>(a) < get<0>(b);
+bool DetailedMgr::estimateNet(size_t netId, vector<double>& vTPortCurr, vector<double>& vTPortVolt) {
+    if (_vNetViaPort.size() != _db.numNets()) initPEEC();
+    NodeIndex& nodeIndex = *_vNodeIndex[0];
+    size_t numNode = indexNodes(netId, nodeIndex);
+    refreshRows(netId, nodeIndex);
+    PEECMultigrid multigrid(_db.numLayers(), _numXs, _numYs);
+    Eigen::VectorXd I = Eigen::VectorXd::Zero(numNode);
+    Eigen::VectorXd V;
+    loadMultigrid(netId, nodeIndex, multigrid, I);
+    multigrid.build();
+    vTPortCurr.assign(_db.vNet(netId)->numTPorts(), 0.0);
+    vTPortVolt.assign(_db.vNet(netId)->numTPorts(), 0.0);
+    if (!multigrid.estimate(_estimateLevel, I, V)) return false;
+
+    loadCurrents(netId, nodeIndex, V, vTPortCurr);
+    for (size_t tPortId = 0; tPortId < _db.vNet(netId)->numTPorts(); ++ tPortId) {
+        double loadResistance = _db.vNet(netId)->targetPort(tPortId)->voltage() / _db.vNet(netId)->targetPort(tPortId)->current();
+        vTPortVolt[tPortId] = vTPortCurr[tPortId] * loadResistance;
+    }
+    return true;
 }
 
-bool DetailedMgr::NetEdgeDetect(size_t netId, size_t layId, Grid* grid){
-    size_t xId = grid->xId();
-    size_t yId = grid->yId();
+void DetailedMgr::loadCurrents(size_t netId, const NodeIndex& nodeIndex, const Eigen::VectorXd& V, vector<double>& vTPortCurr) {
+    // the load current through the target vias, as in simulateNet
+    vTPortCurr.assign(_db.vNet(netId)->numTPorts(), 0.0);
+    for (size_t gridId = 0; gridId < _vNetGrid[netId][0].size(); ++ gridId) {
+        Grid* grid = _vNetGrid[netId][0][gridId];
+        unordered_map< size_t, vector<int> >::const_iterator itVia = _vNetViaPort[netId].find(grid->xId() * _numYs + grid->yId());
+        if (itVia == _vNetViaPort[netId].end()) continue;
+        double voltage = V[nodeIndex.nodeId(0, grid->xId(), grid->yId())];
+        for (size_t i = 0; i < itVia->second.size(); ++ i) {
+            int tPortId = itVia->second[i];
+            if (tPortId >= 0) vTPortCurr[tPortId] += abs(voltage) * _stackup.loadCond(netId, tPortId);
+        }
+    }
+}
+
+bool DetailedMgr::meetsTargets(size_t netId, const vector<double>& vTPortCurr, const vector<double>& vTPortVolt, double margin) {
+    for (size_t tPortId = 0; tPortId < vTPortCurr.size(); ++ tPortId) {
+        if (vTPortCurr[tPortId] < (1 - margin) * _db.vNet(netId)->targetPort(tPortId)->current()) return false;
+        if (vTPortVolt[tPortId] < (1 - margin) * _db.vNet(netId)->targetPort(tPortId)->voltage()) return false;
+    }
+    return true;
+}
 
-    if (legal(xId+1, yId)) {
-        Grid* rGrid = _vGrid[layId][xId+1][yId];
-        if (!rGrid->hasNet(netId)) return true;
+bool DetailedMgr::passesEstimate(size_t netId, vector<double>& vEstCurr, vector<double>& vEstVolt) {
+    // without an estimate the step is simulated, and there is nothing for checkEstimate() to compare
+    if (!estimateNet(netId, vEstCurr, vEstVolt)) {
+        vEstCurr.clear();
+        return true;
     }
-    if (legal(xId-1, yId)) {
-        Grid* lGrid = _vGrid[layId][xId-1][yId];
-        if (!lGrid->hasNet(netId)) return true;
+    return meetsTargets(netId, vEstCurr, vEstVolt, _estimateMargin);
+}
+
+void DetailedMgr::checkEstimate(size_t netId, const vector<double>& vEstCurr, bool screened) {
+    // rejecting on the estimate assumes it is off by less than _estimateMargin, then the step misses the targets anyway
+    if (!_checkEstimate || vEstCurr.size() != _vTPortCurr[netId].size()) return;
+    for (size_t tPortId = 0; tPortId < _vTPortCurr[netId].size(); ++ tPortId) {
+        double current = _vTPortCurr[netId][tPortId];
+        double deviation = (current != 0)? abs(vEstCurr[tPortId] - current) / abs(current) : 0;
+        cerr << "estimate check: net" << netId << " tPort" << tPortId << ": estimated current = " << vEstCurr[tPortId];
+        cerr << ", simulated current = " << current << ", deviation = " << deviation << endl;
     }
-    if (legal(xId, yId+1)) {
-        Grid* uGrid = _vGrid[layId][xId][yId+1];
-        if (!uGrid->hasNet(netId)) return true;
+    if (!screened && meetsTargets(netId, _vTPortCurr[netId], _vTPortVolt[netId], 0)) {
+        cerr << "WARNING: net" << netId << ": the estimate rejected a step that meets the targets, _estimateMargin is too small" << endl;
     }
-    if (legal(xId, yId-1)) {
-        Grid* dGrid = _vGrid[layId][xId][yId-1];
-        if (!dGrid->hasNet(netId)) return true;
+}
+
+void DetailedMgr::simulateScenarios(const vector< vector< vector<double> > >& vScenarioCurr, vector< vector< vector<double> > >& vTPortCurr, vector< vector< vector<double> > >& vTPortVolt) {
+    cerr << "PEEC Scenario Simulation start: " << vScenarioCurr.size() << " scenarios" << endl;
+    if (_vNetViaPort.size() != _db.numNets()) initPEEC();
+    vTPortCurr.assign(vScenarioCurr.size(), vector< vector<double> >(_db.numNets()));
+    vTPortVolt.assign(vScenarioCurr.size(), vector< vector<double> >(_db.numNets()));
+    size_t numThreads = max((size_t)1, min(_numThreads, _db.numNets()));
+    while (_vNodeIndex.size() < numThreads) {
+        _vNodeIndex.push_back(new NodeIndex(_db.numLayers(), _numXs, _numYs));
+    }
+    vector<ostringstream> vLog(_db.numNets());
+    forEachTask(_db.numNets(), [&](size_t netId, size_t threadId) {
+        simulateNetScenarios(netId, *_vNodeIndex[threadId], vScenarioCurr, vTPortCurr, vTPortVolt, vLog[netId]);
+    });
+    for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+        cerr << vLog[netId].str();
+    }
+}
+
+void DetailedMgr::simulateNetScenarios(size_t netId, NodeIndex& nodeIndex, const vector< vector< vector<double> > >& vScenarioCurr,
+                                       vector< vector< vector<double> > >& vTPortCurr, vector< vector< vector<double> > >& vTPortVolt, ostream& log) {
+    // The loads only change the diagonal at the layer 0 grids enclosing target vias (the load nodes), so with U = their columns
+    // of the identity and D = the change of their load conductances, Y_s = Y + U D U^T. By Woodbury,
+    //     U^T V_s = u0 - ZU (1 + D ZU)^-1 D u0,   u0 = U^T Y^-1 I,   ZU = U^T Y^-1 U,
+    // so Y is factorized once and each scenario costs a dense solve of the size of the load nodes.
+    size_t numNode = indexNodes(netId, nodeIndex);
+    refreshRows(netId, nodeIndex);
+    PEECSolver::SpMat Y(numNode, numNode);
+    Eigen::VectorXd I;
+    assembleMtx(netId, nodeIndex, Y, I);
+
+    vector<size_t> vLoadNode;                   // index = [loadId]
+    vector< vector<size_t> > vLoadPort;         // index = [loadId] [viaId], the target port of each via of the load node
+    for (size_t gridId = 0; gridId < _vNetGrid[netId][0].size(); ++ gridId) {
+        Grid* grid = _vNetGrid[netId][0][gridId];
+        unordered_map< size_t, vector<int> >::const_iterator itVia = _vNetViaPort[netId].find(grid->xId() * _numYs + grid->yId());
+        if (itVia == _vNetViaPort[netId].end()) continue;
+        vector<size_t> vPort;
+        for (size_t i = 0; i < itVia->second.size(); ++ i) {
+            if (itVia->second[i] >= 0) vPort.push_back(itVia->second[i]);
+        }
+        if (!vPort.empty()) {
+            vLoadNode.push_back(nodeIndex.nodeId(0, grid->xId(), grid->yId()));
+            vLoadPort.push_back(vPort);
+        }
+    }
+    size_t numLoads = vLoadNode.size();
+
+    // [Y^-1 I, Y^-1 U] restricted to the load nodes, the right-hand sides are solved in blocks to bound the memory;
+    // a part of the net cut off from the source and the loads makes Y singular, then each scenario is solved in full instead
+    PEECContext& context = *_vPEECContext[netId];
+    bool factorized = context.solver.factorize(Y);
+    if (!factorized) log << "WARNING: net" << netId << ": LDL^T of the PEEC matrix failed, solving each scenario in full by CG+Jacobi" << endl;
+    const size_t blockSize = 64;
+    Eigen::VectorXd u0(numLoads);
+    Eigen::MatrixXd ZU(numLoads, numLoads);
+    for (size_t begin = 0; factorized && begin < numLoads + 1; begin += blockSize) {
+        size_t end = min(numLoads + 1, begin + blockSize);
+        // column c is I for c = 0, else the unit vector of load node c-1
+        Eigen::MatrixXd B = Eigen::MatrixXd::Zero(numNode, end - begin);
+        for (size_t c = begin; c < end; ++ c) {
+            if (c == 0) B.col(0) = I;
+            else B(vLoadNode[c-1], c - begin) = 1;
+        }
+        Eigen::MatrixXd X;
+        context.solver.solveBlock(B, X);
+        for (size_t c = begin; c < end; ++ c) {
+            for (size_t loadId = 0; loadId < numLoads; ++ loadId) {
+                if (c == 0) u0[loadId] = X(vLoadNode[loadId], 0);
+                else ZU(loadId, c - 1) = X(vLoadNode[loadId], c - begin);
+            }
+        }
+    }
+
+    for (size_t scenarioId = 0; scenarioId < vScenarioCurr.size(); ++ scenarioId) {
+        const vector<double>& vCurr = vScenarioCurr[scenarioId][netId];   // index = [tPortId]
+        assert(vCurr.size() == _db.vNet(netId)->numTPorts());
+        Eigen::VectorXd D(numLoads);
+        for (size_t loadId = 0; loadId < numLoads; ++ loadId) {
+            D[loadId] = 0;
+            for (size_t i = 0; i < vLoadPort[loadId].size(); ++ i) {
+                size_t tPortId = vLoadPort[loadId][i];
+                D[loadId] += _stackup.loadCond(netId, tPortId, vCurr[tPortId]) - _stackup.loadCond(netId, tPortId);
+            }
+        }
+        Eigen::VectorXd vLoadVolt = u0;
+        if (!factorized) {
+            // Y_s = Y + U D U^T, solved by the original CG+Jacobi, which converges on the consistent singular system
+            PEECSolver::SpMat Ys = Y;
+            for (size_t loadId = 0; loadId < numLoads; ++ loadId) {
+                Ys.coeffRef(vLoadNode[loadId], vLoadNode[loadId]) += D[loadId];
+            }
+            PEECSolver solver;
+            PEECSolveStats stats;
+            Eigen::VectorXd V = Eigen::VectorXd::Zero(numNode);
+            if (!solver.solve(PEECCGJacobi, Ys, I, V, stats)) {
+                log << "WARNING: scenario" << scenarioId << " net" << netId << ": the PEEC solve did not converge, residual = " << stats.residual << endl;
+            }
+            for (size_t loadId = 0; loadId < numLoads; ++ loadId) {
+                vLoadVolt[loadId] = V[vLoadNode[loadId]];
+            }
+        } else if (numLoads > 0) {
+            Eigen::MatrixXd C = D.asDiagonal() * ZU;
+            C.diagonal().array() += 1;
+            vLoadVolt -= ZU * C.partialPivLu().solve(D.cwiseProduct(u0));
+        }
+
+        vector<double>& vPortCurr = vTPortCurr[scenarioId][netId];
+        vector<double>& vPortVolt = vTPortVolt[scenarioId][netId];
+        vPortCurr.assign(_db.vNet(netId)->numTPorts(), 0.0);
+        vPortVolt.assign(_db.vNet(netId)->numTPorts(), 0.0);
+        for (size_t loadId = 0; loadId < numLoads; ++ loadId) {
+            for (size_t i = 0; i < vLoadPort[loadId].size(); ++ i) {
+                size_t tPortId = vLoadPort[loadId][i];
+                vPortCurr[tPortId] += abs(vLoadVolt[loadId]) * _stackup.loadCond(netId, tPortId, vCurr[tPortId]);
+            }
+        }
+        for (size_t tPortId = 0; tPortId < vPortCurr.size(); ++ tPortId) {
+            if (vCurr[tPortId] > 0) {
+                double loadResistance = _db.vNet(netId)->targetPort(tPortId)->voltage() / vCurr[tPortId];
+                vPortVolt[tPortId] = vPortCurr[tPortId] * loadResistance;
+            }
+            log << "scenario" << scenarioId << " net" << netId << " tPort" << tPortId << ": current = " << vPortCurr[tPortId];
+            log << ", voltage = " << vPortVolt[tPortId] << endl;
+        }
     }
+}
 
-    return false;
+//function for current sortint
+bool compareByCurrent(const std::tuple<double, int, int>& a, const std::tuple<double, int, int>& b) {
+    return get<0>(a) < get<0>(b);
 }
 
+void DetailedMgr::NetEdgeDetect(size_t netId, vector< vector< vector<uint64_t> > >& vEdge){
+    // a whole row of 64 grids at a time on the occupancy bit-planes (see GridMap::netEdgeRow)
+    vEdge.resize(_db.numLayers());
+    for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
+        vEdge[layId].resize(_numYs);
+        for (size_t yId = 0; yId < _numYs; ++ yId) {
+            _gridMap->netEdgeRow(netId, layId, yId, vEdge[layId][yId]);
+        }
+    }
+}
 
-void DetailedMgr::SmartGrow(size_t netId, int k){
+void DetailedMgr::updateNetEdge(size_t netId, size_t layId, Grid* grid, vector< vector< vector<uint64_t> > >& vEdge){
+    int xId = grid->xId();
+    int yId = grid->yId();
+    int dX[4] = {1, -1, 0, 0};
+    int dY[4] = {0, 0, 1, -1};
+    for (size_t dirId = 0; dirId < 4; ++ dirId) {
+        int nXId = xId + dX[dirId];
+        int nYId = yId + dY[dirId];
+        if (legal(nXId, nYId) && _vGrid[layId][nXId][nYId]->hasNet(netId)) {
+            vEdge[layId][nYId][nXId / 64] |= (uint64_t)1 << (nXId % 64);
+        }
+    }
+}
+
+bool DetailedMgr::SmartGrow(size_t netId, int k){
     std::cout << "###########Smart GROW###########" << endl;
     //cout << "size of NetGrid after smartgrow : " << _vNetGrid[netId][layId].size() << endl;  
 
@@ -1701,7 +1723,7 @@ void DetailedMgr::SmartGrow(size_t netId, int k){
         //sort 
         std::sort(NodeCurrent.begin(), NodeCurrent.end(), compareByCurrent);
         
-        Grid* r = new Grid(0,0,0);//new a pointer for later remove operation
+        Grid* r = new Grid(NULL,0,0,0,0);//new a pointer for later remove operation
         for(int i = 0; alreadyRemove < removeNum && i < NodeCurrent.size() ; i++){
             int layId =  get<1>(NodeCurrent[i]);
             int gridId = get<2>(NodeCurrent[i]);
@@ -1724,8 +1746,14 @@ void DetailedMgr::SmartGrow(size_t netId, int k){
         delete r;
     }
 
-    //DO PEEC simulation after smartgrow
+    //DO PEEC simulation after smartgrow, unless even the coarse estimate misses the targets by more than _estimateMargin:
+    //then the net has to grow again, and _vTPortCurr / _vTPortVolt and the grid currents keep the last simulation
+    //(the next SmartGrow simulates before it reads the grid currents)
+    vector<double> vEstCurr, vEstVolt;
+    bool screened = passesEstimate(netId, vEstCurr, vEstVolt);
+    if (!screened && !_checkEstimate) return false;
     buildSingleNetMtx(netId);
+    checkEstimate(netId, vEstCurr, screened);
 
 
     //Plot Adding Grid
@@ -1747,6 +1775,7 @@ void DetailedMgr::SmartGrow(size_t netId, int k){
 
     //cout << "size of NetGrid after smartgrow : " << _vNetGrid[netId][layId].size() << endl;  
 
+    return meetsTargets(netId, _vTPortCurr[netId], _vTPortVolt[netId], 0);
 }
 
 
@@ -1769,17 +1798,20 @@ void DetailedMgr::SmartRefine(size_t netId, int k){
     //sort 
     std::sort(NodeCurrent.begin(), NodeCurrent.end(), compareByCurrent);
 
-    //remove k nodes
-    Grid* r = new Grid(0,0,0);//new a pointer for later remove operation
+    //remove k nodes, only from the edge of the net
+    vector< vector< vector<uint64_t> > > vEdge;
+    NetEdgeDetect(netId, vEdge);
+    Grid* r = new Grid(NULL,0,0,0,0);//new a pointer for later remove operation
     int alreadyRemoved = 0;
     for(int i = 0; i < NodeCurrent.size() && alreadyRemoved < k ; i++){
         int layId = get<1>(NodeCurrent[i]);
         int gridId = get<2>(NodeCurrent[i]);
         Grid* grid = _vNetGrid[netId][layId][gridId];
         if(grid->IsPort(netId)) continue; // If it is port, can't remove
-        bool canRemove = NetEdgeDetect(netId, layId, grid);
+        bool canRemove = isNetEdge(vEdge, layId, grid);
         if(canRemove){
             grid->removeNet(netId);//remove it from net
+            updateNetEdge(netId, layId, grid, vEdge);
             grid->decCongestCur();
             _vNetGrid[netId][layId][gridId] = r; //set pointer to r and delete later (avoid changing the size if vNetGrid[netId][layId])
             //cout << "Remove GridID : " << gridId << " ";
@@ -1815,17 +1847,20 @@ bool DetailedMgr::SmartRemove(size_t netId, int k){
 
     int alreadyRemove = 0; 
     vector<pair<size_t,Grid*>> RemovedGrid; //layId and grid*
-    //remove k nodes
-    Grid* r = new Grid(-1,-1,0);//new a pointer for later remove operation
+    //remove k nodes, only from the edge of the net
+    vector< vector< vector<uint64_t> > > vEdge;
+    NetEdgeDetect(netId, vEdge);
+    Grid* r = new Grid(NULL,0,0,-1,-1);//new a pointer for later remove operation
     for(int i = 0; i < NodeCurrent.size() && alreadyRemove < k ; i++){
         int layId = get<1>(NodeCurrent[i]);
         int gridId = get<2>(NodeCurrent[i]);
         Grid* grid = _vNetGrid[netId][layId][gridId];
         if(grid->IsPort(netId)) continue; // If it is port, can't remove
-        bool canRemove = NetEdgeDetect(netId, layId, grid);
+        bool canRemove = isNetEdge(vEdge, layId, grid);
         if(canRemove){
             RemovedGrid.push_back(make_pair(layId,grid));
             grid->removeNet(netId);//remove it from net
+            updateNetEdge(netId, layId, grid, vEdge);
             grid->decCongestCur();
             _vNetGrid[netId][layId][gridId] = r; //set pointer to r and delete later (avoid changing the size if vNetGrid[netId][layId])
             //cout << "Remove GridID : " << gridId << " ";
@@ -1840,19 +1875,17 @@ bool DetailedMgr::SmartRemove(size_t netId, int k){
     }
     delete r;
 
-    //DO PEEC simulation after smartremove
-    buildSingleNetMtx(netId);
-
-    bool ReachTarget = true;
-    for(size_t tPortId = 0; tPortId < _vTPortCurr[netId].size();tPortId++){
-        if(_vTPortCurr[netId][tPortId] < _db.vNet(netId)->targetPort(tPortId)->current()){
-            ReachTarget = false;
-            break;
-        }
-        if(_vTPortVolt[netId][tPortId] < _db.vNet(netId)->targetPort(tPortId)->voltage()){
-            ReachTarget = false;
-            break;
-        }
+    //screen with the coarse estimate: a removal that misses the targets by more than _estimateMargin on it is rejected
+    //without the PEEC simulation (simulated anyway with _checkEstimate), the others are decided by it
+    vector<double> vEstCurr, vEstVolt;
+    bool screened = passesEstimate(netId, vEstCurr, vEstVolt);
+    bool ReachTarget = false;
+    bool Simulated = false;
+    if(screened || _checkEstimate){
+        buildSingleNetMtx(netId);
+        Simulated = true;
+        checkEstimate(netId, vEstCurr, screened);
+        ReachTarget = meetsTargets(netId, _vTPortCurr[netId], _vTPortVolt[netId], 0);
     }
 
     //if violate the current constraint -> go back to last state
@@ -1865,7 +1898,8 @@ bool DetailedMgr::SmartRemove(size_t netId, int k){
             _vNetGrid[netId][layId].push_back(grid);
         }
         cout << "###SmartRemove failed -> Go back to previous condition###" << endl;
-        buildSingleNetMtx(netId);
+        //the grids still hold the simulation of the previous condition unless it was overwritten
+        if(Simulated) buildSingleNetMtx(netId);
         return false;
     }
     //return true if it still satisfy current constraint 
@@ -1900,7 +1934,7 @@ void DetailedMgr::SmartDistribute(){
     }
     
     for(size_t netId = 0; netId < _vNetGrid.size(); netId++){
-        Grid* r = new Grid(0,0,0);//new a pointer for later remove operation
+        Grid* r = new Grid(NULL,0,0,0,0);//new a pointer for later remove operation
         for(size_t layId = 0; layId < _vNetGrid[netId].size();layId ++){
             for(size_t gridId = 0; gridId < _vNetGrid[netId][layId].size() ; gridId++){
                 Grid* grid = _vNetGrid[netId][layId][gridId];
@@ -1967,20 +2001,9 @@ void DetailedMgr::PostProcessing(){
             int count = 0;
 
             while(!ReachTarget){
-                ReachTarget = true;
-                SmartGrow(netId,s);
+                //the targets are checked on the PEEC simulation, SmartGrow only skips it while the estimate is clearly short
+                ReachTarget = SmartGrow(netId,s);
                 //s = (int)(s/1.25);//隨便設一個遞減函數
-
-                for(size_t tPortId = 0; tPortId < _vTPortCurr[netId].size();tPortId++){
-                    if(_vTPortCurr[netId][tPortId] < _db.vNet(netId)->targetPort(tPortId)->current()){
-                        ReachTarget = false;
-                        break;
-                    }
-                    if(_vTPortVolt[netId][tPortId] < _db.vNet(netId)->targetPort(tPortId)->voltage()){
-                        ReachTarget = false;
-                        break;
-                    }
-                }  
                 count ++;
                 // if(count > 5){
                 //     cout << "######OUT of TIME########" << endl; 
@@ -2059,7 +2082,7 @@ void DetailedMgr::PostProcessing(){
 void DetailedMgr::RemoveIsolatedGrid(){
     for(size_t netId=0; netId < _vNetGrid.size(); netId++){
         for(size_t layId=0; layId<_vNetGrid[netId].size(); layId++){
-            Grid* r = new Grid(0,0,0);
+            Grid* r = new Grid(NULL,0,0,0,0);
             for(size_t gridId = 0; gridId < _vNetGrid[netId][layId].size(); gridId++){
                 int Remove = 0;
                 Grid* grid = _vNetGrid[netId][layId][gridId];
@@ -5,7 +5,12 @@
 #include "../base/DB.h"
 #include "DetailedDB.h"
 #include "AStarRouter.h"
+#include "CongestMap.h"
+#include "PEECSolver.h"
+#include "PEECMultigrid.h"
+#include "PEECStackup.h"
 #include <utility>
+#include <functional>
 using namespace std;
 
 class DetailedMgr {
@@ -16,20 +21,34 @@ class DetailedMgr {
             _obsCongest = _db.numNets() * 10.0;
             _distWeight = 0.2;
             _cLineDistWeight = 0.1;
+            _corridorMargin = -1;
+            _numThreads = 1;
+            _peecSolver = PEECAuto;
+            _peecPrecision = PEECDouble;
+            _estimateLevel = 2;
+            _estimateMargin = 0.05;
+            _checkEstimate = false;
             _numXs = _db.boardWidth() / _gridWidth;
             _numYs = _db.boardHeight() / _gridWidth;
+            _gridMap = new GridMap(_db.numLayers(), _numXs, _numYs, _db.numNets());
+            _vNodeIndex.push_back(new NodeIndex(_db.numLayers(), _numXs, _numYs));
             for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
                 vector< vector<Grid*> > vLayGrid;
                 for (size_t xId = 0; xId < _numXs; ++ xId) {
                     vector<Grid*> vXGrid;
                     for (size_t yId = 0; yId < _numYs; ++ yId) {
-                        Grid* grid = new Grid(xId, yId, _db.numNets());
-                        vXGrid.push_back(grid);
+                        vXGrid.push_back(_gridMap->grid(layId, xId, yId));
                     }
                     vLayGrid.push_back(vXGrid);
                 }
                 _vGrid.push_back(vLayGrid);
             }
+            for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
+                _vCongestMap.push_back(new CongestMap(_vGrid[layId], _obsCongest));
+            }
+            for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
+                _vPEECContext.push_back(new PEECContext());
+            }
             for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
                 vector< vector< Grid* > > vNetGrid;
                 for (size_t layId = 0; layId < _db.numLayers(); ++ layId) {
@@ -59,7 +78,18 @@ class DetailedMgr {
                 _vTPortVolt.push_back(temp);
             }
         }
-        ~DetailedMgr() {}
+        ~DetailedMgr() {
+            for (size_t layId = 0; layId < _vCongestMap.size(); ++ layId) {
+                delete _vCongestMap[layId];
+            }
+            delete _gridMap;
+            for (size_t netId = 0; netId < _vPEECContext.size(); ++ netId) {
+                delete _vPEECContext[netId];
+            }
+            for (size_t threadId = 0; threadId < _vNodeIndex.size(); ++ threadId) {
+                delete _vNodeIndex[threadId];
+            }
+        }
 
         vector< vector< vector< pair<int, int> > > > vNetPortGrid() { return _vNetPortGrid; }
 
@@ -72,6 +102,12 @@ class DetailedMgr {
         void plotGridMapCurrent();
         void naiveAStar();
         void negoAStar(bool sameNetCong);
+        void setCorridorMargin(int margin) { _corridorMargin = margin; }
+        void setNumThreads(size_t numThreads) { _numThreads = numThreads; }
+        void setNumNegoIters(size_t numNegoIters) { _numNegoIters = numNegoIters; }
+        void setPEECSolver(PEECSolverType peecSolver) { _peecSolver = peecSolver; }
+        void setPEECPrecision(PEECPrecision peecPrecision) { _peecPrecision = peecPrecision; }
+        void setCheckEstimate(bool checkEstimate) { _checkEstimate = checkEstimate; }
         void addPortVia();
         void plotVia();
         void addViaGrid();
@@ -107,12 +143,24 @@ class DetailedMgr {
         }
         void buildMtx();
         void buildSingleNetMtx(size_t netId);
+        // the target port currents and voltages if the ports drew the currents of each scenario, on the present routing;
+        // vScenarioCurr: index = [scenarioId] [netId] [tPortId], the load current of each target port
+        // vTPortCurr, vTPortVolt: the same index, the results; the grids, _vTPortCurr and _vTPortVolt are left as they are
+        // each net is factorized once by LDL^T (whatever the PEEC solver) and the scenarios are low-rank updates of it
+        void simulateScenarios(const vector< vector< vector<double> > >& vScenarioCurr, vector< vector< vector<double> > >& vTPortCurr, vector< vector< vector<double> > >& vTPortVolt);
         double getResistance(Grid*, Grid*);
         void check();
-        void SmartGrow(size_t netId, int k);
+        // grow net netId by k grids, return whether it then meets its targets
+        bool SmartGrow(size_t netId, int k);
         void SmartRefine(size_t netId, int k);
         bool SmartRemove(size_t netId, int k);
-        bool NetEdgeDetect(size_t netId, size_t layId, Grid* grid);
+        // vEdge: index = [layId] [yId] [xId / 64], bit xId % 64 is set for the grids of net netId with a (legal) 4-neighbor not in the net
+        void NetEdgeDetect(size_t netId, vector< vector< vector<uint64_t> > >& vEdge);
+        bool isNetEdge(const vector< vector< vector<uint64_t> > >& vEdge, size_t layId, Grid* grid) const {
+            return (vEdge[layId][grid->yId()][grid->xId() / 64] >> (grid->xId() % 64)) & 1;
+        }
+        // once grid is removed from net netId, its 4-neighbors still in the net are edges too
+        void updateNetEdge(size_t netId, size_t layId, Grid* grid, vector< vector< vector<uint64_t> > >& vEdge);
         void SmartDistribute();
         void PostProcessing();
         void RemoveIsolatedGrid();
@@ -121,25 +169,79 @@ class DetailedMgr {
     private:
     
         vector< pair<double, double> > kMeansClustering(vector< pair<int,int> > vGrid, int numClusters, int numEpochs);
+        void negoAStarLayer(size_t layId, bool sameNetCong, ostream& log, vector<Grid*>& vPathGrid);
+        // vPos += the grids (xId, yId) with a corner enclosed by shape (or by its bounding box), in increasing (xId, yId)
+        void rasterize(Shape* shape, bool boundBox, vector< pair<int, int> >& vPos);
+        // run func(layId) for every layer, on up to _numThreads threads
+        void forEachLayer(const function<void(size_t)>& func);
+        // run func(taskId, threadId) for taskId = 0..numTasks-1 on up to _numThreads threads, threadId < _numThreads
+        void forEachTask(size_t numTasks, const function<void(size_t, size_t)>& func);
         void clearNet(size_t layId, size_t netId);
+        // the grid (xId, yId) enclosing point (x, y), false if it is outside the board
+        bool enclosingCell(double x, double y, size_t& xId, size_t& yId) const;
+        // fill _vNetViaPort from the port vias of the nets
+        void indexPortVias();
+        // build the via lookup and the conductance tables of the PEEC simulation, once the port vias are placed
+        void initPEEC();
+        // index the grids of net netId in nodeIndex, return the number of nodes
+        size_t indexNodes(size_t netId, NodeIndex& nodeIndex);
+        // assemble and solve the PEEC matrix of net netId, set the voltage and current of its grids and _vTPortCurr[netId]
+        void simulateNet(size_t netId, NodeIndex& nodeIndex, ostream* log);
+        // the target port currents and voltages of net netId estimated on the multigrid level _estimateLevel,
+        // the grids are left as they are; false if the estimate could not be made
+        bool estimateNet(size_t netId, vector<double>& vTPortCurr, vector<double>& vTPortVolt);
+        // vTPortCurr = the load current of each target port of net netId for the node voltages V
+        void loadCurrents(size_t netId, const NodeIndex& nodeIndex, const Eigen::VectorXd& V, vector<double>& vTPortCurr);
+        // whether the target ports of net netId get at least (1 - margin) of their current and voltage
+        bool meetsTargets(size_t netId, const vector<double>& vTPortCurr, const vector<double>& vTPortVolt, double margin);
+        // whether the step of SmartGrow / SmartRemove just made on net netId has to be decided by the PEEC simulation:
+        // false if its estimate (vEstCurr, vEstVolt) misses the targets by more than _estimateMargin
+        bool passesEstimate(size_t netId, vector<double>& vEstCurr, vector<double>& vEstVolt);
+        // with _checkEstimate, log the deviation of the estimate from the PEEC simulation of the same step,
+        // and warn if the estimate rejected (screened = false) a step that meets the targets
+        void checkEstimate(size_t netId, const vector<double>& vEstCurr, bool screened);
+        // multigrid = the PEEC system of net netId from its rows, I (zero, sized to the nodes) = its right-hand side
+        void loadMultigrid(size_t netId, const NodeIndex& nodeIndex, PEECMultigrid& multigrid, Eigen::VectorXd& I);
+        // simulateScenarios() for net netId
+        void simulateNetScenarios(size_t netId, NodeIndex& nodeIndex, const vector< vector< vector<double> > >& vScenarioCurr,
+                                  vector< vector< vector<double> > >& vTPortCurr, vector< vector< vector<double> > >& vTPortVolt, ostream& log);
+        // restamp the rows of net netId whose grid or neighbors changed since its last simulation, return their number
+        size_t refreshRows(size_t netId, const NodeIndex& nodeIndex);
+        // Y, I = the PEEC system of net netId from its rows (Y already sized to the number of nodes)
+        void assembleMtx(size_t netId, const NodeIndex& nodeIndex, PEECSolver::SpMat& Y, Eigen::VectorXd& I);
+        // recompute the stamps of grid_i (on layer layId) in the PEEC matrix of net netId
+        void stampRow(size_t netId, size_t layId, Grid* grid_i, PEECRow& row);
         bool legal(int xId, int yId) { return (xId>=0 && xId<_vGrid[0].size() && yId>=0 && yId<_vGrid[0][0].size()); }
         DB& _db;
         SVGPlot& _plot;
         double _gridWidth;
-        vector< vector< vector< Grid* > > > _vGrid;     // index = [layId] [xId] [yId]; from left xId = 0, from bottom yId = 0
+        GridMap* _gridMap;                              // the storage of all grids
+        vector< vector< vector< Grid* > > > _vGrid;     // index = [layId] [xId] [yId]; from left xId = 0, from bottom yId = 0; handles into _gridMap
         vector< vector< vector< Grid* > > > _vNetGrid;  // index = [netId] [layId] [gridId]
+        PEECStackup _stackup;                           // the conductances of the PEEC model
+        vector< PEECContext* > _vPEECContext;           // index = [netId], the PEEC rows and solver reused by the next simulation of the net
+        vector< NodeIndex* > _vNodeIndex;               // index = [threadId], the PEEC nodes of the net simulated by the thread
+        vector< CongestMap* > _vCongestMap;             // index = [layId], congestion prefix sums used by AStarRouter
         vector< vector< vector< pair<int, int> > > > _vNetPortGrid;        // index = [netId] [portId] [gridId]
+        vector< unordered_map< size_t, vector<int> > > _vNetViaPort;     // index = [netId] [xId * _numYs + yId], the port of each via of the net enclosed by the grid, -1 = the source port
         size_t _numXs;
         size_t _numYs;
         vector< vector< double > > _vTPortVolt;     // index = [netId] [netTportId], record the target port voltage during simulation
         vector< vector< double > > _vTPortCurr;     // index = [netId] [netTportId], record the target port current during simulation
 
         // parameters for tuning
-        size_t _numNegoIters;    // the number of negotiation iterations in each layer
+        size_t _numNegoIters;    // the maximum number of negotiation iterations in each layer
         double _widthRatio;      // the larger, the wider search width
         int _obsCongest;         // the congestion of obstacles and regions outside boundaries
         double _distWeight;      // the weight of distance in A* cost
         double _cLineDistWeight; // the weight of distance to the center line in A* cost
+        int _corridorMargin;     // the margin (in grids) of the A* search corridor around each segment, < 0 to search the whole layer
+        size_t _numThreads;      // the number of layers (or nets in buildMtx) processed concurrently
+        PEECSolverType _peecSolver;  // the linear solver of the PEEC simulation
+        PEECPrecision _peecPrecision;  // of the PEEC simulation; PEECCGMultigrid always solves in double, only its fallback follows it
+        size_t _estimateLevel;   // the multigrid level of the estimate screening SmartGrow / SmartRemove (2 = blocks of 4x4 grids)
+        double _estimateMargin;  // a step is rejected on the estimate alone if it misses the targets by more than this ratio (simulated anyway with _checkEstimate)
+        bool _checkEstimate;     // simulate the steps rejected by the estimate too, and compare every estimate with the simulation
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,197 @@
+#ifndef OPEN_LIST_H
+#define OPEN_LIST_H
+
+#include "../base/Include.h"
+#include "DetailedDB.h"
+using namespace std;
+
+// All open lists share the same interface used by AStarRouter::route():
+//   push(node)   insert a node whose cost() is already set
+//   pop()        remove and return the node with the smallest cost()
+//   decrease(node, oldCost) restore the order after node->cost() has been decreased from oldCost
+// The position of a node inside the list is kept in GNode::heapId() (and GNode::bucketId()),
+// so decrease() never searches the list (except for the multiset, which needs oldCost as its key).
+
+// indexed d-ary min-heap (d = 4) with true decrease-key
+class HeapOpenList {
+    public:
+        HeapOpenList() {}
+        ~HeapOpenList() {}
+
+        bool empty() const { return _vNode.empty(); }
+        size_t size() const { return _vNode.size(); }
+        void clear() { _vNode.clear(); }
+
+        void push(GNode* node) {
+            node->setHeapId(_vNode.size());
+            _vNode.push_back(node);
+            siftUp(_vNode.size()-1);
+        }
+        GNode* pop() {
+            assert(!_vNode.empty());
+            GNode* top = _vNode[0];
+            _vNode[0] = _vNode.back();
+            _vNode[0]->setHeapId(0);
+            _vNode.pop_back();
+            if (!_vNode.empty()) siftDown(0);
+            top->setHeapId(GNode::NoHeapId);
+            return top;
+        }
+        void decrease(GNode* node, double) {
+            assert(node->heapId() < _vNode.size() && _vNode[node->heapId()] == node);
+            siftUp(node->heapId());
+        }
+
+    private:
+        static const size_t _arity = 4;
+        void place(size_t heapId, GNode* node) { _vNode[heapId] = node; node->setHeapId(heapId); }
+        void siftUp(size_t heapId) {
+            GNode* node = _vNode[heapId];
+            while (heapId > 0) {
+                size_t parentId = (heapId - 1) / _arity;
+                if (_vNode[parentId]->cost() <= node->cost()) break;
+                place(heapId, _vNode[parentId]);
+                heapId = parentId;
+            }
+            place(heapId, node);
+        }
+        void siftDown(size_t heapId) {
+            GNode* node = _vNode[heapId];
+            while (true) {
+                size_t childId = heapId * _arity + 1;
+                if (childId >= _vNode.size()) break;
+                size_t minId = childId;
+                size_t lastId = min(childId + _arity, _vNode.size());
+                for (++ childId; childId < lastId; ++ childId) {
+                    if (_vNode[childId]->cost() < _vNode[minId]->cost()) minId = childId;
+                }
+                if (_vNode[minId]->cost() >= node->cost()) break;
+                place(heapId, _vNode[minId]);
+                heapId = minId;
+            }
+            place(heapId, node);
+        }
+        vector<GNode*> _vNode;   // index = [heapId]
+};
+
+// bucket queue: costs are quantized by the bucket width, nodes in the same bucket are popped in arbitrary order,
+// so the result is optimal up to the bucket width. Insertions below the current minimum bucket are allowed.
+// Each search starts at bucketWidth; a cost beyond maxBuckets buckets doubles the width and rebuckets the queue,
+// so the buckets stay within maxBuckets whatever the scale of the costs (e.g. the congestion of obstacles).
+class BucketOpenList {
+    public:
+        BucketOpenList(double bucketWidth = 0.01, size_t maxBuckets = 1 << 16) : _initBucketWidth(bucketWidth), _maxBuckets(maxBuckets) {
+            _bucketWidth = bucketWidth;
+            _minBucketId = 0;
+            _numNodes = 0;
+        }
+        ~BucketOpenList() {}
+
+        bool empty() const { return _numNodes == 0; }
+        size_t size() const { return _numNodes; }
+        void clear() {
+            for (size_t bucketId = 0; bucketId < _vBucket.size(); ++ bucketId) {
+                _vBucket[bucketId].clear();
+            }
+            _bucketWidth = _initBucketWidth;
+            _minBucketId = 0;
+            _numNodes = 0;
+        }
+
+        void push(GNode* node) {
+            size_t bucketId = toBucketId(node->cost());
+            if (bucketId >= _maxBuckets) {
+                widen(node->cost());
+                bucketId = toBucketId(node->cost());
+            }
+            if (bucketId >= _vBucket.size()) _vBucket.resize(bucketId+1);
+            node->setBucketId(bucketId);
+            node->setHeapId(_vBucket[bucketId].size());
+            _vBucket[bucketId].push_back(node);
+            if (_numNodes == 0 || bucketId < _minBucketId) _minBucketId = bucketId;
+            ++ _numNodes;
+        }
+        GNode* pop() {
+            assert(_numNodes > 0);
+            while (_vBucket[_minBucketId].empty()) ++ _minBucketId;
+            GNode* node = _vBucket[_minBucketId].back();
+            _vBucket[_minBucketId].pop_back();
+            -- _numNodes;
+            node->setHeapId(GNode::NoHeapId);
+            return node;
+        }
+        void decrease(GNode* node, double) {
+            size_t bucketId = toBucketId(node->cost());
+            if (bucketId == node->bucketId()) return;
+            erase(node);
+            push(node);
+        }
+
+    private:
+        // _maxBuckets for a cost beyond the buckets
+        size_t toBucketId(double cost) const {
+            if (cost <= 0) return 0;
+            return (cost / _bucketWidth < _maxBuckets) ? (size_t)(cost / _bucketWidth) : _maxBuckets;
+        }
+        // double the width until cost fits, then move the queued nodes to their new buckets (they fit, as the width only grows)
+        void widen(double cost) {
+            while (toBucketId(cost) >= _maxBuckets) _bucketWidth *= 2;
+            vector< vector<GNode*> > vBucket;
+            vBucket.swap(_vBucket);
+            _minBucketId = 0;
+            _numNodes = 0;
+            for (size_t bucketId = 0; bucketId < vBucket.size(); ++ bucketId) {
+                for (size_t i = 0; i < vBucket[bucketId].size(); ++ i) {
+                    push(vBucket[bucketId][i]);
+                }
+            }
+        }
+        void erase(GNode* node) {
+            vector<GNode*>& bucket = _vBucket[node->bucketId()];
+            assert(node->heapId() < bucket.size() && bucket[node->heapId()] == node);
+            bucket[node->heapId()] = bucket.back();
+            bucket[node->heapId()]->setHeapId(node->heapId());
+            bucket.pop_back();
+            -- _numNodes;
+        }
+        double _initBucketWidth;
+        size_t _maxBuckets;
+        double _bucketWidth;
+        size_t _minBucketId;
+        size_t _numNodes;
+        vector< vector<GNode*> > _vBucket;   // index = [bucketId] [heapId]
+};
+
+// the original ordered-set open list, kept for comparison;
+// unlike the old std::multiset<GNode*>, the key is never mutated in place and improved nodes are not duplicated
+class MultisetOpenList {
+    public:
+        MultisetOpenList() {}
+        ~MultisetOpenList() {}
+
+        bool empty() const { return _Q.empty(); }
+        size_t size() const { return _Q.size(); }
+        void clear() { _Q.clear(); }
+
+        void push(GNode* node) {
+            _Q.insert(make_pair(node->cost(), node));
+        }
+        GNode* pop() {
+            assert(!_Q.empty());
+            GNode* node = _Q.begin()->second;
+            _Q.erase(_Q.begin());
+            return node;
+        }
+        // the set is keyed on the cost at insertion, so the old entry is looked up by its old key
+        void decrease(GNode* node, double oldCost) {
+            set< pair<double, GNode*> >::iterator i = _Q.find(make_pair(oldCost, node));
+            assert(i != _Q.end());
+            _Q.erase(i);
+            push(node);
+        }
+
+    private:
+        set< pair<double, GNode*> > _Q;
+};
+
+#endif
@@ -0,0 +1,298 @@
+#include "PEECMultigrid.h"
+
+size_t PEECMultigrid::addNode(size_t layId, size_t xId, size_t yId, double diag) {
+    Level& level = _vLevel[0];
+    level.vKey.push_back((layId * level.numXs + xId) * level.numYs + yId);
+    level.vDiag.push_back(diag);
+    return level.numNodes() - 1;
+}
+
+void PEECMultigrid::build() {
+    _vLevel.erase(_vLevel.begin() + 1, _vLevel.end());
+    Level& finest = _vLevel[0];
+    linkNeighbors(finest);
+    for (size_t nodeId = 0; nodeId < finest.numNodes(); ++ nodeId) {
+        size_t layId = finest.vKey[nodeId] / (finest.numXs * finest.numYs);
+        if (finest.vNbr[XPlus][nodeId] >= 0) finest.vCondX[nodeId] = _vLayerCond[layId];
+        if (finest.vNbr[YPlus][nodeId] >= 0) finest.vCondY[nodeId] = _vLayerCond[layId];
+    }
+    vector<Coupling> vCoupling = _vCoupling;
+    setCouplings(finest, vCoupling);
+
+    while (_vLevel.back().numNodes() > _maxCoarseNodes) {
+        Level& fine = _vLevel.back();
+        if (fine.numXs == 1 && fine.numYs == 1) break;
+        Level coarse((fine.numXs + 1) / 2, (fine.numYs + 1) / 2);
+        coarsen(fine, coarse);
+        // stop when the aggregation no longer pays off (e.g. thin traces that only shrink in one direction)
+        if (coarse.numNodes() * 10 > fine.numNodes() * 9) break;
+        _vLevel.push_back(coarse);
+    }
+    factorizeCoarsest();
+}
+
+void PEECMultigrid::linkNeighbors(Level& level) {
+    size_t numNodes = level.numNodes();
+    unordered_map<size_t, size_t> mNode;    // key -> nodeId
+    mNode.reserve(numNodes);
+    for (size_t nodeId = 0; nodeId < numNodes; ++ nodeId) {
+        mNode[level.vKey[nodeId]] = nodeId;
+    }
+    for (size_t dir = 0; dir < 4; ++ dir) {
+        level.vNbr[dir].assign(numNodes, -1);
+    }
+    level.vCondX.assign(numNodes, 0);
+    level.vCondY.assign(numNodes, 0);
+    for (size_t nodeId = 0; nodeId < numNodes; ++ nodeId) {
+        size_t key = level.vKey[nodeId];
+        size_t yId = key % level.numYs;
+        size_t xId = (key / level.numYs) % level.numXs;
+        unordered_map<size_t, size_t>::const_iterator it;
+        if (xId + 1 < level.numXs && (it = mNode.find(key + level.numYs)) != mNode.end()) {
+            level.vNbr[XPlus][nodeId] = it->second;
+            level.vNbr[XMinus][it->second] = nodeId;
+        }
+        if (yId + 1 < level.numYs && (it = mNode.find(key + 1)) != mNode.end()) {
+            level.vNbr[YPlus][nodeId] = it->second;
+            level.vNbr[YMinus][it->second] = nodeId;
+        }
+    }
+}
+
+void PEECMultigrid::setCouplings(Level& level, vector<Coupling>& vCoupling) {
+    // sort by (nodeId, nbrNodeId) and merge the duplicates into rows
+    sort(vCoupling.begin(), vCoupling.end());
+    level.vCplBegin.assign(level.numNodes() + 1, 0);
+    level.vCplNode.clear();
+    level.vCplCond.clear();
+    for (size_t i = 0; i < vCoupling.size(); ++ i) {
+        if (i > 0 && vCoupling[i].nodeId == vCoupling[i-1].nodeId && vCoupling[i].nbrNodeId == vCoupling[i-1].nbrNodeId) {
+            level.vCplCond.back() += vCoupling[i].conductance;
+            continue;
+        }
+        level.vCplNode.push_back(vCoupling[i].nbrNodeId);
+        level.vCplCond.push_back(vCoupling[i].conductance);
+        ++ level.vCplBegin[vCoupling[i].nodeId + 1];
+    }
+    for (size_t nodeId = 0; nodeId < level.numNodes(); ++ nodeId) {
+        level.vCplBegin[nodeId + 1] += level.vCplBegin[nodeId];
+    }
+}
+
+void PEECMultigrid::coarsen(Level& fine, Level& coarse) {
+    // the coarse nodes are the 2x2 blocks with at least one fine node, in the order of their first fine node
+    unordered_map<size_t, size_t> mNode;    // coarse key -> coarse nodeId
+    mNode.reserve(fine.numNodes() / 2);
+    vector<size_t>& vParent = fine.vParent;
+    vParent.resize(fine.numNodes());
+    for (size_t nodeId = 0; nodeId < fine.numNodes(); ++ nodeId) {
+        size_t key = fine.vKey[nodeId];
+        size_t yId = key % fine.numYs;
+        size_t xId = (key / fine.numYs) % fine.numXs;
+        size_t layId = key / (fine.numXs * fine.numYs);
+        size_t coarseKey = (layId * coarse.numXs + xId / 2) * coarse.numYs + yId / 2;
+        unordered_map<size_t, size_t>::iterator it = mNode.find(coarseKey);
+        if (it == mNode.end()) {
+            it = mNode.insert(make_pair(coarseKey, coarse.vKey.size())).first;
+            coarse.vKey.push_back(coarseKey);
+            coarse.vDiag.push_back(0);
+        }
+        vParent[nodeId] = it->second;
+    }
+    linkNeighbors(coarse);
+
+    // Galerkin coarse operator P^T Y P with piecewise constant P:
+    // the diagonal sums the block, minus the couplings inside it; the couplings between blocks add up
+    vector<Coupling> vCoupling;
+    for (size_t nodeId = 0; nodeId < fine.numNodes(); ++ nodeId) {
+        size_t parent = vParent[nodeId];
+        coarse.vDiag[parent] += fine.vDiag[nodeId];
+        if (fine.vNbr[XPlus][nodeId] >= 0) {
+            size_t nbrParent = vParent[fine.vNbr[XPlus][nodeId]];
+            if (nbrParent == parent) coarse.vDiag[parent] -= 2 * fine.vCondX[nodeId];
+            else coarse.vCondX[parent] += fine.vCondX[nodeId];
+        }
+        if (fine.vNbr[YPlus][nodeId] >= 0) {
+            size_t nbrParent = vParent[fine.vNbr[YPlus][nodeId]];
+            if (nbrParent == parent) coarse.vDiag[parent] -= 2 * fine.vCondY[nodeId];
+            else coarse.vCondY[parent] += fine.vCondY[nodeId];
+        }
+        for (size_t i = fine.vCplBegin[nodeId]; i < fine.vCplBegin[nodeId + 1]; ++ i) {
+            size_t nbrParent = vParent[fine.vCplNode[i]];
+            if (nbrParent == parent) coarse.vDiag[parent] -= fine.vCplCond[i];
+            else vCoupling.push_back(Coupling(parent, nbrParent, fine.vCplCond[i]));
+        }
+    }
+    setCouplings(coarse, vCoupling);
+}
+
+void PEECMultigrid::assemble(const Level& level, double lateralScale, PEECSolver::SpMat& Y) const {
+    // the diagonal holds the lateral conductances of the node, scaled along with them
+    vector< Eigen::Triplet<double> > vTpl;
+    for (size_t nodeId = 0; nodeId < level.numNodes(); ++ nodeId) {
+        vTpl.push_back(Eigen::Triplet<double>(nodeId, nodeId, level.vDiag[nodeId]));
+        if (level.vNbr[XPlus][nodeId] >= 0) {
+            double cond = lateralScale * level.vCondX[nodeId];
+            double diff = level.vCondX[nodeId] - cond;
+            vTpl.push_back(Eigen::Triplet<double>(nodeId, level.vNbr[XPlus][nodeId], -cond));
+            vTpl.push_back(Eigen::Triplet<double>(level.vNbr[XPlus][nodeId], nodeId, -cond));
+            vTpl.push_back(Eigen::Triplet<double>(nodeId, nodeId, -diff));
+            vTpl.push_back(Eigen::Triplet<double>(level.vNbr[XPlus][nodeId], level.vNbr[XPlus][nodeId], -diff));
+        }
+        if (level.vNbr[YPlus][nodeId] >= 0) {
+            double cond = lateralScale * level.vCondY[nodeId];
+            double diff = level.vCondY[nodeId] - cond;
+            vTpl.push_back(Eigen::Triplet<double>(nodeId, level.vNbr[YPlus][nodeId], -cond));
+            vTpl.push_back(Eigen::Triplet<double>(level.vNbr[YPlus][nodeId], nodeId, -cond));
+            vTpl.push_back(Eigen::Triplet<double>(nodeId, nodeId, -diff));
+            vTpl.push_back(Eigen::Triplet<double>(level.vNbr[YPlus][nodeId], level.vNbr[YPlus][nodeId], -diff));
+        }
+        for (size_t i = level.vCplBegin[nodeId]; i < level.vCplBegin[nodeId + 1]; ++ i) {
+            vTpl.push_back(Eigen::Triplet<double>(nodeId, level.vCplNode[i], -level.vCplCond[i]));
+        }
+    }
+    Y.resize(level.numNodes(), level.numNodes());
+    Y.setFromTriplets(vTpl.begin(), vTpl.end());
+}
+
+void PEECMultigrid::factorizeCoarsest() {
+    PEECSolver::SpMat Y;
+    assemble(_vLevel.back(), 1, Y);
+    _coarseSolver.compute(Y);
+    _coarseFactorized = (_coarseSolver.info() == Eigen::Success);
+}
+
+bool PEECMultigrid::estimate(size_t levelId, const Eigen::VectorXd& I, Eigen::VectorXd& V) const {
+    // restrict I to the level, solve there and give every grid the voltage of its block
+    levelId = min(levelId, _vLevel.size() - 1);
+    Eigen::VectorXd b = I;
+    for (size_t k = 0; k < levelId; ++ k) {
+        Eigen::VectorXd bc = Eigen::VectorXd::Zero(_vLevel[k+1].numNodes());
+        for (size_t nodeId = 0; nodeId < _vLevel[k].numNodes(); ++ nodeId) {
+            bc[_vLevel[k].vParent[nodeId]] += b[nodeId];
+        }
+        b.swap(bc);
+    }
+    // the Galerkin operator of an aggregate is a block 2^levelId times as wide but with 2^levelId times the lateral
+    // conductance of the grids (it shorts the inside of the block), so the lateral conductances are scaled back
+    PEECSolver::SpMat Y;
+    assemble(_vLevel[levelId], pow(0.5, (double)levelId), Y);
+    Eigen::SimplicialLDLT<PEECSolver::SpMat> solver(Y);
+    if (solver.info() != Eigen::Success) return false;
+    Eigen::VectorXd x = solver.solve(b);
+    for (size_t k = levelId; k > 0; -- k) {
+        Eigen::VectorXd xf(_vLevel[k-1].numNodes());
+        for (size_t nodeId = 0; nodeId < _vLevel[k-1].numNodes(); ++ nodeId) {
+            xf[nodeId] = x[_vLevel[k-1].vParent[nodeId]];
+        }
+        x.swap(xf);
+    }
+    V = x;
+    return true;
+}
+
+void PEECMultigrid::apply(const Level& level, const Eigen::VectorXd& x, Eigen::VectorXd& y) const {
+    y.resize(level.numNodes());
+    for (size_t nodeId = 0; nodeId < level.numNodes(); ++ nodeId) {
+        y[nodeId] = level.vDiag[nodeId] * x[nodeId];
+    }
+    for (size_t nodeId = 0; nodeId < level.numNodes(); ++ nodeId) {
+        int nbrId = level.vNbr[XPlus][nodeId];
+        if (nbrId >= 0) {
+            y[nodeId] -= level.vCondX[nodeId] * x[nbrId];
+            y[nbrId] -= level.vCondX[nodeId] * x[nodeId];
+        }
+        nbrId = level.vNbr[YPlus][nodeId];
+        if (nbrId >= 0) {
+            y[nodeId] -= level.vCondY[nodeId] * x[nbrId];
+            y[nbrId] -= level.vCondY[nodeId] * x[nodeId];
+        }
+        for (size_t i = level.vCplBegin[nodeId]; i < level.vCplBegin[nodeId + 1]; ++ i) {
+            y[nodeId] -= level.vCplCond[i] * x[level.vCplNode[i]];
+        }
+    }
+}
+
+void PEECMultigrid::smooth(const Level& level, const Eigen::VectorXd& b, Eigen::VectorXd& x, bool forward) const {
+    // one Gauss-Seidel sweep, a forward sweep followed by a backward one keeps the V-cycle symmetric
+    size_t numNodes = level.numNodes();
+    for (size_t k = 0; k < numNodes; ++ k) {
+        size_t nodeId = forward? k : numNodes - 1 - k;
+        if (level.vDiag[nodeId] == 0) continue;
+        double sum = b[nodeId];
+        int nbrId;
+        if ((nbrId = level.vNbr[XPlus][nodeId]) >= 0) sum += level.vCondX[nodeId] * x[nbrId];
+        if ((nbrId = level.vNbr[XMinus][nodeId]) >= 0) sum += level.vCondX[nbrId] * x[nbrId];
+        if ((nbrId = level.vNbr[YPlus][nodeId]) >= 0) sum += level.vCondY[nodeId] * x[nbrId];
+        if ((nbrId = level.vNbr[YMinus][nodeId]) >= 0) sum += level.vCondY[nbrId] * x[nbrId];
+        for (size_t i = level.vCplBegin[nodeId]; i < level.vCplBegin[nodeId + 1]; ++ i) {
+            sum += level.vCplCond[i] * x[level.vCplNode[i]];
+        }
+        x[nodeId] = sum / level.vDiag[nodeId];
+    }
+}
+
+void PEECMultigrid::vCycle(size_t levelId, const Eigen::VectorXd& b, Eigen::VectorXd& x) {
+    const Level& level = _vLevel[levelId];
+    x.setZero(level.numNodes());
+    if (levelId + 1 == _vLevel.size()) {
+        if (_coarseFactorized) {
+            x = _coarseSolver.solve(b);
+        } else {
+            for (size_t iter = 0; iter < 20; ++ iter) {
+                smooth(level, b, x, true);
+                smooth(level, b, x, false);
+            }
+        }
+        return;
+    }
+    for (size_t iter = 0; iter < _numPreSmooths; ++ iter) {
+        smooth(level, b, x, true);
+    }
+    Eigen::VectorXd r;
+    apply(level, x, r);
+    r = b - r;
+    const Level& coarse = _vLevel[levelId + 1];
+    Eigen::VectorXd rc = Eigen::VectorXd::Zero(coarse.numNodes());
+    for (size_t nodeId = 0; nodeId < level.numNodes(); ++ nodeId) {
+        rc[level.vParent[nodeId]] += r[nodeId];
+    }
+    Eigen::VectorXd xc;
+    vCycle(levelId + 1, rc, xc);
+    for (size_t nodeId = 0; nodeId < level.numNodes(); ++ nodeId) {
+        x[nodeId] += _correctionScale * xc[level.vParent[nodeId]];
+    }
+    for (size_t iter = 0; iter < _numPostSmooths; ++ iter) {
+        smooth(level, b, x, false);
+    }
+}
+
+bool PEECMultigrid::solve(const Eigen::VectorXd& I, Eigen::VectorXd& V, double tolerance, size_t maxIterations, PEECSolveStats& stats) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    stats.name = "MG-PCG";
+    const Level& finest = _vLevel[0];
+    double norm = I.norm();
+    if (norm == 0) norm = 1;
+    Eigen::VectorXd r, z, p, q;
+    apply(finest, V, r);
+    r = I - r;
+    vCycle(0, r, z);
+    p = z;
+    double rz = r.dot(z);
+    size_t iter = 0;
+    while (r.norm() > tolerance * norm && iter < maxIterations) {
+        apply(finest, p, q);
+        double alpha = rz / p.dot(q);
+        V += alpha * p;
+        r -= alpha * q;
+        vCycle(0, r, z);
+        double rzNew = r.dot(z);
+        p = z + (rzNew / rz) * p;
+        rz = rzNew;
+        ++ iter;
+    }
+    stats.iterations = iter;
+    stats.residual = r.norm() / norm;
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return stats.residual <= tolerance;
+}
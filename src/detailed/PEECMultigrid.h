@@ -0,0 +1,91 @@
+#ifndef PEEC_MULTIGRID_H
+#define PEEC_MULTIGRID_H
+
+#include "../base/Include.h"
+#include "PEECSolver.h"
+using namespace std;
+
+// A geometric multigrid preconditioned CG for the PEEC system of one net.
+// The system is given by the grids of the net on the regular lattice, the lateral conductance of each layer
+// (every two adjacent grids of the net on a layer are connected by it) and the remaining (via) couplings,
+// and is applied matrix-free: each level stores a 5-point stencil per node instead of a sparse matrix.
+// Level k+1 aggregates the 2x2 blocks of level k on each layer (Galerkin coarsening with piecewise constant
+// interpolation), down to a small level that is factorized directly.
+class PEECMultigrid {
+    public:
+        PEECMultigrid(size_t numLayers, size_t numXs, size_t numYs) : _numLayers(numLayers), _vLayerCond(numLayers, 0), _coarseFactorized(false) {
+            _vLevel.push_back(Level(numXs, numYs));
+            _numPreSmooths = 2;
+            _numPostSmooths = 2;
+            _correctionScale = 1.6;
+            _maxCoarseNodes = 1000;
+        }
+        ~PEECMultigrid() {}
+
+        // the conductance between two adjacent grids on layer layId
+        void setLayerConductance(size_t layId, double conductance) { _vLayerCond[layId] = conductance; }
+        // node id = the order of addNode() calls; diag = the total conductance at the node
+        size_t addNode(size_t layId, size_t xId, size_t yId, double diag);
+        // row nodeId of the system gets -conductance at column nbrNodeId (a coupling other than the lateral ones)
+        void addCoupling(size_t nodeId, size_t nbrNodeId, double conductance) {
+            _vCoupling.push_back(Coupling(nodeId, nbrNodeId, conductance));
+        }
+        // build the hierarchy, call after the last addNode() / addCoupling()
+        void build();
+        size_t numLevels() const { return _vLevel.size(); }
+
+        // V: the initial guess, then the solution; stop at |I - Y V| <= tolerance * |I|
+        bool solve(const Eigen::VectorXd& I, Eigen::VectorXd& V, double tolerance, size_t maxIterations, PEECSolveStats& stats);
+        // V = a cheap approximation of the solution: the system aggregated to level levelId (2x2 blocks of grids on level 1,
+        // 4x4 on level 2, ...) is solved directly and each grid takes the voltage of its block; false if that system is singular
+        bool estimate(size_t levelId, const Eigen::VectorXd& I, Eigen::VectorXd& V) const;
+
+    private:
+        enum { XPlus, XMinus, YPlus, YMinus };
+        struct Coupling {
+            Coupling(size_t nodeId, size_t nbrNodeId, double conductance) : nodeId(nodeId), nbrNodeId(nbrNodeId), conductance(conductance) {}
+            bool operator<(const Coupling& c) const { return (nodeId != c.nodeId)? nodeId < c.nodeId : nbrNodeId < c.nbrNodeId; }
+            size_t nodeId;
+            size_t nbrNodeId;
+            double conductance;
+        };
+        struct Level {
+            Level(size_t numXs, size_t numYs) : numXs(numXs), numYs(numYs) {}
+            size_t numNodes() const { return vDiag.size(); }
+            size_t numXs;
+            size_t numYs;
+            vector<size_t> vKey;            // index = [nodeId], (layId * numXs + xId) * numYs + yId
+            vector<double> vDiag;           // index = [nodeId]
+            vector<int> vNbr[4];            // index = [direction] [nodeId], the adjacent node on the layer, -1 if none
+            vector<double> vCondX;          // index = [nodeId], the conductance to vNbr[XPlus][nodeId]
+            vector<double> vCondY;          // index = [nodeId], the conductance to vNbr[YPlus][nodeId]
+            vector<size_t> vCplBegin;       // index = [nodeId], the couplings of node i are [vCplBegin[i], vCplBegin[i+1])
+            vector<size_t> vCplNode;
+            vector<double> vCplCond;
+            vector<size_t> vParent;         // index = [nodeId], the node of the next level
+        };
+
+        void linkNeighbors(Level& level);
+        void setCouplings(Level& level, vector<Coupling>& vCoupling);
+        void coarsen(Level& fine, Level& coarse);
+        void assemble(const Level& level, double lateralScale, PEECSolver::SpMat& Y) const;
+        void factorizeCoarsest();
+        void apply(const Level& level, const Eigen::VectorXd& x, Eigen::VectorXd& y) const;
+        void smooth(const Level& level, const Eigen::VectorXd& b, Eigen::VectorXd& x, bool forward) const;
+        void vCycle(size_t levelId, const Eigen::VectorXd& b, Eigen::VectorXd& x);
+
+        size_t _numLayers;
+        vector<double> _vLayerCond;     // index = [layId]
+        vector<Coupling> _vCoupling;    // the couplings of the finest level
+        vector<Level> _vLevel;          // index = [levelId], 0 is the lattice of the grids
+        Eigen::SimplicialLDLT<PEECSolver::SpMat> _coarseSolver;
+        bool _coarseFactorized;
+
+        // parameters for tuning
+        size_t _numPreSmooths;      // the number of forward Gauss-Seidel sweeps before the coarse correction
+        size_t _numPostSmooths;     // the number of backward Gauss-Seidel sweeps after it
+        double _correctionScale;    // the coarse correction is scaled up to make up for the too stiff aggregated operator
+        size_t _maxCoarseNodes;     // the coarsest level is factorized once it has no more nodes than this
+};
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef PEEC_SOLVER_H
+#define PEEC_SOLVER_H
+
+#include "../base/Include.h"
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <Eigen/IterativeLinearSolvers>
+using namespace std;
+
+// the linear solver of the PEEC system Y V = I of a net
+enum PEECSolverType {
+    PEECAuto,       // PEECLDLT up to PEECSolver::maxDirectNodes() nodes, PEECCGMultigrid above
+    PEECLDLT,       // sparse direct LDL^T, the symbolic analysis is reused while the sparsity pattern is unchanged
+    PEECCGIChol,    // conjugate gradient preconditioned by incomplete Cholesky (in node order, which is already local)
+    PEECBiCGSTAB,   // BiCGSTAB preconditioned by the diagonal
+    PEECCGJacobi,   // conjugate gradient preconditioned by the diagonal (the original solver)
+    PEECCGMultigrid // conjugate gradient preconditioned by geometric multigrid, matrix-free (see PEECMultigrid)
+};
+
+// the precision of the PEEC solve
+enum PEECPrecision {
+    PEECDouble,         // the matrix and the solver in double
+    PEECMixed,          // the matrix and the solver in float, refined to the double precision solution (see PEECSolver::solveMixed)
+    PEECMixedChecked    // PEECMixed, and the target port voltages of every solve are compared against a PEECDouble solve
+};
+
+struct PEECSolveStats {
+    PEECSolveStats() : name(""), iterations(0), residual(0), seconds(0) {}
+    const char* name;
+    size_t iterations;      // 0 for the direct solver; summed over the refinement steps (1 per step for LDLT) in mixed precision
+    double residual;        // |Y V - I| / |I|
+    double seconds;
+};
+
+class PEECSolver {
+    public:
+        typedef Eigen::SparseMatrix<double> SpMat;
+        typedef Eigen::SparseMatrix<float> SpMatF;
+
+        PEECSolver() : _hasPattern(false) {}
+        ~PEECSolver() {}
+
+        static size_t maxDirectNodes() { return 200000; }
+        // of the mixed precision solve: the refinement stops at |Y V - I| <= refineTolerance() * |I|
+        static double refineTolerance() { return 1e-12; }
+        static size_t maxRefineSteps() { return 50; }
+        // of the inner float solver in each refinement step
+        static float innerTolerance() { return 1e-4f; }
+
+        // V: the initial guess (unused by the direct solver), then the solution
+        // PEECCGMultigrid needs the lattice of the grids and is run by DetailedMgr::simulateNet instead
+        // mixedPrecision: Y is copied to float for the solver, whose solution is refined in double (see solveMixed())
+        bool solve(PEECSolverType type, const SpMat& Y, const Eigen::VectorXd& I, Eigen::VectorXd& V, PEECSolveStats& stats, bool mixedPrecision = false) {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            if (type == PEECAuto) type = ((size_t)Y.rows() <= maxDirectNodes())? PEECLDLT : PEECCGIChol;
+            bool success = false;
+            stats.iterations = 0;
+            if (mixedPrecision) {
+                // fall back to double if the float solver breaks down
+                Eigen::VectorXd V0 = V;
+                success = solveMixed(type, Y, I, V, stats);
+                if (!success) {
+                    V = V0;
+                    stats.iterations = 0;
+                }
+            }
+            if (!success) success = solveDouble(type, Y, I, V, stats);
+            // a part of the net cut off from the source and the loads (e.g. left by SmartRemove) makes Y singular,
+            // LDL^T stops at its zero pivot while CG still converges on the consistent system, as the original solver did
+            if (!success && type != PEECCGJacobi) success = solveDouble(PEECCGJacobi, Y, I, V, stats);
+            double norm = I.norm();
+            stats.residual = (norm > 0)? (Y * V - I).norm() / norm : (Y * V).norm();
+            stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            return success;
+        }
+
+        // factorize Y by LDL^T for solveBlock(), reusing the symbolic analysis while the sparsity pattern is unchanged
+        bool factorize(const SpMat& Y) {
+            if (!samePattern(Y)) {
+                _ldlt.analyzePattern(Y);
+                savePattern(Y);
+            }
+            _ldlt.factorize(Y);
+            return (_ldlt.info() == Eigen::Success);
+        }
+        // X = Y^-1 B for the Y of the last successful factorize(), all the columns of B in one pass
+        void solveBlock(const Eigen::MatrixXd& B, Eigen::MatrixXd& X) const { X = _ldlt.solve(B); }
+
+    private:
+        bool solveDouble(PEECSolverType type, const SpMat& Y, const Eigen::VectorXd& I, Eigen::VectorXd& V, PEECSolveStats& stats) {
+            bool success = false;
+            if (type == PEECLDLT) {
+                stats.name = "LDLT";
+                success = factorize(Y);
+                if (success) V = _ldlt.solve(I);
+            } else if (type == PEECCGIChol) {
+                stats.name = "CG+IChol";
+                Eigen::ConjugateGradient<SpMat, Eigen::Lower|Eigen::Upper, Eigen::IncompleteCholesky<double, Eigen::Lower, Eigen::NaturalOrdering<int> > > solver;
+                solver.compute(Y);
+                V = solver.solveWithGuess(I, V);
+                success = (solver.info() == Eigen::Success);
+                stats.iterations = solver.iterations();
+            } else if (type == PEECBiCGSTAB) {
+                stats.name = "BiCGSTAB";
+                Eigen::BiCGSTAB<SpMat> solver;
+                solver.compute(Y);
+                V = solver.solveWithGuess(I, V);
+                success = (solver.info() == Eigen::Success);
+                stats.iterations = solver.iterations();
+            } else {
+                stats.name = "CG+Jacobi";
+                Eigen::ConjugateGradient<SpMat, Eigen::Upper> solver;
+                solver.compute(Y);
+                V = solver.solveWithGuess(I, V);
+                success = (solver.info() == Eigen::Success);
+                stats.iterations = solver.iterations();
+            }
+            return success;
+        }
+
+        // iterative refinement: each step solves Y d = I - Y V with the float copy of Y and adds d to V,
+        // the residual is computed in double so V converges to the double precision solution
+        bool solveMixed(PEECSolverType type, const SpMat& Y, const Eigen::VectorXd& I, Eigen::VectorXd& V, PEECSolveStats& stats) {
+            SpMatF Yf = Y.cast<float>();
+            if (type == PEECLDLT) {
+                stats.name = "LDLT(float)+refine";
+                Eigen::SimplicialLDLT<SpMatF> solver(Yf);
+                return (solver.info() == Eigen::Success) && refine(solver, Y, I, V, stats);
+            } else if (type == PEECCGIChol) {
+                stats.name = "CG+IChol(float)+refine";
+                Eigen::ConjugateGradient<SpMatF, Eigen::Lower|Eigen::Upper, Eigen::IncompleteCholesky<float, Eigen::Lower, Eigen::NaturalOrdering<int> > > solver;
+                solver.setTolerance(innerTolerance());
+                solver.compute(Yf);
+                return refine(solver, Y, I, V, stats);
+            } else if (type == PEECBiCGSTAB) {
+                stats.name = "BiCGSTAB(float)+refine";
+                Eigen::BiCGSTAB<SpMatF> solver;
+                solver.setTolerance(innerTolerance());
+                solver.compute(Yf);
+                return refine(solver, Y, I, V, stats);
+            } else {
+                stats.name = "CG+Jacobi(float)+refine";
+                Eigen::ConjugateGradient<SpMatF, Eigen::Upper> solver;
+                solver.setTolerance(innerTolerance());
+                solver.compute(Yf);
+                return refine(solver, Y, I, V, stats);
+            }
+        }
+
+        template <class Solver>
+        bool refine(Solver& solver, const SpMat& Y, const Eigen::VectorXd& I, Eigen::VectorXd& V, PEECSolveStats& stats) {
+            double norm = (I.norm() > 0)? I.norm() : 1;
+            for (size_t step = 0; step < maxRefineSteps(); ++ step) {
+                Eigen::VectorXd r = I - Y * V;
+                double rNorm = r.norm();
+                if (rNorm <= refineTolerance() * norm) return true;
+                // the residual is normalized so that it does not underflow in float
+                Eigen::VectorXf d = solver.solve((r / rNorm).cast<float>());
+                if ((solver.info() != Eigen::Success && solver.info() != Eigen::NoConvergence) || !d.allFinite()) return false;
+                V += rNorm * d.cast<double>();
+                stats.iterations += innerIterations(solver);
+            }
+            return (I - Y * V).norm() <= refineTolerance() * norm;
+        }
+        template <class Solver>
+        static size_t innerIterations(const Solver& solver) { return solver.iterations(); }
+        static size_t innerIterations(const Eigen::SimplicialLDLT<SpMatF>&) { return 1; }
+
+        bool samePattern(const SpMat& Y) const {
+            if (!_hasPattern || Y.rows() != _numRows || (size_t)Y.nonZeros() != _vInner.size()) return false;
+            return equal(_vOuter.begin(), _vOuter.end(), Y.outerIndexPtr()) && equal(_vInner.begin(), _vInner.end(), Y.innerIndexPtr());
+        }
+        void savePattern(const SpMat& Y) {
+            _hasPattern = true;
+            _numRows = Y.rows();
+            _vOuter.assign(Y.outerIndexPtr(), Y.outerIndexPtr() + Y.outerSize() + 1);
+            _vInner.assign(Y.innerIndexPtr(), Y.innerIndexPtr() + Y.nonZeros());
+        }
+
+        Eigen::SimplicialLDLT<SpMat> _ldlt;
+        bool _hasPattern;           // whether _ldlt holds the symbolic analysis of the pattern below
+        Eigen::Index _numRows;
+        vector<int> _vOuter;        // the sparsity pattern analyzed by _ldlt
+        vector<int> _vInner;
+};
+
+// The stamps of one grid in the PEEC matrix of a net
+struct PEECRow {
+    PEECRow() : diag(0), rhs(0), hasRhs(false) {}
+    double diag;                                // the total conductance at the node
+    double rhs;                                 // the injected current, only meaningful if hasRhs
+    bool hasRhs;
+    vector< pair<size_t, double> > vOffDiag;    // (grid id of the neighbor, -conductance)
+};
+
+// The state of a net kept between its simulations (see DetailedMgr::simulateNet)
+struct PEECContext {
+    unordered_map<size_t, PEECRow> mRow;        // index = [grid id], the rows of the grids simulated last time
+    PEECSolver solver;
+    PEECSolveStats stats;                       // of the last solve
+};
+
+#endif
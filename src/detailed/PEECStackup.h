@@ -0,0 +1,69 @@
+#ifndef PEEC_STACKUP_H
+#define PEEC_STACKUP_H
+
+#include "../base/Include.h"
+#include "../base/DB.h"
+using namespace std;
+
+// The conductances of the PEEC model, computed once from the stackup of the board and the vias of the ports.
+// Grids are _gridWidth squares of metal, so a grid-to-grid conductance only depends on the layer;
+// a via connects the centers of two adjacent metal layers through the medium layer between them.
+class PEECStackup {
+    public:
+        PEECStackup() {}
+        ~PEECStackup() {}
+
+        // call after the vias of the ports are placed (see DetailedMgr::addPortVia)
+        void build(DB& db) {
+            size_t numLayers = db.numLayers();
+            _vG2GCond.assign(numLayers, 0);
+            _vViaCond.assign(numLayers, 0);
+            for (size_t layId = 0; layId < numLayers; ++ layId) {
+                _vG2GCond[layId] = db.vMetalLayer(layId)->conductivity() * db.vMetalLayer(layId)->thickness() * 1E-3;
+            }
+            // all vias are VIA16D8A24 plated with the metal of layer 0
+            double viaArea = db.VIA16D8A24()->metalArea();
+            for (size_t layId = 0; layId + 1 < numLayers; ++ layId) {
+                double length = 0.5 * db.vMetalLayer(layId)->thickness() + db.vMediumLayer(layId+1)->thickness() + 0.5 * db.vMetalLayer(layId+1)->thickness();
+                _vViaCond[layId] = (db.vMetalLayer(0)->conductivity() * viaArea * 1E-6) / (1E-3 * length);
+            }
+            _vLoadCond.clear();
+            _vLoadScale.clear();
+            for (size_t netId = 0; netId < db.numNets(); ++ netId) {
+                vector<double> vLoadScale;
+                vector<double> vLoadCond;
+                for (size_t tPortId = 0; tPortId < db.vNet(netId)->numTPorts(); ++ tPortId) {
+                    Port* tPort = db.vNet(netId)->targetPort(tPortId);
+                    vLoadScale.push_back(tPort->voltage() * tPort->viaCluster()->numVias());
+                }
+                _vLoadScale.push_back(vLoadScale);
+                for (size_t tPortId = 0; tPortId < db.vNet(netId)->numTPorts(); ++ tPortId) {
+                    vLoadCond.push_back(loadCond(netId, tPortId, db.vNet(netId)->targetPort(tPortId)->current()));
+                }
+                _vLoadCond.push_back(vLoadCond);
+            }
+        }
+
+        // between two adjacent grids on layer layId
+        double g2gCond(size_t layId) const                      { return _vG2GCond[layId]; }
+        // of a via from layer layId to layId+1
+        double viaCondUp(size_t layId) const                    { return _vViaCond[layId]; }
+        // of a via from layer layId to layId-1
+        double viaCondDown(size_t layId) const                  { return _vViaCond[layId-1]; }
+        // of the via from layer 0 to the source port
+        double sourceCond() const                               { return viaCondUp(0); }
+        // from layer 0 through a via of target port tPortId of net netId and its share of the load to ground
+        double loadCond(size_t netId, size_t tPortId) const     { return _vLoadCond[netId][tPortId]; }
+        // the same if the port drew current instead of Port::current()
+        double loadCond(size_t netId, size_t tPortId, double current) const {
+            return 1.0 / (1.0 / viaCondUp(0) + _vLoadScale[netId][tPortId] / current);
+        }
+
+    private:
+        vector<double> _vG2GCond;               // index = [layId]
+        vector<double> _vViaCond;               // index = [layId], between layer layId and layId+1, 0 for the top layer
+        vector< vector<double> > _vLoadCond;    // index = [netId] [tPortId]
+        vector< vector<double> > _vLoadScale;   // index = [netId] [tPortId], the port voltage times its number of vias
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef CAP_ROW_H
+#define CAP_ROW_H
+
+#include "../base/Include.h"
+#include "RGraph.h"
+#include "LPModel.h"
+using namespace std;
+
+// A capacity constraint of FlowLP / VoltSLP, kept so that its coefficients can be refreshed
+// when the voltages (and currents) it was built from change
+struct CapRow {
+    CapRow(OASGEdge* e1, bool right1, double ratio1, OASGEdge* e2, bool right2, double ratio2, double width)
+        : e1(e1), right1(right1), ratio1(ratio1), e2(e2), right2(right2), ratio2(ratio2), width(width) {}
+    OASGEdge* e1;
+    bool right1;
+    double ratio1;
+    OASGEdge* e2;       // NULL for a constraint of a single edge
+    bool right2;
+    double ratio2;
+    double width;
+    LPConstr constr;    // rewritten in place by LPModel::setRow
+    // with one model per net, a row of two nets is split: constr (in the model of e1) fixes the width of e2 at its
+    // present value, constr2 (in the model of e2) fixes the width of e1
+    LPConstr constr2;
+    LPVar slack;        // the overlap of constr once relaxed, with cost lambda
+    LPVar slack2;       // the overlap of constr2
+};
+
+#endif
@@ -2,13 +2,18 @@
 
 // FlowLP::FlowLP(RGraph& rGraph, vector<double> vMediumLayerThickness, vector<double> vMetalLayerThickness, vector<double> vConductivity, double currentNorm)
 //     : _model(_env), _rGraph(rGraph), _vMediumLayerThickness(vMediumLayerThickness), _vMetalLayerThickness(vMetalLayerThickness), _vConductivity(vConductivity), _currentNorm(currentNorm) {
-FlowLP::FlowLP(DB& db, RGraph& rGraph)
-    : _model(_env), _db(db), _rGraph(rGraph) {
+FlowLP::FlowLP(DB& db, RGraph& rGraph, bool decomposed)
+    : _db(db), _rGraph(rGraph), _decomposed(decomposed) {
     // _env.set("LogToConsole", 0);
     // _env.set("OutputFlag", 0);
     // _env.start();
     // _model = new GRBModel(_env);
-    _model.set(GRB_DoubleParam_FeasibilityTol, 1e-9);
+    size_t numModels = _decomposed? _rGraph.numNets() : 1;
+    for (size_t modelId = 0; modelId < numModels; ++ modelId) {
+        _vModel.push_back(LPModel::create());
+        _vModel.back()->setFeasibilityTol(1e-9);
+    }
+    _numThreads = 1;
     _area = 0;
     _overlap = 0;
     _numCapConstrs = 0;
@@ -18,41 +23,42 @@ FlowLP::FlowLP(DB& db, RGraph& rGraph)
     _areaWeight = 0;
     _viaWeight = 0;
     _diffWeight = 0;
-    _vPlaneLeftFlow = new GRBVar** [_rGraph.numNets()];
-    _vPlaneRightFlow = new GRBVar** [_rGraph.numNets()];
-    _vPlaneDiffFlow = new GRBVar** [_rGraph.numNets()];
-    _vViaFlow = new GRBVar** [_rGraph.numNets()];
-    _vMaxViaCost = new GRBVar* [_rGraph.numNets()];
+    _numRelaxedSolves = 0;
+    _vPlaneLeftFlow = new LPVar** [_rGraph.numNets()];
+    _vPlaneRightFlow = new LPVar** [_rGraph.numNets()];
+    _vPlaneDiffFlow = new LPVar** [_rGraph.numNets()];
+    _vViaFlow = new LPVar** [_rGraph.numNets()];
+    _vMaxViaCost = new LPVar* [_rGraph.numNets()];
     for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
-        _vPlaneLeftFlow[netId] = new GRBVar* [_rGraph.numLayers()];
-        _vPlaneRightFlow[netId] = new GRBVar* [_rGraph.numLayers()];
-        _vPlaneDiffFlow[netId] = new GRBVar* [_rGraph.numLayers()];
-        _vViaFlow[netId] = new GRBVar* [_rGraph.numLayerPairs()];
-        _vMaxViaCost[netId] = new GRBVar [_rGraph.numViaOASGEdges(netId)];
+        _vPlaneLeftFlow[netId] = new LPVar* [_rGraph.numLayers()];
+        _vPlaneRightFlow[netId] = new LPVar* [_rGraph.numLayers()];
+        _vPlaneDiffFlow[netId] = new LPVar* [_rGraph.numLayers()];
+        _vViaFlow[netId] = new LPVar* [_rGraph.numLayerPairs()];
+        _vMaxViaCost[netId] = new LPVar [_rGraph.numViaOASGEdges(netId)];
         for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
-            _vPlaneLeftFlow[netId][layId] = new GRBVar [_rGraph.numPlaneOASGEdges(netId, layId)];
-            _vPlaneRightFlow[netId][layId] = new GRBVar [_rGraph.numPlaneOASGEdges(netId, layId)];
-            _vPlaneDiffFlow[netId][layId] = new GRBVar [_rGraph.numPlaneOASGEdges(netId, layId)];
+            _vPlaneLeftFlow[netId][layId] = new LPVar [_rGraph.numPlaneOASGEdges(netId, layId)];
+            _vPlaneRightFlow[netId][layId] = new LPVar [_rGraph.numPlaneOASGEdges(netId, layId)];
+            _vPlaneDiffFlow[netId][layId] = new LPVar [_rGraph.numPlaneOASGEdges(netId, layId)];
             for (size_t pEdgeId = 0; pEdgeId < _rGraph.numPlaneOASGEdges(netId, layId); ++ pEdgeId) {
-                _vPlaneLeftFlow[netId][layId][pEdgeId] = _model.addVar(-GRB_INFINITY, GRB_INFINITY, 0.0, GRB_CONTINUOUS, 
+                _vPlaneLeftFlow[netId][layId][pEdgeId] = model(netId)->addVar(-LPInfinity, LPInfinity, 0.0, LPContinuous, 
                                                         "Fl_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId));
-                _vPlaneRightFlow[netId][layId][pEdgeId] = _model.addVar(-GRB_INFINITY, GRB_INFINITY, 0.0, GRB_CONTINUOUS, 
+                _vPlaneRightFlow[netId][layId][pEdgeId] = model(netId)->addVar(-LPInfinity, LPInfinity, 0.0, LPContinuous, 
                                                         "Fr_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId));
-                _vPlaneDiffFlow[netId][layId][pEdgeId] = _model.addVar(0.0, GRB_INFINITY, 0.0, GRB_CONTINUOUS, 
+                _vPlaneDiffFlow[netId][layId][pEdgeId] = model(netId)->addVar(0.0, LPInfinity, 0.0, LPContinuous, 
                                                         "Fd_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId));                                        
             }
         }
         for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
-            _vViaFlow[netId][layPairId] = new GRBVar [_rGraph.numViaOASGEdges(netId)];
+            _vViaFlow[netId][layPairId] = new LPVar [_rGraph.numViaOASGEdges(netId)];
             for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
                 if (!_rGraph.vViaOASGEdge(netId, layPairId, vEdgeId)->redundant()) {
-                    _vViaFlow[netId][layPairId][vEdgeId] = _model.addVar(0.0, GRB_INFINITY, 0.0, GRB_CONTINUOUS, 
+                    _vViaFlow[netId][layPairId][vEdgeId] = model(netId)->addVar(0.0, LPInfinity, 0.0, LPContinuous, 
                                                             "Fv_n" + to_string(netId) + "_l_" + to_string(layPairId) + "_i_" + to_string(vEdgeId));
                 }
             }     
         }
         for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
-            _vMaxViaCost[netId][vEdgeId] = _model.addVar(0.0, GRB_INFINITY, 0.0, GRB_CONTINUOUS, 
+            _vMaxViaCost[netId][vEdgeId] = model(netId)->addVar(0.0, LPInfinity, 0.0, LPContinuous, 
                                                         "Cv_max_n" + to_string(netId) + "_i_" + to_string(vEdgeId));
         }
     }
@@ -60,90 +66,140 @@ FlowLP::FlowLP(DB& db, RGraph& rGraph)
     // _model.write("/home/leotseng/2023_ASUS_PDN/exp/output/FlowLP_debug.lp");
 }
 
+FlowLP::~FlowLP() {
+    for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+        for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
+            delete [] _vPlaneLeftFlow[netId][layId];
+            delete [] _vPlaneRightFlow[netId][layId];
+            delete [] _vPlaneDiffFlow[netId][layId];
+        }
+        for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
+            delete [] _vViaFlow[netId][layPairId];
+        }
+        delete [] _vPlaneLeftFlow[netId];
+        delete [] _vPlaneRightFlow[netId];
+        delete [] _vPlaneDiffFlow[netId];
+        delete [] _vViaFlow[netId];
+        delete [] _vMaxViaCost[netId];
+    }
+    delete [] _vPlaneLeftFlow;
+    delete [] _vPlaneRightFlow;
+    delete [] _vPlaneDiffFlow;
+    delete [] _vViaFlow;
+    delete [] _vMaxViaCost;
+    for (size_t modelId = 0; modelId < _vModel.size(); ++ modelId) {
+        delete _vModel[modelId];
+    }
+}
+
 void FlowLP::setObjective(double areaWeight, double viaWeight, double diffWeight){
     _areaWeight = areaWeight;
     _viaWeight = viaWeight;
     _diffWeight = diffWeight;
-    GRBLinExpr obj;
+    _vViaCostConstr.assign(_rGraph.numNets(), vector< vector<LPConstr> >(_rGraph.numLayerPairs()));
+    _vViaAreaConstr.assign(_rGraph.numNets(), vector< vector<LPConstr> >(_rGraph.numLayerPairs()));
     for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
         // add cost for horizontal flows
-        // cerr << "add cost for horizontal flows" << endl;
         for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
             for (size_t pEdgeId = 0; pEdgeId < _rGraph.numPlaneOASGEdges(netId, layId); ++ pEdgeId) {
-                // cerr << "planeEdge(net" << netId << " layer" << layId << " pEdge" << pEdgeId;
-                OASGEdge* e = _rGraph.vPlaneOASGEdge(netId, layId, pEdgeId);
-                // assert (e->sNode()->voltage() != e->tNode()->voltage());
-                if (e->sNode()->voltage() == e->tNode()->voltage()) {
-                    _model.addConstr(_vPlaneLeftFlow[netId][layId][pEdgeId] == 0);
-                    _model.addConstr(_vPlaneRightFlow[netId][layId][pEdgeId] == 0);
-                    _model.addConstr(_vPlaneDiffFlow[netId][layId][pEdgeId] == 0);
-                } else {
-                    if (e->sNode()->voltage() > e->tNode()->voltage()) {
-                        _model.addConstr(_vPlaneLeftFlow[netId][layId][pEdgeId] >= 0);
-                        _model.addConstr(_vPlaneRightFlow[netId][layId][pEdgeId] >= 0);
-                    } else {
-                        _model.addConstr(_vPlaneLeftFlow[netId][layId][pEdgeId] <= 0);
-                        _model.addConstr(_vPlaneRightFlow[netId][layId][pEdgeId] <= 0);
-                    }
-                    // cost > 0 if flow & edge have same direction; cost < 0 if opposite
-                    double cost = (areaWeight * pow(1E-3 * e->length(), 2)) / (_db.vMetalLayer(layId)->conductivity() * (e->sNode()->voltage()-e->tNode()->voltage()) * _db.vMetalLayer(layId)->thickness() * 1E-3);
-                    // cerr << " sVolt = " << e->sNode()->voltage() << ", tVolt = " << e->tNode()->voltage() << ", thickness = " << _db.vMetalLayer(layId)->thickness();
-                    // cerr << ", cost = " << cost << endl;
-                    obj += cost * (_vPlaneLeftFlow[netId][layId][pEdgeId] + _vPlaneRightFlow[netId][layId][pEdgeId]);
-                    // _beforeCost += cost * (e->currentLeft() + e->currentRight()) * 1E6;
-
-                    // set diff flow
-                    // 1116 Bug
-                    _model.addConstr(_vPlaneDiffFlow[netId][layId][pEdgeId] >= _vPlaneLeftFlow[netId][layId][pEdgeId] - _vPlaneRightFlow[netId][layId][pEdgeId]);
-                    _model.addConstr(_vPlaneDiffFlow[netId][layId][pEdgeId] >= _vPlaneRightFlow[netId][layId][pEdgeId] - _vPlaneLeftFlow[netId][layId][pEdgeId]);
-                    obj += diffWeight * cost * _vPlaneDiffFlow[netId][layId][pEdgeId];
-                    _beforeCost += diffWeight * cost * abs(e->currentLeft() - e->currentRight()) * 1E6;
-                }
+                // set diff flow
+                // 1116 Bug
+                model(netId)->addConstr(_vPlaneDiffFlow[netId][layId][pEdgeId] >= _vPlaneLeftFlow[netId][layId][pEdgeId] - _vPlaneRightFlow[netId][layId][pEdgeId]);
+                model(netId)->addConstr(_vPlaneDiffFlow[netId][layId][pEdgeId] >= _vPlaneRightFlow[netId][layId][pEdgeId] - _vPlaneLeftFlow[netId][layId][pEdgeId]);
+                setPlaneCoeffs(netId, layId, pEdgeId);
             }
         }
         // add cost for vertical flows
-        // cerr << "add cost for vertical flows" << endl;
         for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
-            // double viaCost = 0;
             for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
-                OASGEdge* e = _rGraph.vViaOASGEdge(netId, layPairId, vEdgeId);
-                if (!e->redundant()) {
-                    double costNum = 1E-3 * (0.5*_db.vMetalLayer(layPairId)->thickness()+ _db.vMediumLayer(layPairId+1)->thickness()+0.5* _db.vMetalLayer(layPairId+1)->thickness());
-                    double costDen = _db.vMetalLayer(0)->conductivity() * (e->sNode()->voltage() - e->tNode()->voltage()); // has not * via cross-sectional area
-                    // cerr << "costDen=" << setprecision(15) << costDen << ", ";
-                    // cerr << "sNode->voltage=" << setprecision(15) << e->sNode()->voltage() << ", ";
-                    // cerr << "tNode->voltage=" << setprecision(15) << e->tNode()->voltage() << endl;
-                    
-                    //Bug
-                    assert (e->sNode()->voltage() > e->tNode()->voltage());
-
-
-                    if (e->sNode()->voltage() == e->tNode()->voltage()) {
-                        _model.addConstr(_vViaFlow[netId][layPairId][vEdgeId] == 0);
-                    } else {
-                        double cost = costNum / costDen;
-                        // cerr << "cost = " << cost << endl;
-                        // _model.addConstr(_vViaFlow[netId][layPairId][vEdgeId] >= 0);
-                        _model.addConstr(cost * _vViaFlow[netId][layPairId][vEdgeId] <= _vMaxViaCost[netId][vEdgeId], 
-                                        "max_via_cost_n" + to_string(netId) + "_l_" + to_string(layPairId) + "_i_" + to_string(vEdgeId));
-                        _model.addConstr(cost * _vViaFlow[netId][layPairId][vEdgeId] * 1E6 >= _db.VIA16D8A24()->metalArea());
-                        // if (cost * e->current() > viaCost) {
-                        //     viaCost = cost * e->current();
-                        // }
-                    }
-                    
+                _vViaCostConstr[netId][layPairId].resize(_rGraph.numViaOASGEdges(netId));
+                _vViaAreaConstr[netId][layPairId].resize(_rGraph.numViaOASGEdges(netId));
+                if (!_rGraph.vViaOASGEdge(netId, layPairId, vEdgeId)->redundant()) {
+                    setViaRows(netId, layPairId, vEdgeId);
                 }
             }
-            obj += viaWeight * _vMaxViaCost[netId][vEdgeId];
-            // _beforeCost += viaWeight * viaCost * 1E6;
+            model(netId)->setObj(_vMaxViaCost[netId][vEdgeId], viaWeight);
         }
     }
-    // cerr << "_model.setObjective(obj, GRB_MINIMIZE)" << endl;
-    _model.setObjective(obj, GRB_MINIMIZE);
+    for (size_t modelId = 0; modelId < _vModel.size(); ++ modelId) {
+        _vModel[modelId]->setObjSense(LPMinimize);
+    }
     // _model.update();
     // _model.write("/home/leotseng/2023_ASUS_PDN/exp/output/FlowLP_debug.lp");
 }
 
+// the bounds and the costs of the flows on plane edge pEdgeId, which follow the voltage drop of the edge
+void FlowLP::setPlaneCoeffs(size_t netId, size_t layId, size_t pEdgeId) {
+    OASGEdge* e = _rGraph.vPlaneOASGEdge(netId, layId, pEdgeId);
+    LPVar leftFlow = _vPlaneLeftFlow[netId][layId][pEdgeId];
+    LPVar rightFlow = _vPlaneRightFlow[netId][layId][pEdgeId];
+    LPVar diffFlow = _vPlaneDiffFlow[netId][layId][pEdgeId];
+    if (e->sNode()->voltage() == e->tNode()->voltage()) {
+        model(netId)->setBounds(leftFlow, 0.0, 0.0);
+        model(netId)->setBounds(rightFlow, 0.0, 0.0);
+        model(netId)->setUB(diffFlow, 0.0);
+        model(netId)->setObj(leftFlow, 0.0);
+        model(netId)->setObj(rightFlow, 0.0);
+        model(netId)->setObj(diffFlow, 0.0);
+        return;
+    }
+    // flows go along the voltage drop
+    if (e->sNode()->voltage() > e->tNode()->voltage()) {
+        model(netId)->setBounds(leftFlow, 0.0, LPInfinity);
+        model(netId)->setBounds(rightFlow, 0.0, LPInfinity);
+    } else {
+        model(netId)->setBounds(leftFlow, -LPInfinity, 0.0);
+        model(netId)->setBounds(rightFlow, -LPInfinity, 0.0);
+    }
+    model(netId)->setUB(diffFlow, LPInfinity);
+    // cost > 0 if flow & edge have same direction; cost < 0 if opposite
+    double cost = (_areaWeight * pow(1E-3 * e->length(), 2)) / (_db.vMetalLayer(layId)->conductivity() * (e->sNode()->voltage()-e->tNode()->voltage()) * _db.vMetalLayer(layId)->thickness() * 1E-3);
+    model(netId)->setObj(leftFlow, cost);
+    model(netId)->setObj(rightFlow, cost);
+    model(netId)->setObj(diffFlow, _diffWeight * cost);
+    _beforeCost += _diffWeight * cost * abs(e->currentLeft() - e->currentRight()) * 1E6;
+}
+
+// cost * via flow <= max via cost and cost * via flow >= the via metal area, where the cost follows the voltage drop of the via edge
+void FlowLP::setViaRows(size_t netId, size_t layPairId, size_t vEdgeId) {
+    OASGEdge* e = _rGraph.vViaOASGEdge(netId, layPairId, vEdgeId);
+    //Bug
+    assert (e->sNode()->voltage() > e->tNode()->voltage());
+    double costNum = 1E-3 * (0.5*_db.vMetalLayer(layPairId)->thickness()+ _db.vMediumLayer(layPairId+1)->thickness()+0.5* _db.vMetalLayer(layPairId+1)->thickness());
+    double costDen = _db.vMetalLayer(0)->conductivity() * (e->sNode()->voltage() - e->tNode()->voltage()); // has not * via cross-sectional area
+    double cost = costNum / costDen;
+    LPVar viaFlow = _vViaFlow[netId][layPairId][vEdgeId];
+    model(netId)->setRow(_vViaCostConstr[netId][layPairId][vEdgeId], cost * viaFlow - _vMaxViaCost[netId][vEdgeId], LPLessEqual, 0.0,
+                   "max_via_cost_n" + to_string(netId) + "_l_" + to_string(layPairId) + "_i_" + to_string(vEdgeId));
+    model(netId)->setRow(_vViaAreaConstr[netId][layPairId][vEdgeId], cost * viaFlow * 1E6, LPGreaterEqual, _db.VIA16D8A24()->metalArea());
+}
+
+void FlowLP::updateVoltage() {
+    for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+        for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
+            for (size_t pEdgeId = 0; pEdgeId < _rGraph.numPlaneOASGEdges(netId, layId); ++ pEdgeId) {
+                setPlaneCoeffs(netId, layId, pEdgeId);
+            }
+        }
+        for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
+            for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
+                if (!_rGraph.vViaOASGEdge(netId, layPairId, vEdgeId)->redundant()) {
+                    setViaRows(netId, layPairId, vEdgeId);
+                }
+            }
+        }
+    }
+    for (size_t capId = 0; capId < _vCapRow.size(); ++ capId) {
+        setCapacityRow(_vCapRow[capId]);
+    }
+    for (size_t sglCapId = 0; sglCapId < _vSglCapRow.size(); ++ sglCapId) {
+        setCapacityRow(_vSglCapRow[sglCapId]);
+    }
+    for (size_t netCapId = 0; netCapId < _vNetCapRow.size(); ++ netCapId) {
+        setCapacityRow(_vNetCapRow[netCapId]);
+    }
+}
+
 void FlowLP::setConserveConstraints(bool useDemandCurrent){
     // the input and output flows for port nodes
     // cerr << "the input and output flows for port nodes" << endl;
@@ -165,7 +221,7 @@ void FlowLP::setConserveConstraints(bool useDemandCurrent){
     // flow conservation constraints for all nodes
     // cerr << "flow conservation constraints for all nodes" << endl;
     for (size_t nodeId = 0; nodeId < _rGraph.numOASGNodes(); ++ nodeId) {
-        GRBLinExpr outFlow;
+        LPExpr outFlow;
         OASGNode* node = _rGraph.vOASGNode(nodeId);
         if (!node->redundant()) {
             // node->print();
@@ -191,7 +247,7 @@ void FlowLP::setConserveConstraints(bool useDemandCurrent){
                     }
                 }
             }
-            _model.addConstr(outFlow == vInputFlow[nodeId], "flow_conserve_n" + to_string(nodeId));
+            model(node->netId())->addConstr(outFlow == vInputFlow[nodeId], "flow_conserve_n" + to_string(nodeId));
         }
     }
     // _model.update();
@@ -223,156 +279,119 @@ void FlowLP::setConserveConstraints(bool useDemandCurrent){
 
 void FlowLP::addViaAreaConstraints(size_t netId, size_t vEdgeId, double area) {
     // _model.addConstr(_vMaxViaCost[netId][vEdgeId] * _currentNorm * 1E6 / _vConductivity[0] <= area);
-    _model.addConstr(_vMaxViaCost[netId][vEdgeId] * 1E6 <= area);
+    model(netId)->addConstr(_vMaxViaCost[netId][vEdgeId] * 1E6 <= area);
 }
 
-void FlowLP::addCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, OASGEdge* e2, bool right2, double ratio2, double width){
-    // printf("E%-2d_%c * %.2f + E%-2d_%c * %.2f <= %.3f\n", e1->edgeId(), right1? 'r': 'l', ratio1, e2->edgeId(), right2? 'r': 'l', ratio2, width);
-    // width unit = milimeter
-    GRBLinExpr totalWidth;
-    double widthWeight1, widthWeight2;
-    assert(!e1->viaEdge());
-    assert(!e2->viaEdge());
-    // assert(e1->sNode()->voltage() != e1->tNode()->voltage());
-    if (e1->sNode()->voltage() == e1->tNode()->voltage()) {
-        widthWeight1 = 0;
-    } else {
-        widthWeight1 = (e1->length()) / ( _db.vMetalLayer(e1->layId())->conductivity() * (e1->sNode()->voltage()-e1->tNode()->voltage()) * _db.vMetalLayer(e1->layId())->thickness());
-    }
-    // assert(e2->sNode()->voltage() != e2->tNode()->voltage());
-    if (e2->sNode()->voltage() == e2->tNode()->voltage()) {
-        widthWeight2 = 0;
-    } else {
-        widthWeight2 = (e2->length()) / ( _db.vMetalLayer(e2->layId())->conductivity() * (e2->sNode()->voltage()-e2->tNode()->voltage()) * _db.vMetalLayer(e2->layId())->thickness());
+double FlowLP::widthWeight(OASGEdge* e) const {
+    assert(!e->viaEdge());
+    if (e->sNode()->voltage() == e->tNode()->voltage()) {
+        return 0;
     }
+    return (e->length()) / (_db.vMetalLayer(e->layId())->conductivity() * (e->sNode()->voltage()-e->tNode()->voltage()) * _db.vMetalLayer(e->layId())->thickness());
+}
 
-    if (right1) {
-        // totalWidth += _vPlaneRightFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * _currentNorm * widthWeight1 * ratio1;
-        totalWidth += _vPlaneRightFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * widthWeight1 * ratio1;
-    } else {
-        // totalWidth += _vPlaneLeftFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * _currentNorm * widthWeight1 * ratio1;
-        totalWidth += _vPlaneLeftFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * widthWeight1 * ratio1;
-    }
-    if (right2) {
-        // totalWidth += _vPlaneRightFlow[e2->netId()][e2->layId()][e2->typeEdgeId()] * _currentNorm * widthWeight2 * ratio2;
-        totalWidth += _vPlaneRightFlow[e2->netId()][e2->layId()][e2->typeEdgeId()] * widthWeight2 * ratio2;
-    } else {
-        // totalWidth += _vPlaneLeftFlow[e2->netId()][e2->layId()][e2->typeEdgeId()] * _currentNorm * widthWeight2 * ratio2;
-        totalWidth += _vPlaneLeftFlow[e2->netId()][e2->layId()][e2->typeEdgeId()] * widthWeight2 * ratio2;
-    }
-    _model.addConstr(totalWidth * 1E3 <= width, "capacity_" + to_string(_numCapConstrs));
-    // _model.update();
-    // _model.write("/home/leotseng/2023_ASUS_PDN/exp/output/FlowLP_debug.lp");
+double FlowLP::presentWidth(OASGEdge* e, bool right, double ratio) const {
+    return (right? e->currentRight() : e->currentLeft()) * widthWeight(e) * ratio;
+}
+
+// width unit = millimeter
+// the terms of an edge without voltage drop are kept with a zero weight, so the row can be refreshed by updateVoltage
+void FlowLP::setCapacityRow(CapRow& row, const string& name) {
+    size_t netId1 = row.e1->netId();
+    LPExpr width1 = planeFlow(row.e1, row.right1) * widthWeight(row.e1) * row.ratio1;
+    if (row.e2 == NULL) {
+        model(netId1)->setRow(row.constr, width1 * 1E3, LPLessEqual, row.width, name);
+        return;
+    }
+    size_t netId2 = row.e2->netId();
+    LPExpr width2 = planeFlow(row.e2, row.right2) * widthWeight(row.e2) * row.ratio2;
+    if (!_decomposed || netId1 == netId2) {
+        LPExpr totalWidth;
+        totalWidth += width1;
+        totalWidth += width2;
+        model(netId1)->setRow(row.constr, totalWidth * 1E3, LPLessEqual, row.width, name);
+        return;
+    }
+    // one copy per net, each with the width of the other net at its last currents
+    model(netId1)->setRow(row.constr, width1 * 1E3, LPLessEqual, row.width - presentWidth(row.e2, row.right2, row.ratio2) * 1E3, name);
+    model(netId2)->setRow(row.constr2, width2 * 1E3, LPLessEqual, row.width - presentWidth(row.e1, row.right1, row.ratio1) * 1E3,
+                          name.empty()? name : name + "_2");
+}
+
+void FlowLP::addCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, OASGEdge* e2, bool right2, double ratio2, double width){
+    // printf("E%-2d_%c * %.2f + E%-2d_%c * %.2f <= %.3f\n", e1->edgeId(), right1? 'r': 'l', ratio1, e2->edgeId(), right2? 'r': 'l', ratio2, width);
+    _vCapRow.push_back(CapRow(e1, right1, ratio1, e2, right2, ratio2, width));
+    setCapacityRow(_vCapRow.back(), "capacity_" + to_string(_numCapConstrs));
     _numCapConstrs ++;
 }
 
 void FlowLP::addCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, double width) {
     // printf("E%-2d_%c * %.2f <= %.3f\n", e1->edgeId(), right1? 'r': 'l', ratio1, width);
-    // width unit = millimeter
-    GRBLinExpr e1Width;
-    assert(!e1->viaEdge());
-    double widthWeight1;
-    if (e1->sNode()->voltage() == e1->tNode()->voltage()) {
-        widthWeight1 = 0;
-    } else {
-        widthWeight1 = (e1->length()) / (_db.vMetalLayer(e1->layId())->conductivity() * (e1->sNode()->voltage()-e1->tNode()->voltage()) * _db.vMetalLayer(e1->layId())->thickness());
-    }
- 
-    if (right1) {
-        // e1Width += _vPlaneRightFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * _currentNorm * widthWeight1 * ratio1;
-        e1Width += _vPlaneRightFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * widthWeight1 * ratio1;
-    } else {
-        // e1Width += _vPlaneLeftFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * _currentNorm * widthWeight1 * ratio1;
-        e1Width += _vPlaneLeftFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * widthWeight1 * ratio1;
-    }
-    _model.addConstr(e1Width * 1E3 <= width, "single_capacity_" + to_string(_numCapConstrs));
-    // _model.update();
-    // _model.write("/home/leotseng/2023_ASUS_PDN/exp/output/FlowLP_debug.lp");
-    // _numCapConstrs ++;
+    _vSglCapRow.push_back(CapRow(e1, right1, ratio1, NULL, false, 0, width));
+    setCapacityRow(_vSglCapRow.back(), "single_capacity_" + to_string(_numCapConstrs));
 }
 
 void FlowLP::addSameNetCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, OASGEdge* e2, bool right2, double ratio2, double width) {
-    GRBLinExpr totalWidth;
-    double widthWeight1, widthWeight2;
-    assert(!e1->viaEdge());
-    assert(!e2->viaEdge());
     assert(e1->netId() == e2->netId());
-    // assert(e1->sNode()->voltage() != e1->tNode()->voltage());
-    if (e1->sNode()->voltage() == e1->tNode()->voltage()) {
-        widthWeight1 = 0;
-    } else {
-        widthWeight1 = (e1->length()) / ( _db.vMetalLayer(e1->layId())->conductivity() * (e1->sNode()->voltage()-e1->tNode()->voltage()) * _db.vMetalLayer(e1->layId())->thickness());
-    }
-    // assert(e2->sNode()->voltage() != e2->tNode()->voltage());
-    if (e2->sNode()->voltage() == e2->tNode()->voltage()) {
-        widthWeight2 = 0;
-    } else {
-        widthWeight2 = (e2->length()) / ( _db.vMetalLayer(e2->layId())->conductivity() * (e2->sNode()->voltage()-e2->tNode()->voltage()) * _db.vMetalLayer(e2->layId())->thickness());
-    }
-
-    if (right1) {
-        // totalWidth += _vPlaneRightFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * _currentNorm * widthWeight1 * ratio1;
-        totalWidth += _vPlaneRightFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * widthWeight1 * ratio1;
-    } else {
-        // totalWidth += _vPlaneLeftFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * _currentNorm * widthWeight1 * ratio1;
-        totalWidth += _vPlaneLeftFlow[e1->netId()][e1->layId()][e1->typeEdgeId()] * widthWeight1 * ratio1;
-    }
-    if (right2) {
-        // totalWidth += _vPlaneRightFlow[e2->netId()][e2->layId()][e2->typeEdgeId()] * _currentNorm * widthWeight2 * ratio2;
-        totalWidth += _vPlaneRightFlow[e2->netId()][e2->layId()][e2->typeEdgeId()] * widthWeight2 * ratio2;
-    } else {
-        // totalWidth += _vPlaneLeftFlow[e2->netId()][e2->layId()][e2->typeEdgeId()] * _currentNorm * widthWeight2 * ratio2;
-        totalWidth += _vPlaneLeftFlow[e2->netId()][e2->layId()][e2->typeEdgeId()] * widthWeight2 * ratio2;
-    }
-    _model.addConstr(totalWidth * 1E3 <= width, "same_net_capacity_" + to_string(_numNetCapConstrs));
-    // _model.update();
-    // _model.write("/home/leotseng/2023_ASUS_PDN/exp/output/FlowLP_debug.lp");
+    _vNetCapRow.push_back(CapRow(e1, right1, ratio1, e2, right2, ratio2, width));
+    setCapacityRow(_vNetCapRow.back(), "same_net_capacity_" + to_string(_numNetCapConstrs));
     _numNetCapConstrs ++;
 }
 
 void FlowLP::relaxCapacityConstraints(vector<double> vLambda) {
     assert(vLambda.size() == _numCapConstrs);
-    _model.update();
-    _modelRelaxed = new GRBModel(_model);
-    for (size_t capId = 0; capId < _numCapConstrs; ++ capId) {
-        const GRBConstr& c = _modelRelaxed->getConstrByName("capacity_" + to_string(capId));
-        // char sense = c->get ( GRB_CharAttr_Sense );
-        // if ( sense != '>') {
-        //     double coef = -1.0;
-        //     _model.addVar (0.0 , GRB_INFINITY , 1.0 , GRB_CONTINUOUS , 1 , & c, & coef , " ArtN_ " + c-> get ( GRB_StringAttr_ConstrName ));
-        // }
-        // if ( sense != '<') {
-        //     double coef = 1.0;
-        //     _model.addVar (0.0 , GRB_INFINITY , 1.0 , GRB_CONTINUOUS , 1 ,& c , & coef , " ArtP_ " + c-> get ( GRB_StringAttr_ConstrName ));
-        // }
-        double coef = -1.0;
-        _modelRelaxed->addVar(0.0 , GRB_INFINITY , vLambda[capId] , GRB_CONTINUOUS, 1, &c, &coef , "lambda_" + c.get ( GRB_StringAttr_ConstrName ));
-    }
-    // _modelRelaxed->update();
-    // _modelRelaxed->write("/home/leotseng/2023_ASUS_PDN/exp/output/FlowLP_debug.lp");
+    relaxRows(_vCapRow, vLambda, "lambda_capacity_");
 }
 
 void FlowLP::relaxCapacityConstraints(vector<double> vLambda, vector<double> vSameNetLambda) {
     assert(vLambda.size() == _numCapConstrs);
     assert(vSameNetLambda.size() == _numNetCapConstrs);
-    _model.update();
-    _modelRelaxed = new GRBModel(_model);
-    for (size_t capId = 0; capId < _numCapConstrs; ++ capId) {
-        const GRBConstr& c = _modelRelaxed->getConstrByName("capacity_" + to_string(capId));
-        double coef = -1.0;
-        _modelRelaxed->addVar(0.0 , GRB_INFINITY , vLambda[capId] , GRB_CONTINUOUS, 1, &c, &coef , "lambda_" + c.get ( GRB_StringAttr_ConstrName ));
+    relaxRows(_vCapRow, vLambda, "lambda_capacity_");
+    relaxRows(_vNetCapRow, vSameNetLambda, "same_net_lambda_same_net_capacity_");
+}
+
+// row i gets a slack (its overlap) with cost vLambda[i] on the first call; later calls only change the costs,
+// so the model is not copied and the next solve starts from the last basis
+void FlowLP::relaxRows(vector<CapRow>& vRow, const vector<double>& vLambda, const string& name) {
+    for (size_t rowId = 0; rowId < vRow.size(); ++ rowId) {
+        CapRow& row = vRow[rowId];
+        LPModel* model1 = model(row.e1->netId());
+        if (row.slack.valid()) {
+            model1->setObj(row.slack, vLambda[rowId]);
+        } else {
+            row.slack = model1->addVar(0.0, LPInfinity, vLambda[rowId], LPContinuous, row.constr, -1.0, name + to_string(rowId));
+        }
+        if (!row.constr2.valid()) continue;
+        LPModel* model2 = model(row.e2->netId());
+        if (row.slack2.valid()) {
+            model2->setObj(row.slack2, vLambda[rowId]);
+        } else {
+            row.slack2 = model2->addVar(0.0, LPInfinity, vLambda[rowId], LPContinuous, row.constr2, -1.0, name + to_string(rowId) + "_2");
+        }
     }
-    for (size_t netCapId = 0; netCapId < _numNetCapConstrs; ++ netCapId) {
-        const GRBConstr& c = _modelRelaxed->getConstrByName("same_net_capacity_" + to_string(netCapId));
-        double coef = -1.0;
-        _modelRelaxed->addVar(0.0 , GRB_INFINITY , vSameNetLambda[netCapId] , GRB_CONTINUOUS, 1, &c, &coef , "same_net_lambda_" + c.get ( GRB_StringAttr_ConstrName ));
+}
+
+// the overlap of a relaxed capacity row; a split row takes the larger overlap of its two copies
+double FlowLP::rowSlack(const CapRow& row) {
+    double slack = model(row.e1->netId())->value(row.slack);
+    if (row.slack2.valid()) {
+        slack = max(slack, model(row.e2->netId())->value(row.slack2));
     }
-    // _modelRelaxed->update();
-    // _modelRelaxed->write("/home/leotseng/2023_ASUS_PDN/exp/output/FlowLP_debug.lp");
+    return slack;
+}
+
+// the per-net models run on one solver thread each, so that the nets rather than the solver share the cores
+void FlowLP::optimizeModels() {
+    if (_decomposed && _numThreads > 1) {
+        for (size_t modelId = 0; modelId < _vModel.size(); ++ modelId) {
+            _vModel[modelId]->setThreads(1);
+        }
+    }
+    LPModel::optimizeAll(_vModel, _numThreads);
 }
 
 void FlowLP::solve() {
-    _model.optimize();
+    optimizeModels();
 }
 
 void FlowLP::collectResult(){
@@ -390,10 +409,10 @@ void FlowLP::collectResult(){
                     widthWeight = (e->length()) / (_db.vMetalLayer(e->layId())->conductivity() * (e->sNode()->voltage()-e->tNode()->voltage()) * _db.vMetalLayer(e->layId())->thickness());
                 }
                 // double leftFlow = _vPlaneLeftFlow[netId][layId][pEdgeId].get(GRB_DoubleAttr_X) * _currentNorm;
-                double leftFlow = _vPlaneLeftFlow[netId][layId][pEdgeId].get(GRB_DoubleAttr_X);
+                double leftFlow = model(netId)->value(_vPlaneLeftFlow[netId][layId][pEdgeId]);
                 // cerr << "leftFlow = " << leftFlow;
                 // double rightFlow = _vPlaneRightFlow[netId][layId][pEdgeId].get(GRB_DoubleAttr_X) * _currentNorm;
-                double rightFlow = _vPlaneRightFlow[netId][layId][pEdgeId].get(GRB_DoubleAttr_X);
+                double rightFlow = model(netId)->value(_vPlaneRightFlow[netId][layId][pEdgeId]);
                 // cerr << " rightFlow = " << rightFlow << endl;
                 _rGraph.vPlaneOASGEdge(netId, layId, pEdgeId)->setCurrentRight(rightFlow);
                 _rGraph.vPlaneOASGEdge(netId, layId, pEdgeId)->setCurrentLeft(leftFlow);
@@ -404,12 +423,12 @@ void FlowLP::collectResult(){
         // collect results for vertical flows
         for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
             // double viaArea = _vMaxViaCost[netId][vEdgeId].get(GRB_DoubleAttr_X) * _currentNorm / _vConductivity[0];
-            double viaArea = _vMaxViaCost[netId][vEdgeId].get(GRB_DoubleAttr_X);
+            double viaArea = model(netId)->value(_vMaxViaCost[netId][vEdgeId]);
             for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
                 // cerr << "vVEdge[" << netId << "][" << layPairId << "][" << vEdgeId << "]: ";
                 if (! _rGraph.vViaOASGEdge(netId, layPairId, vEdgeId) -> redundant()) {
                     // double flow = _vViaFlow[netId][layPairId][vEdgeId].get(GRB_DoubleAttr_X) * _currentNorm;
-                    double flow = _vViaFlow[netId][layPairId][vEdgeId].get(GRB_DoubleAttr_X);
+                    double flow = model(netId)->value(_vViaFlow[netId][layPairId][vEdgeId]);
                     // cerr << "flow = " << flow << endl;
                     _rGraph.vViaOASGEdge(netId, layPairId, vEdgeId)->setCurrentRight(flow);
                     _rGraph.vViaOASGEdge(netId, layPairId, vEdgeId)->setCurrentLeft(0.0);
@@ -449,7 +468,19 @@ void FlowLP::printResult() {
 }
 
 void FlowLP::solveRelaxed() {
-    _modelRelaxed->optimize();
+    if (_decomposed) {
+        for (size_t capId = 0; capId < _vCapRow.size(); ++ capId) {
+            setCapacityRow(_vCapRow[capId]);
+        }
+    }
+    // later solves only see new multipliers or voltage coefficients, so simplex can start from the last basis
+    if (_numRelaxedSolves > 0) {
+        for (size_t modelId = 0; modelId < _vModel.size(); ++ modelId) {
+            _vModel[modelId]->setMethod(LPPrimalSimplex);
+        }
+    }
+    optimizeModels();
+    ++ _numRelaxedSolves;
 }
 
 void FlowLP::collectRelaxedResult() {
@@ -472,11 +503,11 @@ void FlowLP::collectRelaxedResult() {
                 // double widthWeight = (e->length()) / (_db.vMetalLayer(e->layId())->conductivity() * abs(e->sNode()->voltage()-e->tNode()->voltage()) * _db.vMetalLayer(e->layId())->thickness());
                 // double leftFlow = _vPlaneLeftFlow[netId][layId][pEdgeId].get(GRB_DoubleAttr_X) * _currentNorm;
                 // double leftFlow = _modelRelaxed->getVarByName("Fl_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId)).get(GRB_DoubleAttr_X) * _currentNorm;
-                double leftFlow = _modelRelaxed->getVarByName("Fl_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId)).get(GRB_DoubleAttr_X);
+                double leftFlow = model(netId)->value(_vPlaneLeftFlow[netId][layId][pEdgeId]);
                 if (abs(leftFlow) < 1E-3) { leftFlow = 0; }
                 cerr << "leftFlow = " << leftFlow;
                 // double rightFlow = _modelRelaxed->getVarByName("Fr_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId)).get(GRB_DoubleAttr_X) * _currentNorm;
-                double rightFlow = _modelRelaxed->getVarByName("Fr_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId)).get(GRB_DoubleAttr_X);
+                double rightFlow = model(netId)->value(_vPlaneRightFlow[netId][layId][pEdgeId]);
                 if (abs(rightFlow) < 1E-3) { rightFlow = 0; }
                 cerr << " rightFlow = " << rightFlow << endl;
 
@@ -500,14 +531,14 @@ void FlowLP::collectRelaxedResult() {
             double viaCost = 0;
             // double viaArea = _vMaxViaCost[netId][vEdgeId].get(GRB_DoubleAttr_X) * _currentNorm / _vConductivity[0];
             // double viaArea = _modelRelaxed->getVarByName("Cv_max_n" + to_string(netId) + "_i_" + to_string(vEdgeId)).get(GRB_DoubleAttr_X) * _currentNorm / _vConductivity[0];
-            double viaArea = _modelRelaxed->getVarByName("Cv_max_n" + to_string(netId) + "_i_" + to_string(vEdgeId)).get(GRB_DoubleAttr_X);
+            double viaArea = model(netId)->value(_vMaxViaCost[netId][vEdgeId]);
             _viaArea += viaArea * 1E6;
             assert(viaArea * 1E6 > 0);
             for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
                 cerr << "vVEdge[" << netId << "][" << layPairId << "][" << vEdgeId << "]: ";
                 if (! _rGraph.vViaOASGEdge(netId, layPairId, vEdgeId) -> redundant()) {
                     // double flow = _modelRelaxed->getVarByName("Fv_n" + to_string(netId) + "_l_" + to_string(layPairId) + "_i_" + to_string(vEdgeId)).get(GRB_DoubleAttr_X) * _currentNorm;
-                    double flow = _modelRelaxed->getVarByName("Fv_n" + to_string(netId) + "_l_" + to_string(layPairId) + "_i_" + to_string(vEdgeId)).get(GRB_DoubleAttr_X);
+                    double flow = model(netId)->value(_vViaFlow[netId][layPairId][vEdgeId]);
                     if (abs(flow) < 1E-3) { flow = 0; }
                     cerr << "flow = " << flow << endl;
 
@@ -558,7 +589,7 @@ void FlowLP::collectRelaxedResult() {
 void FlowLP::printRelaxedResult() {
     double violation = 0;
     for (size_t capId = 0; capId < _numCapConstrs; ++capId) {
-        violation += _modelRelaxed->getVarByName("lambda_capacity_" + to_string(capId)).get(GRB_DoubleAttr_X);
+        violation += rowSlack(_vCapRow[capId]);
     }
     cerr << "violation = " << violation << endl;
     double planeArea = 0;
@@ -684,6 +715,8 @@ void FlowLP::calculateOverlapCost(vector<double> vLambda, vector<double> vNetLam
         _afterOverlapCost += vNetLambda[netCapId] * _vAfterSameOverlap[netCapId];
         _sameNetOverlap += _vAfterSameOverlap[netCapId];
     }
+    _vOverlap = _vAfterOverlap;
+    _vSameNetOverlap = _vAfterSameOverlap;
     if (_overlap < 1E-3) {
         _overlap = 0;
     }
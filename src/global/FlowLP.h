@@ -1,17 +1,22 @@
 #ifndef FLOW_LP_H
 #define FLOW_LP_H
 
-#include <gurobi_c++.h>
 #include "../base/Include.h"
 #include "RGraph.h"
 #include "../base/DB.h"
+#include "LPModel.h"
+#include "CapRow.h"
 using namespace std;
 
 class FlowLP {
     public:
         // FlowLP(RGraph& rGraph, vector<double> vMediumLayerThickness, vector<double> vMetalLayerThickness, vector<double> vConductivity, double currentNorm);
-        FlowLP(DB& db, RGraph& rGraph);
-        ~FlowLP() {}
+        // decomposed: one model per net instead of a single model, see solveRelaxed()
+        FlowLP(DB& db, RGraph& rGraph, bool decomposed = false);
+        ~FlowLP();
+
+        // the number of per-net models solved concurrently in decomposed mode
+        void setNumThreads(size_t numThreads) { _numThreads = max(numThreads, (size_t)1); }
 
         void setObjective(double areaWeight, double viaWeight, double diffWeight);
         void setConserveConstraints(bool useDemandCurrent);
@@ -24,11 +29,17 @@ class FlowLP {
         void addCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, double width);
         void addSameNetCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, OASGEdge* e2, bool right2, double ratio2, double width);
         // void relaxCapacityConstraints(GRBLinExpr& obj, OASGEdge* e1, bool right1, double ratio1, OASGEdge* e2, bool right2, double ratio2, double width);
+        // relax the capacity constraints in place: the first call adds their slacks, later calls only change the multipliers
         void relaxCapacityConstraints(vector<double> vLambda);
         void relaxCapacityConstraints(vector<double> vLambda, vector<double> vSameNetLambda);
+        // refresh the coefficients that depend on the node voltages after they changed (e.g. by VoltSLP),
+        // instead of building a new FlowLP
+        void updateVoltage();
         void solve();
         void collectResult();
         void printResult();
+        // with one model per net, the capacity rows between two nets are split (see CapRow) and refreshed
+        // at the last currents first, then the nets are solved concurrently (a block-Jacobi step)
         void solveRelaxed();
         void collectRelaxedResult();
         void printRelaxedResult();
@@ -44,6 +55,7 @@ class FlowLP {
         vector<double> vOverlap() { return _vOverlap; }
         double vOverlap(size_t ovId) const { return _vOverlap[ovId]; }
         double sameNetOverlap() const { return _sameNetOverlap; }
+        vector<double> vSameNetOverlap() { return _vSameNetOverlap; }
         double vSameNetOverlap(size_t ovId) const { return _vSameNetOverlap[ovId]; }
         double beforeCost() const { return _beforeCost; }
         double afterCost() const { return _afterCost; }
@@ -54,20 +66,41 @@ class FlowLP {
         //Bug
 
     private:
+        void setPlaneCoeffs(size_t netId, size_t layId, size_t pEdgeId);
+        void setViaRows(size_t netId, size_t layPairId, size_t vEdgeId);
+        void setCapacityRow(CapRow& row, const string& name = "");
+        void relaxRows(vector<CapRow>& vRow, const vector<double>& vLambda, const string& name);
+        double widthWeight(OASGEdge* e) const;
+        // the width of the capacity row term of e at its present current, width unit = meter
+        double presentWidth(OASGEdge* e, bool right, double ratio) const;
+        double rowSlack(const CapRow& row);
+        void optimizeModels();
+        LPModel* model(size_t netId) { return _decomposed? _vModel[netId] : _vModel[0]; }
+        LPVar& planeFlow(OASGEdge* e, bool right) {
+            return right? _vPlaneRightFlow[e->netId()][e->layId()][e->typeEdgeId()] : _vPlaneLeftFlow[e->netId()][e->layId()][e->typeEdgeId()];
+        }
+
         DB& _db;
 
         RGraph& _rGraph;
-        GRBEnv _env;
-        GRBModel _model;
-        GRBModel* _modelRelaxed;
-        // gurobi variables
-        GRBVar*** _vPlaneLeftFlow;   // flows on the left of horizontal OASGEdges, index = [netId] [layId] [pEdgeId]
-        GRBVar*** _vPlaneRightFlow;  // flows on the right of horizontal OASGEdges, index = [netId] [layId] [pEdgeId]
-        GRBVar*** _vPlaneDiffFlow;   // auxiliary variables representing abs(leftFlow - rightFlow), index = [netId] [layId] [pEdgeId]
-        GRBVar*** _vViaFlow;         // flows on vertical OASGEdges, index = [netId] [layPairId] [vEdgeId]
-        GRBVar**  _vMaxViaCost;      // the maximum flow on an OASGEdge, index = [netId] [vEdgeId]
+        bool _decomposed;
+        vector<LPModel*> _vModel;   // one model, or one model per net (index = [netId]) if _decomposed
+        size_t _numThreads;
+        size_t _numRelaxedSolves;
+        // LP variables
+        LPVar*** _vPlaneLeftFlow;   // flows on the left of horizontal OASGEdges, index = [netId] [layId] [pEdgeId]
+        LPVar*** _vPlaneRightFlow;  // flows on the right of horizontal OASGEdges, index = [netId] [layId] [pEdgeId]
+        LPVar*** _vPlaneDiffFlow;   // auxiliary variables representing abs(leftFlow - rightFlow), index = [netId] [layId] [pEdgeId]
+        LPVar*** _vViaFlow;         // flows on vertical OASGEdges, index = [netId] [layPairId] [vEdgeId]
+        LPVar**  _vMaxViaCost;      // the maximum flow on an OASGEdge, index = [netId] [vEdgeId]
         int _numCapConstrs;          // number of capacity constraints
         int _numNetCapConstrs;       // number of same net capacity constraints
+        // LP constraints that depend on the voltages
+        vector< vector< vector<LPConstr> > > _vViaCostConstr;  // cost * via flow <= max via cost, index = [netId] [layPairId] [vEdgeId]
+        vector< vector< vector<LPConstr> > > _vViaAreaConstr;  // cost * via flow >= the via metal area, index = [netId] [layPairId] [vEdgeId]
+        vector<CapRow> _vCapRow;        // index = [capId]
+        vector<CapRow> _vSglCapRow;
+        vector<CapRow> _vNetCapRow;     // index = [netCapId]
 
         // input constants
         // vector<double> _vMediumLayerThickness;
@@ -77,7 +110,7 @@ class FlowLP {
         double _area;       // the resulting area, assigned in collectRelaxedResult
         double _viaArea;
         double _overlap;    // the resulting overlapped width, assigned in collectRelaxedResult
-        vector<double> _vOverlap;   // the resulting overlapped width of each capConstr, assigned in collectRelaxedResult
+        vector<double> _vOverlap;   // the resulting overlapped width of each capConstr, assigned in calculateOverlapCost
         double _sameNetOverlap;
         vector<double> _vSameNetOverlap;
         double _beforeCost;     // the cost without relaxation before LP begins
@@ -2,10 +2,14 @@
 #include "LayerILP.h"
 #include "VoltEigen.h"
 #include "FlowLP.h"
+#ifdef USE_GUROBI
 #include "VoltCP.h"
+#endif
 #include "VoltSLP.h"
 #include "AddCapacity.h"
 #include <utility>
+#include <array>
+#include <functional>
 #include <vector>
 #include <cmath>
 #include <algorithm>
@@ -201,10 +205,41 @@ bool GlobalMgr::doIntersect(OASGNode* p1, OASGNode* q1, OASGNode* p2, OASGNode*
     return false; // Doesn't fall in any of the above cases 
 }
 
-bool GlobalMgr::isSegmentIntersectingWithObstacles(OASGNode* a, OASGNode* b, vector<vector<OASGNode*> > obstacle){
+void GlobalMgr::segmentCandidates(OASGNode* a, OASGNode* b, const vector<vector<OASGNode*> >& obstacle, const BoxIndex* obsIndex, vector<size_t>& vObsId){
+    // only the obstacles whose bounding box touches the segment can intersect it
+    if (obsIndex != NULL) {
+        assert(obsIndex->numBoxes() == obstacle.size());
+        obsIndex->querySegment(a->x(), a->y(), b->x(), b->y(), vObsId, 1e-6);
+        return;
+    }
+    vObsId.resize(obstacle.size());
+    for (size_t i = 0; i < obstacle.size(); ++i){
+        vObsId[i] = i;
+    }
+}
+
+void GlobalMgr::buildNodeIndex(const vector<vector<OASGNode*> >& obstacle, BoxIndex& obsIndex){
+    obsIndex.clear();
+    for (size_t i = 0; i < obstacle.size(); ++i){
+        double minX = obstacle[i][0]->x(), maxX = obstacle[i][0]->x();
+        double minY = obstacle[i][0]->y(), maxY = obstacle[i][0]->y();
+        for (size_t j = 1; j < obstacle[i].size(); ++j){
+            minX = min(minX, obstacle[i][j]->x());
+            maxX = max(maxX, obstacle[i][j]->x());
+            minY = min(minY, obstacle[i][j]->y());
+            maxY = max(maxY, obstacle[i][j]->y());
+        }
+        obsIndex.addBox(minX, maxX, minY, maxY);
+    }
+    obsIndex.build();
+}
+
+bool GlobalMgr::isSegmentIntersectingWithObstacles(OASGNode* a, OASGNode* b, const vector<vector<OASGNode*> >& obstacle, const BoxIndex* obsIndex){
     // return false;
-    int numObs = obstacle.size();
-    for(int i = 0; i< numObs;++i){
+    vector<size_t> vObsId;
+    segmentCandidates(a, b, obstacle, obsIndex, vObsId);
+    for(size_t k = 0; k < vObsId.size();++k){
+        int i = vObsId[k];
         int numVertices = obstacle[0].size();
         for (int j = 0; j< numVertices-1;++j){
             if(doIntersect(a, b, obstacle[i][j], obstacle[i][j+1])){
@@ -224,17 +259,19 @@ bool GlobalMgr::isSegmentIntersectingWithObstacles(OASGNode* a, OASGNode* b, vec
 //現在改掉Obstacle加上Round Edge的Bug
 //但是Via的Edges也會用這個function，所以之後假如有Edge撞到其他Obs就會破
 
-void GlobalMgr::connectWithObstacle(int netId, int layerId, OASGNode* a, OASGNode* b, vector<vector<OASGNode*> > obstacle){
+void GlobalMgr::connectWithObstacle(int netId, int layerId, OASGNode* a, OASGNode* b, const vector<vector<OASGNode*> >& obstacle, const BoxIndex* obsIndex){
     
     // 紀錄這兩個點跟哪兩個
     
-    int numObs = obstacle.size();
+    vector<size_t> vObsId;
+    segmentCandidates(a, b, obstacle, obsIndex, vObsId);
     
     bool obs1IsTested = false;
     bool alreadyDealWtihAObs = false;
     
     bool inTouchWithThisObs = false;
-    for(int i = 0; i< numObs;++i){
+    for(size_t k = 0; k < vObsId.size();++k){
+        int i = vObsId[k];
         if(alreadyDealWtihAObs == true){
             break;
         }
@@ -292,25 +329,25 @@ void GlobalMgr::connectWithObstacle(int netId, int layerId, OASGNode* a, OASGNod
             double dis2Ba = sqrt(pow(obs2B->x() - scanX, 2) + pow(obs2B->y() - scanY, 2));
             double minDis = std::min({dis1Aa , dis2Aa, dis1Ba, dis2Ba}); 
             if (minDis == dis1Aa || minDis == dis1Ba){
-                if (isSegmentIntersectingWithObstacles( a, obs1A, obstacle) && !edgeExist(netId, layerId, a, obs1A)){
+                if (isSegmentIntersectingWithObstacles( a, obs1A, obstacle, obsIndex) && !edgeExist(netId, layerId, a, obs1A)){
                     // connectWithObstacle(netId, layerId, a, obs1A, obstacle);
                 }
                 else if(!edgeExist(netId, layerId, a, obs1A)){
                     _rGraph.addOASGEdge(netId, layerId, a, obs1A, false);
                 }
-                if (isSegmentIntersectingWithObstacles( a, obs1B, obstacle) && !edgeExist(netId, layerId, a, obs1B) ){
+                if (isSegmentIntersectingWithObstacles( a, obs1B, obstacle, obsIndex) && !edgeExist(netId, layerId, a, obs1B) ){
                     // connectWithObstacle(netId, layerId, a, obs1B, obstacle);
                 }
                 else if(!edgeExist(netId, layerId, a, obs1B)){
                     _rGraph.addOASGEdge(netId, layerId, a, obs1B, false);
                 }
-                if (isSegmentIntersectingWithObstacles( b, obs2A, obstacle) && !edgeExist(netId, layerId, b, obs2A) ){
+                if (isSegmentIntersectingWithObstacles( b, obs2A, obstacle, obsIndex) && !edgeExist(netId, layerId, b, obs2A) ){
                     // connectWithObstacle(netId, layerId, b, obs2A, obstacle);
                 }
                 else if(!edgeExist(netId, layerId, b, obs2A)){
                     _rGraph.addOASGEdge(netId, layerId, b, obs2A, false);
                 }
-                if (isSegmentIntersectingWithObstacles( b, obs2B, obstacle)&& !edgeExist(netId, layerId, b, obs2B)){
+                if (isSegmentIntersectingWithObstacles( b, obs2B, obstacle, obsIndex)&& !edgeExist(netId, layerId, b, obs2B)){
                     // connectWithObstacle(netId, layerId, b, obs2B, obstacle);
                 }
                 else if(!edgeExist(netId, layerId, b, obs2B)){
@@ -318,25 +355,25 @@ void GlobalMgr::connectWithObstacle(int netId, int layerId, OASGNode* a, OASGNod
                 }
             }
             else{
-                if (isSegmentIntersectingWithObstacles( b, obs1A, obstacle) && !edgeExist(netId, layerId, b, obs1A)){
+                if (isSegmentIntersectingWithObstacles( b, obs1A, obstacle, obsIndex) && !edgeExist(netId, layerId, b, obs1A)){
                     // connectWithObstacle(netId, layerId, b, obs1A, obstacle);
                 }
                 else if(!edgeExist(netId, layerId, b, obs1A)){
                     _rGraph.addOASGEdge(netId, layerId, b, obs1A, false);
                 }
-                if (isSegmentIntersectingWithObstacles( b, obs1B, obstacle) && !edgeExist(netId, layerId, b, obs1B)){
+                if (isSegmentIntersectingWithObstacles( b, obs1B, obstacle, obsIndex) && !edgeExist(netId, layerId, b, obs1B)){
                     // connectWithObstacle(netId, layerId, b, obs1B, obstacle);
                 }
                 else if(!edgeExist(netId, layerId, b, obs1B)){
                     _rGraph.addOASGEdge(netId, layerId, b, obs1B, false);
                 }
-                if (isSegmentIntersectingWithObstacles( a, obs2A, obstacle) && !edgeExist(netId, layerId, a, obs2A)){
+                if (isSegmentIntersectingWithObstacles( a, obs2A, obstacle, obsIndex) && !edgeExist(netId, layerId, a, obs2A)){
                     // connectWithObstacle(netId, layerId, a, obs2A, obstacle);
                 }
                 else if(!edgeExist(netId, layerId, a, obs2A)){
                     _rGraph.addOASGEdge(netId, layerId, a, obs2A, false);
                 }
-                if (isSegmentIntersectingWithObstacles( a, obs2B, obstacle) && !edgeExist(netId, layerId, a, obs2B)){
+                if (isSegmentIntersectingWithObstacles( a, obs2B, obstacle, obsIndex) && !edgeExist(netId, layerId, a, obs2B)){
                     // connectWithObstacle(netId, layerId, a, obs2B, obstacle);
                 }
                 else if(!edgeExist(netId, layerId, a, obs2B)){
@@ -347,16 +384,16 @@ void GlobalMgr::connectWithObstacle(int netId, int layerId, OASGNode* a, OASGNod
     }
 }
 
-bool GlobalMgr::checkWithVias(int netId, int layerId, OASGNode* a, OASGNode* b, vector<vector<vector<OASGNode*>>> viaOASGNodes){
+bool GlobalMgr::checkWithVias(int netId, int layerId, OASGNode* a, OASGNode* b, const vector<vector<vector<OASGNode*>>>& viaOASGNodes, const vector<BoxIndex>& viaIndex){
 
 
     bool edgeTouchVia = false;
     for(int i = 0; i < viaOASGNodes.size();++i){
         if(netId == i) continue;
         int numVias = viaOASGNodes[i].size();
-        if(isSegmentIntersectingWithObstacles(a,b,viaOASGNodes[i])){
+        if(isSegmentIntersectingWithObstacles(a,b,viaOASGNodes[i],&viaIndex[i])){
 
-            connectWithObstacle(netId, layerId, a,b,viaOASGNodes[i]);
+            connectWithObstacle(netId, layerId, a,b,viaOASGNodes[i],&viaIndex[i]);
             edgeTouchVia = true;
         }
     }    
@@ -442,6 +479,11 @@ void GlobalMgr::buildOASG(bool case5, bool uniPath) {
         viaOASGNodes[netId] = tempViaOASGNodes;
     }
     }
+    // index = [netId], the bounding boxes of viaOASGNodes[netId]
+    vector<BoxIndex> viaIndex(viaOASGNodes.size());
+    for (size_t netId = 0; netId < viaOASGNodes.size(); ++ netId) {
+        buildNodeIndex(viaOASGNodes[netId], viaIndex[netId]);
+    }
 
     for (size_t layerId = 0; layerId < _rGraph.numLayers(); ++ layerId){
         //Step 0: 先把每層的Middle 的OASG Node建完(因為每條Net的OASG Node都不一樣，所以直接包在裡面)
@@ -460,6 +502,8 @@ void GlobalMgr::buildOASG(bool case5, bool uniPath) {
             }
 
             vector<vector<OASGNode*>> obsNodes;
+            // obsNodes[obsId] are the vertices of _db.vObstacle(layerId, obsId), so they share the layer's obstacle index
+            const BoxIndex* obsIndex = &_db.vMetalLayer(layerId)->obsIndex();
             //如果這個Obs已經有要加Round Edges，就變成True 
             addObsRoundEdges.resize(_db.numObstacles(layerId));
             for (int i = 0; i < _db.numObstacles(layerId); ++i){
@@ -519,13 +563,13 @@ void GlobalMgr::buildOASG(bool case5, bool uniPath) {
                         double curX = traverseNodes[i]-> x();
                         double curY = traverseNodes[i]-> y();
 
-                        if (isSegmentIntersectingWithObstacles(_rGraph.sourceOASGNode(netId,layerId), traverseNodes[i], obsNodes)){
+                        if (isSegmentIntersectingWithObstacles(_rGraph.sourceOASGNode(netId,layerId), traverseNodes[i], obsNodes, obsIndex)){
 
-                            connectWithObstacle(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i], obsNodes);
+                            connectWithObstacle(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i], obsNodes, obsIndex);
                             thisNetTouchObsThisLayer = true;
                         }
                         else {
-                            if(!checkWithVias(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i],viaOASGNodes)){
+                            if(!checkWithVias(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i],viaOASGNodes, viaIndex)){
                                 if(!edgeExist(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i])){
                                     _rGraph.addOASGEdge(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i], false);
                                 }   
@@ -536,13 +580,13 @@ void GlobalMgr::buildOASG(bool case5, bool uniPath) {
                             double curX = traverseNodes[i]-> x();
                             double curY = traverseNodes[i]-> y();
 
-                            if (isSegmentIntersectingWithObstacles(_rGraph.sourceOASGNode(netId,layerId), traverseNodes[i], obsNodes)){
+                            if (isSegmentIntersectingWithObstacles(_rGraph.sourceOASGNode(netId,layerId), traverseNodes[i], obsNodes, obsIndex)){
 
-                                connectWithObstacle(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i], obsNodes);
+                                connectWithObstacle(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i], obsNodes, obsIndex);
                                 thisNetTouchObsThisLayer = true;
                             }
                             else {
-                                if(!checkWithVias(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i],viaOASGNodes)){
+                                if(!checkWithVias(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i],viaOASGNodes, viaIndex)){
                                     if(!edgeExist(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i])){
                                         _rGraph.addOASGEdge(netId, layerId, _rGraph.sourceOASGNode(netId,layerId), traverseNodes[i], false);
                                     }   
@@ -566,13 +610,13 @@ void GlobalMgr::buildOASG(bool case5, bool uniPath) {
                         double curX = traverseNodes[i]-> x();
                         double curY = traverseNodes[i]-> y();
                         if(curX >= scanX && curY >= scanY){
-                            if (isSegmentIntersectingWithObstacles(traverseNodes[i], traverseNodes[i+1], obsNodes)){
+                            if (isSegmentIntersectingWithObstacles(traverseNodes[i], traverseNodes[i+1], obsNodes, obsIndex)){
 
-                                connectWithObstacle(netId, layerId, traverseNodes[i], traverseNodes[i+1], obsNodes);
+                                connectWithObstacle(netId, layerId, traverseNodes[i], traverseNodes[i+1], obsNodes, obsIndex);
                                 thisNetTouchObsThisLayer = true;
                             }
                             else {
-                                if(!checkWithVias(netId, layerId, traverseNodes[i], traverseNodes[i+1],viaOASGNodes)){
+                                if(!checkWithVias(netId, layerId, traverseNodes[i], traverseNodes[i+1],viaOASGNodes, viaIndex)){
                                     if(!edgeExist(netId, layerId, traverseNodes[i], traverseNodes[i+1])){
                                         _rGraph.addOASGEdge(netId, layerId, traverseNodes[i], traverseNodes[i+1], false);
                                     }
@@ -583,13 +627,13 @@ void GlobalMgr::buildOASG(bool case5, bool uniPath) {
                             curX = traverseNodes[numScanNode-1]-> x();
                             curY = traverseNodes[numScanNode-1]-> y();
                             if(curX >= scanX && curY >= scanY){
-                                if (isSegmentIntersectingWithObstacles(traverseNodes[1], traverseNodes[numScanNode-1], obsNodes)){
+                                if (isSegmentIntersectingWithObstacles(traverseNodes[1], traverseNodes[numScanNode-1], obsNodes, obsIndex)){
 
-                                    connectWithObstacle(netId, layerId, traverseNodes[1], traverseNodes[numScanNode-1], obsNodes);
+                                    connectWithObstacle(netId, layerId, traverseNodes[1], traverseNodes[numScanNode-1], obsNodes, obsIndex);
                                     thisNetTouchObsThisLayer = true;
                                 }
                                 else {
-                                    if(!checkWithVias(netId, layerId, traverseNodes[1], traverseNodes[numScanNode-1],viaOASGNodes)){
+                                    if(!checkWithVias(netId, layerId, traverseNodes[1], traverseNodes[numScanNode-1],viaOASGNodes, viaIndex)){
                                         if(!edgeExist(netId, layerId, traverseNodes[1], traverseNodes[numScanNode-1])){
                                             _rGraph.addOASGEdge(netId, layerId, traverseNodes[1], traverseNodes[numScanNode-1], false);
                                         }
@@ -605,12 +649,12 @@ void GlobalMgr::buildOASG(bool case5, bool uniPath) {
                         //後面是要判斷他們不是同一個點
 
                         if(curX >= scanX && curY <= scanY){
-                            if (isSegmentIntersectingWithObstacles(traverseNodes[i], traverseNodes[i+1], obsNodes)){
-                                connectWithObstacle(netId, layerId, traverseNodes[i], traverseNodes[i+1], obsNodes);
+                            if (isSegmentIntersectingWithObstacles(traverseNodes[i], traverseNodes[i+1], obsNodes, obsIndex)){
+                                connectWithObstacle(netId, layerId, traverseNodes[i], traverseNodes[i+1], obsNodes, obsIndex);
                                 thisNetTouchObsThisLayer = true;
                             }
                             else {
-                                if(!checkWithVias(netId, layerId,  traverseNodes[i], traverseNodes[i+1],viaOASGNodes)){
+                                if(!checkWithVias(netId, layerId,  traverseNodes[i], traverseNodes[i+1],viaOASGNodes, viaIndex)){
                                     if(!edgeExist(netId, layerId,  traverseNodes[i], traverseNodes[i+1])){
                                         _rGraph.addOASGEdge(netId, layerId,  traverseNodes[i], traverseNodes[i+1], false);
                                     }
@@ -621,13 +665,13 @@ void GlobalMgr::buildOASG(bool case5, bool uniPath) {
                             curX = traverseNodes[numScanNode-1]-> x();
                             curY = traverseNodes[numScanNode-1]-> y();
                             if(curX >= scanX && curY >= scanY){
-                                if (isSegmentIntersectingWithObstacles(traverseNodes[1], traverseNodes[numScanNode-1], obsNodes)){
+                                if (isSegmentIntersectingWithObstacles(traverseNodes[1], traverseNodes[numScanNode-1], obsNodes, obsIndex)){
 
-                                    connectWithObstacle(netId, layerId, traverseNodes[1], traverseNodes[numScanNode-1], obsNodes);
+                                    connectWithObstacle(netId, layerId, traverseNodes[1], traverseNodes[numScanNode-1], obsNodes, obsIndex);
                                     thisNetTouchObsThisLayer = true;
                                 }
                                 else {
-                                    if(!checkWithVias(netId, layerId,  traverseNodes[1], traverseNodes[numScanNode-1],viaOASGNodes)){
+                                    if(!checkWithVias(netId, layerId,  traverseNodes[1], traverseNodes[numScanNode-1],viaOASGNodes, viaIndex)){
                                         if(!edgeExist(netId, layerId, traverseNodes[1], traverseNodes[numScanNode-1])){
                                             _rGraph.addOASGEdge(netId, layerId, traverseNodes[1], traverseNodes[numScanNode-1], false);
                                         }
@@ -742,102 +786,95 @@ void GlobalMgr::genCrossConstrs(bool uniPath) {
 
     _rGraph.constructRGraph();
 
-    auto addConstraint = [&] (size_t netId, size_t twoPinNetId) {
-        for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
-            for (size_t RGEdgeId = 0; RGEdgeId < _rGraph.numRGEdges(twoPinNetId, layId); ++ RGEdgeId) {
-                RGEdge* e = _rGraph.vEdge(twoPinNetId, layId, RGEdgeId);
-
-                // the RGEdges from other nets
-                for (size_t netId1 = netId+1; netId1 < _rGraph.numNets(); ++ netId1) {
-                    Port* sPort1 = _rGraph.sPort(netId1);
-                    if (uniPath) {
-                        size_t netTPortId1 = 0;
-                        // the two pin net between the target port and the source port of net1
-                        Port* tPort1 = _rGraph.tPort(netId1, netTPortId1);
-                        size_t twoPinNetId1 = _rGraph.twoPinNetId(sPort1->portId(), tPort1->portId());
-                        for (size_t RGEdgeId1 = 0; RGEdgeId1 < _rGraph.numRGEdges(twoPinNetId1, layId); ++ RGEdgeId1) {
-                            RGEdge* e1 = _rGraph.vEdge(twoPinNetId1, layId, RGEdgeId1);
-                            if (e->cross(e1)) {
-                                _vCrossConstr.push_back(make_pair(e, e1));
-                                // _model.addConstr(_vFlow[twoPinNetId][layId][RGEdgeId] + _vFlow[twoPinNetId1][layId][RGEdgeId1] <= 1);
-                            }
-                        }
-
-                        // the two pin net between the target port and other target ports of net1
-                        for (size_t netTPortId11 = netTPortId1+1; netTPortId11 < _rGraph.numTPorts(netId1); ++ netTPortId11) {
-                            Port* tPort11 = _rGraph.tPort(netId1, netTPortId11);
-                            size_t twoPinNetId11 = _rGraph.twoPinNetId(tPort1->portId(), tPort11->portId());
-                            for (size_t RGEdgeId11 = 0; RGEdgeId11 < _rGraph.numRGEdges(twoPinNetId11, layId); ++ RGEdgeId11) {
-                                RGEdge* e11 = _rGraph.vEdge(twoPinNetId11, layId, RGEdgeId11);
-                                if (e->cross(e11)) {
-                                    _vCrossConstr.push_back(make_pair(e, e11));
-                                    // _model.addConstr(_vFlow[twoPinNetId][layId][RGEdgeId] + _vFlow[twoPinNetId11][layId][RGEdgeId11] <= 1);
-                                }
-                            }
-                        }
-                    } else {
-                        for (size_t netTPortId1 = 0; netTPortId1 < _rGraph.numTPorts(netId1); ++ netTPortId1) {
-                            // the two pin net between the target port and the source port of net1
-                            Port* tPort1 = _rGraph.tPort(netId1, netTPortId1);
-                            size_t twoPinNetId1 = _rGraph.twoPinNetId(sPort1->portId(), tPort1->portId());
-                            for (size_t RGEdgeId1 = 0; RGEdgeId1 < _rGraph.numRGEdges(twoPinNetId1, layId); ++ RGEdgeId1) {
-                                RGEdge* e1 = _rGraph.vEdge(twoPinNetId1, layId, RGEdgeId1);
-                                if (e->cross(e1)) {
-                                    _vCrossConstr.push_back(make_pair(e, e1));
-                                    // _model.addConstr(_vFlow[twoPinNetId][layId][RGEdgeId] + _vFlow[twoPinNetId1][layId][RGEdgeId1] <= 1);
-                                }
-                            }
-
-                            // the two pin net between the target port and other target ports of net1
-                            for (size_t netTPortId11 = netTPortId1+1; netTPortId11 < _rGraph.numTPorts(netId1); ++ netTPortId11) {
-                                Port* tPort11 = _rGraph.tPort(netId1, netTPortId11);
-                                size_t twoPinNetId11 = _rGraph.twoPinNetId(tPort1->portId(), tPort11->portId());
-                                for (size_t RGEdgeId11 = 0; RGEdgeId11 < _rGraph.numRGEdges(twoPinNetId11, layId); ++ RGEdgeId11) {
-                                    RGEdge* e11 = _rGraph.vEdge(twoPinNetId11, layId, RGEdgeId11);
-                                    if (e->cross(e11)) {
-                                        _vCrossConstr.push_back(make_pair(e, e11));
-                                        // _model.addConstr(_vFlow[twoPinNetId][layId][RGEdgeId] + _vFlow[twoPinNetId11][layId][RGEdgeId11] <= 1);
-                                    }
-                                }
-                            }
-
-                        }
-                    }
-                }
-
-            }
-        }
-    };
-
-    for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+    // vTwoPinNetId = the two pin nets of the net that take part in the constraints
+    auto twoPinNets = [&] (size_t netId, vector<size_t>& vTwoPinNetId) {
+        vTwoPinNetId.clear();
         Port* sPort = _rGraph.sPort(netId);
-        if (uniPath) {
-            size_t netTPortId = 0;
+        size_t numSTPorts = uniPath? min((size_t)1, _rGraph.numTPorts(netId)) : _rGraph.numTPorts(netId);
+        for (size_t netTPortId = 0; netTPortId < numSTPorts; ++ netTPortId) {
             // the two pin net between the target port and the source port of the net
             Port* tPort = _rGraph.tPort(netId, netTPortId);
-            size_t twoPinNetId = _rGraph.twoPinNetId(sPort->portId(), tPort->portId());
-            addConstraint(netId, twoPinNetId);
+            vTwoPinNetId.push_back(_rGraph.twoPinNetId(sPort->portId(), tPort->portId()));
 
             // the two pin net between the target port and other target ports of the net
             for (size_t netTPortId2 = netTPortId+1; netTPortId2 < _rGraph.numTPorts(netId); ++ netTPortId2) {
                 Port* tPort2 = _rGraph.tPort(netId, netTPortId2);
-                size_t twoPinNetId2 = _rGraph.twoPinNetId(tPort->portId(), tPort2->portId());
-                addConstraint(netId, twoPinNetId2);
+                vTwoPinNetId.push_back(_rGraph.twoPinNetId(tPort->portId(), tPort2->portId()));
             }
-        } else {
-            for (size_t netTPortId = 0; netTPortId < _rGraph.numTPorts(netId); ++ netTPortId) {
-                // the two pin net between the target port and the source port of the net
-                Port* tPort = _rGraph.tPort(netId, netTPortId);
-                size_t twoPinNetId = _rGraph.twoPinNetId(sPort->portId(), tPort->portId());
-                addConstraint(netId, twoPinNetId);
+        }
+    };
+    vector< vector<size_t> > vNetTwoPinNetId(_rGraph.numNets());    // index = [netId] [netTwoPinNetId]
+    for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+        twoPinNets(netId, vNetTwoPinNetId[netId]);
+    }
 
-                // the two pin net between the target port and other target ports of the net
-                for (size_t netTPortId2 = netTPortId+1; netTPortId2 < _rGraph.numTPorts(netId); ++ netTPortId2) {
-                    Port* tPort2 = _rGraph.tPort(netId, netTPortId2);
-                    size_t twoPinNetId2 = _rGraph.twoPinNetId(tPort->portId(), tPort2->portId());
-                    addConstraint(netId, twoPinNetId2);
+    // Index the OASGEdges of all the RGEdges on each layer by their bounding boxes, so that an RGEdge is only
+    // tested against the OASGEdges of later nets around it instead of every RGEdge of every later net.
+    // The RGEdges of a layer are ranked in the order (netId, two pin net, RGEdgeId) they are enumerated.
+    vector< vector<RGEdge*> > vLayRGEdge(_rGraph.numLayers());      // index = [layId] [rank]
+    vector< vector<size_t> > vLayRGNetId(_rGraph.numLayers());      // index = [layId] [rank]
+    vector< vector<OASGEdge*> > vLayOASGEdge(_rGraph.numLayers());  // index = [layId] [boxId]
+    vector< vector<size_t> > vLayBoxRank(_rGraph.numLayers());      // the rank of the RGEdge of the box, index = [layId] [boxId]
+    vector<BoxIndex> vLayIndex(_rGraph.numLayers());
+    for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
+        for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+            for (size_t netTwoPinNetId = 0; netTwoPinNetId < vNetTwoPinNetId[netId].size(); ++ netTwoPinNetId) {
+                size_t twoPinNetId = vNetTwoPinNetId[netId][netTwoPinNetId];
+                for (size_t RGEdgeId = 0; RGEdgeId < _rGraph.numRGEdges(twoPinNetId, layId); ++ RGEdgeId) {
+                    RGEdge* e = _rGraph.vEdge(twoPinNetId, layId, RGEdgeId);
+                    size_t rank = vLayRGEdge[layId].size();
+                    vLayRGEdge[layId].push_back(e);
+                    vLayRGNetId[layId].push_back(netId);
+                    for (size_t edgeId = 0; edgeId < e->numEdges(); ++ edgeId) {
+                        OASGEdge* oEdge = e->vEdge(edgeId);
+                        vLayIndex[layId].addBox(min(oEdge->sNode()->x(), oEdge->tNode()->x()), max(oEdge->sNode()->x(), oEdge->tNode()->x()),
+                                                min(oEdge->sNode()->y(), oEdge->tNode()->y()), max(oEdge->sNode()->y(), oEdge->tNode()->y()));
+                        vLayOASGEdge[layId].push_back(oEdge);
+                        vLayBoxRank[layId].push_back(rank);
+                    }
                 }
+            }
+        }
+        vLayIndex[layId].build();
+    }
 
+    // Only OASGEdges with touching bounding boxes can cross. The constraints are added in the order of the
+    // pairwise enumeration: (netId, two pin net, layId, RGEdgeId) of e, then the rank of the crossed RGEdge.
+    vector< vector<size_t> > vLayMark(_rGraph.numLayers());        // the rank of the last RGEdge that crossed it, index = [layId] [rank]
+    vector<size_t> vNextRank(_rGraph.numLayers(), 0);               // index = [layId]
+    for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
+        vLayMark[layId].assign(vLayRGEdge[layId].size(), numeric_limits<size_t>::max());
+    }
+    vector<size_t> vBoxId;
+    vector<size_t> vCrossRank;
+    for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+        for (size_t netTwoPinNetId = 0; netTwoPinNetId < vNetTwoPinNetId[netId].size(); ++ netTwoPinNetId) {
+            size_t twoPinNetId = vNetTwoPinNetId[netId][netTwoPinNetId];
+            for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
+                for (size_t RGEdgeId = 0; RGEdgeId < _rGraph.numRGEdges(twoPinNetId, layId); ++ RGEdgeId) {
+                    RGEdge* e = _rGraph.vEdge(twoPinNetId, layId, RGEdgeId);
+                    size_t rank = vNextRank[layId] ++;
+                    assert(vLayRGEdge[layId][rank] == e);
+                    vCrossRank.clear();
+                    for (size_t edgeId = 0; edgeId < e->numEdges(); ++ edgeId) {
+                        OASGEdge* oEdge = e->vEdge(edgeId);
+                        vLayIndex[layId].querySegment(oEdge->sNode()->x(), oEdge->sNode()->y(), oEdge->tNode()->x(), oEdge->tNode()->y(), vBoxId, 1e-6);
+                        for (size_t i = 0; i < vBoxId.size(); ++ i) {
+                            size_t rank1 = vLayBoxRank[layId][vBoxId[i]];
+                            // the RGEdges from other nets, each reported once
+                            if (vLayRGNetId[layId][rank1] <= netId || vLayMark[layId][rank1] == rank) continue;
+                            if (oEdge->cross(vLayOASGEdge[layId][vBoxId[i]])) {
+                                vLayMark[layId][rank1] = rank;
+                                vCrossRank.push_back(rank1);
+                            }
+                        }
+                    }
+                    sort(vCrossRank.begin(), vCrossRank.end());
+                    for (size_t crossId = 0; crossId < vCrossRank.size(); ++ crossId) {
+                        _vCrossConstr.push_back(make_pair(e, vLayRGEdge[layId][vCrossRank[crossId]]));
+                        // _model.addConstr(_vFlow[twoPinNetId][layId][RGEdgeId] + _vFlow[twoPinNetId1][layId][RGEdgeId1] <= 1);
+                    }
+                }
             }
         }
     }
@@ -910,9 +947,9 @@ void GlobalMgr::layerDistribution() {
         solver.formulate();
         solver.solve();
         solver.collectResult();
-    } catch (GRBException e) {
-        cerr << "Error = " << e.getErrorCode() << endl;
-        cerr << e.getMessage() << endl;
+    } catch (LPException& e) {
+        cerr << "Error = " << e.errorCode() << endl;
+        cerr << e.what() << endl;
     }
 }
 
@@ -1170,15 +1207,16 @@ void GlobalMgr::voltCurrOpt() {
         }
     }
 
-    FlowLP* currentSolver;
+    // both models are built once and then only refreshed (see FlowLP::updateVoltage and VoltSLP::updateLinearization),
+    // so every later iteration re-solves from the last basis
+    FlowLP* currentSolver = NULL;
     // VoltCP* voltageSolver;
-    VoltSLP* voltageSolver;
+    VoltSLP* voltageSolver = NULL;
     vector<double> vLambda(_vCapConstr.size(), 2.0);
     vector<double> vNetLambda(_vNetCapConstr.size(), 4.0);
-    vector<double> vLastOverlap(_vCapConstr.size(), 0.0);
-    vector<double> vDiffLastOverlap;
-    double PRatio = 10.0;
-    double DRatio = 1.0;
+    // updates the multipliers from the overlaps of each solve, and tells when the loops below can stop early
+    MultiplierScheduler scheduler((MultiplierSchedule)lambdaSchedule);
+    bool converged = false;
     
 
     // cerr << "Check vEdgeId..." << endl;
@@ -1200,34 +1238,39 @@ void GlobalMgr::voltCurrOpt() {
             vLambda[capId] =  4;
         }
 
-    //Change for into while, add early stop for all three loops
-    for (size_t ivIter = 0; ivIter < numIVIter; ++ ivIter) {
+    // with earlyStop, each loop ends once the scheduler sees no overlap and a settled area or a closed gap
+    for (size_t ivIter = 0; ivIter < numIVIter && !converged; ++ ivIter) {
         cerr << "ivIter = " << ivIter << endl;
         
         
         // current optimization
-        // currentSolver = new FlowLP(_rGraph, vMediumLayerThickness, vMetalLayerThickness, vConductivity, normRatio);
-        currentSolver = new FlowLP(_db, _rGraph);
-        currentSolver->setObjective(_db.areaWeight(), _db.viaWeight(), 0.1);
-        currentSolver->setConserveConstraints(true);
-        // currentSolver->addViaAreaConstraints
-        for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
-            for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
-                cerr << "_vUBViaArea[" << netId << "][" << vEdgeId << "] = " << _vUBViaArea[netId][vEdgeId] << endl;
-                currentSolver->addViaAreaConstraints(netId, vEdgeId, _vUBViaArea[netId][vEdgeId]);
+        if (currentSolver == NULL) {
+            // currentSolver = new FlowLP(_rGraph, vMediumLayerThickness, vMetalLayerThickness, vConductivity, normRatio);
+            currentSolver = new FlowLP(_db, _rGraph, decomposeLP);
+            currentSolver->setNumThreads(numThreads);
+            currentSolver->setObjective(_db.areaWeight(), _db.viaWeight(), 0.1);
+            currentSolver->setConserveConstraints(true);
+            // currentSolver->addViaAreaConstraints
+            for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+                for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
+                    cerr << "_vUBViaArea[" << netId << "][" << vEdgeId << "] = " << _vUBViaArea[netId][vEdgeId] << endl;
+                    currentSolver->addViaAreaConstraints(netId, vEdgeId, _vUBViaArea[netId][vEdgeId]);
+                }
             }
-        }
-        for (size_t capId = 0; capId < _vCapConstr.size(); ++ capId) {
-            CapConstr cap = _vCapConstr[capId];
-            currentSolver->addCapacityConstraints(cap.e1, cap.right1, cap.ratio1, cap.e2, cap.right2, cap.ratio2, cap.width);
-        }
-        for (size_t sglCapId = 0; sglCapId < _vSglCapConstr.size(); ++ sglCapId) {
-            SingleCapConstr sglCap = _vSglCapConstr[sglCapId];
-            currentSolver->addCapacityConstraints(sglCap.e1, sglCap.right1, sglCap.ratio1, sglCap.width);
-        }
-        for (size_t netCapId = 0; netCapId < _vNetCapConstr.size(); ++ netCapId) {
-            CapConstr cap = _vNetCapConstr[netCapId];
-            currentSolver->addSameNetCapacityConstraints(cap.e1, cap.right1, cap.ratio1, cap.e2, cap.right2, cap.ratio2, cap.width);
+            for (size_t capId = 0; capId < _vCapConstr.size(); ++ capId) {
+                CapConstr cap = _vCapConstr[capId];
+                currentSolver->addCapacityConstraints(cap.e1, cap.right1, cap.ratio1, cap.e2, cap.right2, cap.ratio2, cap.width);
+            }
+            for (size_t sglCapId = 0; sglCapId < _vSglCapConstr.size(); ++ sglCapId) {
+                SingleCapConstr sglCap = _vSglCapConstr[sglCapId];
+                currentSolver->addCapacityConstraints(sglCap.e1, sglCap.right1, sglCap.ratio1, sglCap.width);
+            }
+            for (size_t netCapId = 0; netCapId < _vNetCapConstr.size(); ++ netCapId) {
+                CapConstr cap = _vNetCapConstr[netCapId];
+                currentSolver->addSameNetCapacityConstraints(cap.e1, cap.right1, cap.ratio1, cap.e2, cap.right2, cap.ratio2, cap.width);
+            }
+        } else {
+            currentSolver->updateVoltage();
         }
         for (size_t iIter = 0; iIter < numIIter; ++iIter) {
             currentSolver->clearVOverlap();
@@ -1261,29 +1304,12 @@ void GlobalMgr::voltCurrOpt() {
             _vAfterOverlapCost.push_back(currentSolver->afterOverlapCost());
             cerr << "iIter = " << iIter << endl;
             currentSolver->printRelaxedResult();
-            // lagrange multiplier scheduling
-            for (size_t capId = 0; capId < _vCapConstr.size(); ++ capId) {
-                // schedule1: exp(exp(.))
-                // vLambda[capId] *= vLambda[capId];
-
-                // schedule2: exp(.)
-                vLambda[capId] *= 1.1;
-
-                // schedule3: P control
-                // vLambda[capId] += PRatio * currentSolver->vOverlap(capId);
-
-                // schedule4: PD control
-                // double curOverlap = currentSolver->vOverlap(capId);
-                // double diffOverlap = 0;
-                // if (iIter > 0) {
-                //     diffOverlap = vLastOverlap[capId] - curOverlap;
-                // }
-                // vLambda[capId] += PRatio * curOverlap + DRatio * diffOverlap;
-                // vLastOverlap[capId] = curOverlap;
-            }
-            for (size_t netCapId = 0; netCapId <_vNetCapConstr.size(); ++ netCapId) {
-                //調
-                vNetLambda[netCapId] *= 1;
+            // lagrange multiplier scheduling (exp, P, PD control or Polyak step, see MultiplierScheduler)
+            scheduler.record(ivIter, 'I', iIter, currentSolver->vOverlap(), currentSolver->vSameNetOverlap(),
+                             currentSolver->afterCost(), currentSolver->area(), vLambda, vNetLambda);
+            scheduler.updateMultipliers(currentSolver->vOverlap(), currentSolver->vSameNetOverlap(), vLambda, vNetLambda);
+            if (earlyStop && scheduler.converged()) {
+                break;
             }
         }
 
@@ -1298,27 +1324,32 @@ void GlobalMgr::voltCurrOpt() {
         //     vOldVoltage.push_back(temp);
         // }
         for (size_t vIter = 0; vIter < numVIter; ++ vIter) {
-            // voltageSolver = new VoltSLP(_db, _rGraph, vOldVoltage);
-            voltageSolver = new VoltSLP(_db, _rGraph);
-            voltageSolver->setObjective(_db.areaWeight(), _db.viaWeight());
-            // voltageSolver->setVoltConstraints(1E-15);
-            voltageSolver->setLimitConstraint(0.9);
-            for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
-                for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
-                    voltageSolver->addViaAreaConstraints(netId, vEdgeId, _vUBViaArea[netId][vEdgeId]);
+            if (voltageSolver == NULL) {
+                // voltageSolver = new VoltSLP(_db, _rGraph, vOldVoltage);
+                voltageSolver = new VoltSLP(_db, _rGraph, decomposeLP);
+                voltageSolver->setNumThreads(numThreads);
+                voltageSolver->setObjective(_db.areaWeight(), _db.viaWeight());
+                // voltageSolver->setVoltConstraints(1E-15);
+                voltageSolver->setLimitConstraint(0.9);
+                for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+                    for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
+                        voltageSolver->addViaAreaConstraints(netId, vEdgeId, _vUBViaArea[netId][vEdgeId]);
+                    }
                 }
-            }
-            for (size_t capId = 0; capId < _vCapConstr.size(); ++ capId) {
-                CapConstr cap = _vCapConstr[capId];
-                voltageSolver->addCapacityConstraints(cap.e1, cap.right1, cap.ratio1, cap.e2, cap.right2, cap.ratio2, cap.width);
-            }
-            for (size_t sglCapId = 0; sglCapId < _vSglCapConstr.size(); ++ sglCapId) {
-                SingleCapConstr sglCap = _vSglCapConstr[sglCapId];
-                voltageSolver->addCapacityConstraints(sglCap.e1, sglCap.right1, sglCap.ratio1, sglCap.width);
-            }
-            for (size_t netCapId = 0; netCapId < _vNetCapConstr.size(); ++ netCapId) {
-                CapConstr cap = _vNetCapConstr[netCapId];
-                voltageSolver->addSameNetCapacityConstraints(cap.e1, cap.right1, cap.ratio1, cap.e2, cap.right2, cap.ratio2, cap.width);
+                for (size_t capId = 0; capId < _vCapConstr.size(); ++ capId) {
+                    CapConstr cap = _vCapConstr[capId];
+                    voltageSolver->addCapacityConstraints(cap.e1, cap.right1, cap.ratio1, cap.e2, cap.right2, cap.ratio2, cap.width);
+                }
+                for (size_t sglCapId = 0; sglCapId < _vSglCapConstr.size(); ++ sglCapId) {
+                    SingleCapConstr sglCap = _vSglCapConstr[sglCapId];
+                    voltageSolver->addCapacityConstraints(sglCap.e1, sglCap.right1, sglCap.ratio1, sglCap.width);
+                }
+                for (size_t netCapId = 0; netCapId < _vNetCapConstr.size(); ++ netCapId) {
+                    CapConstr cap = _vNetCapConstr[netCapId];
+                    voltageSolver->addSameNetCapacityConstraints(cap.e1, cap.right1, cap.ratio1, cap.e2, cap.right2, cap.ratio2, cap.width);
+                }
+            } else {
+                voltageSolver->updateLinearization();
             }
             voltageSolver->relaxCapacityConstraints(vLambda, vNetLambda);
             voltageSolver->solveRelaxed();
@@ -1342,6 +1373,15 @@ void GlobalMgr::voltCurrOpt() {
             _vAfterOverlapCost.push_back(voltageSolver->afterOverlapCost());
             cerr << "vIter = " << vIter << endl;
             voltageSolver->printRelaxedResult();
+            scheduler.record(ivIter, 'V', vIter, voltageSolver->vOverlap(), voltageSolver->vSameNetOverlap(),
+                             voltageSolver->afterCost(), voltageSolver->area(), vLambda, vNetLambda);
+            // the fixed exp schedule only steps after the current solves
+            if (scheduler.schedule() != ScheduleExp) {
+                scheduler.updateMultipliers(voltageSolver->vOverlap(), voltageSolver->vSameNetOverlap(), vLambda, vNetLambda);
+            }
+            if (earlyStop && scheduler.converged()) {
+                break;
+            }
             // voltageSolver->collectRelaxedTempVoltage();
             // vOldVoltage = voltageSolver->vNewVoltage();
         }
@@ -1372,7 +1412,12 @@ void GlobalMgr::voltCurrOpt() {
         //     // }
         // }
 
+        converged = earlyStop && scheduler.converged();
     }
+    cerr << "voltCurrOpt: " << scheduler.numSolves() << " relaxed solves" << (converged? " (converged)" : "") << endl;
+    _vScheduleRecord = scheduler.vRecord();
+    delete currentSolver;
+    delete voltageSolver;
 
     // add traces to each net
     for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
@@ -1405,121 +1450,66 @@ void GlobalMgr::voltCurrOpt() {
         }
     }
 
-    // print the recorded area and overlapped width
+    // the multiplier trajectory, one line per relaxed solve
+    cerr << "multiplier trajectory:" << endl;
+    MultiplierScheduler::writeTrajectory(cerr, _vScheduleRecord);
+
+    // print the recorded area and overlapped width, one value per relaxed solve
+    // (the loops above stop early once the schedule converged, so follow the records instead of numIVIter / numIIter / numVIter)
+    size_t firstRecord = _vArea.size() - _vScheduleRecord.size();
+    auto printRecorded = [&] (const function<void(size_t)>& printValue) {
+        size_t i = 0;
+        while (i < _vScheduleRecord.size()) {
+            size_t ivIter = _vScheduleRecord[i].ivIter;
+            cerr << "ivIter = " << ivIter << endl;
+            cerr << "I opt: ";
+            for (; i < _vScheduleRecord.size() && _vScheduleRecord[i].ivIter == ivIter && _vScheduleRecord[i].stage == 'I'; ++ i) {
+                printValue(firstRecord + i);
+            }
+            cerr << endl;
+            cerr << "V opt: ";
+            for (; i < _vScheduleRecord.size() && _vScheduleRecord[i].ivIter == ivIter && _vScheduleRecord[i].stage == 'V'; ++ i) {
+                printValue(firstRecord + i);
+            }
+            cerr << endl;
+        }
+    };
     cerr << "////////////////" << endl;
     cerr << "//    area    //" << endl;
     cerr << "////////////////" << endl;
-    size_t i = 0;
-    for (size_t ivIter = 0; ivIter < numIVIter; ++ ivIter) {
-        cerr << "ivIter = " << ivIter << endl;
-        cerr << "I opt: ";
-        for (size_t iIter = 0; iIter < numIIter; ++iIter) {
-            cerr << _vArea[i] << " -> ";
-            i++;
-        }
-        cerr << endl;
-        cerr << "V opt: ";
-        for (size_t vIter = 0; vIter < numVIter; ++ vIter) {
-            cerr << _vArea[i] << " -> ";
-            i++;
-        }
-        cerr << endl;
-    }
+    printRecorded([&] (size_t i) {
+        cerr << _vArea[i] << " -> ";
+    });
     cerr << "///////////////////" << endl;
     cerr << "//    viaArea    //" << endl;
     cerr << "///////////////////" << endl;
-    i = 0;
-    for (size_t ivIter = 0; ivIter < numIVIter; ++ ivIter) {
-        cerr << "ivIter = " << ivIter << endl;
-        cerr << "I opt: ";
-        for (size_t iIter = 0; iIter < numIIter; ++iIter) {
-            cerr << _vViaArea[i] << " -> ";
-            i++;
-        }
-        cerr << endl;
-        cerr << "V opt: ";
-        for (size_t vIter = 0; vIter < numVIter; ++ vIter) {
-            cerr << _vViaArea[i] << " -> ";
-            i++;
-        }
-        cerr << endl;
-    }
+    printRecorded([&] (size_t i) {
+        cerr << _vViaArea[i] << " -> ";
+    });
     cerr << "////////////////////////////" << endl;
     cerr << "//    overlapped width    //" << endl;
     cerr << "////////////////////////////" << endl;
-    i = 0;
-    for (size_t ivIter = 0; ivIter < numIVIter; ++ ivIter) {
-        cerr << "ivIter = " << ivIter << endl;
-        cerr << "I opt: ";
-        for (size_t iIter = 0; iIter < numIIter; ++iIter) {
-            cerr << _vOverlap[i] << " -> ";
-            i++;
-        }
-        cerr << endl;
-        cerr << "V opt: ";
-        for (size_t vIter = 0; vIter < numVIter; ++ vIter) {
-            cerr << _vOverlap[i] << " -> ";
-            i++;
-        }
-        cerr << endl;
-    }
+    printRecorded([&] (size_t i) {
+        cerr << _vOverlap[i] << " -> ";
+    });
     cerr << "/////////////////////////////////////" << endl;
     cerr << "//    same net overlapped width    //" << endl;
     cerr << "/////////////////////////////////////" << endl;
-    i = 0;
-    for (size_t ivIter = 0; ivIter < numIVIter; ++ ivIter) {
-        cerr << "ivIter = " << ivIter << endl;
-        cerr << "I opt: ";
-        for (size_t iIter = 0; iIter < numIIter; ++iIter) {
-            cerr << _vSameNetOverlap[i] << " -> ";
-            i++;
-        }
-        cerr << endl;
-        cerr << "V opt: ";
-        for (size_t vIter = 0; vIter < numVIter; ++ vIter) {
-            cerr << _vSameNetOverlap[i] << " -> ";
-            i++;
-        }
-        cerr << endl;
-    }
+    printRecorded([&] (size_t i) {
+        cerr << _vSameNetOverlap[i] << " -> ";
+    });
     cerr << "//////////////////////" << endl;
     cerr << "//    Total Cost    //" << endl;
     cerr << "//////////////////////" << endl;
-    i = 0;
-    for (size_t ivIter = 0; ivIter < numIVIter; ++ ivIter) {
-        cerr << "ivIter = " << ivIter << endl;
-        cerr << "I opt: ";
-        for (size_t iIter = 0; iIter < numIIter; ++iIter) {
-            cerr << "(" << _vBeforeCost[i] << " -> " << _vAfterCost[i] << ") => ";
-            i++;
-        }
-        cerr << endl;
-        cerr << "V opt: ";
-        for (size_t vIter = 0; vIter < numVIter; ++ vIter) {
-            cerr << "(" << _vBeforeCost[i] << " -> " << _vAfterCost[i] << ") => ";
-            i++;
-        }
-        cerr << endl;
-    }
+    printRecorded([&] (size_t i) {
+        cerr << "(" << _vBeforeCost[i] << " -> " << _vAfterCost[i] << ") => ";
+    });
     cerr << "////////////////////////" << endl;
     cerr << "//    Overlap Cost    //" << endl;
     cerr << "////////////////////////" << endl;
-    i = 0;
-    for (size_t ivIter = 0; ivIter < numIVIter; ++ ivIter) {
-        cerr << "ivIter = " << ivIter << endl;
-        cerr << "I opt: ";
-        for (size_t iIter = 0; iIter < numIIter; ++iIter) {
-            cerr << "(" << _vBeforeOverlapCost[i] << " -> " << _vAfterOverlapCost[i] << ") => ";
-            i++;
-        }
-        cerr << endl;
-        cerr << "V opt: ";
-        for (size_t vIter = 0; vIter < numVIter; ++ vIter) {
-            cerr << "(" << _vBeforeOverlapCost[i] << " -> " << _vAfterOverlapCost[i] << ") => ";
-            i++;
-        }
-        cerr << endl;
-    }
+    printRecorded([&] (size_t i) {
+        cerr << "(" << _vBeforeOverlapCost[i] << " -> " << _vAfterOverlapCost[i] << ") => ";
+    });
     // assert(false);
 }
 
@@ -2981,7 +2971,14 @@ void GlobalMgr::genCapConstrs() {
                     ///////////////////////////////////////////////////////////////////////////////
 
                     // obstacle constraint
+                    const BoxIndex& obsIndex = _db.vMetalLayer(layId)->obsIndex();
+                    double e1MinX = min(e1->sNode()->x(), e1->tNode()->x()), e1MaxX = max(e1->sNode()->x(), e1->tNode()->x());
+                    double e1MinY = min(e1->sNode()->y(), e1->tNode()->y()), e1MaxY = max(e1->sNode()->y(), e1->tNode()->y());
                     for (size_t obsId = 0; obsId < _db.vMetalLayer(layId)->numObstacles(); ++ obsId) {
+                        // width/ratio >= width >= the gap between the bounding boxes (up to the edge shifts below),
+                        // so an obstacle farther than both current minima cannot tighten either of them
+                        double pad = 1e-6 * (obsIndex.maxX(obsId) - obsIndex.minX(obsId) + obsIndex.maxY(obsId) - obsIndex.minY(obsId)) + 1e-9;
+                        if (obsIndex.boxDist(obsId, e1MinX, e1MaxX, e1MinY, e1MaxY) - pad >= max(min_width_R/min_ratio_R, min_width_L/min_ratio_L)) continue;
                     
                         Obstacle* obs = _db.vMetalLayer(layId)->vObstacle(obsId);
                         pair<double, double> S2, T2;
@@ -4,7 +4,9 @@
 #include "../base/Include.h"
 #include "../base/SVGPlot.h"
 #include "../base/DB.h"
+#include "../base/BoxIndex.h"
 #include "RGraph.h"
+#include "MultiplierScheduler.h"
 
 struct CapConstr {
     OASGEdge* e1;
@@ -27,6 +29,10 @@ class GlobalMgr {
 
         GlobalMgr(DB& db, SVGPlot& plot): _db(db), _plot(plot) {
             cerr << "numNets = " << _db.numNets() << endl;
+            numThreads = 1;
+            decomposeLP = false;
+            lambdaSchedule = ScheduleExp;
+            earlyStop = false;
             _rGraph.initRGraph(db);
             
             for (size_t netId = 0; netId < _db.numNets(); ++ netId) {
@@ -42,12 +48,16 @@ class GlobalMgr {
         void buildOASG(bool case5, bool uniPath);
         void buildOASGXObs();
 
-        bool isSegmentIntersectingWithObstacles(OASGNode* a, OASGNode* b, vector<vector<OASGNode*> > obstacle);
+        // obsIndex (optional) indexes the bounding boxes of obstacle, to skip the obstacles far from the segment
+        bool isSegmentIntersectingWithObstacles(OASGNode* a, OASGNode* b, const vector<vector<OASGNode*> >& obstacle, const BoxIndex* obsIndex = NULL);
         bool onSegment(OASGNode* p, OASGNode* q, OASGNode* r);
         int orientation(OASGNode* p, OASGNode* q, OASGNode* r);
         bool doIntersect(OASGNode* p1, OASGNode* q1, OASGNode* p2, OASGNode* q2);
-        void connectWithObstacle(int netId, int layerId,OASGNode* a, OASGNode* b, vector<vector<OASGNode*> > obstacle);
-        bool checkWithVias(int netId, int layerId, OASGNode* a, OASGNode* b, vector<vector<vector<OASGNode*>>> viaOASGNodes);
+        void connectWithObstacle(int netId, int layerId,OASGNode* a, OASGNode* b, const vector<vector<OASGNode*> >& obstacle, const BoxIndex* obsIndex = NULL);
+        bool checkWithVias(int netId, int layerId, OASGNode* a, OASGNode* b, const vector<vector<vector<OASGNode*>>>& viaOASGNodes, const vector<BoxIndex>& viaIndex);
+        // vObsId = the obstacles (in increasing obsId) that may touch segment ab, all of them if obsIndex is NULL
+        void segmentCandidates(OASGNode* a, OASGNode* b, const vector<vector<OASGNode*> >& obstacle, const BoxIndex* obsIndex, vector<size_t>& vObsId);
+        void buildNodeIndex(const vector<vector<OASGNode*> >& obstacle, BoxIndex& obsIndex);
         //用來存每一層有哪一個Obstacle要繞Rounding Edges
         vector<bool> addObsRoundEdges;
         //用來存這一層中有哪些Net已經被建立過了。裡面會存兩個座標的(xMin, xMax, yMin, yMax)
@@ -84,6 +94,12 @@ class GlobalMgr {
         size_t numIVIter; //3
         size_t numIIter; //6
         size_t numVIter; //10
+        // solve FlowLP / VoltSLP as one LP per net, up to numThreads of them at a time
+        bool decomposeLP;
+        size_t numThreads;
+        // MultiplierSchedule of the capacity multipliers in voltCurrOpt, and whether its loops may stop early
+        int lambdaSchedule;
+        bool earlyStop;
 
         //羅：1109把它丟到public
         vector<double> _vArea;  // record the plane area of each iteration in voltCurrOpt
@@ -94,6 +110,7 @@ class GlobalMgr {
         vector<double> _vAfterCost;
         vector<double> _vBeforeOverlapCost;
         vector<double> _vAfterOverlapCost;
+        vector<ScheduleRecord> _vScheduleRecord;   // the multiplier schedule of each relaxed solve in voltCurrOpt
     private:
         double oldViaEdgeArea(OASGEdge* e);
         // double viaEdgeArea(OASGEdge* e);
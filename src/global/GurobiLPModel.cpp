@@ -0,0 +1,78 @@
+#include "GurobiLPModel.h"
+
+#ifdef USE_GUROBI
+
+using namespace std;
+
+GurobiLPModel::GurobiLPModel() : _env(NULL), _model(NULL), _hasPendingConstrs(false) {
+    try {
+        _env = new GRBEnv();
+        _model = new GRBModel(*_env);
+    } catch (GRBException e) {
+        delete _env;
+        throw LPException("Gurobi: " + e.getMessage(), e.getErrorCode());
+    }
+}
+
+LPVar GurobiLPModel::addVar(double lb, double ub, double obj, LPVarType type, const string& name) {
+    char vtype = (type == LPBinary)? GRB_BINARY : (type == LPInteger)? GRB_INTEGER : GRB_CONTINUOUS;
+    _vVar.push_back(_model->addVar(max(lb, -GRB_INFINITY), min(ub, GRB_INFINITY), obj, vtype, name));
+    ++ _numVars;
+    return LPVar(_vVar.size() - 1);
+}
+
+LPVar GurobiLPModel::addVar(double lb, double ub, double obj, LPVarType type, LPConstr constr, double coeff, const string& name) {
+    if (_hasPendingConstrs) {
+        _model->update();
+        _hasPendingConstrs = false;
+    }
+    char vtype = (type == LPBinary)? GRB_BINARY : (type == LPInteger)? GRB_INTEGER : GRB_CONTINUOUS;
+    _vVar.push_back(_model->addVar(max(lb, -GRB_INFINITY), min(ub, GRB_INFINITY), obj, vtype, 1, &_vConstr[constr.id()], &coeff, name));
+    ++ _numVars;
+    return LPVar(_vVar.size() - 1);
+}
+
+LPConstr GurobiLPModel::addConstr(const LPExpr& lhs, char sense, double rhs, const string& name) {
+    _vConstr.push_back(_model->addConstr(linExpr(lhs), sense, rhs, name));
+    _hasPendingConstrs = true;
+    ++ _numConstrs;
+    return LPConstr(_vConstr.size() - 1);
+}
+
+void GurobiLPModel::setMethod(LPMethod method) {
+    int grbMethod = GRB_METHOD_AUTO;
+    if (method == LPPrimalSimplex) grbMethod = GRB_METHOD_PRIMAL;
+    else if (method == LPDualSimplex) grbMethod = GRB_METHOD_DUAL;
+    else if (method == LPBarrier) grbMethod = GRB_METHOD_BARRIER;
+    _model->set(GRB_IntParam_Method, grbMethod);
+}
+
+LPStatus GurobiLPModel::solveModel() {
+    try {
+        _model->optimize();
+        _hasPendingConstrs = false;
+    } catch (GRBException e) {
+        throw LPException("Gurobi: " + e.getMessage(), e.getErrorCode());
+    }
+    int status = _model->get(GRB_IntAttr_Status);
+    if (status == GRB_OPTIMAL) return LPOptimal;
+    if (status == GRB_INFEASIBLE) return LPInfeasible;
+    if (status == GRB_UNBOUNDED || status == GRB_INF_OR_UNBD) return LPUnbounded;
+    return LPNotSolved;
+}
+
+GRBLinExpr GurobiLPModel::linExpr(const LPExpr& expr) const {
+    vector<GRBVar> vVar;
+    vector<double> vCoeff;
+    vVar.reserve(expr.size());
+    vCoeff.reserve(expr.size());
+    for (size_t termId = 0; termId < expr.size(); ++ termId) {
+        vVar.push_back(_vVar[expr.var(termId).id()]);
+        vCoeff.push_back(expr.coeff(termId));
+    }
+    GRBLinExpr grbExpr(expr.constant());
+    if (!vVar.empty()) grbExpr.addTerms(&vCoeff[0], &vVar[0], vVar.size());
+    return grbExpr;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef GUROBI_LP_MODEL_H
+#define GUROBI_LP_MODEL_H
+
+#ifdef USE_GUROBI
+
+#include <gurobi_c++.h>
+#include "../base/Include.h"
+#include "LPModel.h"
+using namespace std;
+
+// LPModel on a GRBModel with an environment of its own
+class GurobiLPModel : public LPModel {
+    public:
+        GurobiLPModel();
+        ~GurobiLPModel() { delete _model; delete _env; }
+        LPBackend backend() const { return LPGurobi; }
+
+        LPVar addVar(double lb, double ub, double obj, LPVarType type, const string& name = "");
+        LPVar addVar(double lb, double ub, double obj, LPVarType type, LPConstr constr, double coeff, const string& name = "");
+        LPConstr addConstr(const LPExpr& lhs, char sense, double rhs, const string& name = "");
+
+        void setObjective(const LPExpr& obj, LPObjSense sense) { _model->setObjective(linExpr(obj), (sense == LPMinimize)? GRB_MINIMIZE : GRB_MAXIMIZE); }
+        void setObjSense(LPObjSense sense) { _model->set(GRB_IntAttr_ModelSense, (sense == LPMinimize)? GRB_MINIMIZE : GRB_MAXIMIZE); }
+        void setObj(LPVar var, double obj) { _vVar[var.id()].set(GRB_DoubleAttr_Obj, obj); }
+        void setBounds(LPVar var, double lb, double ub) { setLB(var, lb); setUB(var, ub); }
+        void setLB(LPVar var, double lb) { _vVar[var.id()].set(GRB_DoubleAttr_LB, lb); }
+        void setUB(LPVar var, double ub) { _vVar[var.id()].set(GRB_DoubleAttr_UB, ub); }
+        void chgCoeff(LPConstr constr, LPVar var, double coeff) { _model->chgCoeff(_vConstr[constr.id()], _vVar[var.id()], coeff); }
+        void setRHS(LPConstr constr, char sense, double rhs) {
+            _vConstr[constr.id()].set(GRB_CharAttr_Sense, sense);
+            _vConstr[constr.id()].set(GRB_DoubleAttr_RHS, rhs);
+        }
+
+        void setFeasibilityTol(double tolerance) { _model->set(GRB_DoubleParam_FeasibilityTol, tolerance); }
+        void setTimeLimit(double seconds) { _model->set(GRB_DoubleParam_TimeLimit, seconds); }
+        void setThreads(size_t numThreads) { _model->set(GRB_IntParam_Threads, (int)numThreads); }
+        void setMethod(LPMethod method);
+        void setVerbose(bool verbose) { _model->set(GRB_IntParam_OutputFlag, verbose? 1 : 0); }
+
+        double value(LPVar var) { return _vVar[var.id()].get(GRB_DoubleAttr_X); }
+        double objValue() { return _model->get(GRB_DoubleAttr_ObjVal); }
+
+    protected:
+        LPStatus solveModel();
+
+    private:
+        GRBLinExpr linExpr(const LPExpr& expr) const;
+
+        GRBEnv* _env;
+        GRBModel* _model;
+        vector<GRBVar> _vVar;           // index = [LPVar id]
+        vector<GRBConstr> _vConstr;     // index = [LPConstr id]
+        bool _hasPendingConstrs;        // constraints added since the last update, which addVar by column needs
+};
+
+#endif
+
+#endif
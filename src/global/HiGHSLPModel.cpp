@@ -0,0 +1,133 @@
+#include "HiGHSLPModel.h"
+
+#ifdef USE_HIGHS
+
+using namespace std;
+
+HiGHSLPModel::HiGHSLPModel() {
+    _highs = Highs_create();
+    if (_highs == NULL) {
+        throw LPException("HiGHS: cannot create a model");
+    }
+    _inf = Highs_getInfinity(_highs);
+    Highs_changeObjectiveSense(_highs, kHighsObjSenseMinimize);
+}
+
+LPVar HiGHSLPModel::addVar(double lb, double ub, double obj, LPVarType type, const string& name) {
+    HighsInt colId = Highs_getNumCol(_highs);
+    if (type == LPBinary) {
+        lb = max(lb, 0.0);
+        ub = min(ub, 1.0);
+    }
+    _vLB.push_back(bound(lb));
+    _vUB.push_back(bound(ub));
+    Highs_addCol(_highs, obj, _vLB.back(), _vUB.back(), 0, NULL, NULL);
+    if (type != LPContinuous) Highs_changeColIntegrality(_highs, colId, kHighsVarTypeInteger);
+    if (!name.empty()) Highs_passColName(_highs, colId, name.c_str());
+    ++ _numVars;
+    return LPVar(colId);
+}
+
+LPVar HiGHSLPModel::addVar(double lb, double ub, double obj, LPVarType type, LPConstr constr, double coeff, const string& name) {
+    HighsInt colId = Highs_getNumCol(_highs);
+    HighsInt rowId = constr.id();
+    _vLB.push_back(bound(lb));
+    _vUB.push_back(bound(ub));
+    Highs_addCol(_highs, obj, _vLB.back(), _vUB.back(), 1, &rowId, &coeff);
+    if (type != LPContinuous) Highs_changeColIntegrality(_highs, colId, kHighsVarTypeInteger);
+    if (!name.empty()) Highs_passColName(_highs, colId, name.c_str());
+    ++ _numVars;
+    return LPVar(colId);
+}
+
+LPConstr HiGHSLPModel::addConstr(const LPExpr& lhs, char sense, double rhs, const string& name) {
+    // HiGHS rejects a row with a repeated column, and warns about each zero coefficient
+    // (kept by FlowLP and VoltSLP for setRow, which inserts the coefficient once it becomes nonzero)
+    vector<int> vVarId;
+    vector<double> vCoeff;
+    collectTerms(lhs, vVarId, vCoeff);
+    vector<HighsInt> vColId;
+    vector<double> vValue;
+    for (size_t termId = 0; termId < vVarId.size(); ++ termId) {
+        if (vCoeff[termId] != 0.0) {
+            vColId.push_back(vVarId[termId]);
+            vValue.push_back(vCoeff[termId]);
+        }
+    }
+    double lower, upper;
+    rowBounds(sense, rhs - lhs.constant(), lower, upper);
+    HighsInt rowId = Highs_getNumRow(_highs);
+    Highs_addRow(_highs, lower, upper, vColId.size(), vColId.empty()? NULL : &vColId[0], vValue.empty()? NULL : &vValue[0]);
+    if (!name.empty()) Highs_passRowName(_highs, rowId, name.c_str());
+    ++ _numConstrs;
+    return LPConstr(rowId);
+}
+
+void HiGHSLPModel::setObjective(const LPExpr& obj, LPObjSense sense) {
+    HighsInt numCols = Highs_getNumCol(_highs);
+    vector<double> vCost(numCols, 0.0);
+    for (size_t termId = 0; termId < obj.size(); ++ termId) {
+        vCost[obj.var(termId).id()] += obj.coeff(termId);
+    }
+    if (numCols > 0) Highs_changeColsCostByRange(_highs, 0, numCols - 1, &vCost[0]);
+    Highs_changeObjectiveOffset(_highs, obj.constant());
+    setObjSense(sense);
+}
+
+void HiGHSLPModel::setRHS(LPConstr constr, char sense, double rhs) {
+    double lower, upper;
+    rowBounds(sense, rhs, lower, upper);
+    Highs_changeRowBounds(_highs, constr.id(), lower, upper);
+}
+
+void HiGHSLPModel::rowBounds(char sense, double rhs, double& lower, double& upper) const {
+    lower = (sense == LPLessEqual)? -_inf : rhs;
+    upper = (sense == LPGreaterEqual)? _inf : rhs;
+}
+
+void HiGHSLPModel::setFeasibilityTol(double tolerance) {
+    Highs_setDoubleOptionValue(_highs, "primal_feasibility_tolerance", tolerance);
+    Highs_setDoubleOptionValue(_highs, "mip_feasibility_tolerance", tolerance);
+}
+
+void HiGHSLPModel::setMethod(LPMethod method) {
+    if (method == LPBarrier) {
+        Highs_setStringOptionValue(_highs, "solver", "ipm");
+    } else if (method == LPAutoMethod) {
+        Highs_setStringOptionValue(_highs, "solver", "choose");
+    } else {
+        // simplex_strategy: 1 = dual, 4 = primal
+        Highs_setStringOptionValue(_highs, "solver", "simplex");
+        Highs_setIntOptionValue(_highs, "simplex_strategy", (method == LPPrimalSimplex)? 4 : 1);
+    }
+}
+
+double HiGHSLPModel::value(LPVar var) {
+    // same as reading GRB_DoubleAttr_X of a model without a solution
+    if (!var.valid() || (size_t)var.id() >= _vColValue.size()) {
+        throw LPException("HiGHS: no solution value for variable " + to_string(var.id()));
+    }
+    return _vColValue[var.id()];
+}
+
+LPStatus HiGHSLPModel::solveModel() {
+    if (Highs_run(_highs) == kHighsStatusError) {
+        throw LPException("HiGHS: run failed");
+    }
+    _vColValue.clear();
+    HighsInt status = Highs_getModelStatus(_highs);
+    if (status == kHighsModelStatusOptimal || status == kHighsModelStatusModelEmpty) {
+        _vColValue.resize(Highs_getNumCol(_highs));
+        vector<double> vColDual(_vColValue.size());
+        vector<double> vRowValue(Highs_getNumRow(_highs));
+        vector<double> vRowDual(vRowValue.size());
+        Highs_getSolution(_highs, _vColValue.empty()? NULL : &_vColValue[0], vColDual.empty()? NULL : &vColDual[0],
+                          vRowValue.empty()? NULL : &vRowValue[0], vRowDual.empty()? NULL : &vRowDual[0]);
+        return LPOptimal;
+    }
+    if (status == kHighsModelStatusInfeasible) return LPInfeasible;
+    if (status == kHighsModelStatusUnbounded || status == kHighsModelStatusUnboundedOrInfeasible) return LPUnbounded;
+    return LPNotSolved;
+}
+
+#endif
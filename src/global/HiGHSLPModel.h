@@ -0,0 +1,62 @@
+#ifndef HIGHS_LP_MODEL_H
+#define HIGHS_LP_MODEL_H
+
+#ifdef USE_HIGHS
+
+#include <interfaces/highs_c_api.h>
+#include "../base/Include.h"
+#include "LPModel.h"
+using namespace std;
+
+// LPModel on HiGHS (https://highs.dev), column id = LPVar id, row id = LPConstr id.
+// It goes through the C API of HiGHS, whose ABI does not change between releases, so a prebuilt libhighs works.
+// HiGHS keeps the basis across the modifications of a model, so the next run warm starts from it.
+class HiGHSLPModel : public LPModel {
+    public:
+        HiGHSLPModel();
+        ~HiGHSLPModel() { Highs_destroy(_highs); }
+        LPBackend backend() const { return LPHiGHS; }
+
+        LPVar addVar(double lb, double ub, double obj, LPVarType type, const string& name = "");
+        LPVar addVar(double lb, double ub, double obj, LPVarType type, LPConstr constr, double coeff, const string& name = "");
+        LPConstr addConstr(const LPExpr& lhs, char sense, double rhs, const string& name = "");
+
+        void setObjective(const LPExpr& obj, LPObjSense sense);
+        void setObjSense(LPObjSense sense) { Highs_changeObjectiveSense(_highs, (sense == LPMinimize)? kHighsObjSenseMinimize : kHighsObjSenseMaximize); }
+        void setObj(LPVar var, double obj) { Highs_changeColCost(_highs, var.id(), obj); }
+        void setBounds(LPVar var, double lb, double ub) {
+            _vLB[var.id()] = bound(lb);
+            _vUB[var.id()] = bound(ub);
+            Highs_changeColBounds(_highs, var.id(), _vLB[var.id()], _vUB[var.id()]);
+        }
+        void setLB(LPVar var, double lb) { setBounds(var, lb, _vUB[var.id()]); }
+        void setUB(LPVar var, double ub) { setBounds(var, _vLB[var.id()], ub); }
+        void chgCoeff(LPConstr constr, LPVar var, double coeff) { Highs_changeCoeff(_highs, constr.id(), var.id(), coeff); }
+        void setRHS(LPConstr constr, char sense, double rhs);
+
+        void setFeasibilityTol(double tolerance);
+        void setTimeLimit(double seconds) { Highs_setDoubleOptionValue(_highs, "time_limit", seconds); }
+        void setThreads(size_t numThreads) { Highs_setIntOptionValue(_highs, "threads", (HighsInt)numThreads); }
+        void setMethod(LPMethod method);
+        void setVerbose(bool verbose) { Highs_setBoolOptionValue(_highs, "output_flag", verbose? 1 : 0); }
+
+        double value(LPVar var);
+        double objValue() { return Highs_getObjectiveValue(_highs); }
+
+    protected:
+        LPStatus solveModel();
+
+    private:
+        double bound(double value) const { return (value >= LPInfinity)? _inf : (value <= -LPInfinity)? -_inf : value; }
+        void rowBounds(char sense, double rhs, double& lower, double& upper) const;
+
+        void* _highs;
+        double _inf;                // the infinity of HiGHS
+        vector<double> _vLB;        // index = [LPVar id]
+        vector<double> _vUB;
+        vector<double> _vColValue;  // the solution of the last run, index = [LPVar id]
+};
+
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+#include "LPModel.h"
+#include "GurobiLPModel.h"
+#include "HiGHSLPModel.h"
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
+using namespace std;
+
+// HiGHS whenever it is compiled in: GurobiLPModel has not been built against a Gurobi installation yet,
+// it is chosen by setDefaultBackend(LPGurobi) (lpBackend = 0 in the parameter file)
+#ifdef USE_HIGHS
+LPBackend LPModel::_defaultBackend = LPHiGHS;
+#else
+LPBackend LPModel::_defaultBackend = LPGurobi;
+#endif
+
+namespace {
+    // the solve statistics of each backend, index = [LPBackend]
+    mutex statsMutex;
+    size_t vNumSolves[2] = {0, 0};
+    double vSolveSeconds[2] = {0, 0};
+}
+
+bool LPModel::available(LPBackend backend) {
+#ifdef USE_GUROBI
+    if (backend == LPGurobi) return true;
+#endif
+#ifdef USE_HIGHS
+    if (backend == LPHiGHS) return true;
+#endif
+    return false;
+}
+
+void LPModel::setDefaultBackend(LPBackend backend) {
+    if (!available(backend)) {
+        cerr << "LPModel: " << backendName(backend) << " is not compiled in, using " << backendName(_defaultBackend) << endl;
+        return;
+    }
+    _defaultBackend = backend;
+}
+
+LPModel* LPModel::create() {
+    return create(_defaultBackend);
+}
+
+LPModel* LPModel::create(LPBackend backend) {
+    if (!available(backend)) backend = _defaultBackend;
+#ifdef USE_GUROBI
+    if (backend == LPGurobi) return new GurobiLPModel();
+#endif
+#ifdef USE_HIGHS
+    if (backend == LPHiGHS) return new HiGHSLPModel();
+#endif
+    throw LPException("LPModel: no LP backend is compiled in");
+}
+
+void LPModel::printStats() {
+    lock_guard<mutex> lock(statsMutex);
+    for (size_t backend = 0; backend < 2; ++ backend) {
+        if (vNumSolves[backend] == 0) continue;
+        cerr << "LP backend " << backendName((LPBackend)backend) << ": " << vNumSolves[backend] << " solves, "
+             << vSolveSeconds[backend] << " s, " << vSolveSeconds[backend] / vNumSolves[backend] << " s per solve" << endl;
+    }
+}
+
+LPStatus LPModel::optimize() {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    _status = solveModel();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    {
+        lock_guard<mutex> lock(statsMutex);
+        ++ vNumSolves[backend()];
+        vSolveSeconds[backend()] += seconds;
+    }
+    if (_status != LPOptimal) {
+        cerr << "LPModel: " << backendName(backend()) << " ended without an optimal solution (status " << _status << ")" << endl;
+    }
+    return _status;
+}
+
+void LPModel::optimizeAll(const vector<LPModel*>& vModel, size_t numThreads) {
+    numThreads = min(numThreads, vModel.size());
+    if (numThreads <= 1) {
+        for (size_t modelId = 0; modelId < vModel.size(); ++ modelId) {
+            vModel[modelId]->optimize();
+        }
+        return;
+    }
+    atomic<size_t> nextModelId(0);
+    mutex errorMutex;
+    exception_ptr error;
+    auto worker = [&]() {
+        for (size_t modelId = nextModelId ++; modelId < vModel.size(); modelId = nextModelId ++) {
+            try {
+                vModel[modelId]->optimize();
+            } catch (...) {
+                lock_guard<mutex> lock(errorMutex);
+                if (!error) error = current_exception();
+            }
+        }
+    };
+    vector<thread> vThread;
+    for (size_t threadId = 0; threadId < numThreads; ++ threadId) {
+        vThread.push_back(thread(worker));
+    }
+    for (size_t threadId = 0; threadId < numThreads; ++ threadId) {
+        vThread[threadId].join();
+    }
+    if (error) rethrow_exception(error);
+}
+
+void LPModel::setRow(LPConstr& constr, const LPExpr& lhs, char sense, double rhs, const string& name) {
+    if (!constr.valid()) {
+        constr = addConstr(lhs, sense, rhs, name);
+        return;
+    }
+    vector<int> vVarId;
+    vector<double> vCoeff;
+    collectTerms(lhs, vVarId, vCoeff);
+    for (size_t termId = 0; termId < vVarId.size(); ++ termId) {
+        chgCoeff(constr, LPVar(vVarId[termId]), vCoeff[termId]);
+    }
+    setRHS(constr, sense, rhs - lhs.constant());
+}
+
+void LPModel::collectTerms(const LPExpr& expr, vector<int>& vVarId, vector<double>& vCoeff) {
+    vVarId.clear();
+    vCoeff.clear();
+    // the position of each variable in vVarId; most expressions are short, so search them linearly
+    unordered_map<int, size_t> mTermId;
+    bool useMap = (expr.size() > 16);
+    for (size_t termId = 0; termId < expr.size(); ++ termId) {
+        int varId = expr.var(termId).id();
+        size_t pos = vVarId.size();
+        if (useMap) {
+            unordered_map<int, size_t>::iterator it = mTermId.find(varId);
+            if (it != mTermId.end()) {
+                pos = it->second;
+            } else {
+                mTermId[varId] = pos;
+            }
+        } else {
+            pos = find(vVarId.begin(), vVarId.end(), varId) - vVarId.begin();
+        }
+        if (pos == vVarId.size()) {
+            vVarId.push_back(varId);
+            vCoeff.push_back(0.0);
+        }
+        vCoeff[pos] += expr.coeff(termId);
+    }
+}
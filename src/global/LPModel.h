@@ -0,0 +1,193 @@
+#ifndef LP_MODEL_H
+#define LP_MODEL_H
+
+#include "../base/Include.h"
+#include <stdexcept>
+using namespace std;
+
+// The LP / MILP solvers behind LPModel, each compiled in only if its library is found (see src/global/CMakeLists.txt)
+enum LPBackend {
+    LPGurobi,   // USE_GUROBI
+    LPHiGHS     // USE_HIGHS, open source, no license needed per solve
+};
+
+enum LPVarType { LPContinuous, LPBinary, LPInteger };
+
+// the same characters as GRB_LESS_EQUAL, GRB_GREATER_EQUAL and GRB_EQUAL
+enum LPSense { LPLessEqual = '<', LPGreaterEqual = '>', LPEqual = '=' };
+
+enum LPObjSense { LPMinimize = 1, LPMaximize = -1 };
+
+enum LPMethod {
+    LPAutoMethod,
+    LPPrimalSimplex,    // warm starts well after the costs change
+    LPDualSimplex,      // warm starts well after the coefficients and right-hand sides change
+    LPBarrier
+};
+
+enum LPStatus { LPOptimal, LPInfeasible, LPUnbounded, LPNotSolved };
+
+// bounds at or beyond LPInfinity are infinite
+const double LPInfinity = 1e100;
+
+// a variable of an LPModel, index = the order of addVar() calls
+class LPVar {
+    public:
+        LPVar() : _id(-1) {}
+        explicit LPVar(int id) : _id(id) {}
+        int id() const { return _id; }
+        bool valid() const { return _id >= 0; }
+    private:
+        int _id;
+};
+
+// a linear constraint of an LPModel, index = the order of addConstr() calls
+class LPConstr {
+    public:
+        LPConstr() : _id(-1) {}
+        explicit LPConstr(int id) : _id(id) {}
+        int id() const { return _id; }
+        bool valid() const { return _id >= 0; }
+    private:
+        int _id;
+};
+
+// sum of coeff * var + constant; a variable may appear in more than one term
+class LPExpr {
+    public:
+        LPExpr(double constant = 0.0) : _constant(constant) {}
+        LPExpr(LPVar var, double coeff = 1.0) : _constant(0.0) { _vTerm.push_back(make_pair(var.id(), coeff)); }
+
+        size_t size() const { return _vTerm.size(); }
+        LPVar var(size_t termId) const { return LPVar(_vTerm[termId].first); }
+        double coeff(size_t termId) const { return _vTerm[termId].second; }
+        double constant() const { return _constant; }
+
+        LPExpr& operator+=(const LPExpr& expr) {
+            _vTerm.insert(_vTerm.end(), expr._vTerm.begin(), expr._vTerm.end());
+            _constant += expr._constant;
+            return *this;
+        }
+        LPExpr& operator-=(const LPExpr& expr) {
+            for (size_t termId = 0; termId < expr._vTerm.size(); ++ termId) {
+                _vTerm.push_back(make_pair(expr._vTerm[termId].first, -expr._vTerm[termId].second));
+            }
+            _constant -= expr._constant;
+            return *this;
+        }
+        LPExpr& operator*=(double scale) {
+            for (size_t termId = 0; termId < _vTerm.size(); ++ termId) {
+                _vTerm[termId].second *= scale;
+            }
+            _constant *= scale;
+            return *this;
+        }
+
+    private:
+        vector< pair<int, double> > _vTerm;     // (var id, coeff)
+        double _constant;
+};
+
+inline LPExpr operator+(LPExpr a, const LPExpr& b) { a += b; return a; }
+inline LPExpr operator-(LPExpr a, const LPExpr& b) { a -= b; return a; }
+inline LPExpr operator-(LPExpr a) { a *= -1.0; return a; }
+inline LPExpr operator*(LPExpr a, double scale) { a *= scale; return a; }
+inline LPExpr operator*(double scale, LPExpr a) { a *= scale; return a; }
+inline LPExpr operator/(LPExpr a, double scale) { a *= 1.0 / scale; return a; }
+
+// lhs (sense) rhs, built by the comparison operators of LPExpr
+struct LPTempConstr {
+    LPTempConstr(const LPExpr& lhs, char sense, double rhs) : lhs(lhs), sense(sense), rhs(rhs) {}
+    LPExpr lhs;
+    char sense;
+    double rhs;
+};
+
+inline LPTempConstr operator<=(const LPExpr& a, const LPExpr& b) { return LPTempConstr(a - b, LPLessEqual, 0.0); }
+inline LPTempConstr operator>=(const LPExpr& a, const LPExpr& b) { return LPTempConstr(a - b, LPGreaterEqual, 0.0); }
+inline LPTempConstr operator==(const LPExpr& a, const LPExpr& b) { return LPTempConstr(a - b, LPEqual, 0.0); }
+
+class LPException : public runtime_error {
+    public:
+        LPException(const string& message, int errorCode = 0) : runtime_error(message), _errorCode(errorCode) {}
+        int errorCode() const { return _errorCode; }
+    private:
+        int _errorCode;
+};
+
+// A thin modeling interface over the LP / MILP solvers, so that FlowLP, VoltSLP, LayerILP and VoltEigen
+// run on Gurobi or on HiGHS alike. The model is modified in place between solves (costs, bounds, coefficients,
+// right-hand sides), and each backend warm starts the next optimize() from the basis of the last one.
+class LPModel {
+    public:
+        // a new model of backend, or of the default backend (see setDefaultBackend()); delete it after use
+        static LPModel* create();
+        static LPModel* create(LPBackend backend);
+        static LPBackend defaultBackend() { return _defaultBackend; }
+        // a backend that is not compiled in falls back to one that is, with a warning
+        static void setDefaultBackend(LPBackend backend);
+        static bool available(LPBackend backend);
+        static const char* backendName(LPBackend backend) { return (backend == LPGurobi)? "Gurobi" : "HiGHS"; }
+        // the number of optimize() calls and their total wall time of each backend, summed over all models
+        static void printStats();
+
+        virtual ~LPModel() {}
+        virtual LPBackend backend() const = 0;
+
+        // variables and constraints
+        virtual LPVar addVar(double lb, double ub, double obj, LPVarType type, const string& name = "") = 0;
+        // a variable with coefficient coeff in the existing constraint constr
+        virtual LPVar addVar(double lb, double ub, double obj, LPVarType type, LPConstr constr, double coeff, const string& name = "") = 0;
+        virtual LPConstr addConstr(const LPExpr& lhs, char sense, double rhs, const string& name = "") = 0;
+        LPConstr addConstr(const LPTempConstr& tempConstr, const string& name = "") {
+            return addConstr(tempConstr.lhs, tempConstr.sense, tempConstr.rhs, name);
+        }
+        size_t numVars() const { return _numVars; }
+        size_t numConstrs() const { return _numConstrs; }
+
+        // in-place modification
+        virtual void setObjective(const LPExpr& obj, LPObjSense sense) = 0;
+        virtual void setObjSense(LPObjSense sense) = 0;
+        virtual void setObj(LPVar var, double obj) = 0;
+        virtual void setBounds(LPVar var, double lb, double ub) = 0;
+        virtual void setLB(LPVar var, double lb) = 0;
+        virtual void setUB(LPVar var, double ub) = 0;
+        virtual void chgCoeff(LPConstr constr, LPVar var, double coeff) = 0;
+        virtual void setRHS(LPConstr constr, char sense, double rhs) = 0;
+        // add lhs (sense) rhs as constr if constr is not valid yet, otherwise rewrite constr in place, so a model
+        // built once can follow the coefficients that move between its solves instead of being rebuilt.
+        // On a rewrite, the variables of lhs must include every variable with a nonzero coefficient in the row
+        // (keep zero terms in lhs); a variable appearing twice is summed.
+        void setRow(LPConstr& constr, const LPExpr& lhs, char sense, double rhs, const string& name = "");
+
+        // parameters
+        virtual void setFeasibilityTol(double tolerance) = 0;
+        virtual void setTimeLimit(double seconds) = 0;
+        virtual void setThreads(size_t numThreads) = 0;
+        virtual void setMethod(LPMethod method) = 0;
+        virtual void setVerbose(bool verbose) = 0;
+
+        // solve, warm started from the last basis if there is one
+        LPStatus optimize();
+        // optimize() each model of vModel on up to numThreads threads; the models must be distinct.
+        // The first exception of a model is rethrown after every thread has joined.
+        static void optimizeAll(const vector<LPModel*>& vModel, size_t numThreads);
+        LPStatus status() const { return _status; }
+        virtual double value(LPVar var) = 0;
+        virtual double objValue() = 0;
+
+    protected:
+        LPModel() : _numVars(0), _numConstrs(0), _status(LPNotSolved) {}
+        virtual LPStatus solveModel() = 0;
+        // the terms of expr with the duplicate variables summed, in the order of their first appearance
+        static void collectTerms(const LPExpr& expr, vector<int>& vVarId, vector<double>& vCoeff);
+
+        size_t _numVars;
+        size_t _numConstrs;
+
+    private:
+        LPStatus _status;
+        static LPBackend _defaultBackend;
+};
+
+#endif
@@ -2,25 +2,36 @@
 using namespace std;
 
 LayerILP::LayerILP(RGraph& rGraph, vector< vector<double> > vNetWeight, vector<double> vAccuViaLength)
-        : _model(_env), _rGraph(rGraph), _vNetWeight(vNetWeight), _vAccuViaLength(vAccuViaLength) {
-    // _model.getEnv().set(GRB_DoubleParam_TimeLimit, 400);
-    _model.set(GRB_DoubleParam_FeasibilityTol, 1e-9);
-    _vFlow = new GRBVar** [_rGraph.num2PinNets()];
+        : _rGraph(rGraph), _model(LPModel::create()), _vNetWeight(vNetWeight), _vAccuViaLength(vAccuViaLength) {
+    // _model->setTimeLimit(400);
+    _model->setFeasibilityTol(1e-9);
+    _vFlow = new LPVar** [_rGraph.num2PinNets()];
     for (size_t twoPinNetId = 0; twoPinNetId < _rGraph.num2PinNets(); ++ twoPinNetId) {
-        _vFlow[twoPinNetId] = new GRBVar* [ _rGraph.numLayers() ];
+        _vFlow[twoPinNetId] = new LPVar* [ _rGraph.numLayers() ];
         for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
-            _vFlow[twoPinNetId][layId] = new GRBVar [ _rGraph.numRGEdges(twoPinNetId, layId) ];
+            _vFlow[twoPinNetId][layId] = new LPVar [ _rGraph.numRGEdges(twoPinNetId, layId) ];
             for (size_t RGEdgeId = 0; RGEdgeId < _rGraph.numRGEdges(twoPinNetId, layId); ++ RGEdgeId) {
-                _vFlow[twoPinNetId][layId][RGEdgeId] = _model.addVar(0.0, 1.0, 0.0, GRB_BINARY, 
+                _vFlow[twoPinNetId][layId][RGEdgeId] = _model->addVar(0.0, 1.0, 0.0, LPBinary, 
                                                         "F_n" + to_string(twoPinNetId) + "_l_" + to_string(layId) + "_i_" + to_string(RGEdgeId));
             }
         }
     }
-    _currentLB = _model.addVar(-100000.0, 100000.0, 0.0, GRB_CONTINUOUS, "_currentLB");
+    _currentLB = _model->addVar(-100000.0, 100000.0, 0.0, LPContinuous, "_currentLB");
     // _model.update();
     // _model.write("exp/output/LayerILP_debug.lp");
 }
 
+LayerILP::~LayerILP() {
+    for (size_t twoPinNetId = 0; twoPinNetId < _rGraph.num2PinNets(); ++ twoPinNetId) {
+        for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
+            delete [] _vFlow[twoPinNetId][layId];
+        }
+        delete [] _vFlow[twoPinNetId];
+    }
+    delete [] _vFlow;
+    delete _model;
+}
+
 void LayerILP::formulate() {
     setObjective();
     setConflictConstraints();
@@ -29,14 +40,15 @@ void LayerILP::formulate() {
 }
 
 void LayerILP::solve() {
-    _model.optimize();
+    _model->optimize();
 }
 
 void LayerILP::collectResult() {
     for (size_t twoPinNetId = 0; twoPinNetId < _rGraph.num2PinNets(); ++ twoPinNetId) {
         for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
             for (size_t RGEdgeId = 0; RGEdgeId < _rGraph.numRGEdges(twoPinNetId, layId); ++ RGEdgeId) {
-                if (_vFlow[twoPinNetId][layId][RGEdgeId].get(GRB_DoubleAttr_X) != 0) {
+                // a binary up to the integrality tolerance of the solver
+                if (_model->value(_vFlow[twoPinNetId][layId][RGEdgeId]) > 0.5) {
                     _rGraph.vEdge(twoPinNetId, layId, RGEdgeId)->select();
                 }
             }
@@ -48,7 +60,7 @@ void LayerILP::setObjective() {
     for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
         Port* sPort = _rGraph.sPort(netId);
         for (size_t netTPortId = 0; netTPortId < _rGraph.numTPorts(netId); ++ netTPortId) {
-            GRBLinExpr netCurrent;
+            LPExpr netCurrent;
             Port* tPort = _rGraph.tPort(netId, netTPortId);
             size_t twoPinNetId = _rGraph.twoPinNetId(sPort->portId(), tPort->portId());
             for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
@@ -77,13 +89,13 @@ void LayerILP::setObjective() {
                 }
             }
             netCurrent *= _vNetWeight[netId][netTPortId];
-            _model.addConstr(netCurrent >= _currentLB, "obj_constr_n" + to_string(netId) + "_t" + to_string(netTPortId));
+            _model->addConstr(netCurrent >= _currentLB, "obj_constr_n" + to_string(netId) + "_t" + to_string(netTPortId));
         }
     }
 
-    GRBLinExpr obj;
+    LPExpr obj;
     obj += _currentLB;
-    _model.setObjective(obj, GRB_MAXIMIZE);
+    _model->setObjective(obj, LPMaximize);
 }
 
 void LayerILP::setConflictConstraints() {
@@ -123,7 +135,7 @@ void LayerILP::addConflictConstraint(size_t netId, size_t twoPinNetId) {
                     for (size_t RGEdgeId1 = 0; RGEdgeId1 < _rGraph.numRGEdges(twoPinNetId1, layId); ++ RGEdgeId1) {
                         RGEdge* e1 = _rGraph.vEdge(twoPinNetId1, layId, RGEdgeId1);
                         if (e->cross(e1)) {
-                            _model.addConstr(_vFlow[twoPinNetId][layId][RGEdgeId] + _vFlow[twoPinNetId1][layId][RGEdgeId1] <= 1);
+                            _model->addConstr(_vFlow[twoPinNetId][layId][RGEdgeId] + _vFlow[twoPinNetId1][layId][RGEdgeId1] <= 1);
                         }
                     }
 
@@ -134,7 +146,7 @@ void LayerILP::addConflictConstraint(size_t netId, size_t twoPinNetId) {
                         for (size_t RGEdgeId11 = 0; RGEdgeId11 < _rGraph.numRGEdges(twoPinNetId11, layId); ++ RGEdgeId11) {
                             RGEdge* e11 = _rGraph.vEdge(twoPinNetId11, layId, RGEdgeId11);
                             if (e->cross(e11)) {
-                                _model.addConstr(_vFlow[twoPinNetId][layId][RGEdgeId] + _vFlow[twoPinNetId11][layId][RGEdgeId11] <= 1);
+                                _model->addConstr(_vFlow[twoPinNetId][layId][RGEdgeId] + _vFlow[twoPinNetId11][layId][RGEdgeId11] <= 1);
                             }
                         }
                     }
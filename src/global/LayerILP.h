@@ -1,15 +1,15 @@
 #ifndef LAYER_ILP
 #define LAYER_ILP
 
-#include <gurobi_c++.h>
 #include "../base/Include.h"
 #include "RGraph.h"
+#include "LPModel.h"
 using namespace std;
 
 class LayerILP {
     public:
         LayerILP(RGraph& rGraph, vector< vector<double> > vNetWeight, vector<double> vAccuViaLength);
-        ~LayerILP() {}
+        ~LayerILP();
 
         void formulate();
         void solve();
@@ -23,11 +23,10 @@ class LayerILP {
         void addConflictConstraint(size_t netId, size_t twoPinNetId);
         
         RGraph& _rGraph;
-        GRBEnv _env;
-        GRBModel _model;
-        // gurobi variables
-        GRBVar*** _vFlow;  // index = [twoPinNetId] [layId] [RGEdgeId]
-        GRBVar _currentLB;  // gamma
+        LPModel* _model;
+        // LP variables
+        LPVar*** _vFlow;  // index = [twoPinNetId] [layId] [RGEdgeId]
+        LPVar _currentLB;  // gamma
         
         // input constants
         vector< vector<double> > _vNetWeight; // index = [netId] [netTPortId]
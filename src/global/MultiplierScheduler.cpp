@@ -0,0 +1,127 @@
+#include "MultiplierScheduler.h"
+
+void MultiplierScheduler::reset() {
+    _vLastOverlap.clear();
+    _vLastNetOverlap.clear();
+    _bestDual = -numeric_limits<double>::infinity();
+    _bestFeasible = numeric_limits<double>::infinity();
+    _numStalls = 0;
+    _converged = false;
+    _vRecord.clear();
+}
+
+void MultiplierScheduler::record(size_t ivIter, char stage, size_t iter, const vector<double>& vOverlap, const vector<double>& vNetOverlap,
+                                 double cost, double area, const vector<double>& vLambda, const vector<double>& vNetLambda) {
+    assert(vOverlap.size() == vLambda.size());
+    assert(vNetOverlap.size() == vNetLambda.size());
+    double overlap = 0, sameNetOverlap = 0, dual = cost, sumLambda = 0;
+    for (size_t capId = 0; capId < vOverlap.size(); ++ capId) {
+        overlap += vOverlap[capId];
+        dual += vLambda[capId] * vOverlap[capId];
+        sumLambda += vLambda[capId];
+    }
+    for (size_t netCapId = 0; netCapId < vNetOverlap.size(); ++ netCapId) {
+        sameNetOverlap += vNetOverlap[netCapId];
+        dual += vNetLambda[netCapId] * vNetOverlap[netCapId];
+    }
+    bool feasible = (overlap + sameNetOverlap <= _overlapTol);
+    if (feasible) {
+        _bestFeasible = min(_bestFeasible, cost);
+    }
+    if (dual > _bestDual) {
+        _bestDual = dual;
+        _numStalls = 0;
+    } else if (++ _numStalls >= _patience) {
+        _theta *= 0.5;
+        _numStalls = 0;
+    }
+    double gap = -1;
+    if (_bestFeasible < numeric_limits<double>::infinity() && _bestFeasible > 0) {
+        gap = max(0.0, (_bestFeasible - _bestDual) / _bestFeasible);
+    }
+
+    // stopping criteria
+    _converged = false;
+    if (feasible) {
+        if (gap >= 0 && gap <= _gapTol) {
+            _converged = true;
+        } else if (!_vRecord.empty() && _vRecord.back().area > 0 && abs(area - _vRecord.back().area) <= _areaTol * _vRecord.back().area) {
+            _converged = true;
+        }
+    }
+
+    ScheduleRecord record = {ivIter, stage, iter, area, overlap, sameNetOverlap, dual, gap, 0,
+                             vLambda.empty()? 0 : sumLambda / vLambda.size()};
+    _vRecord.push_back(record);
+    cerr << "multiplier schedule: " << stage << ivIter << "." << iter << " overlap = " << overlap << ", sameNetOverlap = " << sameNetOverlap
+         << ", dual = " << dual << ", gap = " << gap << (_converged? ", converged" : "") << endl;
+}
+
+void MultiplierScheduler::updateMultipliers(const vector<double>& vOverlap, const vector<double>& vNetOverlap, vector<double>& vLambda, vector<double>& vNetLambda) {
+    assert(!_vRecord.empty());
+    double stepSize = (_schedule == SchedulePolyak)? step(vOverlap, vNetOverlap) : 0;
+    updateLambda(vOverlap, _vLastOverlap, _expRatio, stepSize, vLambda);
+    updateLambda(vNetOverlap, _vLastNetOverlap, _netExpRatio, stepSize, vNetLambda);
+    double sumLambda = 0;
+    for (size_t capId = 0; capId < vLambda.size(); ++ capId) {
+        sumLambda += vLambda[capId];
+    }
+    _vRecord.back().step = stepSize;
+    _vRecord.back().meanLambda = vLambda.empty()? 0 : sumLambda / vLambda.size();
+}
+
+// theta * (target - dual) / |overlap|^2, where target is the best feasible cost, or a dual value targetGap above
+// the best one if no solve is feasible yet (or the dual estimate passed the feasible cost)
+double MultiplierScheduler::step(const vector<double>& vOverlap, const vector<double>& vNetOverlap) {
+    double norm2 = 0;
+    for (size_t capId = 0; capId < vOverlap.size(); ++ capId) {
+        norm2 += vOverlap[capId] * vOverlap[capId];
+    }
+    for (size_t netCapId = 0; netCapId < vNetOverlap.size(); ++ netCapId) {
+        norm2 += vNetOverlap[netCapId] * vNetOverlap[netCapId];
+    }
+    if (norm2 == 0) {
+        return 0;
+    }
+    double dual = _vRecord.back().dual;
+    double target = _bestFeasible;
+    if (target == numeric_limits<double>::infinity() || target <= dual) {
+        target = max(_bestDual, dual) + _targetGap * abs(max(_bestDual, dual));
+    }
+    return _theta * (target - dual) / norm2;
+}
+
+void MultiplierScheduler::updateLambda(const vector<double>& vOverlap, vector<double>& vLastOverlap, double expRatio, double step, vector<double>& vLambda) {
+    if (vLastOverlap.size() != vOverlap.size()) {
+        vLastOverlap = vOverlap;
+    }
+    for (size_t ovId = 0; ovId < vLambda.size(); ++ ovId) {
+        double overlap = vOverlap[ovId];
+        switch (_schedule) {
+            case ScheduleExp:
+                vLambda[ovId] *= expRatio;
+                break;
+            case ScheduleP:
+                vLambda[ovId] += _pRatio * overlap;
+                break;
+            case SchedulePD:
+                vLambda[ovId] += _pRatio * overlap + _dRatio * (vLastOverlap[ovId] - overlap);
+                break;
+            case SchedulePolyak:
+                vLambda[ovId] += step * overlap;
+                break;
+        }
+        vLambda[ovId] = max(vLambda[ovId], 0.0);
+        vLastOverlap[ovId] = overlap;
+    }
+}
+
+void MultiplierScheduler::writeTrajectory(ostream& out, const vector<ScheduleRecord>& vRecord) {
+    out << "# ivIter stage iter area overlap sameNetOverlap dual gap step meanLambda\n";
+    for (size_t recordId = 0; recordId < vRecord.size(); ++ recordId) {
+        const ScheduleRecord& record = vRecord[recordId];
+        out << record.ivIter << " " << record.stage << " " << record.iter << " " << record.area << " " << record.overlap << " "
+            << record.sameNetOverlap << " " << record.dual << " " << record.gap << " " << record.step << " " << record.meanLambda << "\n";
+    }
+    out << "\n";
+}
@@ -0,0 +1,91 @@
+#ifndef MULTIPLIER_SCHEDULER_H
+#define MULTIPLIER_SCHEDULER_H
+
+#include "../base/Include.h"
+#include <limits>
+using namespace std;
+
+// the update rule of the capacity multipliers in GlobalMgr::voltCurrOpt
+enum MultiplierSchedule {
+    ScheduleExp = 0,    // lambda *= expRatio
+    ScheduleP = 1,      // lambda += pRatio * overlap
+    SchedulePD = 2,     // lambda += pRatio * overlap + dRatio * (last overlap - overlap)
+    SchedulePolyak = 3  // lambda += step * overlap, step = theta * (target - dual) / |overlap|^2
+};
+
+// the state after one relaxed solve of voltCurrOpt, a line of the trajectory
+struct ScheduleRecord {
+    size_t ivIter;
+    char stage;             // 'I' for FlowLP, 'V' for VoltSLP
+    size_t iter;            // iIter or vIter
+    double area;
+    double overlap;
+    double sameNetOverlap;
+    double dual;            // cost + sum of lambda * overlap of this solve
+    double gap;             // (best feasible cost - best dual) / best feasible cost, -1 before a feasible solve
+    double step;            // the Polyak step size, 0 for the other schedules
+    double meanLambda;      // the mean capacity multiplier, after updateMultipliers if it was called
+};
+
+// Updates the multipliers of the relaxed capacity constraints from the overlaps measured after each solve,
+// and decides when voltCurrOpt can stop: once the overlap is gone and either the area stops moving or the
+// gap between the best feasible cost and the best dual value is closed.
+// The dual value is cost + sum(lambda * overlap) of the solve, which is only an estimate of the Lagrangian
+// bound since VoltSLP solves a linearization.
+class MultiplierScheduler {
+    public:
+        MultiplierScheduler(MultiplierSchedule schedule)
+        : _schedule(schedule), _expRatio(1.1), _netExpRatio(1.0), _pRatio(10.0), _dRatio(1.0),
+          _theta(1.0), _targetGap(0.05), _patience(3), _overlapTol(1E-3), _areaTol(1E-3), _gapTol(1E-2) {
+            reset();
+        }
+        ~MultiplierScheduler() {}
+
+        void setExpRatio(double ratio, double netRatio) { _expRatio = ratio; _netExpRatio = netRatio; }
+        void setPDRatio(double pRatio, double dRatio) { _pRatio = pRatio; _dRatio = dRatio; }
+        // theta halves after patience updates without a better dual value
+        void setPolyak(double theta, double targetGap, size_t patience) { _theta = theta; _targetGap = targetGap; _patience = patience; }
+        // overlapTol: total overlap (mm) of a feasible solve, areaTol: relative area change, gapTol: relative gap
+        void setTolerances(double overlapTol, double areaTol, double gapTol) { _overlapTol = overlapTol; _areaTol = areaTol; _gapTol = gapTol; }
+        void reset();
+
+        // record the solve (ivIter, stage, iter) with per-constraint overlaps vOverlap / vNetOverlap, cost (without
+        // the penalties) and area, under the multipliers vLambda / vNetLambda it was solved with
+        void record(size_t ivIter, char stage, size_t iter, const vector<double>& vOverlap, const vector<double>& vNetOverlap,
+                    double cost, double area, const vector<double>& vLambda, const vector<double>& vNetLambda);
+        // update vLambda / vNetLambda for the next solve from the overlaps of the last recorded one
+        void updateMultipliers(const vector<double>& vOverlap, const vector<double>& vNetOverlap, vector<double>& vLambda, vector<double>& vNetLambda);
+        // true if the last recorded solve meets the stopping criteria
+        bool converged() const { return _converged; }
+        size_t numSolves() const { return _vRecord.size(); }
+        const vector<ScheduleRecord>& vRecord() const { return _vRecord; }
+        MultiplierSchedule schedule() const { return _schedule; }
+        // one line per record: ivIter stage iter area overlap sameNetOverlap dual gap step meanLambda
+        static void writeTrajectory(ostream& out, const vector<ScheduleRecord>& vRecord);
+
+    private:
+        double step(const vector<double>& vOverlap, const vector<double>& vNetOverlap);
+        void updateLambda(const vector<double>& vOverlap, vector<double>& vLastOverlap, double expRatio, double step, vector<double>& vLambda);
+
+        MultiplierSchedule _schedule;
+        double _expRatio;
+        double _netExpRatio;
+        double _pRatio;
+        double _dRatio;
+        double _theta;
+        double _targetGap;
+        size_t _patience;
+        double _overlapTol;
+        double _areaTol;
+        double _gapTol;
+
+        vector<double> _vLastOverlap;       // index = [capId]
+        vector<double> _vLastNetOverlap;    // index = [netCapId]
+        double _bestDual;
+        double _bestFeasible;               // the least cost of a solve without overlap, infinity before one
+        size_t _numStalls;                  // updates since the best dual value improved
+        bool _converged;
+        vector<ScheduleRecord> _vRecord;
+};
+
+#endif
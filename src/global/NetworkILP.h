@@ -1,7 +1,6 @@
 #ifndef NETWORKILP_H
 #define NETWORKILP_H
 
-#include <gurobi_c++.h>
 #include "../base/Include.h"
 // #include "OASG.h"
 using namespace std;
@@ -22,7 +22,7 @@ void VoltEigen::setInputVector(size_t rowNodeId, double inputCurrent) {
 void VoltEigen::solve() {
     // cerr << "G = " << endl;
     for (size_t rowId = 0; rowId < _numNodes; ++ rowId) {
-        GRBLinExpr current;
+        LPExpr current;
         for (size_t colId = 0; colId < _numNodes; ++ colId) {
             current += _G[rowId][colId] * _vVoltage[colId];
             // cerr << _G[rowId][colId];
@@ -31,16 +31,16 @@ void VoltEigen::solve() {
             // }
         }
         // cerr << ";" << endl;
-        _model.addConstr(current == _I[rowId], "I_constr_n" + to_string(rowId));
+        _model->addConstr(current == _I[rowId], "I_constr_n" + to_string(rowId));
     }
     // cerr << "I = " << endl;
     // for (size_t rowId = 0; rowId < _numNodes; ++ rowId) {
     //     cerr << _I[rowId] << ";" << endl;
     // }
-    _model.optimize();
+    _model->optimize();
     cerr << "voltage = " << endl;
     for (size_t rowId = 0; rowId < _numNodes; ++ rowId) {
-        _V[rowId] = _vVoltage[rowId].get(GRB_DoubleAttr_X);
+        _V[rowId] = _model->value(_vVoltage[rowId]);
         cerr << setprecision(15) << _V[rowId] << " ";
     }
     cerr << endl;
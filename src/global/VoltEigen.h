@@ -1,25 +1,24 @@
 #ifndef VOLT_EIGEN_H
 #define VOLT_EIGEN_H
 
-#include <gurobi_c++.h>
 #include "../base/Include.h"
+#include "LPModel.h"
 using namespace std;
 
 class VoltEigen {
     public:
-        VoltEigen(size_t numNodes) : _model(_env), _numNodes(numNodes) {
+        VoltEigen(size_t numNodes) : _model(LPModel::create()), _numNodes(numNodes) {
             vector<double> GRow(numNodes, 0.0);
             for (size_t rowId = 0; rowId < numNodes; ++ rowId) {
                 _G.push_back(GRow);
                 _I.push_back(0.0);
                 _V.push_back(0.0);
             }
-            _vVoltage = new GRBVar [numNodes];
             for (size_t nodeId = 0; nodeId < numNodes; ++ nodeId) {
-                _vVoltage[nodeId] = _model.addVar(0.0, std::numeric_limits<double>::max(), 0.0, GRB_CONTINUOUS, "V_n" + to_string(nodeId) );
+                _vVoltage.push_back(_model->addVar(0.0, LPInfinity, 0.0, LPContinuous, "V_n" + to_string(nodeId)));
             }
         }
-        ~VoltEigen() {}
+        ~VoltEigen() { delete _model; }
         void setMatrix(size_t rowNodeId, double conductance);
         void setMatrix(size_t rowNodeId, size_t colNodeId, double conductance);
         void setInputVector(size_t rowNodeId, double inputVolt, double conductance);
@@ -33,9 +32,8 @@ class VoltEigen {
         size_t numNodes() const { return _numNodes; }
     private:
 
-        GRBEnv _env;
-        GRBModel _model;
-        GRBVar* _vVoltage;
+        LPModel* _model;
+        vector<LPVar> _vVoltage;
         vector< vector< double > > _G;  // the conductance matrix
         vector<double> _I;  // the input current vector
         vector<double> _V;  // the voltage vector to be solved
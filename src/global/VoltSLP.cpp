@@ -1,8 +1,13 @@
 #include "VoltSLP.h"
 
-VoltSLP::VoltSLP(DB& db, RGraph& rGraph)
- : _model(_env), _db(db), _rGraph(rGraph) {
-    _model.set(GRB_DoubleParam_FeasibilityTol, 1e-9);
+VoltSLP::VoltSLP(DB& db, RGraph& rGraph, bool decomposed)
+ : _db(db), _rGraph(rGraph), _decomposed(decomposed) {
+    size_t numModels = _decomposed? _rGraph.numNets() : 1;
+    for (size_t modelId = 0; modelId < numModels; ++ modelId) {
+        _vModel.push_back(LPModel::create());
+        _vModel.back()->setFeasibilityTol(1e-9);
+    }
+    _numThreads = 1;
     _area = 0;
     _overlap = 0;
     _numCapConstrs = 0;
@@ -13,21 +18,23 @@ VoltSLP::VoltSLP(DB& db, RGraph& rGraph)
     _afterOverlapCost = 0;
     _areaWeight = 0;
     _viaWeight = 0;
-    _vVoltage = new GRBVar* [_rGraph.numNets()];
+    _limitRatio = 0;
+    _numRelaxedSolves = 0;
+    _vVoltage = new LPVar* [_rGraph.numNets()];
     for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
-        _vVoltage[netId] = new GRBVar [_rGraph.numNPortOASGNodes(netId)];
+        _vVoltage[netId] = new LPVar [_rGraph.numNPortOASGNodes(netId)];
         for (size_t nPortNodeId = 0; nPortNodeId < _rGraph.numNPortOASGNodes(netId); ++ nPortNodeId) {
-            _vVoltage[netId][nPortNodeId] = _model.addVar(0.0, GRB_INFINITY, 0.0, GRB_CONTINUOUS, 
+            _vVoltage[netId][nPortNodeId] = model(netId)->addVar(0.0, LPInfinity, 0.0, LPContinuous, 
                                                         "V_n" + to_string(netId) + "_i_" + to_string(nPortNodeId));
         }
     }
     // _vPEdgeInV = new GRBVar** [_rGraph.numNets()];
     // _vVEdgeInV = new GRBVar** [_rGraph.numNets()];
-    _vMaxViaCost = new GRBVar* [_rGraph.numNets()];
+    _vMaxViaCost = new LPVar* [_rGraph.numNets()];
     for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
         // _vPEdgeInV[netId] = new GRBVar* [_rGraph.numLayers()];
         // _vVEdgeInV[netId] = new GRBVar* [_rGraph.numLayerPairs()];
-        _vMaxViaCost[netId] = new GRBVar [_rGraph.numViaOASGEdges(netId)];
+        _vMaxViaCost[netId] = new LPVar [_rGraph.numViaOASGEdges(netId)];
         // for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
         //     _vPEdgeInV[netId][layId] = new GRBVar [_rGraph.numPlaneOASGEdges(netId, layId)];
         //     for (size_t pEdgeId = 0; pEdgeId < _rGraph.numPlaneOASGEdges(netId, layId); ++ pEdgeId) {
@@ -45,7 +52,7 @@ VoltSLP::VoltSLP(DB& db, RGraph& rGraph)
         //     }     
         // }
         for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
-            _vMaxViaCost[netId][vEdgeId] = _model.addVar(0.0, GRB_INFINITY, 0.0, GRB_CONTINUOUS, 
+            _vMaxViaCost[netId][vEdgeId] = model(netId)->addVar(0.0, LPInfinity, 0.0, LPContinuous, 
                                                         "Cv_max_n" + to_string(netId) + "_i_" + to_string(vEdgeId));
         }
     }
@@ -56,14 +63,26 @@ VoltSLP::VoltSLP(DB& db, RGraph& rGraph)
     // }
 }
 
+VoltSLP::~VoltSLP() {
+    for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+        delete [] _vVoltage[netId];
+        delete [] _vMaxViaCost[netId];
+    }
+    delete [] _vVoltage;
+    delete [] _vMaxViaCost;
+    for (size_t modelId = 0; modelId < _vModel.size(); ++ modelId) {
+        delete _vModel[modelId];
+    }
+}
+
 void VoltSLP::setVoltConstraints(double threshold) {
     assert(false);
     for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
         for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
             for (size_t pEdgeId = 0; pEdgeId < _rGraph.numPlaneOASGEdges(netId, layId); ++ pEdgeId) {
                 OASGEdge* edge = _rGraph.vPlaneOASGEdge(netId, layId, pEdgeId);
-                GRBLinExpr sVolt;
-                GRBLinExpr tVolt;
+                LPExpr sVolt;
+                LPExpr tVolt;
                 if (edge->sNode()->nPort()) {
                     sVolt += _vVoltage[netId][edge->sNode()->nPortNodeId()];
                 } else {
@@ -74,15 +93,15 @@ void VoltSLP::setVoltConstraints(double threshold) {
                 } else {
                     tVolt += edge->tNode()->voltage();
                 }
-                _model.addConstr(sVolt - tVolt >= threshold);
+                model(netId)->addConstr(sVolt - tVolt >= threshold);
             }
         }
         for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
             for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
                 OASGEdge* edge = _rGraph.vViaOASGEdge(netId, layPairId, vEdgeId);
                 if(!edge->redundant()) {
-                    GRBLinExpr sVolt;
-                    GRBLinExpr tVolt;
+                    LPExpr sVolt;
+                    LPExpr tVolt;
                     if (edge->sNode()->nPort()) {
                         sVolt += _vVoltage[netId][edge->sNode()->nPortNodeId()];
                     } else {
@@ -93,18 +112,18 @@ void VoltSLP::setVoltConstraints(double threshold) {
                     } else {
                         tVolt += edge->tNode()->voltage();
                     }
-                    _model.addConstr(sVolt - tVolt >= threshold);
+                    model(netId)->addConstr(sVolt - tVolt >= threshold);
                 }
             }
         }
     }
 }
 
-GRBLinExpr VoltSLP::linApprox(double cost, OASGEdge* edge) {
+LPExpr VoltSLP::linApprox(double cost, OASGEdge* edge) {
     assert(!edge->redundant());
-    GRBLinExpr lin;
+    LPExpr lin;
     double sOldVolt, tOldVolt;
-    GRBLinExpr sVolt, tVolt;
+    LPExpr sVolt, tVolt;
     if (edge->sNode()->nPort()) {
         // sOldVolt = _vOldVoltage[edge->netId()][edge->sNode()->nPortNodeId()];
         sOldVolt = edge->sNode()->voltage();
@@ -123,7 +142,8 @@ GRBLinExpr VoltSLP::linApprox(double cost, OASGEdge* edge) {
     }
     assert(edge->current() * (sOldVolt - tOldVolt) >= 0);
     if (sOldVolt == tOldVolt) {
-        lin += 0;
+        // keep the voltage variables with a zero coefficient, so the row can be refreshed by updateLinearization
+        lin += 0.0 * (sVolt-tVolt);
     } else {
         lin += (2*cost)/(sOldVolt-tOldVolt) - (cost/pow(sOldVolt-tOldVolt, 2)) * (sVolt-tVolt);
     }
@@ -133,296 +153,298 @@ GRBLinExpr VoltSLP::linApprox(double cost, OASGEdge* edge) {
 void VoltSLP::setObjective(double areaWeight, double viaWeight){
     _areaWeight = areaWeight;
     _viaWeight = viaWeight;
-    GRBLinExpr obj;
+    _vViaCostConstr.assign(_rGraph.numNets(), vector< vector<LPConstr> >(_rGraph.numLayerPairs()));
+    _vViaAreaConstr.assign(_rGraph.numNets(), vector< vector<LPConstr> >(_rGraph.numLayerPairs()));
     for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
-        // add cost for horizontal flows
-        // cerr << "add cost for horizontal flows" << endl;
-        for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
-            for (size_t pEdgeId = 0; pEdgeId < _rGraph.numPlaneOASGEdges(netId, layId); ++ pEdgeId) {
-                OASGEdge* e = _rGraph.vPlaneOASGEdge(netId, layId, pEdgeId);
-                // assert(e->current() * (e->sNode()->voltage() - e->tNode()->voltage()) >= 0); // asserted in linApprox (use oldVolt)
-                double cost = (areaWeight * pow(1E-3 * e->length(), 2)) * e->current() / (_db.vMetalLayer(layId)->conductivity() * _db.vMetalLayer(layId)->thickness() * 1E-3);
-                // cerr << "cost = " << cost << endl;
-                obj += linApprox(cost, e);
-                // double sOldVolt, tOldVolt;
-                // if (e->sNode()->nPort()) {
-                //     sOldVolt = _vOldVoltage[e->netId()][e->sNode()->nPortNodeId()];
-                // } else {
-                //     sOldVolt = e->sNode()->voltage();
-                // }
-                // if (e->tNode()->nPort()) {
-                //     tOldVolt = _vOldVoltage[e->netId()][e->tNode()->nPortNodeId()];
-                // } else {
-                //     tOldVolt = e->tNode()->voltage();
-                // }
-                // if (sOldVolt != tOldVolt) {
-                //     _beforeCost += 1E6 * cost / (sOldVolt - tOldVolt);
-                // }
-            }
+        for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
+            _vViaCostConstr[netId][layPairId].resize(_rGraph.numViaOASGEdges(netId));
+            _vViaAreaConstr[netId][layPairId].resize(_rGraph.numViaOASGEdges(netId));
         }
-        // add cost for vertical flows
-        // cerr << "add cost for vertical flows" << endl;
         for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
-            double viaCost = 0;
             for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
-                OASGEdge* e = _rGraph.vViaOASGEdge(netId, layPairId, vEdgeId);
-                if (!e->redundant()) {
-                    // assert(e->current() * (e->sNode()->voltage() - e->tNode()->voltage()) >= 0); // asserted in linApprox (use oldVolt)
-                    double l = 1E-3 * (0.5*_db.vMetalLayer(layPairId)->thickness()+_db.vMediumLayer(layPairId+1)->thickness()+0.5*_db.vMetalLayer(layPairId+1)->thickness());
-                    double costNum = l * e->current();
-                    double costDen = _db.vMetalLayer(0)->conductivity(); // has not * via cross-sectional area
-                    // cerr << "costDen=" << setprecision(15) << costDen << ", ";
-                    // cerr << "sNode->voltage=" << setprecision(15) << e->sNode()->voltage() << ", ";
-                    // cerr << "tNode->voltage=" << setprecision(15) << e->tNode()->voltage() << endl;
-                    double cost = costNum / costDen;
-                    // cerr << "cost = " << cost << endl;
-                    _model.addConstr(linApprox(cost, e) <= _vMaxViaCost[netId][vEdgeId], 
-                                    "max_via_cost_n" + to_string(netId) + "_l_" + to_string(layPairId) + "_i_" + to_string(vEdgeId));
-                    _model.addConstr(linApprox(cost, e) * 1E6 >= _db.VIA16D8A24()->metalArea());
-                    // double sOldVolt, tOldVolt;
-                    // if (e->sNode()->nPort()) {
-                    //     sOldVolt = _vOldVoltage[e->netId()][e->sNode()->nPortNodeId()];
-                    // } else {
-                    //     sOldVolt = e->sNode()->voltage();
-                    // }
-                    // if (e->tNode()->nPort()) {
-                    //     tOldVolt = _vOldVoltage[e->netId()][e->tNode()->nPortNodeId()];
-                    // } else {
-                    //     tOldVolt = e->tNode()->voltage();
-                    // }
-                    // if (sOldVolt != tOldVolt) {
-                    //     if (viaCost < cost / (sOldVolt - tOldVolt)) {
-                    //         viaCost = cost / (sOldVolt - tOldVolt);
-                    //     }
-                    // }
-                    
+                if (!_rGraph.vViaOASGEdge(netId, layPairId, vEdgeId)->redundant()) {
+                    setViaRows(netId, layPairId, vEdgeId);
                 }
             }
-            obj += viaWeight * _vMaxViaCost[netId][vEdgeId];
-            // _beforeCost += 1E6 * viaWeight * viaCost;
         }
     }
-    // cerr << "_model.setObjective(obj, GRB_MINIMIZE)" << endl;
-    _model.setObjective(obj, GRB_MINIMIZE);
-    // assert(false);
+    setObjectives();
     // _model.update();
     // _model.write("/home/leotseng/2023_ASUS_PDN/exp/output/FlowLP_debug.lp");
 }
 
+// the area cost of net netId linearized at the present voltages, plus the penalties of the relaxed capacity
+// constraints in the model of the net
+LPExpr VoltSLP::objective(size_t netId) {
+    LPExpr obj;
+    // add cost for horizontal flows
+    for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
+        for (size_t pEdgeId = 0; pEdgeId < _rGraph.numPlaneOASGEdges(netId, layId); ++ pEdgeId) {
+            OASGEdge* e = _rGraph.vPlaneOASGEdge(netId, layId, pEdgeId);
+            // assert(e->current() * (e->sNode()->voltage() - e->tNode()->voltage()) >= 0); // asserted in linApprox (use oldVolt)
+            double cost = (_areaWeight * pow(1E-3 * e->length(), 2)) * e->current() / (_db.vMetalLayer(layId)->conductivity() * _db.vMetalLayer(layId)->thickness() * 1E-3);
+            obj += linApprox(cost, e);
+        }
+    }
+    // add cost for vertical flows
+    for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
+        obj += _viaWeight * _vMaxViaCost[netId][vEdgeId];
+    }
+    addSlackCosts(obj, netId, _vCapRow, _vLambda);
+    addSlackCosts(obj, netId, _vNetCapRow, _vNetLambda);
+    return obj;
+}
+
+// obj += the cost of each slack of vRow in the model of net netId
+void VoltSLP::addSlackCosts(LPExpr& obj, size_t netId, const vector<CapRow>& vRow, const vector<double>& vLambda) {
+    for (size_t rowId = 0; rowId < vRow.size(); ++ rowId) {
+        const CapRow& row = vRow[rowId];
+        if (row.slack.valid() && row.e1->netId() == netId) {
+            obj += vLambda[rowId] * row.slack;
+        }
+        if (row.slack2.valid() && row.e2->netId() == netId) {
+            obj += vLambda[rowId] * row.slack2;
+        }
+    }
+}
+
+void VoltSLP::setObjectives() {
+    if (_decomposed) {
+        for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+            _vModel[netId]->setObjective(objective(netId), LPMinimize);
+        }
+        return;
+    }
+    LPExpr obj;
+    for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+        obj += objective(netId);
+    }
+    _vModel[0]->setObjective(obj, LPMinimize);
+}
+
+// linApprox(cost) <= max via cost and linApprox(cost) >= the via metal area of via edge vEdgeId
+void VoltSLP::setViaRows(size_t netId, size_t layPairId, size_t vEdgeId) {
+    OASGEdge* e = _rGraph.vViaOASGEdge(netId, layPairId, vEdgeId);
+    // assert(e->current() * (e->sNode()->voltage() - e->tNode()->voltage()) >= 0); // asserted in linApprox (use oldVolt)
+    double l = 1E-3 * (0.5*_db.vMetalLayer(layPairId)->thickness()+_db.vMediumLayer(layPairId+1)->thickness()+0.5*_db.vMetalLayer(layPairId+1)->thickness());
+    double costNum = l * e->current();
+    double costDen = _db.vMetalLayer(0)->conductivity(); // has not * via cross-sectional area
+    double cost = costNum / costDen;
+    LPExpr viaCost = linApprox(cost, e);
+    model(netId)->setRow(_vViaCostConstr[netId][layPairId][vEdgeId], viaCost - _vMaxViaCost[netId][vEdgeId], LPLessEqual, 0.0,
+                   "max_via_cost_n" + to_string(netId) + "_l_" + to_string(layPairId) + "_i_" + to_string(vEdgeId));
+    model(netId)->setRow(_vViaAreaConstr[netId][layPairId][vEdgeId], viaCost * 1E6, LPGreaterEqual, _db.VIA16D8A24()->metalArea());
+}
+
 void VoltSLP::setLimitConstraint(double ratio) {
     // cerr << "setLimitConstraint..." << endl;
+    _limitRatio = ratio;
     for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
         for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
             for (size_t pEdgeId = 0; pEdgeId < _rGraph.numPlaneOASGEdges(netId, layId); ++ pEdgeId) {
-                OASGEdge* edge = _rGraph.vPlaneOASGEdge(netId, layId, pEdgeId);
-                double sOldVolt, tOldVolt;
-                GRBLinExpr sVolt, tVolt;
-                if (edge->sNode()->nPort()) {
-                    // sOldVolt = _vOldVoltage[edge->netId()][edge->sNode()->nPortNodeId()];
-                    sOldVolt = edge->sNode()->voltage();
-                    sVolt += _vVoltage[edge->netId()][edge->sNode()->nPortNodeId()];
-                } else {
-                    sOldVolt = edge->sNode()->voltage();
-                    sVolt += edge->sNode()->voltage();
-                }
-                if (edge->tNode()->nPort()) {
-                    // tOldVolt = _vOldVoltage[edge->netId()][edge->tNode()->nPortNodeId()];
-                    tOldVolt = edge->tNode()->voltage();
-                    tVolt += _vVoltage[edge->netId()][edge->tNode()->nPortNodeId()];
-                } else {
-                    tOldVolt = edge->tNode()->voltage();
-                    tVolt += edge->tNode()->voltage();
-                }
-                if (sOldVolt >= tOldVolt) {
-                    _model.addConstr( (sVolt-tVolt) >= ratio*(sOldVolt-tOldVolt), "lbPV_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId) );
-                    _model.addConstr( (sVolt-tVolt) <= (2.0-ratio)*(sOldVolt-tOldVolt), "ubPV_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId) );
-                } else {
-                    _model.addConstr( (sVolt-tVolt) <= ratio*(sOldVolt-tOldVolt), "lbPV_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId) );
-                    _model.addConstr( (sVolt-tVolt) >= (2.0-ratio)*(sOldVolt-tOldVolt), "ubPV_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId) );
-                }
-
+                _vLimitRow.push_back(LimitRow(_rGraph.vPlaneOASGEdge(netId, layId, pEdgeId)));
+                setLimitRows(_vLimitRow.back(), "PV_n" + to_string(netId) + "_l_" + to_string(layId) + "_i_" + to_string(pEdgeId));
             }
         }
-        // add cost for vertical flows
-        // cerr << "add cost for vertical flows" << endl;
         for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
             for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
                 OASGEdge* edge = _rGraph.vViaOASGEdge(netId, layPairId, vEdgeId);
                 if (!edge->redundant()) {
-                    double sOldVolt, tOldVolt;
-                    GRBLinExpr sVolt, tVolt;
-                    if (edge->sNode()->nPort()) {
-                        // sOldVolt = _vOldVoltage[edge->netId()][edge->sNode()->nPortNodeId()];
-                        sOldVolt = edge->sNode()->voltage();
-                        sVolt += _vVoltage[edge->netId()][edge->sNode()->nPortNodeId()];
-                    } else {
-                        sOldVolt = edge->sNode()->voltage();
-                        sVolt += edge->sNode()->voltage();
-                    }
-                    if (edge->tNode()->nPort()) {
-                        // tOldVolt = _vOldVoltage[edge->netId()][edge->tNode()->nPortNodeId()];
-                        tOldVolt = edge->tNode()->voltage();
-                        tVolt += _vVoltage[edge->netId()][edge->tNode()->nPortNodeId()];
-                    } else {
-                        tOldVolt = edge->tNode()->voltage();
-                        tVolt += edge->tNode()->voltage();
-                    }
-                    assert(sOldVolt >= tOldVolt);
-                    _model.addConstr( (sVolt-tVolt) >= ratio*(sOldVolt-tOldVolt), "lbVV_n" + to_string(netId) + "_l_" + to_string(layPairId) + "_i_" + to_string(vEdgeId) );
-                    _model.addConstr( (sVolt-tVolt) <= (2.0-ratio)*(sOldVolt-tOldVolt), "ubVV_n" + to_string(netId) + "_l_" + to_string(layPairId) + "_i_" + to_string(vEdgeId) );
+                    _vLimitRow.push_back(LimitRow(edge));
+                    setLimitRows(_vLimitRow.back(), "VV_n" + to_string(netId) + "_l_" + to_string(layPairId) + "_i_" + to_string(vEdgeId));
                 }
             }
         }
     }
 }
 
+// the voltage drop of the edge stays within [ratio, 2-ratio] times its present value
+void VoltSLP::setLimitRows(LimitRow& row, const string& name) {
+    OASGEdge* edge = row.edge;
+    LPExpr sVolt, tVolt;
+    if (edge->sNode()->nPort()) {
+        sVolt += _vVoltage[edge->netId()][edge->sNode()->nPortNodeId()];
+    } else {
+        sVolt += edge->sNode()->voltage();
+    }
+    if (edge->tNode()->nPort()) {
+        tVolt += _vVoltage[edge->netId()][edge->tNode()->nPortNodeId()];
+    } else {
+        tVolt += edge->tNode()->voltage();
+    }
+    double oldDrop = edge->sNode()->voltage() - edge->tNode()->voltage();
+    assert(!edge->viaEdge() || oldDrop >= 0);
+    if (oldDrop >= 0) {
+        model(edge->netId())->setRow(row.lb, sVolt-tVolt, LPGreaterEqual, _limitRatio*oldDrop, "lb" + name);
+        model(edge->netId())->setRow(row.ub, sVolt-tVolt, LPLessEqual, (2.0-_limitRatio)*oldDrop, "ub" + name);
+    } else {
+        model(edge->netId())->setRow(row.lb, sVolt-tVolt, LPLessEqual, _limitRatio*oldDrop, "lb" + name);
+        model(edge->netId())->setRow(row.ub, sVolt-tVolt, LPGreaterEqual, (2.0-_limitRatio)*oldDrop, "ub" + name);
+    }
+}
+
 void VoltSLP::addViaAreaConstraints(size_t netId, size_t vEdgeId, double area) {
     cerr << "addViaAreaConstraints: net" << netId << " vEdge" << vEdgeId << " area = " << area << endl;
-    _model.addConstr(_vMaxViaCost[netId][vEdgeId] * 1E6 <= area);
+    model(netId)->addConstr(_vMaxViaCost[netId][vEdgeId] * 1E6 <= area);
 }
 
-void VoltSLP::addCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, OASGEdge* e2, bool right2, double ratio2, double width){
-    // width unit = millimeter
-    GRBLinExpr totalWidth;
-    double widthWeight1 = (e1->length()) / (_db.vMetalLayer(e1->layId())->conductivity() * _db.vMetalLayer(e1->layId())->thickness());
-    double widthWeight2 = (e2->length()) / (_db.vMetalLayer(e2->layId())->conductivity() * _db.vMetalLayer(e2->layId())->thickness());
-    double cost1, cost2;
+// the cost of the capacity row term of e, whose width is cost / (voltage drop of e)
+double VoltSLP::widthCost(OASGEdge* e, bool right, double ratio) const {
+    double widthWeight = (e->length()) / (_db.vMetalLayer(e->layId())->conductivity() * _db.vMetalLayer(e->layId())->thickness());
+    return (right? e->currentRight() : e->currentLeft()) * widthWeight * ratio;
+}
+
+// the width of the capacity row term of e at the present voltages, width unit = meter
+double VoltSLP::presentWidth(OASGEdge* e, bool right, double ratio) const {
+    double drop = e->sNode()->voltage() - e->tNode()->voltage();
+    return (drop == 0)? 0 : widthCost(e, right, ratio) / drop;
+}
+
+// width unit = millimeter
+void VoltSLP::setCapacityRow(CapRow& row, const string& name) {
+    size_t netId1 = row.e1->netId();
+    LPExpr width1 = linApprox(widthCost(row.e1, row.right1, row.ratio1), row.e1);
+    if (row.e2 == NULL) {
+        model(netId1)->setRow(row.constr, width1 * 1E3, LPLessEqual, row.width, name);
+        return;
+    }
+    size_t netId2 = row.e2->netId();
+    LPExpr width2 = linApprox(widthCost(row.e2, row.right2, row.ratio2), row.e2);
+    if (!_decomposed || netId1 == netId2) {
+        LPExpr totalWidth;
+        totalWidth += width1;
+        totalWidth += width2;
+        model(netId1)->setRow(row.constr, totalWidth * 1E3, LPLessEqual, row.width, name);
+        return;
+    }
+    // one copy per net, each with the width of the other net at the present voltages
+    model(netId1)->setRow(row.constr, width1 * 1E3, LPLessEqual, row.width - presentWidth(row.e2, row.right2, row.ratio2) * 1E3, name);
+    model(netId2)->setRow(row.constr2, width2 * 1E3, LPLessEqual, row.width - presentWidth(row.e1, row.right1, row.ratio1) * 1E3,
+                          name.empty()? name : name + "_2");
+}
+
+// the overlap of the capacity constraint at the present voltages
+double VoltSLP::beforeOverlap(const CapRow& row) {
     double oldTotalWidth = 0;
-    if (right1) {
-        cost1 = e1->currentRight() * widthWeight1 * ratio1;
-        totalWidth += linApprox(cost1, e1);
-        // totalWidth += _vPEdgeInV[e1->netId()][e1->layId()][e1->typeEdgeId()] * e1->currentRight() * widthWeight1 * ratio1;
-    } else {
-        cost1 = e1->currentLeft() * widthWeight1 * ratio1;
-        totalWidth += linApprox(cost1, e1);
-        // totalWidth += _vPEdgeInV[e1->netId()][e1->layId()][e1->typeEdgeId()] * e1->currentLeft() * widthWeight1 * ratio1;
-    }
-    if (e1->sNode()->voltage() != e1->tNode()->voltage()) {
-        oldTotalWidth += cost1 / (e1->sNode()->voltage() - e1->tNode()->voltage());
-    }
-    if (right2) {
-        cost2 = e2->currentRight() * widthWeight2 * ratio2;
-        totalWidth += linApprox(cost2, e2);
-        // totalWidth += _vPEdgeInV[e2->netId()][e2->layId()][e2->typeEdgeId()] * e2->currentRight() * widthWeight2 * ratio2;
-    } else {
-        cost2 = e2->currentLeft() * widthWeight2 * ratio2;
-        totalWidth += linApprox(cost2, e2);
-        // totalWidth += _vPEdgeInV[e2->netId()][e2->layId()][e2->typeEdgeId()] * e2->currentLeft() * widthWeight2 * ratio2;
+    double widthWeight1 = (row.e1->length()) / (_db.vMetalLayer(row.e1->layId())->conductivity() * _db.vMetalLayer(row.e1->layId())->thickness());
+    double widthWeight2 = (row.e2->length()) / (_db.vMetalLayer(row.e2->layId())->conductivity() * _db.vMetalLayer(row.e2->layId())->thickness());
+    double cost1 = (row.right1? row.e1->currentRight() : row.e1->currentLeft()) * widthWeight1 * row.ratio1;
+    double cost2 = (row.right2? row.e2->currentRight() : row.e2->currentLeft()) * widthWeight2 * row.ratio2;
+    if (row.e1->sNode()->voltage() != row.e1->tNode()->voltage()) {
+        oldTotalWidth += cost1 / (row.e1->sNode()->voltage() - row.e1->tNode()->voltage());
     }
-    if (e2->sNode()->voltage() != e2->tNode()->voltage()) {
-        oldTotalWidth += cost2 / (e2->sNode()->voltage() - e2->tNode()->voltage());
+    if (row.e2->sNode()->voltage() != row.e2->tNode()->voltage()) {
+        oldTotalWidth += cost2 / (row.e2->sNode()->voltage() - row.e2->tNode()->voltage());
     }
-    _model.addConstr(totalWidth * 1E3 <= width, "capacity_" + to_string(_numCapConstrs));
-    // _model.update();
-    // _model.write("/home/leotseng/2023_ASUS_PDN/exp/output/FlowLP_debug.lp");
+    return (oldTotalWidth * 1E3 > row.width)? oldTotalWidth * 1E3 - row.width : 0;
+}
+
+void VoltSLP::addCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, OASGEdge* e2, bool right2, double ratio2, double width){
+    _vCapRow.push_back(CapRow(e1, right1, ratio1, e2, right2, ratio2, width));
+    setCapacityRow(_vCapRow.back(), "capacity_" + to_string(_numCapConstrs));
     _numCapConstrs ++;
-    if (oldTotalWidth * 1E3 > width) {
-        _vBeforeOverlap.push_back(oldTotalWidth * 1E3 - width);
-    } else {
-        _vBeforeOverlap.push_back(0);
-    }
+    _vBeforeOverlap.push_back(beforeOverlap(_vCapRow.back()));
 }
 
 void VoltSLP::addCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, double width) {
-    // width unit = millimeter
-    GRBLinExpr e1Width;
-    double widthWeight1 = (e1->length()) / (_db.vMetalLayer(e1->layId())->conductivity() * _db.vMetalLayer(e1->layId())->thickness());
-    double cost1;
-    if (right1) {
-        cost1 = e1->currentRight() * widthWeight1 * ratio1;
-        e1Width += linApprox(cost1, e1);
-        // e1Width += _vPEdgeInV[e1->netId()][e1->layId()][e1->typeEdgeId()] * e1->currentRight() * widthWeight1 * ratio1;
-    } else {
-        cost1 = e1->currentLeft() * widthWeight1 * ratio1;
-        e1Width += linApprox(cost1, e1);
-        // e1Width += _vPEdgeInV[e1->netId()][e1->layId()][e1->typeEdgeId()] * e1->currentLeft() * widthWeight1 * ratio1;
-    }
-    _model.addConstr(e1Width * 1E3 <= width, "single_capacity_" + to_string(_numCapConstrs));
-    // _model.update();
-    // _model.write("/home/leotseng/2023_ASUS_PDN/exp/output/FlowLP_debug.lp");
-    // _numCapConstrs ++;
+    _vSglCapRow.push_back(CapRow(e1, right1, ratio1, NULL, false, 0, width));
+    setCapacityRow(_vSglCapRow.back(), "single_capacity_" + to_string(_numCapConstrs));
 }
 
 void VoltSLP::addSameNetCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, OASGEdge* e2, bool right2, double ratio2, double width) {
-    GRBLinExpr totalWidth;
-    double widthWeight1 = (e1->length()) / (_db.vMetalLayer(e1->layId())->conductivity() * _db.vMetalLayer(e1->layId())->thickness());
-    double widthWeight2 = (e2->length()) / (_db.vMetalLayer(e2->layId())->conductivity() * _db.vMetalLayer(e2->layId())->thickness());
-    double cost1, cost2;
-    double oldTotalWidth = 0;
-    if (right1) {
-        cost1 = e1->currentRight() * widthWeight1 * ratio1;
-        totalWidth += linApprox(cost1, e1);
-        // totalWidth += _vPEdgeInV[e1->netId()][e1->layId()][e1->typeEdgeId()] * e1->currentRight() * widthWeight1 * ratio1;
-    } else {
-        cost1 = e1->currentLeft() * widthWeight1 * ratio1;
-        totalWidth += linApprox(cost1, e1);
-        // totalWidth += _vPEdgeInV[e1->netId()][e1->layId()][e1->typeEdgeId()] * e1->currentLeft() * widthWeight1 * ratio1;
-    }
-    if (e1->sNode()->voltage() != e1->tNode()->voltage()) {
-        oldTotalWidth += cost1 / (e1->sNode()->voltage() - e1->tNode()->voltage());
-    }
-    if (right2) {
-        cost2 = e2->currentRight() * widthWeight2 * ratio2;
-        totalWidth += linApprox(cost2, e2);
-        // totalWidth += _vPEdgeInV[e2->netId()][e2->layId()][e2->typeEdgeId()] * e2->currentRight() * widthWeight2 * ratio2;
-    } else {
-        cost2 = e2->currentLeft() * widthWeight2 * ratio2;
-        totalWidth += linApprox(cost2, e2);
-        // totalWidth += _vPEdgeInV[e2->netId()][e2->layId()][e2->typeEdgeId()] * e2->currentLeft() * widthWeight2 * ratio2;
-    }
-    if (e2->sNode()->voltage() != e2->tNode()->voltage()) {
-        oldTotalWidth += cost2 / (e2->sNode()->voltage() - e2->tNode()->voltage());
-    }
-    _model.addConstr(totalWidth * 1E3 <= width, "same_net_capacity_" + to_string(_numNetCapConstrs));
-    // _model.update();
-    // _model.write("/home/leotseng/2023_ASUS_PDN/exp/output/FlowLP_debug.lp");
+    _vNetCapRow.push_back(CapRow(e1, right1, ratio1, e2, right2, ratio2, width));
+    setCapacityRow(_vNetCapRow.back(), "same_net_capacity_" + to_string(_numNetCapConstrs));
     _numNetCapConstrs ++;
-    if (oldTotalWidth * 1E3 > width) {
-        _vBeforeSameOverlap.push_back(oldTotalWidth * 1E3 - width);
-    } else {
-        _vBeforeSameOverlap.push_back(0);
-    }
+    _vBeforeSameOverlap.push_back(beforeOverlap(_vNetCapRow.back()));
 }
 
 void VoltSLP::relaxCapacityConstraints(vector<double> vLambda) {
     assert(vLambda.size() == _numCapConstrs);
-    _model.update();
-    _modelRelaxed = new GRBModel(_model);
-    for (size_t capId = 0; capId < _numCapConstrs; ++ capId) {
-        const GRBConstr& c = _modelRelaxed->getConstrByName("capacity_" + to_string(capId));
-        // char sense = c->get ( GRB_CharAttr_Sense );
-        // if ( sense != '>') {
-        //     double coef = -1.0;
-        //     _model.addVar (0.0 , GRB_INFINITY , 1.0 , GRB_CONTINUOUS , 1 , & c, & coef , " ArtN_ " + c-> get ( GRB_StringAttr_ConstrName ));
-        // }
-        // if ( sense != '<') {
-        //     double coef = 1.0;
-        //     _model.addVar (0.0 , GRB_INFINITY , 1.0 , GRB_CONTINUOUS , 1 ,& c , & coef , " ArtP_ " + c-> get ( GRB_StringAttr_ConstrName ));
-        // }
-        double coef = -1.0;
-        _modelRelaxed->addVar(0.0 , GRB_INFINITY , vLambda[capId] , GRB_CONTINUOUS, 1, &c, &coef , "lambda_" + c.get ( GRB_StringAttr_ConstrName ));
-    }
+    _vLambda = vLambda;
+    relaxRows(_vCapRow, vLambda, "lambda_capacity_");
 }
 
 void VoltSLP::relaxCapacityConstraints(vector<double> vLambda, vector<double> vNetLambda) {
     assert(vLambda.size() == _numCapConstrs);
     assert(vNetLambda.size() == _numNetCapConstrs);
-    _model.update();
-    _modelRelaxed = new GRBModel(_model);
-    for (size_t capId = 0; capId < _numCapConstrs; ++ capId) {
-        const GRBConstr& c = _modelRelaxed->getConstrByName("capacity_" + to_string(capId));
-        double coef = -1.0;
-        _modelRelaxed->addVar(0.0 , GRB_INFINITY , vLambda[capId] , GRB_CONTINUOUS, 1, &c, &coef , "lambda_" + c.get ( GRB_StringAttr_ConstrName ));
+    _vLambda = vLambda;
+    _vNetLambda = vNetLambda;
+    relaxRows(_vCapRow, vLambda, "lambda_capacity_");
+    relaxRows(_vNetCapRow, vNetLambda, "same_net_lambda_same_net_capacity_");
+}
+
+// row i gets a slack (its overlap) with cost vLambda[i] on the first call; later calls only change the costs
+void VoltSLP::relaxRows(vector<CapRow>& vRow, const vector<double>& vLambda, const string& name) {
+    for (size_t rowId = 0; rowId < vRow.size(); ++ rowId) {
+        CapRow& row = vRow[rowId];
+        LPModel* model1 = model(row.e1->netId());
+        if (row.slack.valid()) {
+            model1->setObj(row.slack, vLambda[rowId]);
+        } else {
+            row.slack = model1->addVar(0.0, LPInfinity, vLambda[rowId], LPContinuous, row.constr, -1.0, name + to_string(rowId));
+        }
+        if (!row.constr2.valid()) continue;
+        LPModel* model2 = model(row.e2->netId());
+        if (row.slack2.valid()) {
+            model2->setObj(row.slack2, vLambda[rowId]);
+        } else {
+            row.slack2 = model2->addVar(0.0, LPInfinity, vLambda[rowId], LPContinuous, row.constr2, -1.0, name + to_string(rowId) + "_2");
+        }
     }
-    for (size_t netCapId = 0; netCapId < _numNetCapConstrs; ++ netCapId) {
-        const GRBConstr& c = _modelRelaxed->getConstrByName("same_net_capacity_" + to_string(netCapId));
-        double coef = -1.0;
-        _modelRelaxed->addVar(0.0 , GRB_INFINITY , vNetLambda[netCapId] , GRB_CONTINUOUS, 1, &c, &coef , "same_net_lambda_" + c.get ( GRB_StringAttr_ConstrName ));
+}
+
+// the overlap of a relaxed capacity row; a split row takes the larger overlap of its two copies
+double VoltSLP::rowSlack(const CapRow& row) {
+    double slack = model(row.e1->netId())->value(row.slack);
+    if (row.slack2.valid()) {
+        slack = max(slack, model(row.e2->netId())->value(row.slack2));
+    }
+    return slack;
+}
+
+// the per-net models run on one solver thread each, so that the nets rather than the solver share the cores
+void VoltSLP::optimizeModels() {
+    if (_decomposed && _numThreads > 1) {
+        for (size_t modelId = 0; modelId < _vModel.size(); ++ modelId) {
+            _vModel[modelId]->setThreads(1);
+        }
     }
+    LPModel::optimizeAll(_vModel, _numThreads);
+}
+
+void VoltSLP::updateLinearization() {
+    for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
+        for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
+            for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
+                if (!_rGraph.vViaOASGEdge(netId, layPairId, vEdgeId)->redundant()) {
+                    setViaRows(netId, layPairId, vEdgeId);
+                }
+            }
+        }
+    }
+    for (size_t limitId = 0; limitId < _vLimitRow.size(); ++ limitId) {
+        setLimitRows(_vLimitRow[limitId]);
+    }
+    _vBeforeOverlap.clear();
+    _vBeforeSameOverlap.clear();
+    _vAfterOverlap.clear();
+    _vAfterSameOverlap.clear();
+    for (size_t capId = 0; capId < _vCapRow.size(); ++ capId) {
+        setCapacityRow(_vCapRow[capId]);
+        _vBeforeOverlap.push_back(beforeOverlap(_vCapRow[capId]));
+    }
+    for (size_t sglCapId = 0; sglCapId < _vSglCapRow.size(); ++ sglCapId) {
+        setCapacityRow(_vSglCapRow[sglCapId]);
+    }
+    for (size_t netCapId = 0; netCapId < _vNetCapRow.size(); ++ netCapId) {
+        setCapacityRow(_vNetCapRow[netCapId]);
+        _vBeforeSameOverlap.push_back(beforeOverlap(_vNetCapRow[netCapId]));
+    }
+    setObjectives();
 }
 
 void VoltSLP::solve() {
-    _model.optimize();
+    optimizeModels();
 }
 
 void VoltSLP::collectTempVoltage() {
@@ -437,7 +459,7 @@ void VoltSLP::collectResult() {
     for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
         // collect voltage results
         for (size_t nPortNodeId = 0; nPortNodeId < _rGraph.numNPortOASGNodes(netId); ++ nPortNodeId) {
-            _rGraph.vNPortOASGNode(netId, nPortNodeId)->setVoltage( _vVoltage[netId][nPortNodeId].get(GRB_DoubleAttr_X) );
+            _rGraph.vNPortOASGNode(netId, nPortNodeId)->setVoltage( model(netId)->value(_vVoltage[netId][nPortNodeId]) );
         }
         // collect width results for horizontal flows
         for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
@@ -466,7 +488,7 @@ void VoltSLP::collectResult() {
         }
         // collect area results for vertical flows
         for (size_t vEdgeId = 0; vEdgeId < _rGraph.numViaOASGEdges(netId); ++ vEdgeId) {
-            double viaArea = _vMaxViaCost[netId][vEdgeId].get(GRB_DoubleAttr_X);
+            double viaArea = model(netId)->value(_vMaxViaCost[netId][vEdgeId]);
             for (size_t layPairId = 0; layPairId < _rGraph.numLayerPairs(); ++ layPairId) {
                 // cerr << "vVEdge[" << netId << "][" << layPairId << "][" << vEdgeId << "]: ";
                 if (! _rGraph.vViaOASGEdge(netId, layPairId, vEdgeId) -> redundant()) {
@@ -522,7 +544,14 @@ void VoltSLP::solveRelaxed() {
             }
         }
     }
-    _modelRelaxed->optimize();
+    // later solves only move the linearization and the multipliers, so simplex can start from the last basis
+    if (_numRelaxedSolves > 0) {
+        for (size_t modelId = 0; modelId < _vModel.size(); ++ modelId) {
+            _vModel[modelId]->setMethod(LPDualSimplex);
+        }
+    }
+    optimizeModels();
+    ++ _numRelaxedSolves;
 }
 
 void VoltSLP::collectRelaxedTempVoltage() {
@@ -607,7 +636,7 @@ void VoltSLP::collectRelaxedResult() {
     for (size_t netId = 0; netId < _rGraph.numNets(); ++ netId) {
         // collect voltage results
         for (size_t nPortNodeId = 0; nPortNodeId < _rGraph.numNPortOASGNodes(netId); ++ nPortNodeId) {
-            _rGraph.vNPortOASGNode(netId, nPortNodeId)->setVoltage( _modelRelaxed->getVarByName("V_n" + to_string(netId) + "_i_" + to_string(nPortNodeId)).get(GRB_DoubleAttr_X) );
+            _rGraph.vNPortOASGNode(netId, nPortNodeId)->setVoltage( model(netId)->value(_vVoltage[netId][nPortNodeId]) );
         }
         // collect width results for horizontal flows
         for (size_t layId = 0; layId < _rGraph.numLayers(); ++ layId) {
@@ -725,7 +754,7 @@ void VoltSLP::collectRelaxedResult() {
 void VoltSLP::printRelaxedResult() {
     double violation = 0;
     for (size_t capId = 0; capId < _numCapConstrs; ++capId) {
-        violation += _modelRelaxed->getVarByName("lambda_capacity_" + to_string(capId)).get(GRB_DoubleAttr_X);
+        violation += rowSlack(_vCapRow[capId]);
     }
     cerr << "violation = " << violation << endl;
     double planeArea = 0;
@@ -811,6 +840,8 @@ void VoltSLP::calculateOverlapCost(vector<double> vLambda, vector<double> vNetLa
         _afterOverlapCost += vNetLambda[netCapId] * _vAfterSameOverlap[netCapId];
         _sameNetOverlap += _vAfterSameOverlap[netCapId];
     }
+    _vOverlap = _vAfterOverlap;
+    _vSameNetOverlap = _vAfterSameOverlap;
     if (_overlap < 1E-3) {
         _overlap = 0;
     }
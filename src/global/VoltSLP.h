@@ -1,16 +1,21 @@
 #ifndef VOLT_SLP_H
 #define VOLT_SLP_H
 
-#include <gurobi_c++.h>
 #include "../base/Include.h"
 #include "RGraph.h"
 #include "../base/DB.h"
+#include "LPModel.h"
+#include "CapRow.h"
 using namespace std;
 
 class VoltSLP {
     public:
-        VoltSLP(DB& db, RGraph& rGraph);
-        ~VoltSLP() {}
+        // decomposed: one model per net instead of a single model, see solveRelaxed()
+        VoltSLP(DB& db, RGraph& rGraph, bool decomposed = false);
+        ~VoltSLP();
+
+        // the number of per-net models solved concurrently in decomposed mode
+        void setNumThreads(size_t numThreads) { _numThreads = max(numThreads, (size_t)1); }
 
         void setObjective(double areaWeight, double viaWeight);
         void setVoltConstraints(double threshold);
@@ -19,12 +24,18 @@ class VoltSLP {
         void addCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, OASGEdge* e2, bool right2, double ratio2, double width);
         void addCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, double width);
         void addSameNetCapacityConstraints(OASGEdge* e1, bool right1, double ratio1, OASGEdge* e2, bool right2, double ratio2, double width);
+        // relax the capacity constraints in place: the first call adds their slacks, later calls only change the multipliers
         void relaxCapacityConstraints(vector<double> vLambda);
         void relaxCapacityConstraints(vector<double> vLambda, vector<double> vNetLambda);
+        // linearize the model again at the present voltages and currents (after the last solve, or a FlowLP),
+        // instead of building a new VoltSLP
+        void updateLinearization();
         void solve();
         void collectResult();
         // void printResult();
         void collectTempVoltage();
+        // with one model per net, the capacity rows between two nets are split (see CapRow), each copy holding
+        // the other net at the voltages of the linearization, and the nets are solved concurrently
         void solveRelaxed();
         void collectRelaxedTempVoltage();
         void collectRelaxedResult();
@@ -37,7 +48,10 @@ class VoltSLP {
         double area() const { return _area; }
         double viaArea() const { return _viaArea; }
         double overlap() const { return _overlap; }
+        vector<double> vOverlap() { return _vOverlap; }
+        double vOverlap(size_t ovId) const { return _vOverlap[ovId]; }
         double sameNetOverlap() const { return _sameNetOverlap; }
+        vector<double> vSameNetOverlap() { return _vSameNetOverlap; }
         double vSameNetOverlap(size_t ovId) const { return _vSameNetOverlap[ovId]; }
         double beforeCost() const { return _beforeCost; }
         double afterCost() const { return _afterCost; }
@@ -45,7 +59,28 @@ class VoltSLP {
         double afterOverlapCost() const { return _afterOverlapCost; }
 
     private:
-        GRBLinExpr linApprox(double cost, OASGEdge* edge);
+        // the voltage drop limits of an edge
+        struct LimitRow {
+            LimitRow(OASGEdge* edge) : edge(edge) {}
+            OASGEdge* edge;
+            LPConstr lb;
+            LPConstr ub;
+        };
+        LPExpr linApprox(double cost, OASGEdge* edge);
+        LPExpr objective(size_t netId);
+        void addSlackCosts(LPExpr& obj, size_t netId, const vector<CapRow>& vRow, const vector<double>& vLambda);
+        // set the objective of each model, the sum of objective(netId) over its nets
+        void setObjectives();
+        void setViaRows(size_t netId, size_t layPairId, size_t vEdgeId);
+        void setLimitRows(LimitRow& row, const string& name = "");
+        void setCapacityRow(CapRow& row, const string& name = "");
+        double widthCost(OASGEdge* e, bool right, double ratio) const;
+        double presentWidth(OASGEdge* e, bool right, double ratio) const;
+        double beforeOverlap(const CapRow& row);
+        void relaxRows(vector<CapRow>& vRow, const vector<double>& vLambda, const string& name);
+        double rowSlack(const CapRow& row);
+        void optimizeModels();
+        LPModel* model(size_t netId) { return _decomposed? _vModel[netId] : _vModel[0]; }
         // input
         DB& _db;
         RGraph& _rGraph;
@@ -53,18 +88,29 @@ class VoltSLP {
         // vector< vector< vector< double > > > _vPOldInV;     // inverse of the (plane) edge voltage difference from the last iteration, index = [netId] [layId] [pEdgeId]
         // vector< vector< vector< double > > > _vVOldInV;     // inverse of the (via) edge voltage difference from the last iteration, index = [netId] [layPairId] [vEdgeId]
 
-        // gurobi model
-        GRBEnv _env;
-        GRBModel _model;
-        GRBModel* _modelRelaxed;
+        // LP model
+        bool _decomposed;
+        vector<LPModel*> _vModel;   // one model, or one model per net (index = [netId]) if _decomposed
+        size_t _numThreads;
+        size_t _numRelaxedSolves;
 
-        // gurobi variable
-        GRBVar** _vVoltage;    // non-port node voltage, index = [netId] [nPortnodeId]
+        // LP variable
+        LPVar** _vVoltage;    // non-port node voltage, index = [netId] [nPortnodeId]
         // GRBVar*** _vPEdgeInV;   // inverse of the (plane) edge voltage difference, index = [netId] [layId] [pEdgeId]
         // GRBVar*** _vVEdgeInV;   // inverse of the (via) edge voltage difference, index = [netId] [layPairId] [vEdgeId]
-        GRBVar**  _vMaxViaCost;      // the maximum flow on an OASGEdge, index = [netId] [vEdgeId]
+        LPVar**  _vMaxViaCost;      // the maximum flow on an OASGEdge, index = [netId] [vEdgeId]
         int _numCapConstrs;          // number of non-obstacle/boundary capacity constraints
         int _numNetCapConstrs;       // number of same net non-obstacle/boundary capacity constraints
+        // LP constraints that depend on the linearization
+        vector< vector< vector<LPConstr> > > _vViaCostConstr;  // linApprox <= max via cost, index = [netId] [layPairId] [vEdgeId]
+        vector< vector< vector<LPConstr> > > _vViaAreaConstr;  // linApprox >= the via metal area, index = [netId] [layPairId] [vEdgeId]
+        vector<LimitRow> _vLimitRow;
+        double _limitRatio;
+        vector<CapRow> _vCapRow;        // index = [capId]
+        vector<CapRow> _vSglCapRow;
+        vector<CapRow> _vNetCapRow;     // index = [netCapId]
+        vector<double> _vLambda;        // the multipliers of the last relaxCapacityConstraints, index = [capId]
+        vector<double> _vNetLambda;     // index = [netCapId]
         double _areaWeight;
         double _viaWeight;
 
@@ -73,6 +119,7 @@ class VoltSLP {
         double _area;       // the resulting area, assigned in collectRelaxedResult
         double _viaArea;
         double _overlap;    // the resulting overlapped width, assigned in collectRelaxedResult
+        vector<double> _vOverlap;   // the resulting overlapped width of each capConstr, assigned in calculateOverlapCost
         double _sameNetOverlap;
         vector<double> _vSameNetOverlap;
         double _beforeCost;